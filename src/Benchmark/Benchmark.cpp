@@ -0,0 +1,613 @@
+// Benchmarks of the Core text buffer and file system on synthetic corpora.
+//
+// Builds with the regression tests from CMakeLists.txt beside it:
+//
+//   cmake -S src/Benchmark -B build && cmake --build build
+//
+// Usage: vune-benchmark [--sizes 1K,1M,...|all] [--filter name] [--output results.json]
+//                       [--baseline baseline.json] [--threshold percent] [--directory path]
+//
+// Results are written as JSON, one result per line, to --output or stdout; progress
+// and comparisons go to stderr. With --baseline every result is compared with the
+// result of the same name and corpus size, and the exit code is 1 if the median
+// latency or the throughput of any got worse by more than the threshold.
+
+#include "pch.h"
+#include "FileSystem.h"
+#include "MappedFile.h"
+#include "TextBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Vune::Core;
+
+namespace {
+    const uint64_t kSeed = 0x5EED5EED5EED5EEDull;
+
+    // Operations per latency benchmark; the same for every corpus size, so sizes
+    // compare by cost per operation
+    const int kKeystrokes = 20000;
+    const int kCursorCount = 100;
+    const int kCursorRounds = 200;
+    const int kPasteCount = 20;
+    const size_t kMaxPasteSize = 4 * 1024 * 1024;
+    const int kRandomAccessCount = 100000;
+
+    // Whole-document benchmarks repeat until both are reached
+    const int kMinRepetitions = 3;
+    const double kMinSeconds = 0.2;
+
+    struct Options {
+        std::vector<uint64_t> sizes;
+        std::string filter;
+        std::string outputPath;
+        std::string baselinePath;
+        double threshold;
+        std::string directory;
+
+        Options() : threshold(10.0), directory(".") {}
+    };
+
+    struct Result {
+        std::string name;
+        uint64_t corpusBytes;
+        uint64_t operations;
+        uint64_t bytes;         // processed, 0 where throughput counts operations only
+        double seconds;
+        uint64_t p50;           // latency of one operation in nanoseconds
+        uint64_t p99;
+
+        // Resident memory the benchmark added: the peak while it ran over the
+        // start where the peak can be reset (Linux), else what it still held at
+        // the end. Memory an earlier benchmark freed and this one reused does
+        // not count.
+        uint64_t rssGrowth;
+
+        Result() : corpusBytes(0), operations(0), bytes(0), seconds(0), p50(0), p99(0), rssGrowth(0) {}
+
+        double operationsPerSecond() const {
+            return seconds > 0 ? operations / seconds : 0;
+        }
+
+        double bytesPerSecond() const {
+            return seconds > 0 ? bytes / seconds : 0;
+        }
+    };
+
+    // xorshift64*, so corpora are identical on every platform and run
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed ? seed : 1) {}
+
+        uint64_t next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1Dull;
+        }
+
+        // Uniform enough in [0, bound) for the bounds used here
+        uint64_t below(uint64_t bound) {
+            return bound ? next() % bound : 0;
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    struct ResidentMemory {
+        uint64_t current;
+        uint64_t peak;      // since resetPeakResidentMemory, or the current size where it cannot be reset
+    };
+
+    // Start measuring the peak over from the current size
+    void resetPeakResidentMemory() {
+#ifdef __linux__
+        FILE* file = fopen("/proc/self/clear_refs", "w");
+        if (file) {
+            fputs("5", file);
+            fclose(file);
+        }
+#endif
+    }
+
+    ResidentMemory residentMemory() {
+        ResidentMemory memory = { 0, 0 };
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            memory.current = counters.WorkingSetSize;
+        }
+        memory.peak = memory.current;
+#elif defined(__linux__)
+        FILE* file = fopen("/proc/self/status", "r");
+        if (file) {
+            char line[256];
+            unsigned long long kilobytes;
+            while (fgets(line, sizeof(line), file)) {
+                if (sscanf(line, "VmRSS: %llu kB", &kilobytes) == 1) {
+                    memory.current = kilobytes * 1024;
+                }
+                else if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) {
+                    memory.peak = kilobytes * 1024;
+                }
+            }
+            fclose(file);
+        }
+#endif
+        // Elsewhere not measured; getrusage has only the peak of the whole run
+        return memory;
+    }
+
+    // Source-like text: indented lines of identifiers, keywords and punctuation,
+    // ending in "\n", exactly size bytes long
+    std::string makeCorpus(uint64_t size, uint64_t seed) {
+        static const char* const kWords[] = {
+            "if", "else", "for", "while", "return", "const", "auto", "int", "void", "std::string",
+            "buffer", "offset", "length", "position", "line", "range", "text", "result", "index", "count",
+            "=", "==", "+", "-", "*", "<", ">", "&&", "||", "->", "::", "(", ")", "{", "}", ";", ",",
+            "getText", "applyEdits", "insert", "value", "node", "left", "right", "parent", "0", "1", "42"
+        };
+        const size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+        Random random(seed);
+        std::string text;
+        text.reserve(size);
+        int depth = 0;
+        while (text.size() < size) {
+            uint64_t shape = random.below(16);
+            if (shape == 0) {
+                text += '\n';
+                continue;
+            }
+            depth = std::max(0, std::min(8, depth + static_cast<int>(random.below(3)) - 1));
+            text.append(depth * 4, ' ');
+            size_t words = 2 + random.below(12);
+            for (size_t i = 0; i < words; ++i) {
+                if (i > 0) {
+                    text += ' ';
+                }
+                text += kWords[random.below(kWordCount)];
+            }
+            text += '\n';
+        }
+        text.resize(size);
+        if (size > 0) {
+            text.back() = '\n';
+        }
+        return text;
+    }
+
+    class Samples {
+    public:
+        void reserve(size_t count) {
+            values.reserve(count);
+        }
+
+        void add(uint64_t nanoseconds) {
+            values.push_back(nanoseconds);
+        }
+
+        uint64_t percentile(double fraction) {
+            if (values.empty()) {
+                return 0;
+            }
+            size_t rank = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            return values[rank];
+        }
+
+        void finish(Result& result) {
+            result.p50 = percentile(0.50);
+            result.p99 = percentile(0.99);
+        }
+
+    private:
+        std::vector<uint64_t> values;
+    };
+
+    // Repeat a whole-document operation and time each run
+    template <typename Operation>
+    void repeat(Result& result, uint64_t bytesPerRun, Operation operation) {
+        Samples samples;
+        uint64_t start = now();
+        do {
+            uint64_t runStart = now();
+            operation();
+            samples.add(now() - runStart);
+            result.operations++;
+            result.bytes += bytesPerRun;
+        } while (result.operations < kMinRepetitions || (now() - start) < kMinSeconds * 1e9);
+        result.seconds = (now() - start) / 1e9;
+        samples.finish(result);
+    }
+
+    // A keystroke at a time in the middle of the document, with a line break
+    // every 60 characters
+    void benchmarkTyping(const std::string& corpus, Result& result) {
+        TextBuffer buffer(corpus);
+        Position cursor(buffer.getLineCount() / 2, 0);
+        std::string key = "a";
+        std::string lineBreak = "\n";
+        Samples samples;
+        samples.reserve(kKeystrokes);
+
+        uint64_t start = now();
+        for (int i = 0; i < kKeystrokes; ++i) {
+            bool breaksLine = i % 60 == 59;
+            uint64_t editStart = now();
+            buffer.insert(cursor, breaksLine ? lineBreak : key);
+            samples.add(now() - editStart);
+            cursor = breaksLine ? Position(cursor.line + 1, 0) : Position(cursor.line, cursor.character + 1);
+        }
+        result.seconds = (now() - start) / 1e9;
+        result.operations = kKeystrokes;
+        result.bytes = kKeystrokes;
+        samples.finish(result);
+    }
+
+    // A character typed at each of many cursors spread over the document, as one
+    // batch per keystroke
+    void benchmarkMultiCursor(const std::string& corpus, Result& result) {
+        TextBuffer buffer(corpus);
+        int lineCount = buffer.getLineCount();
+        int cursors = std::min(kCursorCount, lineCount);
+        std::vector<TextEdit> edits(cursors);
+        for (int i = 0; i < cursors; ++i) {
+            int line = static_cast<int>(static_cast<int64_t>(i) * lineCount / cursors);
+            edits[i] = TextEdit(Range(line, 0, line, 0), "x");
+        }
+        Samples samples;
+        samples.reserve(kCursorRounds);
+
+        uint64_t start = now();
+        for (int round = 0; round < kCursorRounds; ++round) {
+            uint64_t editStart = now();
+            buffer.applyEdits(edits);
+            samples.add(now() - editStart);
+            for (TextEdit& edit : edits) {
+                edit.range.start.character++;
+                edit.range.end.character++;
+            }
+        }
+        result.seconds = (now() - start) / 1e9;
+        result.operations = kCursorRounds;
+        result.bytes = static_cast<uint64_t>(kCursorRounds) * cursors;
+        samples.finish(result);
+    }
+
+    // Large blocks inserted at random places
+    void benchmarkPaste(const std::string& corpus, Result& result) {
+        TextBuffer buffer(corpus);
+        std::string block = makeCorpus(std::max<size_t>(1, std::min<size_t>(corpus.size() / 4, kMaxPasteSize)), kSeed + 1);
+        Random random(kSeed + 2);
+        Samples samples;
+
+        uint64_t start = now();
+        for (int i = 0; i < kPasteCount; ++i) {
+            Position position = buffer.positionAt(static_cast<int>(random.below(corpus.size())));
+            uint64_t editStart = now();
+            buffer.insert(position, block);
+            samples.add(now() - editStart);
+        }
+        result.seconds = (now() - start) / 1e9;
+        result.operations = kPasteCount;
+        result.bytes = static_cast<uint64_t>(kPasteCount) * block.size();
+        samples.finish(result);
+    }
+
+    // Random positions converted to offsets, after some edits so the tree has
+    // more than the original piece
+    void benchmarkOffsetAt(const std::string& corpus, Result& result, bool toPosition) {
+        TextBuffer buffer(corpus);
+        Random random(kSeed + 3);
+        for (int i = 0; i < 1000; ++i) {
+            buffer.insert(buffer.positionAt(static_cast<int>(random.below(corpus.size()))), "edit");
+        }
+
+        int length = static_cast<int>(corpus.size()) + 1000 * 4;
+        std::vector<int> offsets(kRandomAccessCount);
+        std::vector<Position> positions(kRandomAccessCount);
+        for (int i = 0; i < kRandomAccessCount; ++i) {
+            offsets[i] = static_cast<int>(random.below(length));
+            positions[i] = buffer.positionAt(offsets[i]);
+        }
+        Samples samples;
+        samples.reserve(kRandomAccessCount);
+
+        // Summed so the calls cannot be optimized away
+        int64_t checksum = 0;
+        uint64_t start = now();
+        for (int i = 0; i < kRandomAccessCount; ++i) {
+            uint64_t callStart = now();
+            if (toPosition) {
+                checksum += buffer.positionAt(offsets[i]).line;
+            }
+            else {
+                checksum += buffer.offsetAt(positions[i]);
+            }
+            samples.add(now() - callStart);
+        }
+        result.seconds = (now() - start) / 1e9;
+        result.operations = kRandomAccessCount;
+        samples.finish(result);
+        if (checksum == -1) {
+            fprintf(stderr, "unexpected checksum\n");
+        }
+    }
+
+    void benchmarkGetText(const std::string& corpus, Result& result) {
+        TextBuffer buffer(corpus);
+        Random random(kSeed + 4);
+        for (int i = 0; i < 1000; ++i) {
+            buffer.insert(buffer.positionAt(static_cast<int>(random.below(corpus.size()))), "edit");
+        }
+        size_t length = 0;
+        repeat(result, corpus.size() + 1000 * 4, [&buffer, &length]() {
+            length += buffer.getText().size();
+        });
+    }
+
+    void benchmarkLoad(const FileSystem& fileSystem, const std::string& path, uint64_t size, Result& result, bool mapped) {
+        int lineCount = 0;
+        repeat(result, size, [&]() {
+            if (mapped) {
+                TextBuffer buffer(fileSystem.mapFile(path));
+                lineCount += buffer.getLineCount();
+            }
+            else {
+                TextBuffer buffer(fileSystem.readTextFile(path));
+                lineCount += buffer.getLineCount();
+            }
+        });
+    }
+
+    void benchmarkSave(FileSystem& fileSystem, const std::string& corpus, const std::string& path, Result& result) {
+        TextBuffer buffer(corpus);
+        Random random(kSeed + 5);
+        for (int i = 0; i < 1000; ++i) {
+            buffer.insert(buffer.positionAt(static_cast<int>(random.below(corpus.size()))), "edit");
+        }
+        TextSnapshot snapshot = buffer.snapshot();
+        repeat(result, corpus.size() + 1000 * 4, [&]() {
+            if (!fileSystem.writeTextFile(path, snapshot)) {
+                fprintf(stderr, "cannot write %s\n", path.c_str());
+            }
+        });
+    }
+
+    bool parseSize(const std::string& text, uint64_t& size) {
+        char* end = nullptr;
+        unsigned long long value = strtoull(text.c_str(), &end, 10);
+        if (end == text.c_str()) {
+            return false;
+        }
+        std::string unit(end);
+        if (unit == "K" || unit == "KB") value <<= 10;
+        else if (unit == "M" || unit == "MB") value <<= 20;
+        else if (unit == "G" || unit == "GB") value <<= 30;
+        else if (!unit.empty()) return false;
+        size = value;
+        return value > 0 && value < (uint64_t(1) << 31);
+    }
+
+    std::string formatSize(uint64_t size) {
+        if (size % (1 << 30) == 0) return std::to_string(size >> 30) + "G";
+        if (size % (1 << 20) == 0) return std::to_string(size >> 20) + "M";
+        if (size % (1 << 10) == 0) return std::to_string(size >> 10) + "K";
+        return std::to_string(size);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        std::string sizes = "1K,64K,1M,16M";
+        for (int i = 1; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (argument == "--sizes") sizes = value == "all" ? "1K,64K,1M,16M,256M,1G" : value;
+            else if (argument == "--filter") options.filter = value;
+            else if (argument == "--output") options.outputPath = value;
+            else if (argument == "--baseline") options.baselinePath = value;
+            else if (argument == "--threshold") options.threshold = atof(value.c_str());
+            else if (argument == "--directory") options.directory = value;
+            else return false;
+        }
+
+        size_t start = 0;
+        while (start <= sizes.size()) {
+            size_t comma = sizes.find(',', start);
+            if (comma == std::string::npos) {
+                comma = sizes.size();
+            }
+            uint64_t size;
+            if (!parseSize(sizes.substr(start, comma - start), size)) {
+                return false;
+            }
+            options.sizes.push_back(size);
+            start = comma + 1;
+        }
+        return true;
+    }
+
+    std::string toJson(const Result& result) {
+        char line[512];
+        snprintf(line, sizeof(line),
+            "{\"name\": \"%s\", \"corpusBytes\": %llu, \"operations\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+            "\"operationsPerSecond\": %.1f, \"bytesPerSecond\": %.1f, \"p50Ns\": %llu, \"p99Ns\": %llu, \"rssGrowthBytes\": %llu}",
+            result.name.c_str(), static_cast<unsigned long long>(result.corpusBytes),
+            static_cast<unsigned long long>(result.operations), static_cast<unsigned long long>(result.bytes), result.seconds,
+            result.operationsPerSecond(), result.bytesPerSecond(), static_cast<unsigned long long>(result.p50),
+            static_cast<unsigned long long>(result.p99), static_cast<unsigned long long>(result.rssGrowth));
+        return line;
+    }
+
+    // Value of a field in a line written by toJson
+    bool findField(const std::string& line, const char* field, std::string& value) {
+        std::string key = std::string("\"") + field + "\": ";
+        size_t start = line.find(key);
+        if (start == std::string::npos) {
+            return false;
+        }
+        start += key.size();
+        if (start < line.size() && line[start] == '"') {
+            size_t end = line.find('"', start + 1);
+            value = line.substr(start + 1, end - start - 1);
+        }
+        else {
+            value = line.substr(start, line.find_first_of(",}", start) - start);
+        }
+        return true;
+    }
+
+    // Results of an earlier run, by name and corpus size
+    bool readBaseline(const std::string& path, std::map<std::pair<std::string, uint64_t>, Result>& baseline) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line, value;
+        while (std::getline(file, line)) {
+            Result result;
+            if (!findField(line, "name", result.name) || !findField(line, "corpusBytes", value)) {
+                continue;
+            }
+            result.corpusBytes = strtoull(value.c_str(), nullptr, 10);
+            if (findField(line, "operations", value)) result.operations = strtoull(value.c_str(), nullptr, 10);
+            if (findField(line, "bytes", value)) result.bytes = strtoull(value.c_str(), nullptr, 10);
+            if (findField(line, "seconds", value)) result.seconds = atof(value.c_str());
+            if (findField(line, "p50Ns", value)) result.p50 = strtoull(value.c_str(), nullptr, 10);
+            if (findField(line, "p99Ns", value)) result.p99 = strtoull(value.c_str(), nullptr, 10);
+            if (findField(line, "rssGrowthBytes", value)) result.rssGrowth = strtoull(value.c_str(), nullptr, 10);
+            baseline[std::make_pair(result.name, result.corpusBytes)] = result;
+        }
+        return true;
+    }
+
+    // Percent by which a result got worse; negative if it improved
+    double slowdown(double current, double previous, bool higherIsBetter) {
+        if (current <= 0 || previous <= 0) {
+            return 0;
+        }
+        return higherIsBetter ? (previous / current - 1) * 100 : (current / previous - 1) * 100;
+    }
+
+    // Print the change of every result against the baseline; returns how many
+    // regressed beyond the threshold
+    int compare(const std::vector<Result>& results, const std::map<std::pair<std::string, uint64_t>, Result>& baseline, double threshold) {
+        int regressions = 0;
+        fprintf(stderr, "\n%-14s %6s %10s %10s %10s %10s\n", "benchmark", "corpus", "p50", "p99", "throughput", "RSS growth");
+        for (const Result& result : results) {
+            auto found = baseline.find(std::make_pair(result.name, result.corpusBytes));
+            if (found == baseline.end()) {
+                fprintf(stderr, "%-14s %6s  (not in baseline)\n", result.name.c_str(), formatSize(result.corpusBytes).c_str());
+                continue;
+            }
+            const Result& previous = found->second;
+            double p50 = slowdown(static_cast<double>(result.p50), static_cast<double>(previous.p50), false);
+            double p99 = slowdown(static_cast<double>(result.p99), static_cast<double>(previous.p99), false);
+            double throughput = slowdown(result.operationsPerSecond(), previous.operationsPerSecond(), true);
+            double rss = slowdown(static_cast<double>(result.rssGrowth), static_cast<double>(previous.rssGrowth), false);
+            bool regressed = p50 > threshold || throughput > threshold;
+            regressions += regressed ? 1 : 0;
+            fprintf(stderr, "%-14s %6s %+9.1f%% %+9.1f%% %+9.1f%% %+9.1f%%%s\n", result.name.c_str(), formatSize(result.corpusBytes).c_str(),
+                p50, p99, throughput, rss, regressed ? "  REGRESSION" : "");
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--sizes 1K,1M,...|all] [--filter name] [--output path] [--baseline path] "
+            "[--threshold percent] [--directory path]\n", argv[0]);
+        return 2;
+    }
+
+    std::map<std::pair<std::string, uint64_t>, Result> baseline;
+    if (!options.baselinePath.empty() && !readBaseline(options.baselinePath, baseline)) {
+        fprintf(stderr, "cannot read baseline %s\n", options.baselinePath.c_str());
+        return 2;
+    }
+
+    FileSystem fileSystem;
+    std::string corpusPath = fileSystem.combinePaths(options.directory, "vune-benchmark-corpus.txt");
+    std::string savePath = fileSystem.combinePaths(options.directory, "vune-benchmark-save.txt");
+    std::vector<Result> results;
+
+    for (uint64_t size : options.sizes) {
+        std::string corpus = makeCorpus(size, kSeed);
+        bool written = false;
+
+        auto run = [&](const char* name, const std::function<void(Result&)>& benchmark) {
+            if (!options.filter.empty() && std::string(name).find(options.filter) == std::string::npos) {
+                return;
+            }
+            fprintf(stderr, "%-14s %6s ... ", name, formatSize(size).c_str());
+            fflush(stderr);
+            Result result;
+            result.name = name;
+            result.corpusBytes = size;
+            resetPeakResidentMemory();
+            ResidentMemory before = residentMemory();
+            benchmark(result);
+            ResidentMemory after = residentMemory();
+            result.rssGrowth = after.peak > before.current ? after.peak - before.current : 0;
+            fprintf(stderr, "p50 %llu ns, p99 %llu ns, %.0f ops/s\n", static_cast<unsigned long long>(result.p50),
+                static_cast<unsigned long long>(result.p99), result.operationsPerSecond());
+            results.push_back(result);
+        };
+        auto writeCorpus = [&]() {
+            if (!written) {
+                written = fileSystem.writeTextFile(corpusPath, corpus);
+            }
+        };
+
+        run("typing", [&](Result& result) { benchmarkTyping(corpus, result); });
+        run("multiCursor", [&](Result& result) { benchmarkMultiCursor(corpus, result); });
+        run("paste", [&](Result& result) { benchmarkPaste(corpus, result); });
+        run("offsetAt", [&](Result& result) { benchmarkOffsetAt(corpus, result, false); });
+        run("positionAt", [&](Result& result) { benchmarkOffsetAt(corpus, result, true); });
+        run("getText", [&](Result& result) { benchmarkGetText(corpus, result); });
+        run("loadRead", [&](Result& result) { writeCorpus(); benchmarkLoad(fileSystem, corpusPath, size, result, false); });
+        run("loadMapped", [&](Result& result) { writeCorpus(); benchmarkLoad(fileSystem, corpusPath, size, result, true); });
+        run("save", [&](Result& result) { benchmarkSave(fileSystem, corpus, savePath, result); });
+    }
+    fileSystem.deleteFile(corpusPath);
+    fileSystem.deleteFile(savePath);
+
+    std::string json = "{\"benchmark\": \"vune-core\", \"formatVersion\": 2, \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        json += "  " + toJson(results[i]) + (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json += "]}\n";
+    if (options.outputPath.empty()) {
+        fputs(json.c_str(), stdout);
+    }
+    else if (!fileSystem.writeTextFile(options.outputPath, json)) {
+        fprintf(stderr, "cannot write %s\n", options.outputPath.c_str());
+        return 2;
+    }
+
+    if (!options.baselinePath.empty() && compare(results, baseline, options.threshold) > 0) {
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
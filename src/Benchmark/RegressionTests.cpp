@@ -0,0 +1,1195 @@
+// Regression tests for bugs found in the Core sources. Each test reproduces one
+// reported problem; the executable prints the failures and exits 1 if there are any.
+//
+// Usage: vune-regression-tests [name filter]
+//
+// Started with ExtensionWorker::kCommandLineSwitch, it serves as the extension
+// worker of the tests that start one.
+
+#include "pch.h"
+#include "AsyncFileIO.h"
+#include "CoreAPI.h"
+#include "Diff.h"
+#include "DirectoryWalker.h"
+#include "ExtensionHost.h"
+#include "ExtensionRegistry.h"
+#include "ExtensionWorker.h"
+#include "FileSystem.h"
+#include "FileWatcher.h"
+#include "FuzzyFinder.h"
+#include "Glob.h"
+#include "IpcChannel.h"
+#include "LargeFile.h"
+#include "MappedFile.h"
+#include "TextBuffer.h"
+#include "ThreadPool.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+#include "TrigramIndex.h"
+#include "WorkspaceSearch.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace Vune::Core;
+
+namespace {
+    struct TestCase {
+        const char* name;
+        void (*run)();
+    };
+
+    std::vector<TestCase>& getTests() {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    struct Registration {
+        Registration(const char* name, void (*run)()) {
+            getTests().push_back(TestCase{ name, run });
+        }
+    };
+
+    int failures = 0;
+
+    void fail(const char* file, int line, const std::string& message) {
+        fprintf(stderr, "%s:%d: %s\n", file, line, message.c_str());
+        ++failures;
+    }
+
+    // Escapes line breaks, so failures show them
+    std::string quote(const std::string& text) {
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '\n') quoted += "\\n";
+            else if (c == '\r') quoted += "\\r";
+            else quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    std::string toString(const std::string& value) { return quote(value); }
+    template <typename T>
+    std::string toString(const T& value) { return std::to_string(value); }
+
+    // Directory for files a test creates, removed with everything in it
+    class TemporaryDirectory {
+    public:
+        explicit TemporaryDirectory(FileSystem& fileSystem) : fileSystem(fileSystem) {
+#ifdef _WIN32
+            char temp[MAX_PATH + 1];
+            GetTempPathA(sizeof(temp), temp);
+            path = fileSystem.combinePaths(temp, "vune-tests-" + std::to_string(GetCurrentProcessId()));
+#else
+            path = "/tmp/vune-tests-" + std::to_string(getpid());
+#endif
+            fileSystem.createDirectory(path);
+        }
+
+        ~TemporaryDirectory() {
+            fileSystem.deleteDirectory(path, true);
+        }
+
+        std::string file(const std::string& name) const {
+            return fileSystem.combinePaths(path, name);
+        }
+
+    private:
+        FileSystem& fileSystem;
+        std::string path;
+    };
+    // Set once from any thread; waited for with a timeout, so a stall fails the
+    // test instead of hanging it
+    class Signal {
+    public:
+        Signal() : signalled(false) {}
+
+        void set() {
+            std::lock_guard<std::mutex> lock(mutex);
+            signalled = true;
+            changed.notify_all();
+        }
+
+        bool waitFor(int milliseconds) {
+            std::unique_lock<std::mutex> lock(mutex);
+            return changed.wait_for(lock, std::chrono::milliseconds(milliseconds), [this] { return signalled; });
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool signalled;
+    };
+}
+
+#define TEST(name) \
+    static void name(); \
+    static Registration name##Registration(#name, name); \
+    static void name()
+
+#define EXPECT(condition) \
+    do { if (!(condition)) fail(__FILE__, __LINE__, "expected " #condition); } while (0)
+
+#define EXPECT_EQ(actual, expected) \
+    do { \
+        auto actualValue = (actual); \
+        auto expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) { \
+            fail(__FILE__, __LINE__, #actual " is " + toString(actualValue) + ", expected " + toString(expectedValue)); \
+        } \
+    } while (0)
+
+// Saving a buffer and loading it again gives back the same text, CRLF line
+// breaks included
+TEST(textBufferSaveRoundTrip) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("roundtrip.txt");
+
+    TextBuffer buffer(std::string("one\r\ntwo\r\nthree\r\nfour"));
+    buffer.insert(Position(1, 3), "!");
+    EXPECT(fileSystem.writeTextFile(path, buffer.snapshot()));
+
+    TextBuffer loaded(fileSystem.mapFile(path));
+    EXPECT_EQ(loaded.getText(), std::string("one\r\ntwo!\r\nthree\r\nfour"));
+    EXPECT_EQ(loaded.getLineCount(), 4);
+}
+
+// Undo and redo restore the text step by step, a group counting as one step,
+// and listeners see every change with its offsets and origin
+TEST(textBufferUndoRedoNotifiesListeners) {
+    TextBuffer buffer(std::string("hello world"));
+    std::vector<TextDocumentChangeEvent> events;
+    buffer.addChangeListener([&events](const TextDocumentChangeEvent& event) {
+        events.push_back(event);
+    });
+
+    buffer.replace(Range(0, 6, 0, 11), "there");
+    EXPECT_EQ(events.size(), static_cast<size_t>(1));
+    EXPECT_EQ(events.back().version, buffer.getVersion());
+    EXPECT_EQ(events.back().changes.size(), static_cast<size_t>(1));
+    EXPECT_EQ(events.back().changes[0].rangeOffset, 6);
+    EXPECT_EQ(events.back().changes[0].rangeLength, 5);
+    EXPECT_EQ(events.back().changes[0].text, std::string("there"));
+
+    buffer.beginUndoGroup();
+    buffer.insert(Position(0, 0), "oh, ");
+    buffer.insert(Position(0, 15), "!");
+    buffer.endUndoGroup();
+    EXPECT_EQ(buffer.getText(), std::string("oh, hello there!"));
+    EXPECT_EQ(events.size(), static_cast<size_t>(3));
+
+    EXPECT(buffer.undo());
+    EXPECT_EQ(buffer.getText(), std::string("hello there"));
+    EXPECT(events.back().isUndo);
+    EXPECT(buffer.undo());
+    EXPECT_EQ(buffer.getText(), std::string("hello world"));
+    EXPECT(!buffer.canUndo());
+    EXPECT(!buffer.undo());
+
+    EXPECT(buffer.redo());
+    EXPECT_EQ(buffer.getText(), std::string("hello there"));
+    EXPECT(events.back().isRedo);
+    EXPECT(buffer.canRedo());
+
+    // A new edit drops what was left to redo
+    buffer.insert(Position(0, 0), ">");
+    EXPECT(!buffer.canRedo());
+
+    for (size_t i = 1; i < events.size(); ++i) {
+        EXPECT(events[i].version > events[i - 1].version);
+    }
+}
+
+// Deleting lines across the end of a block comment leaves the following lines
+// inside the comment, so they are tokenized again
+TEST(tokenizerMultiLineDeleteIntoComment) {
+    RegexGrammar::Rule comment;
+    comment.begin = "/\\*";
+    comment.end = "\\*/";
+    comment.scope = "comment";
+    auto grammar = std::make_shared<RegexGrammar>("source.test", std::vector<RegexGrammar::Rule>{ comment });
+
+    TextBuffer buffer(std::string("/* a\nb */\nc\nd"));
+    Tokenizer tokenizer(buffer, grammar);
+    tokenizer.waitUntilIdle();
+
+    buffer.remove(Range(0, 4, 2, 1));
+    tokenizer.waitUntilIdle();
+    EXPECT_EQ(buffer.getText(), std::string("/* a\nd"));
+
+    std::vector<Token> tokens;
+    EXPECT(tokenizer.getLineTokens(1, tokens));
+    EXPECT(!tokens.empty());
+    if (!tokens.empty()) {
+        EXPECT_EQ(grammar->getScopeName(tokens.back().scope), std::string("comment"));
+    }
+
+    // Closing the comment again takes the rest out of it
+    buffer.insert(Position(0, 4), " */");
+    tokenizer.waitUntilIdle();
+    EXPECT(tokenizer.getLineTokens(1, tokens));
+    if (!tokens.empty()) {
+        EXPECT_EQ(grammar->getScopeName(tokens.back().scope), std::string("source.test"));
+    }
+}
+
+// Myers diffs of small inputs are minimal: the lines they insert and delete
+// are exactly those outside a longest common subsequence
+TEST(lineDiffIsMinimal) {
+    uint32_t seed = 12345;
+    auto nextRandom = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        std::vector<uint32_t> original(nextRandom() % 24);
+        std::vector<uint32_t> modified(nextRandom() % 24);
+        for (uint32_t& line : original) {
+            line = nextRandom() % 4;
+        }
+        for (uint32_t& line : modified) {
+            line = nextRandom() % 4;
+        }
+
+        std::vector<std::vector<int>> common(original.size() + 1, std::vector<int>(modified.size() + 1, 0));
+        for (size_t i = original.size(); i-- > 0;) {
+            for (size_t j = modified.size(); j-- > 0;) {
+                common[i][j] = original[i] == modified[j] ? common[i + 1][j + 1] + 1
+                    : std::max(common[i + 1][j], common[i][j + 1]);
+            }
+        }
+
+        std::vector<LineChange> changes = LineDiff::compute(original, modified);
+        int edited = 0;
+        for (const LineChange& change : changes) {
+            edited += change.originalLength + change.modifiedLength;
+        }
+        EXPECT_EQ(edited, static_cast<int>(original.size() + modified.size()) - 2 * common[0][0]);
+    }
+
+    std::vector<LineChange> changes = LineDiff::compute(std::vector<uint32_t>{ 1, 2, 3, 4, 5 }, std::vector<uint32_t>{ 1, 2, 9, 4, 5 });
+    EXPECT_EQ(changes.size(), static_cast<size_t>(1));
+    if (!changes.empty()) {
+        EXPECT(changes[0] == LineChange(2, 1, 2, 1));
+    }
+}
+
+// File name and word start matches rank above scattered ones, paths missing
+// a character never match, and an uppercase query is case-sensitive
+TEST(fuzzyFinderRanksFileNameMatchesFirst) {
+    ThreadPool pool(2);
+    FuzzyFinder finder;
+    finder.setPaths({
+        "lib/cubic/profile.txt",
+        "src/Core/TextBuffer.cpp",
+        "docs/buffers/overview.md",
+        "src/Core/Tokenizer.cpp"
+    });
+
+    std::vector<FuzzyMatch> matches = finder.find(pool, "textbuf", 10);
+    EXPECT_EQ(matches.size(), static_cast<size_t>(1));
+    if (!matches.empty()) {
+        EXPECT_EQ(matches[0].index, static_cast<uint32_t>(1));
+    }
+
+    matches = finder.find(pool, "buf", 10);
+    EXPECT_EQ(matches.size(), static_cast<size_t>(3));
+    if (matches.size() == 3) {
+        EXPECT_EQ(matches[0].index, static_cast<uint32_t>(1));
+        EXPECT_EQ(matches[2].index, static_cast<uint32_t>(0));
+        EXPECT(matches[0].score >= matches[1].score && matches[1].score >= matches[2].score);
+    }
+
+    matches = finder.find(pool, "TB", 10);
+    EXPECT_EQ(matches.size(), static_cast<size_t>(1));
+
+    std::vector<int> positions = finder.getMatchPositions("TB", 1);
+    EXPECT(positions == std::vector<int>({ 9, 13 }));
+    EXPECT(finder.getMatchPositions("xyz", 1).empty());
+}
+
+// Lone "\r" breaks lines in workspace search results as it does in a TextBuffer,
+// for literal and regular expression queries alike
+TEST(workspaceSearchLoneCarriageReturn) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("breaks.txt");
+    EXPECT(fileSystem.writeTextFile(path, std::string("a\rfoo\r\nbar\r\nfoo")));
+
+    ThreadPool pool(2);
+    for (bool isRegex : { false, true }) {
+        WorkspaceSearchOptions options;
+        options.query = SearchOptions(isRegex ? "fo+" : "foo", true, isRegex);
+        std::vector<FileMatch> matches;
+        WorkspaceSearch search(fileSystem, pool, { DirectoryEntry(path, false, 14, 0) }, options, [&matches](const FileSearchResult& result) {
+            matches = result.matches;
+            return true;
+        });
+        search.wait();
+
+        EXPECT_EQ(matches.size(), static_cast<size_t>(2));
+        if (matches.size() == 2) {
+            EXPECT_EQ(matches[0].line, 1);
+            EXPECT_EQ(matches[0].character, 0);
+            EXPECT_EQ(matches[0].preview, std::string("foo"));
+            EXPECT_EQ(matches[1].line, 3);
+        }
+    }
+
+    // A match starting inside a "\r\n" counts the break once
+    WorkspaceSearchOptions options;
+    options.query = SearchOptions("\nbar\r\nfoo", true, false);
+    std::vector<FileMatch> matches;
+    WorkspaceSearch search(fileSystem, pool, { DirectoryEntry(path, false, 14, 0) }, options, [&matches](const FileSearchResult& result) {
+        matches = result.matches;
+        return true;
+    });
+    search.wait();
+    EXPECT_EQ(matches.size(), static_cast<size_t>(1));
+    if (!matches.empty()) {
+        EXPECT_EQ(matches[0].line, 1);
+    }
+}
+
+// Files over the memory budget wait in a queue instead of in pool tasks, and
+// each is still searched once the files ahead of it are done
+TEST(workspaceSearchOverBudgetFilesAllSearched) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::vector<DirectoryEntry> files;
+    for (int i = 0; i < 50; ++i) {
+        std::string path = directory.file("file" + std::to_string(i) + ".txt");
+        EXPECT(fileSystem.writeTextFile(path, std::string("needle\n")));
+        files.emplace_back(path, false, 7, 0);
+    }
+
+    ThreadPool pool(4);
+    WorkspaceSearchOptions options;
+    options.query = SearchOptions("needle", true, false);
+    options.maxBytesInFlight = 1;
+    std::atomic<size_t> reported(0);
+    WorkspaceSearch search(fileSystem, pool, files, options, [&reported](const FileSearchResult&) {
+        ++reported;
+        return true;
+    });
+    search.wait();
+    EXPECT_EQ(reported.load(), files.size());
+    EXPECT_EQ(search.getStats().filesSearched, files.size());
+}
+
+// A task that throws is counted off, and its error comes out of wait
+TEST(taskGroupRethrowsTaskErrors) {
+    ThreadPool pool(2);
+    TaskGroup group(pool);
+    std::atomic<int> ran(0);
+    for (int i = 0; i < 8; ++i) {
+        group.run([&ran, i]() {
+            ++ran;
+            if (i == 3) {
+                throw std::runtime_error("task failed");
+            }
+        });
+    }
+    bool thrown = false;
+    try {
+        group.wait();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT(thrown);
+    EXPECT_EQ(ran.load(), 8);
+    EXPECT(group.isFinished());
+    group.wait();
+}
+
+// A search task that throws ends the search instead of hanging it
+TEST(workspaceSearchRethrowsTaskErrors) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::vector<DirectoryEntry> files;
+    for (int i = 0; i < 10; ++i) {
+        std::string path = directory.file("file" + std::to_string(i) + ".txt");
+        EXPECT(fileSystem.writeTextFile(path, std::string("needle\n")));
+        files.emplace_back(path, false, 7, 0);
+    }
+
+    ThreadPool pool(2);
+    WorkspaceSearchOptions options;
+    options.query = SearchOptions("needle", true, false);
+    WorkspaceSearch search(fileSystem, pool, files, options, [](const FileSearchResult&) -> bool {
+        throw std::runtime_error("callback failed");
+    });
+    bool thrown = false;
+    try {
+        search.wait();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT(thrown);
+    EXPECT(search.isFinished());
+}
+
+// Stars are matched without nested backtracking, so patterns with many of
+// them stay fast on long names; a "**" that is not a whole segment stays
+// within one segment
+TEST(globStarsMatchInLinearTime) {
+    std::string name(4000, 'a');
+    auto start = std::chrono::steady_clock::now();
+    EXPECT(!Glob("*a*a*a*a*a*a*a*b").matches(name));
+    EXPECT(!Glob("**/*a*a*a*a*a*a*b").matches("dir/" + name));
+    EXPECT(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+    EXPECT(Glob("*a*a*a*b").matches(name + "b"));
+
+    EXPECT(!Glob("a**b").matches("a/x/b"));
+    EXPECT(Glob("a**b").matches("axxb"));
+    EXPECT(!Glob("src/**.js").matches("src/lib/main.js"));
+    EXPECT(Glob("src/**/*.js").matches("src/main.js"));
+    EXPECT(Glob("src/**/*.js").matches("src/lib/deep/main.js"));
+    EXPECT(Glob("**/x/**/y").matches("a/x/b/x/c/y"));
+    EXPECT(Glob("out/**").matches("out/a/b"));
+    EXPECT(!Glob("out/**").matches("out"));
+}
+
+// A walker whose queue is not drained holds back listing directories instead of
+// parking pool threads, and still reports every directory once drained
+TEST(directoryWalkerFullQueueDoesNotBlockPool) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string root = directory.file("tree");
+    fileSystem.createDirectory(root);
+    for (int i = 0; i < 10; ++i) {
+        std::string child = fileSystem.combinePaths(root, "d" + std::to_string(i));
+        fileSystem.createDirectory(child);
+        for (int j = 0; j < 10; ++j) {
+            std::string grandchild = fileSystem.combinePaths(child, "e" + std::to_string(j));
+            fileSystem.createDirectory(grandchild);
+            EXPECT(fileSystem.writeTextFile(fileSystem.combinePaths(grandchild, "file.txt"), std::string("x")));
+        }
+    }
+
+    ThreadPool pool(2);
+    WalkOptions options;
+    options.maxQueuedBatches = 2;
+    DirectoryWalker walker(fileSystem, pool, root, options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Before the fix both workers waited for room in the queue here
+    Signal otherWorkRan;
+    pool.submit([&otherWorkRan] {
+        otherWorkRan.set();
+    });
+    EXPECT(otherWorkRan.waitFor(5000));
+
+    size_t files = 0;
+    WalkBatch batch;
+    while (walker.nextBatch(batch)) {
+        files += batch.entries.size();
+    }
+    EXPECT_EQ(files, static_cast<size_t>(100));
+    EXPECT(walker.isFinished());
+}
+
+// A saved index whose section offsets wrap around when added to their sizes is
+// rejected instead of read outside the mapping
+TEST(trigramIndexRejectsWrappingOffsets) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string root = directory.file("tree");
+    fileSystem.createDirectory(root);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT(fileSystem.writeTextFile(fileSystem.combinePaths(root, "f" + std::to_string(i) + ".txt"), std::string("needle ") + std::to_string(i)));
+    }
+
+    ThreadPool pool(2);
+    std::string indexPath = directory.file("index");
+    TrigramIndex index(fileSystem);
+    index.build(pool, root, WalkOptions());
+    EXPECT(index.save(indexPath));
+    EXPECT_EQ(index.getFileCount(), static_cast<size_t>(4));
+
+    std::string saved;
+    EXPECT(fileSystem.readFile(indexPath, saved));
+    if (saved.size() < 56) {
+        return;
+    }
+
+    // filesOffset such that filesOffset + fileCount * sizeof(FileRecord) wraps to
+    // just past the header
+    uint32_t fileCount;
+    std::memcpy(&fileCount, &saved[8], sizeof(fileCount));
+    uint64_t filesOffset = 56 - uint64_t(fileCount) * 32;
+    std::string corrupt = saved;
+    std::memcpy(&corrupt[16], &filesOffset, sizeof(filesOffset));
+    EXPECT(fileSystem.writeTextFile(indexPath, corrupt));
+    EXPECT(!index.load(indexPath));
+    EXPECT_EQ(index.getFileCount(), static_cast<size_t>(0));
+
+    // Misaligned files section
+    corrupt = saved;
+    uint64_t misaligned = 60;
+    std::memcpy(&corrupt[16], &misaligned, sizeof(misaligned));
+    EXPECT(fileSystem.writeTextFile(indexPath, corrupt));
+    EXPECT(!index.load(indexPath));
+
+    EXPECT(fileSystem.writeTextFile(indexPath, saved));
+    EXPECT(index.load(indexPath));
+    EXPECT_EQ(index.getFileCount(), static_cast<size_t>(4));
+}
+
+// A save whose rename fails reports failure, though its contents were written
+TEST(asyncSaveReportsFailedRename) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+
+    // A file cannot be renamed over a directory
+    std::string target = directory.file("target");
+    fileSystem.createDirectory(target);
+
+    ThreadPool pool(2);
+    AsyncFileIO io(fileSystem, pool);
+    std::vector<FileWriteRequest> requests;
+    requests.emplace_back(target, std::string("contents"));
+    std::vector<FileWriteResult> results = io.write(std::move(requests)).get();
+    EXPECT_EQ(results.size(), static_cast<size_t>(1));
+    if (!results.empty()) {
+        EXPECT(!results[0].succeeded);
+    }
+
+    requests.clear();
+    requests.emplace_back(directory.file("file"), std::string("contents"));
+    results = io.write(std::move(requests)).get();
+    EXPECT(!results.empty() && results[0].succeeded);
+}
+
+#ifndef _WIN32
+// Saving through a symbolic link replaces the file it points to and keeps the
+// link, and a saved file keeps its owner
+TEST(atomicSaveFollowsSymlinksAndKeepsOwner) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string target = directory.file("target.txt");
+    std::string link = directory.file("link.txt");
+    EXPECT(fileSystem.writeTextFile(target, std::string("old")));
+    EXPECT(symlink(target.c_str(), link.c_str()) == 0);
+
+    EXPECT(fileSystem.writeTextFile(link, std::string("new")));
+    struct stat info;
+    EXPECT(lstat(link.c_str(), &info) == 0 && S_ISLNK(info.st_mode));
+    std::string content;
+    EXPECT(fileSystem.readFile(target, content));
+    EXPECT_EQ(content, std::string("new"));
+
+    // Only a privileged process can give a file away to test this
+    if (geteuid() == 0) {
+        EXPECT(chown(target.c_str(), 65534, 65534) == 0);
+        EXPECT(chmod(target.c_str(), 0640) == 0);
+        EXPECT(fileSystem.writeTextFile(target, std::string("newer")));
+        EXPECT(stat(target.c_str(), &info) == 0);
+        EXPECT_EQ(static_cast<unsigned>(info.st_uid), 65534u);
+        EXPECT_EQ(static_cast<unsigned>(info.st_gid), 65534u);
+        EXPECT_EQ(static_cast<unsigned>(info.st_mode & 07777), 0640u);
+    }
+}
+#endif
+
+// A file whose owner a save cannot keep is copied over in place, by saves of
+// the same path one at a time, and cut to the new length once the copy is whole
+TEST(asyncSaveCopiesInPlaceWhenOwnerCannotBeKept) {
+    // Only a privileged process can set up a file another user owns
+    if (geteuid() != 0) {
+        return;
+    }
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string target = directory.file("owned.txt");
+    EXPECT(fileSystem.writeTextFile(target, std::string("old contents, longer than the new")));
+    EXPECT(chown(target.c_str(), 65534, 65534) == 0);
+    EXPECT(chmod(target.c_str(), 0666) == 0);
+    EXPECT(chmod(directory.file(".").c_str(), 0777) == 0);
+
+    pid_t child = fork();
+    if (child == 0) {
+        if (setgid(65533) != 0 || setuid(65533) != 0) {
+            _exit(2);
+        }
+        ThreadPool pool(2);
+        AsyncFileIO io(fileSystem, pool);
+        std::vector<FileWriteRequest> requests;
+        requests.emplace_back(target, std::string("first, also longer than the last"));
+        requests.emplace_back(target, std::string("last"));
+        std::vector<FileWriteResult> results = io.write(std::move(requests)).get();
+        bool succeeded = results.size() == 2;
+        for (const FileWriteResult& result : results) {
+            succeeded = succeeded && result.succeeded && result.recoveryPath.empty();
+        }
+        _exit(succeeded ? 0 : 1);
+    }
+
+    int status = 0;
+    EXPECT(child > 0 && waitpid(child, &status, 0) == child);
+    EXPECT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    std::string content;
+    EXPECT(fileSystem.readFile(target, content));
+    EXPECT_EQ(content, std::string("last"));
+    struct stat info;
+    EXPECT(stat(target.c_str(), &info) == 0);
+    EXPECT_EQ(static_cast<unsigned>(info.st_uid), 65534u);
+}
+
+// Without a worker executable nothing is started, and activations fail
+TEST(extensionHostRequiresWorkerPath) {
+    ExtensionHost host;
+    EXPECT(host.installExtension("publisher.extension", "1.0.0"));
+    EXPECT(!host.activateExtension("publisher.extension"));
+    EXPECT(!host.isExtensionActive("publisher.extension"));
+    EXPECT(!host.isWorkerRunning());
+}
+
+// Requests reach the other side and replies come back under the same id, and
+// a closed peer ends a wait instead of leaving it to time out
+TEST(ipcChannelRoundTrip) {
+    std::unique_ptr<IpcChannel> host = IpcChannel::create(64 * 1024);
+    EXPECT(host != nullptr);
+    if (!host) {
+        return;
+    }
+    std::unique_ptr<IpcChannel> worker = IpcChannel::open(host->getName());
+    EXPECT(worker != nullptr);
+    if (!worker) {
+        return;
+    }
+
+    std::thread echo([&worker]() {
+        IpcMessage request;
+        while (worker->receive(request, 5000) == IpcResult::Ok) {
+            EXPECT(worker->send(request.type, request.id, "re: " + request.payload, 5000) == IpcResult::Ok);
+        }
+        worker->close();
+    });
+
+    for (uint64_t id = 1; id <= 100; ++id) {
+        std::string payload = "request " + std::to_string(id);
+        EXPECT(host->send(7, id, payload, 5000) == IpcResult::Ok);
+        IpcMessage reply;
+        EXPECT(host->receive(reply, 5000) == IpcResult::Ok);
+        EXPECT_EQ(reply.type, static_cast<uint16_t>(7));
+        EXPECT_EQ(reply.id, id);
+        EXPECT_EQ(reply.payload, "re: " + payload);
+    }
+
+    host->close();
+    echo.join();
+    IpcMessage message;
+    EXPECT(host->receive(message, 5000) == IpcResult::Closed);
+}
+
+// A large message whose send timed out partway is dropped by the receiver
+// instead of merging with the next one
+TEST(ipcChannelDropsInterruptedMessages) {
+    std::unique_ptr<IpcChannel> host = IpcChannel::create(64 * 1024);
+    EXPECT(host != nullptr);
+    if (!host) {
+        return;
+    }
+    std::unique_ptr<IpcChannel> worker = IpcChannel::open(host->getName());
+    EXPECT(worker != nullptr);
+    if (!worker) {
+        return;
+    }
+
+    // Nobody reads yet, so only the first fragments fit
+    EXPECT(host->send(1, 1, std::string(256 * 1024, 'x'), 0) == IpcResult::Timeout);
+
+    IpcMessage message;
+    std::thread sender([&host]() {
+        EXPECT(host->send(2, 2, "next", 5000) == IpcResult::Ok);
+    });
+    EXPECT(worker->receive(message, 5000) == IpcResult::Ok);
+    sender.join();
+    EXPECT_EQ(message.type, static_cast<uint16_t>(2));
+    EXPECT(message.payload == "next");
+
+    // Round trip of a message large enough to be split
+    std::string large(200 * 1024, 'y');
+    sender = std::thread([&host, &large]() {
+        EXPECT(host->send(3, 3, large, 5000) == IpcResult::Ok);
+    });
+    EXPECT(worker->receive(message, 5000) == IpcResult::Ok);
+    sender.join();
+    EXPECT_EQ(message.id, static_cast<uint64_t>(3));
+    EXPECT(message.payload == large);
+}
+
+// The core starts the extension worker from the current executable, which
+// serves it from main, and activations get there and back
+TEST(coreApiActivatesExtensionsInWorker) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    CoreAPI& core = CoreAPI::getInstance();
+    EXPECT(core.initialize(directory.file("settings.json")));
+    EXPECT(core.installExtension("vune.sample", "1.0.0"));
+    EXPECT(core.activateExtension("vune.sample"));
+    EXPECT(!core.activateExtension("vune.missing"));
+    core.shutdown();
+}
+
+// A change that does not continue from the mirror's version makes the worker
+// drop the mirror and ask for the document again
+TEST(extensionWorkerResyncsOnVersionGap) {
+    std::unique_ptr<IpcChannel> host = IpcChannel::create();
+    EXPECT(host != nullptr);
+    if (!host) {
+        return;
+    }
+#ifdef _WIN32
+    unsigned long processId = GetCurrentProcessId();
+#else
+    unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+    std::unique_ptr<ExtensionWorker> worker = ExtensionWorker::connect(host->getName(), processId);
+    EXPECT(worker != nullptr);
+    if (!worker) {
+        return;
+    }
+    std::atomic<int> changes(0);
+    worker->setDocumentHandler([&changes](const std::string&, const TextDocumentChangeEvent&) { changes++; });
+    std::thread running([&worker]() { worker->run(); });
+
+    IpcWriter writer;
+    writer.writeString("file:///a.txt");
+    writer.writeString("plaintext");
+    writer.writeI32(1);
+    writer.writeString("hello");
+    host->send(static_cast<uint16_t>(ExtensionMessage::OpenDocument), 0, writer.getBuffer());
+
+    auto sendChange = [&host, &writer](int32_t baseVersion, int32_t version) {
+        writer.clear();
+        writer.writeString("file:///a.txt");
+        writer.writeI32(baseVersion);
+        writer.writeI32(version);
+        writer.writeU32(1);
+        for (int i = 0; i < 4; ++i) {
+            writer.writeI32(0);
+        }
+        writer.writeString("!");
+        host->send(static_cast<uint16_t>(ExtensionMessage::ChangeDocument), 0, writer.getBuffer());
+    };
+    sendChange(1, 2);
+    sendChange(3, 4);
+
+    IpcMessage message;
+    EXPECT(host->receive(message, 5000) == IpcResult::Ok);
+    EXPECT_EQ(message.type, static_cast<uint16_t>(ExtensionMessage::ResyncDocument));
+    IpcReader reader(message.payload);
+    std::string uri;
+    EXPECT(reader.readString(uri));
+    EXPECT_EQ(uri, std::string("file:///a.txt"));
+    EXPECT_EQ(changes.load(), 1);
+
+    host->send(static_cast<uint16_t>(ExtensionMessage::Shutdown), 0, std::string_view());
+    running.join();
+    EXPECT(worker->getDocument("file:///a.txt") == nullptr);
+}
+
+// Threads that exit hand their trace entry on, and pool threads take none while
+// tracing is disabled
+TEST(traceReusesEntriesOfExitedThreads) {
+    auto threadCount = []() {
+        std::string json = Trace::exportChromeJson();
+        size_t count = 0;
+        for (size_t at = json.find("\"thread_name\""); at != std::string::npos; at = json.find("\"thread_name\"", at + 1)) {
+            ++count;
+        }
+        return count;
+    };
+
+    Trace::setEnabled(true);
+    {
+        TraceScope scope("main");
+    }
+    size_t before = threadCount();
+    for (int i = 0; i < 20; ++i) {
+        std::thread([]() { TraceScope scope("short-lived"); }).join();
+    }
+    EXPECT(threadCount() <= before + 1);
+
+    Trace::setEnabled(false);
+    before = threadCount();
+    for (int i = 0; i < 5; ++i) {
+        ThreadPool pool(4);
+    }
+    EXPECT_EQ(threadCount(), before);
+}
+
+// Cache offsets and counts that would wrap or misalign the records are rejected
+TEST(extensionRegistryRejectsCorruptCache) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string extensions = directory.file("extensions");
+    std::string cachePath = directory.file("extensions.cache");
+    fileSystem.createDirectory(extensions);
+    fileSystem.createDirectory(fileSystem.combinePaths(extensions, "pub.tool-1.0.0"));
+    EXPECT(fileSystem.writeTextFile(fileSystem.combinePaths(extensions, "pub.tool-1.0.0/package.json"),
+        "{\"name\": \"tool\", \"publisher\": \"pub\", \"version\": \"1.0.0\"}"));
+
+    ExtensionRegistry registry(fileSystem, extensions);
+    EXPECT_EQ(registry.refresh(), static_cast<size_t>(1));
+    EXPECT(registry.save(cachePath));
+    std::string saved;
+    EXPECT(fileSystem.readFile(cachePath, saved));
+    if (saved.size() < 64) {
+        return;
+    }
+
+    auto expectRejected = [&](size_t at, uint64_t value, size_t width) {
+        std::string corrupt = saved;
+        std::memcpy(&corrupt[at], &value, width);
+        EXPECT(fileSystem.writeTextFile(cachePath, corrupt));
+        EXPECT(!registry.load(cachePath));
+        EXPECT_EQ(registry.getExtensionCount(), static_cast<size_t>(0));
+    };
+    // recordsOffset wrapping past the end, then misaligned; a string count whose
+    // table would wrap
+    expectRejected(24, ~uint64_t(0) - 7, 8);
+    expectRejected(24, 68, 8);
+    expectRejected(12, 0xFFFFFFFF, 4);
+
+    EXPECT(fileSystem.writeTextFile(cachePath, saved));
+    EXPECT(registry.load(cachePath));
+    EXPECT_EQ(registry.getExtensionCount(), static_cast<size_t>(1));
+}
+
+#ifndef _WIN32
+// An older version installed beside a newer one comes from the cache, not its
+// package.json, once the newer one is removed
+TEST(extensionRegistryCachesSupersededVersions) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string extensions = directory.file("extensions");
+    std::string cachePath = directory.file("extensions.cache");
+    fileSystem.createDirectory(extensions);
+    for (const char* version : { "1.0.0", "2.0.0" }) {
+        std::string folder = fileSystem.combinePaths(extensions, std::string("pub.tool-") + version);
+        fileSystem.createDirectory(folder);
+        EXPECT(fileSystem.writeTextFile(fileSystem.combinePaths(folder, "package.json"),
+            std::string("{\"name\": \"tool\", \"publisher\": \"pub\", \"version\": \"") + version + "\"}"));
+    }
+    {
+        ExtensionRegistry registry(fileSystem, extensions);
+        EXPECT_EQ(registry.refresh(), static_cast<size_t>(1));
+        EXPECT(registry.save(cachePath));
+    }
+
+    // Break the older manifest in place, keeping its size and modification time,
+    // so only a parse would notice
+    std::string manifest = fileSystem.combinePaths(extensions, "pub.tool-1.0.0/package.json");
+    struct stat info;
+    EXPECT(stat(manifest.c_str(), &info) == 0);
+    FILE* file = std::fopen(manifest.c_str(), "r+");
+    EXPECT(file != nullptr);
+    if (!file) {
+        return;
+    }
+    std::fputc('x', file);
+    std::fclose(file);
+    struct timespec times[2] = { info.st_atim, info.st_mtim };
+    EXPECT(utimensat(AT_FDCWD, manifest.c_str(), times, 0) == 0);
+    EXPECT(fileSystem.deleteDirectory(fileSystem.combinePaths(extensions, "pub.tool-2.0.0"), true));
+
+    ExtensionRegistry registry(fileSystem, extensions);
+    EXPECT(registry.load(cachePath));
+    EXPECT_EQ(registry.refresh(), static_cast<size_t>(1));
+    ExtensionManifest loaded;
+    EXPECT(registry.getManifest("pub.tool", loaded));
+    EXPECT_EQ(loaded.version, std::string("1.0.0"));
+}
+#endif
+
+#ifndef _WIN32
+// Bytes of a mapped file truncated by another process read as zeros, not a fault
+TEST(mappedFileSurvivesTruncation) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("document.txt");
+    EXPECT(fileSystem.writeTextFile(path, std::string(3 * 4096 + 100, 'x')));
+
+    std::shared_ptr<MappedFile> file = fileSystem.mapFile(path);
+    EXPECT(file != nullptr);
+    if (!file) {
+        return;
+    }
+    EXPECT(file->isIntact());
+    EXPECT(truncate(path.c_str(), 10) == 0);
+
+    size_t nonZero = 0;
+    for (size_t i = 0; i < file->size(); ++i) {
+        nonZero += file->data()[i] != 0;
+    }
+    EXPECT(nonZero >= 10);
+    EXPECT(!file->isIntact());
+}
+#endif
+
+// An empty line saved right after a lone "\r" must not turn it into "\r\n"
+TEST(largeFileSaveKeepsLoneCarriageReturnLines) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("mixed.log");
+    std::string savedPath = directory.file("saved.log");
+    EXPECT(fileSystem.writeTextFile(path, "a\rb\nc\n"));
+
+    ThreadPool pool(2);
+    std::unique_ptr<LargeFile> file = LargeFile::open(pool, path);
+    EXPECT(file != nullptr);
+    if (!file) {
+        return;
+    }
+    file->waitForLines(4);
+    EXPECT(file->replace(1, 0, 1, 1, ""));
+    EXPECT(file->save(savedPath));
+
+    std::string saved;
+    EXPECT(fileSystem.readFile(savedPath, saved));
+    EXPECT_EQ(saved, std::string("a\r\r\nc\n"));
+
+    std::unique_ptr<LargeFile> reopened = LargeFile::open(pool, savedPath);
+    EXPECT(reopened != nullptr);
+    if (!reopened) {
+        return;
+    }
+    reopened->waitForLines(4);
+    std::vector<std::string> lines;
+    EXPECT_EQ(reopened->getLines(0, 10, lines), static_cast<size_t>(4));
+    lines.resize(4);
+    EXPECT_EQ(lines[0], std::string("a"));
+    EXPECT_EQ(lines[1], std::string(""));
+    EXPECT_EQ(lines[2], std::string("c"));
+    EXPECT_EQ(lines[3], std::string(""));
+}
+
+#ifndef _WIN32
+// A log truncated under an open LargeFile must fail reads rather than fault
+TEST(largeFileTruncatedUnderReader) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("rotated.log");
+    std::string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += "line " + std::to_string(i) + "\n";
+    }
+    EXPECT(fileSystem.writeTextFile(path, text));
+
+    ThreadPool pool(2);
+    std::unique_ptr<LargeFile> file = LargeFile::open(pool, path);
+    EXPECT(file != nullptr);
+    if (!file) {
+        return;
+    }
+    file->waitForLines(1001);
+    std::string line;
+    EXPECT(file->getLine(500, line));
+    EXPECT_EQ(line, std::string("line 500"));
+
+    // As copytruncate leaves it
+    EXPECT(truncate(path.c_str(), 0) == 0);
+    EXPECT(!file->getLine(500, line));
+    std::vector<std::string> lines;
+    EXPECT_EQ(file->getLines(0, 10, lines), static_cast<size_t>(0));
+    EXPECT(file->getStatus().truncated);
+    EXPECT(!file->save(directory.file("saved.log")));
+}
+
+// A truncation in the middle of indexing, which no check beforehand can rule
+// out, fails the index instead of crashing with SIGBUS
+TEST(largeFileTruncatedWhileIndexing) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string path = directory.file("rotating.log");
+    std::string text;
+    for (int i = 0; i < 200000; ++i) {
+        text += "a line of a log that is rotated while it is indexed " + std::to_string(i) + "\n";
+    }
+
+    ThreadPool pool(2);
+    LargeFileOptions options;
+    options.indexChunkSize = 64 * 1024;
+    for (int attempt = 0; attempt < 5; ++attempt) {
+        EXPECT(fileSystem.writeTextFile(path, text));
+        std::unique_ptr<LargeFile> file = LargeFile::open(pool, path, options);
+        EXPECT(file != nullptr);
+        if (!file) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500 * attempt));
+        EXPECT(truncate(path.c_str(), 0) == 0);
+        file->waitForLines(static_cast<uint64_t>(-1));
+
+        LargeFileStatus status = file->getStatus();
+        EXPECT(status.indexComplete != status.indexFailed);
+        std::string line;
+        EXPECT(!file->getLine(100000, line));
+    }
+}
+#endif
+
+#ifndef _WIN32
+// Renaming a file reports the old path deleted and the new one created
+TEST(fileWatcherReportsRenames) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string root = directory.file("renamed");
+    fileSystem.createDirectory(root);
+    std::string before = fileSystem.combinePaths(root, "before.txt");
+    std::string after = fileSystem.combinePaths(root, "after.txt");
+    EXPECT(fileSystem.writeTextFile(before, "text"));
+
+    std::mutex mutex;
+    bool deleted = false;
+    bool created = false;
+    Signal both;
+    ThreadPool pool(2);
+    FileWatcherOptions options;
+    options.debounceMilliseconds = 10;
+    FileWatcher watcher(fileSystem, pool, root, options, [&](const std::vector<FileChange>& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const FileChange& change : changes) {
+            deleted = deleted || (change.path == before && change.type == FileChangeType::Deleted);
+            created = created || (change.path == after && change.type == FileChangeType::Created);
+        }
+        if (deleted && created) {
+            both.set();
+        }
+    });
+    EXPECT(watcher.isWatching());
+    watcher.waitUntilReady();
+
+    EXPECT(rename(before.c_str(), after.c_str()) == 0);
+    EXPECT(both.waitFor(5000));
+}
+
+// Every directory of a new subtree is reported as created, however deep and
+// whether or not walks report directories
+TEST(fileWatcherReportsNewNestedDirectories) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string root = directory.file("watched");
+    fileSystem.createDirectory(root);
+
+    std::mutex mutex;
+    std::set<std::string> created;
+    Signal deepest;
+    std::string newDirectory = fileSystem.combinePaths(root, "new");
+    std::string deep = fileSystem.combinePaths(newDirectory, "deep");
+    std::string er = fileSystem.combinePaths(deep, "er");
+
+    ThreadPool pool(2);
+    FileWatcherOptions options;
+    options.debounceMilliseconds = 10;
+    FileWatcher watcher(fileSystem, pool, root, options, [&](const std::vector<FileChange>& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const FileChange& change : changes) {
+            if (change.type == FileChangeType::Created && change.isDirectory) {
+                created.insert(change.path);
+                if (change.path == er) {
+                    deepest.set();
+                }
+            }
+        }
+    });
+    EXPECT(watcher.isWatching());
+    watcher.waitUntilReady();
+
+    // Moved in whole, so only the walk of the new directory finds the levels
+    // below it
+    std::string outside = directory.file("outside");
+    fileSystem.createDirectory(outside);
+    fileSystem.createDirectory(fileSystem.combinePaths(outside, "deep"));
+    fileSystem.createDirectory(fileSystem.combinePaths(outside, "deep/er"));
+    EXPECT(rename(outside.c_str(), newDirectory.c_str()) == 0);
+    EXPECT(deepest.waitFor(5000));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT(created.count(newDirectory) == 1);
+    EXPECT(created.count(deep) == 1);
+    EXPECT(created.count(er) == 1);
+}
+
+// Moving a directory out drops the watches below it even when a sibling such
+// as "foo-bar" sorts between "foo" and "foo/sub"
+TEST(fileWatcherUnwatchesMovedOutSubtree) {
+    FileSystem fileSystem;
+    TemporaryDirectory directory(fileSystem);
+    std::string root = directory.file("tree");
+    std::string foo = fileSystem.combinePaths(root, "foo");
+    fileSystem.createDirectory(fileSystem.combinePaths(foo, "sub"));
+    fileSystem.createDirectory(fileSystem.combinePaths(root, "foo-bar"));
+
+    std::mutex mutex;
+    std::vector<FileChange> seen;
+    Signal removed;
+    ThreadPool pool(2);
+    FileWatcherOptions options;
+    options.debounceMilliseconds = 10;
+    FileWatcher watcher(fileSystem, pool, root, options, [&](const std::vector<FileChange>& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const FileChange& change : changes) {
+            seen.push_back(change);
+            if (change.type == FileChangeType::Deleted && change.path == foo) {
+                removed.set();
+            }
+        }
+    });
+    watcher.waitUntilReady();
+    EXPECT_EQ(watcher.getStatus().watchedDirectories, static_cast<size_t>(4));
+
+    std::string outside = directory.file("outside");
+    EXPECT(rename(foo.c_str(), outside.c_str()) == 0);
+    EXPECT(removed.waitFor(5000));
+    EXPECT_EQ(watcher.getStatus().watchedDirectories, static_cast<size_t>(2));
+
+    // Nothing is reported for the moved directory any more
+    fileSystem.writeTextFile(fileSystem.combinePaths(outside, "sub/late.txt"), "late");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const FileChange& change : seen) {
+        EXPECT(change.path.find("late.txt") == std::string::npos);
+    }
+}
+#endif
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::string(argv[1]) == ExtensionWorker::kCommandLineSwitch) {
+        return CoreAPI::getInstance().runExtensionWorker(argv[2], std::stoul(argv[3]));
+    }
+
+    std::string filter = argc > 1 ? argv[1] : "";
+    int run = 0;
+    for (const TestCase& test : getTests()) {
+        if (!filter.empty() && std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        int before = failures;
+        test.run();
+        fprintf(stderr, "%s %s\n", failures == before ? "PASS" : "FAIL", test.name);
+        ++run;
+    }
+    fprintf(stderr, "%d tests, %d failed checks\n", run, failures);
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file
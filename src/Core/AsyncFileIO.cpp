@@ -0,0 +1,244 @@
+#include "pch.h"
+#include "AsyncFileIO.h"
+#include "AtomicFile.h"
+#include "FileSystem.h"
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <mutex>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Shared with the pool tasks, which may outlive the object by the time
+            // they take to return
+            struct IOState {
+                IOState(const FileSystem& fileSystem, ThreadPool& pool)
+                    : fileSystem(fileSystem), pool(pool), pending(0), nextSequence(0) {}
+
+                const FileSystem& fileSystem;
+                ThreadPool& pool;
+
+                // Guards the task count and the save order; changed signals both the
+                // last task and the end of an in-place copy
+                std::mutex mutex;
+                std::condition_variable changed;
+                size_t pending;
+
+                // Per path with saves in flight: how many there are, the newest that
+                // replaced the file, and whether one is copying over it in place,
+                // which runs unlocked and keeps the others waiting
+                struct SaveOrder {
+                    size_t inFlight = 0;
+                    uint64_t replaced = 0;
+                    bool copying = false;
+                };
+                uint64_t nextSequence;
+                std::unordered_map<std::string, SaveOrder> saves;
+
+                // Serializes callback invocations
+                std::mutex callbackMutex;
+            };
+
+            using StatePtr = std::shared_ptr<IOState>;
+
+            // Queue a task and count it until it has run
+            void spawn(const StatePtr& state, std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->pending++;
+                }
+
+                state->pool.submit([state, task = std::move(task)] {
+                    task();
+
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (--state->pending == 0) {
+                        state->changed.notify_all();
+                    }
+                });
+            }
+
+            bool writeContents(AtomicFile& file, const FileWriteRequest& request) {
+                if (!request.fromSnapshot) {
+                    return file.write(request.content.data(), request.content.size());
+                }
+
+                bool written = true;
+                request.snapshot.forEachChunk([&file, &written](std::string_view chunk) {
+                    written = file.write(chunk.data(), chunk.size());
+                    return written;
+                });
+                return written;
+            }
+
+            bool save(IOState& state, const FileWriteRequest& request, uint64_t sequence, std::string& recoveryPath) {
+                // Writing and flushing, the slow part, run alongside other saves of the
+                // same path; only the renames are put in order
+                std::unique_ptr<AtomicFile> file = AtomicFile::create(request.path);
+                bool written = file && writeContents(*file, request) && file->sync();
+
+                bool replaced = false;
+                bool superseded = false;
+                bool copying = false;
+                uint64_t previous = 0;
+                {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+                    IOState::SaveOrder& order = state.saves[request.path];
+                    state.changed.wait(lock, [&order] { return !order.copying; });
+                    if (written && order.replaced > sequence) {
+                        // Newer contents are on disk already
+                        file.reset();
+                        superseded = true;
+                    }
+                    else if (written && file->replacesInPlace()) {
+                        // Claim the file, then copy without holding up other paths
+                        previous = order.replaced;
+                        order.replaced = sequence;
+                        order.copying = true;
+                        copying = true;
+                    }
+                    else if (written && file->replace()) {
+                        order.replaced = sequence;
+                        replaced = true;
+                    }
+                    if (!copying && --order.inFlight == 0) {
+                        state.saves.erase(request.path);
+                    }
+                }
+
+                if (copying) {
+                    replaced = file->replace();
+                    recoveryPath = file->getRecoveryPath();
+
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    IOState::SaveOrder& order = state.saves[request.path];
+                    if (!replaced) {
+                        order.replaced = previous;
+                    }
+                    order.copying = false;
+                    if (--order.inFlight == 0) {
+                        state.saves.erase(request.path);
+                    }
+                    state.changed.notify_all();
+                }
+
+                if (replaced) {
+                    file->syncDirectory();
+                }
+                return replaced || superseded;
+            }
+
+            void submitRead(const StatePtr& state, std::string path, std::function<void(FileReadResult&)> done) {
+                spawn(state, [state, path = std::move(path), done = std::move(done)] {
+                    FileReadResult result;
+                    result.path = path;
+                    result.succeeded = state->fileSystem.readFile(path, result.content);
+
+                    std::lock_guard<std::mutex> lock(state->callbackMutex);
+                    done(result);
+                });
+            }
+
+            void submitSave(const StatePtr& state, FileWriteRequest request, std::function<void(FileWriteResult&)> done) {
+                uint64_t sequence;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    sequence = ++state->nextSequence;
+                    state->saves[request.path].inFlight++;
+                }
+
+                spawn(state, [state, request = std::move(request), sequence, done = std::move(done)] {
+                    FileWriteResult result;
+                    result.path = request.path;
+                    result.succeeded = save(*state, request, sequence, result.recoveryPath);
+
+                    std::lock_guard<std::mutex> lock(state->callbackMutex);
+                    done(result);
+                });
+            }
+
+            // Results gathered in request order for a future. Completions are
+            // serialized, so the count needs no lock of its own.
+            template <typename Result>
+            struct Gathered {
+                explicit Gathered(size_t count) : results(count), remaining(count) {}
+
+                void complete(size_t index, Result& result) {
+                    results[index] = std::move(result);
+                    if (--remaining == 0) {
+                        promise.set_value(std::move(results));
+                    }
+                }
+
+                std::vector<Result> results;
+                size_t remaining;
+                std::promise<std::vector<Result>> promise;
+            };
+
+            template <typename Result, typename Request, typename Submit>
+            std::future<std::vector<Result>> gather(const StatePtr& state, std::vector<Request>& requests, Submit submit) {
+                auto gathered = std::make_shared<Gathered<Result>>(requests.size());
+                std::future<std::vector<Result>> future = gathered->promise.get_future();
+                if (requests.empty()) {
+                    gathered->promise.set_value({});
+                }
+
+                for (size_t i = 0; i < requests.size(); ++i) {
+                    submit(state, std::move(requests[i]), [gathered, i](Result& result) {
+                        gathered->complete(i, result);
+                    });
+                }
+                return future;
+            }
+        }
+
+        class AsyncFileIO::Impl {
+        public:
+            StatePtr state;
+        };
+
+        AsyncFileIO::AsyncFileIO(const FileSystem& fileSystem, ThreadPool& pool) : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<IOState>(fileSystem, pool);
+        }
+
+        AsyncFileIO::~AsyncFileIO() {
+            wait();
+        }
+
+        void AsyncFileIO::read(std::vector<std::string> paths, FileReadCallback callback) {
+            auto shared = std::make_shared<FileReadCallback>(std::move(callback));
+            for (std::string& path : paths) {
+                submitRead(pImpl->state, std::move(path), [shared](FileReadResult& result) {
+                    (*shared)(result);
+                });
+            }
+        }
+
+        std::future<std::vector<FileReadResult>> AsyncFileIO::read(std::vector<std::string> paths) {
+            return gather<FileReadResult>(pImpl->state, paths, submitRead);
+        }
+
+        void AsyncFileIO::write(std::vector<FileWriteRequest> requests, FileWriteCallback callback) {
+            auto shared = std::make_shared<FileWriteCallback>(std::move(callback));
+            for (FileWriteRequest& request : requests) {
+                submitSave(pImpl->state, std::move(request), [shared](FileWriteResult& result) {
+                    (*shared)(result);
+                });
+            }
+        }
+
+        std::future<std::vector<FileWriteResult>> AsyncFileIO::write(std::vector<FileWriteRequest> requests) {
+            return gather<FileWriteResult>(pImpl->state, requests, submitSave);
+        }
+
+        void AsyncFileIO::wait() {
+            IOState& state = *pImpl->state;
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&state] {
+                return state.pending == 0;
+            });
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
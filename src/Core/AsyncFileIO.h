@@ -0,0 +1,93 @@
+#pragma once
+
+#include "pch.h"
+#include "TextBuffer.h"
+#include <future>
+
+namespace Vune {
+    namespace Core {
+
+        class FileSystem;
+        class ThreadPool;
+
+        struct FileReadResult {
+            std::string path;
+            std::string content;
+            bool succeeded;
+
+            FileReadResult() : path(), content(), succeeded(false) {}
+        };
+
+        // New contents for a file, as a string or as a buffer snapshot, which is
+        // streamed chunk by chunk without building the whole text
+        struct FileWriteRequest {
+            std::string path;
+            std::string content;
+            TextSnapshot snapshot;
+            bool fromSnapshot;
+
+            FileWriteRequest() : path(), content(), snapshot(), fromSnapshot(false) {}
+            FileWriteRequest(const std::string& path, std::string content)
+                : path(path), content(std::move(content)), snapshot(), fromSnapshot(false) {}
+            FileWriteRequest(const std::string& path, const TextSnapshot& snapshot)
+                : path(path), content(), snapshot(snapshot), fromSnapshot(true) {}
+        };
+
+        struct FileWriteResult {
+            std::string path;
+            bool succeeded;
+
+            // Where the new contents were left when a failed in-place copy damaged
+            // the file (see AtomicFile); empty otherwise
+            std::string recoveryPath;
+
+            FileWriteResult() : path(), succeeded(false), recoveryPath() {}
+        };
+
+        // Receive each file as it completes, one call at a time from the pool threads
+        using FileReadCallback = std::function<void(FileReadResult&)>;
+        using FileWriteCallback = std::function<void(const FileWriteResult&)>;
+
+        // Reads and saves batches of files on a ThreadPool, every file its own task,
+        // so dozens of documents wait on the disk together instead of one after
+        // another, and never on the calling thread. Saves go through AtomicFile:
+        // written beside the target, flushed, then renamed over it.
+        //
+        // Saves of one path land in the order they were requested; a save finishing
+        // after a later one of the same path is dropped rather than replacing the
+        // newer contents, and reports success.
+        class AsyncFileIO {
+        public:
+            // Blocking I/O occupies pool threads, so a pool of its own keeps saves
+            // from holding up searches
+            AsyncFileIO(const FileSystem& fileSystem, ThreadPool& pool);
+
+            // Waits for the requests in flight
+            ~AsyncFileIO();
+
+            void read(std::vector<std::string> paths, FileReadCallback callback);
+
+            // Results in the order of paths
+            std::future<std::vector<FileReadResult>> read(std::vector<std::string> paths);
+
+            void write(std::vector<FileWriteRequest> requests, FileWriteCallback callback);
+
+            // Results in the order of requests
+            std::future<std::vector<FileWriteResult>> write(std::vector<FileWriteRequest> requests);
+
+            // Block until every request so far has completed. Must not be called from
+            // a thread of the pool.
+            void wait();
+
+        private:
+            // Prevent copying
+            AsyncFileIO(const AsyncFileIO&) = delete;
+            AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
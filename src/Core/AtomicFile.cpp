@@ -0,0 +1,264 @@
+#include "pch.h"
+#include "AtomicFile.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Temporaries get a number of their own, so concurrent saves of one file
+            // never share one
+            std::string makeTempPath(const std::string& path) {
+                static std::atomic<uint64_t> counter(0);
+                return path + ".vune-save-" + std::to_string(counter++);
+            }
+
+            // The file a path names, so that saving through a symbolic link replaces
+            // what it points to rather than the link. A new file is created as named.
+            std::string resolveTarget(const std::string& path) {
+                std::error_code error;
+                fs::path target = fs::canonical(fs::u8path(path), error);
+                return error ? path : target.u8string();
+            }
+        }
+
+        class AtomicFile::Impl {
+        public:
+#ifdef _WIN32
+            HANDLE file = INVALID_HANDLE_VALUE;
+
+            void close() {
+                if (file != INVALID_HANDLE_VALUE) {
+                    CloseHandle(file);
+                    file = INVALID_HANDLE_VALUE;
+                }
+            }
+#else
+            int descriptor = -1;
+
+            // Copy the temporary over the target instead of renaming it
+            bool inPlace = false;
+
+            void close() {
+                if (descriptor >= 0) {
+                    ::close(descriptor);
+                    descriptor = -1;
+                }
+            }
+#endif
+        };
+
+        AtomicFile::AtomicFile(const std::string& path)
+            : path(path), targetPath(resolveTarget(path)), tempPath(makeTempPath(targetPath)), recoveryPath(), failed(false), synced(false), committed(false), pImpl(std::make_unique<Impl>()) {
+        }
+
+        AtomicFile::~AtomicFile() {
+            pImpl->close();
+            if (!committed && recoveryPath.empty()) {
+                std::error_code error;
+                fs::remove(fs::u8path(tempPath), error);
+            }
+        }
+
+        std::unique_ptr<AtomicFile> AtomicFile::create(const std::string& path) {
+            std::unique_ptr<AtomicFile> result(new AtomicFile(path));
+            Impl& impl = *result->pImpl;
+
+#ifdef _WIN32
+            impl.file = CreateFileW(fs::u8path(result->tempPath).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (impl.file == INVALID_HANDLE_VALUE) {
+                return nullptr;
+            }
+#else
+            // Keep the permissions and owner of the file being replaced
+            mode_t mode = 0666;
+            struct stat info;
+            bool exists = stat(result->targetPath.c_str(), &info) == 0;
+            if (exists) {
+                mode = info.st_mode & 07777;
+            }
+
+            // Read back too, for copying in place
+            impl.descriptor = ::open(result->tempPath.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+            if (impl.descriptor < 0) {
+                return nullptr;
+            }
+
+            struct stat created;
+            if (exists && fstat(impl.descriptor, &created) == 0 && (created.st_uid != info.st_uid || created.st_gid != info.st_gid) &&
+                fchown(impl.descriptor, info.st_uid, info.st_gid) != 0) {
+                impl.inPlace = true;
+            }
+
+            // After fchown, which may clear the set-id bits
+            if (exists) {
+                fchmod(impl.descriptor, mode);
+            }
+#endif
+            return result;
+        }
+
+        bool AtomicFile::replacesInPlace() const {
+#ifdef _WIN32
+            return false;
+#else
+            return pImpl->inPlace;
+#endif
+        }
+
+        bool AtomicFile::write(const char* data, size_t length) {
+            if (failed || committed) {
+                return false;
+            }
+            synced = false;
+
+            while (length > 0) {
+#ifdef _WIN32
+                DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+                DWORD written = 0;
+                if (!WriteFile(pImpl->file, data, chunk, &written, nullptr)) {
+                    failed = true;
+                    return false;
+                }
+#else
+                ssize_t written = ::write(pImpl->descriptor, data, length);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    failed = true;
+                    return false;
+                }
+#endif
+                data += written;
+                length -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+        bool AtomicFile::sync() {
+            if (failed || committed) {
+                return false;
+            }
+            if (!synced) {
+#ifdef _WIN32
+                synced = FlushFileBuffers(pImpl->file) != 0;
+#else
+                synced = fsync(pImpl->descriptor) == 0;
+#endif
+                failed = !synced;
+            }
+            return synced;
+        }
+
+        bool AtomicFile::replace() {
+            if (!sync()) {
+                return false;
+            }
+
+#ifdef _WIN32
+            pImpl->close();
+            committed = MoveFileExW(fs::u8path(tempPath).c_str(), fs::u8path(targetPath).c_str(),
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+            if (pImpl->inPlace) {
+                committed = copyInPlace();
+                pImpl->close();
+                if (committed) {
+                    unlink(tempPath.c_str());
+                }
+            }
+            else {
+                pImpl->close();
+                committed = rename(tempPath.c_str(), targetPath.c_str()) == 0;
+            }
+#endif
+            failed = !committed;
+            return committed;
+        }
+
+        bool AtomicFile::syncDirectory() {
+#ifdef _WIN32
+            // MOVEFILE_WRITE_THROUGH already waited for the rename
+            return committed;
+#else
+            if (pImpl->inPlace) {
+                // The directory did not change
+                return committed;
+            }
+            std::string directory = fs::path(targetPath).parent_path().string();
+            int handle = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (handle < 0) {
+                return false;
+            }
+            bool flushed = fsync(handle) == 0;
+            ::close(handle);
+            return flushed;
+#endif
+        }
+
+#ifndef _WIN32
+        bool AtomicFile::copyInPlace() {
+            // Truncated only once the copy is whole, so that a failure before any
+            // write leaves the old contents as they were
+            int target = ::open(targetPath.c_str(), O_WRONLY | O_CLOEXEC);
+            if (target < 0) {
+                return false;
+            }
+
+            std::vector<char> buffer(1 << 20);
+            off_t copiedLength = 0;
+            bool copied = lseek(pImpl->descriptor, 0, SEEK_SET) == 0;
+            while (copied) {
+                ssize_t length = ::read(pImpl->descriptor, buffer.data(), buffer.size());
+                if (length < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (length <= 0) {
+                    copied = length == 0;
+                    break;
+                }
+                for (ssize_t done = 0; copied && done < length;) {
+                    ssize_t written = ::write(target, buffer.data() + done, static_cast<size_t>(length - done));
+                    if (written < 0 && errno != EINTR) {
+                        copied = false;
+                    }
+                    done += std::max<ssize_t>(written, 0);
+                    copiedLength += std::max<ssize_t>(written, 0);
+                }
+            }
+
+            copied = copied && ftruncate(target, copiedLength) == 0 && fsync(target) == 0;
+            ::close(target);
+
+            // The target may now hold a mix of old and new bytes
+            if (!copied && copiedLength > 0) {
+                recoveryPath = tempPath;
+            }
+            return copied;
+        }
+#endif
+
+        bool AtomicFile::commit() {
+            // A replacement that is merely not yet durable still counts
+            if (!replace()) {
+                return false;
+            }
+            syncDirectory();
+            return true;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // New contents for a file, written under a temporary name beside it and renamed
+        // over it once flushed to disk. Readers, crashes included, see either the old
+        // file or the new one, never a truncated mix; buffers mapping the old file
+        // keep reading its original contents. Dropping an uncommitted file deletes the
+        // temporary.
+        //
+        // A symbolic link is followed, and the file it points to replaced. The new
+        // file keeps the permissions and owner of the old one; where the owner cannot
+        // be given to it, the finished temporary is copied over the old file in place
+        // instead, which readers can then see half done, and which buffers mapping
+        // the old file see too. Should that copy fail partway, the temporary is kept
+        // as the only whole copy of the new contents (see getRecoveryPath).
+        class AtomicFile {
+        public:
+            ~AtomicFile();
+
+            // Start replacing path; returns null if the temporary cannot be created
+            static std::unique_ptr<AtomicFile> create(const std::string& path);
+
+            const std::string& getPath() const { return path; }
+
+            // Whether replace copies over the target rather than renaming, so that it
+            // takes as long as writing the file again
+            bool replacesInPlace() const;
+
+            // The kept temporary after a failed in-place copy left the target damaged;
+            // empty otherwise
+            const std::string& getRecoveryPath() const { return recoveryPath; }
+
+            bool write(const char* data, size_t length);
+
+            // Flush the written bytes to disk. Slow, but touches only the temporary,
+            // so replacements can be ordered after it.
+            bool sync();
+
+            // Sync if not done yet, then rename over the target. The file can no
+            // longer be written afterwards.
+            bool replace();
+
+            // Flush the directory, making a replacement survive a crash too
+            bool syncDirectory();
+
+            // replace, then syncDirectory
+            bool commit();
+
+        private:
+            explicit AtomicFile(const std::string& path);
+
+            // Prevent copying
+            AtomicFile(const AtomicFile&) = delete;
+            AtomicFile& operator=(const AtomicFile&) = delete;
+
+            // Overwrite the target with the temporary, for when renaming would lose
+            // the target's owner
+            bool copyInPlace();
+
+            std::string path;
+            std::string targetPath;     // path with symbolic links resolved
+            std::string tempPath;
+            std::string recoveryPath;
+            bool failed;
+            bool synced;
+            bool committed;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
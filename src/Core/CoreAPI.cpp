@@ -1,11 +1,40 @@
 #include "pch.h"
 #include "CoreAPI.h"
 #include "ExtensionHost.h"
+#include "ExtensionRegistry.h"
+#include "ExtensionWorker.h"
 #include "FileSystem.h"
+#include "Trace.h"
+#include <filesystem>
+
+namespace fs = std::filesystem;
 
 namespace Vune {
     namespace Core {
 
+        namespace {
+            // Path of the running executable, or empty if it cannot be found
+            std::string currentExecutable() {
+#ifdef _WIN32
+                std::vector<wchar_t> buffer(MAX_PATH);
+                for (;;) {
+                    DWORD length = GetModuleFileNameW(nullptr, buffer.data(), static_cast<DWORD>(buffer.size()));
+                    if (length == 0) {
+                        return std::string();
+                    }
+                    if (length < buffer.size()) {
+                        return fs::path(std::wstring(buffer.data(), length)).u8string();
+                    }
+                    buffer.resize(buffer.size() * 2);
+                }
+#else
+                std::error_code error;
+                fs::path path = fs::read_symlink("/proc/self/exe", error);
+                return error ? std::string() : path.u8string();
+#endif
+            }
+        }
+
         std::string Version::toString() const {
             return std::to_string(major) + "." + std::to_string(minor) + "." + std::to_string(patch);
         }
@@ -16,7 +45,9 @@ namespace Vune {
             
             bool initialized;
             Version version;
+            ExtensionHostOptions hostOptions;
             std::unique_ptr<ExtensionHost> extensionHost;
+            std::unique_ptr<ExtensionRegistry> extensionRegistry;
             std::unique_ptr<FileSystem> fileSystem;
         };
 
@@ -37,9 +68,27 @@ namespace Vune {
                 return true; // Already initialized
             }
             
+            TraceScope scope("CoreAPI::initialize");
+            
             // Initialize subsystems
             pImpl->fileSystem = std::make_unique<FileSystem>();
-            pImpl->extensionHost = std::make_unique<ExtensionHost>();
+            if (pImpl->hostOptions.workerPath.empty()) {
+                pImpl->hostOptions.workerPath = currentExecutable();
+            }
+            pImpl->extensionHost = std::make_unique<ExtensionHost>(pImpl->hostOptions);
+            
+            // Installed extensions come from the manifest cache beside the
+            // configuration; only manifests changed since it was saved are parsed
+            std::string configDirectory = pImpl->fileSystem->getDirectoryName(configPath);
+            std::string cachePath = pImpl->fileSystem->combinePaths(configDirectory, "extensions.cache");
+            pImpl->extensionRegistry = std::make_unique<ExtensionRegistry>(*pImpl->fileSystem,
+                pImpl->fileSystem->combinePaths(configDirectory, "extensions"));
+            pImpl->extensionRegistry->load(cachePath);
+            pImpl->extensionRegistry->refresh();
+            pImpl->extensionRegistry->save(cachePath);
+            for (const ExtensionManifest& manifest : pImpl->extensionRegistry->getManifests()) {
+                pImpl->extensionHost->installExtension(manifest.id, manifest.version, manifest.activationEvents, manifest.dependencies);
+            }
             
             // Load configuration
             // TODO: Implement configuration loading
@@ -48,6 +97,11 @@ namespace Vune {
             return true;
         }
 
+        void CoreAPI::setExtensionWorker(const std::string& path, const std::vector<std::string>& arguments) {
+            pImpl->hostOptions.workerPath = path;
+            pImpl->hostOptions.workerArguments = arguments;
+        }
+
         Version CoreAPI::getVersion() const {
             return pImpl->version;
         }
@@ -76,12 +130,49 @@ namespace Vune {
             return pImpl->extensionHost->getInstalledExtensions();
         }
 
+        bool CoreAPI::activateExtension(const std::string& extensionId) {
+            if (!pImpl->initialized || !pImpl->extensionHost) {
+                return false;
+            }
+            
+            return pImpl->extensionHost->activateExtension(extensionId);
+        }
+
+        int CoreAPI::runExtensionWorker(const std::string& channelName, unsigned long hostProcessId) {
+            auto worker = ExtensionWorker::connect(channelName, hostProcessId);
+            if (!worker) {
+                return 1;
+            }
+            
+            return worker->run();
+        }
+
+        void CoreAPI::setTracingEnabled(bool enabled) {
+            Trace::setEnabled(enabled);
+        }
+
+        bool CoreAPI::isTracingEnabled() const {
+            return Trace::isEnabled();
+        }
+
+        void CoreAPI::clearTrace() {
+            Trace::clear();
+        }
+
+        std::string CoreAPI::exportTrace() const {
+            return Trace::exportChromeJson();
+        }
+
         bool CoreAPI::importVSCodeData(const std::string& vscodePath, bool importSettings, bool importExtensions, bool importThemes) {
             if (!pImpl->initialized) {
                 return false;
             }
             
             // TODO: Implement VS Code data import
+            (void)vscodePath;
+            (void)importSettings;
+            (void)importExtensions;
+            (void)importThemes;
             return false;
         }
 
@@ -92,6 +183,7 @@ namespace Vune {
             
             // Shutdown subsystems in reverse order
             pImpl->extensionHost.reset();
+            pImpl->extensionRegistry.reset();
             pImpl->fileSystem.reset();
             
             pImpl->initialized = false;
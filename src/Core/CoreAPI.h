@@ -2,7 +2,10 @@
 
 #include "pch.h"
 
-#ifdef CORE_EXPORTS
+// Exported from the Windows DLL; elsewhere Core is a static library
+#if !defined(_WIN32)
+#define CORE_API
+#elif defined(CORE_EXPORTS)
 #define CORE_API __declspec(dllexport)
 #else
 #define CORE_API __declspec(dllimport)
@@ -24,7 +27,15 @@ namespace Vune {
         public:
             static CoreAPI& getInstance();
             
-            // Initialize the core with configuration
+            // Executable to start as the extension worker, given arguments before
+            // the worker's own. Set before initialize; by default it is the current
+            // executable, whose entry point must then hand a command line with
+            // ExtensionWorker::kCommandLineSwitch to runExtensionWorker.
+            void setExtensionWorker(const std::string& path, const std::vector<std::string>& arguments);
+            
+            // Initialize the core with configuration. Extensions installed in the
+            // "extensions" directory beside the configuration file are registered
+            // from the manifest cache "extensions.cache" there (see ExtensionRegistry).
             bool initialize(const std::string& configPath);
             
             // Get version information
@@ -34,6 +45,21 @@ namespace Vune {
             bool installExtension(const std::string& extensionId, const std::string& version);
             bool uninstallExtension(const std::string& extensionId);
             std::vector<std::string> getInstalledExtensions() const;
+            bool activateExtension(const std::string& extensionId);
+            
+            // Serve as the extension worker process of another instance. The
+            // executable named by ExtensionHostOptions::workerPath calls this when
+            // started with ExtensionWorker::kCommandLineSwitch, passing the channel
+            // name and host process id that follow it, and exits with the returned
+            // code.
+            int runExtensionWorker(const std::string& channelName, unsigned long hostProcessId);
+            
+            // Tracing (see Trace). Enabled before initialize, it covers startup
+            // too. The export is Chrome trace JSON, which Perfetto opens.
+            void setTracingEnabled(bool enabled);
+            bool isTracingEnabled() const;
+            void clearTrace();
+            std::string exportTrace() const;
             
             // VS Code data import
             bool importVSCodeData(const std::string& vscodePath, bool importSettings, bool importExtensions, bool importThemes);
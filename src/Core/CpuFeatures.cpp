@@ -0,0 +1,49 @@
+#include "pch.h"
+#include "CpuFeatures.h"
+
+#if defined(VUNE_X86) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        bool CpuFeatures::hasSse2() {
+#if !defined(VUNE_X86)
+            return false;
+#elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+#endif
+        }
+
+        bool CpuFeatures::hasAvx2() {
+#if !defined(VUNE_X86)
+            return false;
+#elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+
+            // The OS must save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+            __cpuid(info, 1);
+            if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6) {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "pch.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VUNE_X86 1
+#include <immintrin.h>
+#endif
+
+// Compile a function for an instruction set the whole build does not assume; callers
+// must check the CPU supports it first
+#if defined(__GNUC__) || defined(__clang__)
+#define VUNE_TARGET(name) __attribute__((target(name)))
+#else
+#define VUNE_TARGET(name)
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        // Instruction set extensions available to vectorized code paths
+        class CpuFeatures {
+        public:
+            static bool hasSse2();
+            static bool hasAvx2();
+        };
+
+        // Index of the lowest set bit; value must not be zero
+        inline unsigned countTrailingZeros(uint32_t value) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, value);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+        }
+
+        inline unsigned countTrailingZeros(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanForward64(&index, value);
+            return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+            uint32_t low = static_cast<uint32_t>(value);
+            return low ? countTrailingZeros(low) : 32 + countTrailingZeros(static_cast<uint32_t>(value >> 32));
+#else
+            return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+        }
+
+        // Index of the highest set bit; value must not be zero
+        inline unsigned highestSetBit(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+            unsigned long index;
+            uint32_t high = static_cast<uint32_t>(value >> 32);
+            _BitScanReverse(&index, high ? high : static_cast<uint32_t>(value));
+            return static_cast<unsigned>(index) + (high ? 32 : 0);
+#else
+            return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,592 @@
+#include "pch.h"
+#include "Diff.h"
+#include "LineScanner.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Lines occurring more often than this are not used as histogram anchors
+            const size_t kMaxOccurrences = 64;
+
+            // Unresolved region of a diff: [aStart, aEnd) of the original against
+            // [bStart, bEnd) of the modified lines
+            struct DiffRange {
+                int aStart;
+                int aEnd;
+                int bStart;
+                int bEnd;
+            };
+
+            // Where a line occurs in the original part of a histogram region, and how
+            // often in the modified part
+            struct Occurrences {
+                std::vector<int> positions;
+                size_t modifiedCount = 0;
+
+                size_t count() const {
+                    return positions.size() + modifiedCount;
+                }
+            };
+
+            // Search cost beyond which Myers settles for a non-minimal split, about
+            // the square root of the region size as in GNU diff
+            int costLimit(int size) {
+                int limit = 1;
+                for (int remaining = size; remaining != 0; remaining >>= 2) {
+                    limit <<= 1;
+                }
+                return std::max(limit, 256);
+            }
+
+            class DiffBuilder {
+            public:
+                DiffBuilder(const uint32_t* a, const uint32_t* b, std::vector<LineChange>& output) : a(a), b(b), output(output) {
+                }
+
+                // Regions are resolved left to right from a stack rather than by
+                // recursion, which long inputs could nest deeply
+                void myers(const DiffRange& range) {
+                    std::vector<DiffRange> stack(1, range);
+                    while (!stack.empty()) {
+                        DiffRange current = stack.back();
+                        stack.pop_back();
+                        if (settle(current)) {
+                            continue;
+                        }
+
+                        int x, y;
+                        if (!split(current, x, y)) {
+                            emit(current);
+                            continue;
+                        }
+                        stack.push_back({ current.aStart + x, current.aEnd, current.bStart + y, current.bEnd });
+                        stack.push_back({ current.aStart, current.aStart + x, current.bStart, current.bStart + y });
+                    }
+                }
+
+                void histogram(const DiffRange& range) {
+                    std::vector<DiffRange> stack(1, range);
+                    std::unordered_map<uint32_t, Occurrences> occurrences;
+                    while (!stack.empty()) {
+                        DiffRange current = stack.back();
+                        stack.pop_back();
+                        if (settle(current)) {
+                            continue;
+                        }
+
+                        occurrences.clear();
+                        for (int i = current.aStart; i < current.aEnd; ++i) {
+                            occurrences[a[i]].positions.push_back(i);
+                        }
+                        for (int j = current.bStart; j < current.bEnd; ++j) {
+                            auto found = occurrences.find(b[j]);
+                            if (found != occurrences.end()) {
+                                found->second.modifiedCount++;
+                            }
+                        }
+
+                        // The common region whose rarest line is rarest on both sides,
+                        // then the longest. Regions that would force more insertions and
+                        // deletions around them than the lines they keep are skipped; in
+                        // repetitive text they are copies of the line somewhere else.
+                        int skew = std::abs((current.aEnd - current.aStart) - (current.bEnd - current.bStart));
+                        int bestA = 0, bestB = 0, bestLength = 0;
+                        size_t bestCount = kMaxOccurrences + 1;
+                        for (int j = current.bStart; j < current.bEnd;) {
+                            int next = j + 1;
+                            auto found = occurrences.find(b[j]);
+                            if (found != occurrences.end() && found->second.positions.size() <= kMaxOccurrences) {
+                                for (int i : found->second.positions) {
+                                    int startA = i, startB = j;
+                                    while (startA > current.aStart && startB > current.bStart && a[startA - 1] == b[startB - 1]) {
+                                        --startA;
+                                        --startB;
+                                    }
+                                    int endA = i + 1, endB = j + 1;
+                                    while (endA < current.aEnd && endB < current.bEnd && a[endA] == b[endB]) {
+                                        ++endA;
+                                        ++endB;
+                                    }
+
+                                    next = std::max(next, endB);
+                                    int displacement = std::abs((startA - current.aStart) - (startB - current.bStart)) +
+                                        std::abs((current.aEnd - endA) - (current.bEnd - endB));
+                                    if (displacement - skew > endA - startA) {
+                                        continue;
+                                    }
+
+                                    size_t count = found->second.count();
+                                    for (int k = startA; k < endA && count > 2; ++k) {
+                                        count = std::min(count, occurrences[a[k]].count());
+                                    }
+                                    if (count < bestCount || (count == bestCount && endA - startA > bestLength)) {
+                                        bestA = startA;
+                                        bestB = startB;
+                                        bestLength = endA - startA;
+                                        bestCount = count;
+                                    }
+                                }
+                            }
+                            j = next;
+                        }
+
+                        if (bestLength == 0) {
+                            myers(current);
+                            continue;
+                        }
+                        stack.push_back({ bestA + bestLength, current.aEnd, bestB + bestLength, current.bEnd });
+                        stack.push_back({ current.aStart, bestA, current.bStart, bestB });
+                    }
+                }
+
+            private:
+                // Trim the common prefix and suffix; returns true once nothing is left
+                // to match, emitting the remainder as a change
+                bool settle(DiffRange& range) {
+                    while (range.aStart < range.aEnd && range.bStart < range.bEnd && a[range.aStart] == b[range.bStart]) {
+                        ++range.aStart;
+                        ++range.bStart;
+                    }
+                    while (range.aStart < range.aEnd && range.bStart < range.bEnd && a[range.aEnd - 1] == b[range.bEnd - 1]) {
+                        --range.aEnd;
+                        --range.bEnd;
+                    }
+                    if (range.aStart == range.aEnd || range.bStart == range.bEnd) {
+                        emit(range);
+                        return true;
+                    }
+                    return false;
+                }
+
+                void emit(const DiffRange& range) {
+                    int aLength = range.aEnd - range.aStart;
+                    int bLength = range.bEnd - range.bStart;
+                    if (aLength == 0 && bLength == 0) {
+                        return;
+                    }
+
+                    // Changes separated only by an empty split are joined
+                    if (!output.empty()) {
+                        LineChange& last = output.back();
+                        if (last.originalStart + last.originalLength == range.aStart && last.modifiedStart + last.modifiedLength == range.bStart) {
+                            last.originalLength += aLength;
+                            last.modifiedLength += bLength;
+                            return;
+                        }
+                    }
+                    output.emplace_back(range.aStart, aLength, range.bStart, bLength);
+                }
+
+                // Point of the middle snake, where a shortest edit script crosses from
+                // the first half of its edits to the second, found by searching from
+                // both corners at once (Myers 1986, section 4b). Coordinates are
+                // relative to the range, which has no common prefix or suffix.
+                bool split(const DiffRange& range, int& splitX, int& splitY) {
+                    const uint32_t* first = a + range.aStart;
+                    const uint32_t* second = b + range.bStart;
+                    int n = range.aEnd - range.aStart;
+                    int m = range.bEnd - range.bStart;
+                    int maxD = (n + m + 1) / 2;
+                    int offset = maxD;
+                    int length = 2 * maxD + 2;
+                    forward.assign(length, -1);
+                    backward.assign(length, -1);
+                    forward[offset + 1] = 0;
+                    backward[offset + 1] = 0;
+
+                    int delta = n - m;
+                    bool odd = (delta & 1) != 0;
+                    int limit = costLimit(n + m);
+
+                    // Diagonals that left the grid are skipped from then on
+                    int forwardStart = 0, forwardEnd = 0, backwardStart = 0, backwardEnd = 0;
+                    int bestX = 0, bestY = 0;
+
+                    for (int d = 0; d < maxD; ++d) {
+                        for (int k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+                            int index = offset + k;
+                            int x = (k == -d || (k != d && forward[index - 1] < forward[index + 1])) ? forward[index + 1] : forward[index - 1] + 1;
+                            int y = x - k;
+                            while (x < n && y < m && first[x] == second[y]) {
+                                ++x;
+                                ++y;
+                            }
+                            forward[index] = x;
+
+                            if (x > n) {
+                                forwardEnd += 2;
+                            }
+                            else if (y > m) {
+                                forwardStart += 2;
+                            }
+                            else {
+                                if (x + y > bestX + bestY) {
+                                    bestX = x;
+                                    bestY = y;
+                                }
+                                int other = offset + delta - k;
+                                if (odd && other >= 0 && other < length && backward[other] != -1 && x >= n - backward[other]) {
+                                    splitX = x;
+                                    splitY = y;
+                                    return true;
+                                }
+                            }
+                        }
+
+                        // Backward paths count x from the end of both sequences
+                        for (int k = -d + backwardStart; k <= d - backwardEnd; k += 2) {
+                            int index = offset + k;
+                            int x = (k == -d || (k != d && backward[index - 1] < backward[index + 1])) ? backward[index + 1] : backward[index - 1] + 1;
+                            int y = x - k;
+                            while (x < n && y < m && first[n - x - 1] == second[m - y - 1]) {
+                                ++x;
+                                ++y;
+                            }
+                            backward[index] = x;
+
+                            if (x > n) {
+                                backwardEnd += 2;
+                            }
+                            else if (y > m) {
+                                backwardStart += 2;
+                            }
+                            else {
+                                int other = offset + delta - k;
+                                if (!odd && other >= 0 && other < length && forward[other] != -1) {
+                                    int forwardX = forward[other];
+                                    int forwardY = offset + forwardX - other;
+                                    if (forwardX >= n - x) {
+                                        splitX = forwardX;
+                                        splitY = forwardY;
+                                        return true;
+                                    }
+                                }
+                            }
+                        }
+
+                        // Too expensive: split where the forward search got furthest
+                        if (d >= limit && (bestX > 0 || bestY > 0) && (bestX < n || bestY < m)) {
+                            splitX = bestX;
+                            splitY = bestY;
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                const uint32_t* a;
+                const uint32_t* b;
+                std::vector<LineChange>& output;
+                std::vector<int> forward;
+                std::vector<int> backward;
+            };
+
+            // Maps line texts to ids, equal exactly when the texts are
+            class LineInterner {
+            public:
+                explicit LineInterner(bool ignoreTrailingWhitespace) : ignoreTrailingWhitespace(ignoreTrailingWhitespace) {
+                }
+
+                uint32_t intern(std::string_view line) {
+                    if (ignoreTrailingWhitespace) {
+                        size_t end = line.find_last_not_of(" \t");
+                        line = line.substr(0, end == std::string_view::npos ? 0 : end + 1);
+                    }
+
+                    key.assign(line.data(), line.size());
+                    auto found = ids.find(key);
+                    if (found != ids.end()) {
+                        return found->second;
+                    }
+                    uint32_t id = static_cast<uint32_t>(ids.size());
+                    ids.emplace(key, id);
+                    return id;
+                }
+
+                size_t size() const {
+                    return ids.size();
+                }
+
+            private:
+                bool ignoreTrailingWhitespace;
+                std::unordered_map<std::string, uint32_t> ids;
+                std::string key;
+            };
+
+            // Ids of the lines of text, which are split at "\n", "\r\n" and lone "\r"
+            // as in a TextBuffer
+            void internText(std::string_view text, LineInterner& interner, std::vector<uint32_t>& ids) {
+                std::vector<uint32_t> lineStarts;
+                LineScanner::scan(text.data(), text.size(), &lineStarts);
+
+                ids.clear();
+                ids.reserve(lineStarts.size() + 1);
+                size_t start = 0;
+                for (uint32_t next : lineStarts) {
+                    size_t end = next - 1;
+                    if (text[end] == '\n' && end > start && text[end - 1] == '\r') {
+                        --end;
+                    }
+                    ids.push_back(interner.intern(text.substr(start, end - start)));
+                    start = next;
+                }
+                ids.push_back(interner.intern(text.substr(start)));
+            }
+
+            void internLines(const TextSnapshot& snapshot, int first, int last, LineInterner& interner, std::vector<uint32_t>& ids) {
+                std::string scratch;
+                for (int line = first; line < last; ++line) {
+                    ids.push_back(interner.intern(snapshot.getLineView(line, scratch)));
+                }
+            }
+
+            void diffRange(const std::vector<uint32_t>& original, const std::vector<uint32_t>& modified, const DiffRange& range,
+                DiffAlgorithm algorithm, std::vector<LineChange>& output) {
+                DiffBuilder builder(original.data(), modified.data(), output);
+                if (algorithm == DiffAlgorithm::Histogram) {
+                    builder.histogram(range);
+                }
+                else {
+                    builder.myers(range);
+                }
+            }
+        }
+
+        std::vector<LineChange> LineDiff::compute(const std::vector<uint32_t>& original, const std::vector<uint32_t>& modified, DiffAlgorithm algorithm) {
+            std::vector<LineChange> result;
+            DiffRange range = { 0, static_cast<int>(original.size()), 0, static_cast<int>(modified.size()) };
+            diffRange(original, modified, range, algorithm, result);
+            return result;
+        }
+
+        std::vector<LineChange> LineDiff::compute(const TextSnapshot& original, const TextSnapshot& modified, const DiffOptions& options) {
+            LineInterner interner(options.ignoreTrailingWhitespace);
+            std::vector<uint32_t> originalIds, modifiedIds;
+            internLines(original, 0, original.getLineCount(), interner, originalIds);
+            internLines(modified, 0, modified.getLineCount(), interner, modifiedIds);
+            return compute(originalIds, modifiedIds, options.algorithm);
+        }
+
+        class DirtyDiff::Impl {
+        public:
+            // Distant edits between updates are tracked apart, up to this many
+            static const size_t kMaxDirtyRanges = 16;
+
+            // Lines [start, end) in current coordinates changed since the last
+            // update, which added delta lines there
+            struct DirtyRange {
+                int start;
+                int end;
+                int delta;
+            };
+
+            Impl(std::string_view original, const DiffOptions& options)
+                : options(options), original(original), interner(options.ignoreTrailingWhitespace), version(0) {
+            }
+
+            void diffAll(const TextSnapshot& modified) {
+                interner = LineInterner(options.ignoreTrailingWhitespace);
+                internText(original, interner, originalIds);
+                modifiedIds.clear();
+                internLines(modified, 0, modified.getLineCount(), interner, modifiedIds);
+
+                changes.clear();
+                diffRange(originalIds, modifiedIds, { 0, static_cast<int>(originalIds.size()), 0, static_cast<int>(modifiedIds.size()) },
+                    options.algorithm, changes);
+
+                version = modified.getVersion();
+                dirtyRanges.clear();
+            }
+
+            // Re-intern the dirty lines, then re-diff from the first to the last
+            // together with the changes touching them. The region is bounded by
+            // unchanged lines, whose original line numbers the previous changes give.
+            void diffDirty(const TextSnapshot& modified) {
+                int lineDelta = 0;
+                for (const DirtyRange& range : dirtyRanges) {
+                    lineDelta += range.delta;
+                }
+                int dirtyStart = dirtyRanges.front().start;
+                int dirtyEnd = dirtyRanges.back().end;
+                int oldDirtyEnd = dirtyEnd - lineDelta;
+                if (dirtyEnd > modified.getLineCount() || oldDirtyEnd > static_cast<int>(modifiedIds.size())) {
+                    diffAll(modified);
+                    return;
+                }
+
+                // Back to front, so the previous line numbers of earlier ranges hold
+                std::vector<uint32_t> fresh;
+                int shift = lineDelta;
+                for (auto range = dirtyRanges.rbegin(); range != dirtyRanges.rend(); ++range) {
+                    int oldEnd = range->end - shift;
+                    shift -= range->delta;
+                    int oldStart = range->start - shift;
+
+                    fresh.clear();
+                    internLines(modified, range->start, range->end, interner, fresh);
+                    modifiedIds.erase(modifiedIds.begin() + oldStart, modifiedIds.begin() + oldEnd);
+                    modifiedIds.insert(modifiedIds.begin() + oldStart, fresh.begin(), fresh.end());
+                }
+
+                // Changes that overlap or touch the dirty lines, in previous coordinates
+                auto first = std::find_if(changes.begin(), changes.end(), [dirtyStart](const LineChange& change) {
+                    return change.modifiedStart + change.modifiedLength >= dirtyStart;
+                });
+                auto last = std::find_if(first, changes.end(), [oldDirtyEnd](const LineChange& change) {
+                    return change.modifiedStart > oldDirtyEnd;
+                });
+
+                int start = dirtyStart;
+                int end = oldDirtyEnd;
+                if (first != last) {
+                    start = std::min(start, first->modifiedStart);
+                    end = std::max(end, (last - 1)->modifiedStart + (last - 1)->modifiedLength);
+                }
+
+                int shiftBefore = 0;
+                for (auto change = changes.begin(); change != first; ++change) {
+                    shiftBefore += change->modifiedLength - change->originalLength;
+                }
+                int shiftThrough = shiftBefore;
+                for (auto change = first; change != last; ++change) {
+                    shiftThrough += change->modifiedLength - change->originalLength;
+                }
+
+                std::vector<LineChange> region;
+                DiffRange range = { start - shiftBefore, end - shiftThrough, start, end + lineDelta };
+                diffRange(originalIds, modifiedIds, range, options.algorithm, region);
+
+                for (auto change = last; change != changes.end(); ++change) {
+                    change->modifiedStart += lineDelta;
+                }
+                changes.insert(changes.erase(first, last), region.begin(), region.end());
+
+                version = modified.getVersion();
+                dirtyRanges.clear();
+
+                // Every edited line stays interned; start over once most ids are dead
+                if (interner.size() > 2 * (originalIds.size() + modifiedIds.size()) + 4096) {
+                    diffAll(modified);
+                }
+            }
+
+            // Mark the lines replacing [start, end], which added delta lines
+            void markDirty(int start, int end, int lineBreaks) {
+                int delta = lineBreaks - (end - start);
+                DirtyRange marked = { start, start + lineBreaks + 1, delta };
+
+                // Ranges overlapping or touching the replaced lines merge into it;
+                // lines after it move by delta
+                std::vector<DirtyRange> ranges;
+                ranges.reserve(dirtyRanges.size() + 1);
+                bool placed = false;
+                for (const DirtyRange& range : dirtyRanges) {
+                    if (range.end < start) {
+                        ranges.push_back(range);
+                    }
+                    else if (range.start > end + 1) {
+                        if (!placed) {
+                            ranges.push_back(marked);
+                            placed = true;
+                        }
+                        ranges.push_back({ range.start + delta, range.end + delta, range.delta });
+                    }
+                    else {
+                        marked.start = std::min(marked.start, range.start);
+                        marked.end = std::max(marked.end, range.end > end ? range.end + delta : range.end);
+                        marked.delta += range.delta;
+                    }
+                }
+                if (!placed) {
+                    ranges.push_back(marked);
+                }
+
+                // Too many ranges: join the two closest
+                if (ranges.size() > kMaxDirtyRanges) {
+                    size_t closest = 0;
+                    for (size_t i = 1; i + 1 < ranges.size(); ++i) {
+                        if (ranges[i + 1].start - ranges[i].end < ranges[closest + 1].start - ranges[closest].end) {
+                            closest = i;
+                        }
+                    }
+                    ranges[closest].end = ranges[closest + 1].end;
+                    ranges[closest].delta += ranges[closest + 1].delta;
+                    ranges.erase(ranges.begin() + closest + 1);
+                }
+                dirtyRanges.swap(ranges);
+            }
+
+            DiffOptions options;
+            std::string original;
+            LineInterner interner;
+            std::vector<uint32_t> originalIds;
+            std::vector<uint32_t> modifiedIds;
+            std::vector<LineChange> changes;
+
+            // Version the diff is up to date with, once the dirty lines are diffed
+            int version;
+
+            // In order, neither overlapping nor touching
+            std::vector<DirtyRange> dirtyRanges;
+        };
+
+        DirtyDiff::DirtyDiff(std::string_view original, const TextSnapshot& modified, const DiffOptions& options)
+            : pImpl(std::make_unique<Impl>(original, options)) {
+            pImpl->diffAll(modified);
+        }
+
+        DirtyDiff::~DirtyDiff() {
+        }
+
+        void DirtyDiff::setOriginal(std::string_view original) {
+            pImpl->original.assign(original.data(), original.size());
+
+            // A version no snapshot has forces a full diff
+            pImpl->version = -1;
+        }
+
+        void DirtyDiff::noteChange(const TextDocumentChangeEvent& event) {
+            for (const auto& change : event.changes) {
+                int lineBreaks = static_cast<int>(std::count(change.text.begin(), change.text.end(), '\n'));
+                pImpl->markDirty(change.range.start.line, change.range.end.line, lineBreaks);
+            }
+
+            if (pImpl->version >= 0) {
+                pImpl->version = event.version;
+            }
+        }
+
+        const std::vector<LineChange>& DirtyDiff::update(const TextSnapshot& modified) {
+            if (modified.getVersion() != pImpl->version) {
+                pImpl->diffAll(modified);
+            }
+            else if (!pImpl->dirtyRanges.empty()) {
+                pImpl->diffDirty(modified);
+            }
+            return pImpl->changes;
+        }
+
+        const std::vector<LineChange>& DirtyDiff::getChanges() const {
+            return pImpl->changes;
+        }
+
+        std::vector<GutterMarker> DirtyDiff::getGutterMarkers() const {
+            std::vector<GutterMarker> markers;
+            markers.reserve(pImpl->changes.size());
+            for (const LineChange& change : pImpl->changes) {
+                if (change.modifiedLength == 0) {
+                    markers.emplace_back(change.modifiedStart, 0, GutterMarkerKind::Deleted);
+                }
+                else {
+                    GutterMarkerKind kind = change.originalLength == 0 ? GutterMarkerKind::Added : GutterMarkerKind::Modified;
+                    markers.emplace_back(change.modifiedStart, change.modifiedLength, kind);
+                }
+            }
+            return markers;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "pch.h"
+#include "TextBuffer.h"
+
+namespace Vune {
+    namespace Core {
+
+        enum class DiffAlgorithm {
+            // Fewest inserted and deleted lines. Linear space; very different inputs
+            // fall back to a faster, non-minimal split.
+            Myers,
+
+            // Anchors on the rarest common lines first, which usually lines up code
+            // better around moved or repeated lines. Regions without such anchors
+            // use Myers.
+            Histogram
+        };
+
+        struct DiffOptions {
+            DiffAlgorithm algorithm;
+
+            // Lines differing only in trailing spaces and tabs compare equal
+            bool ignoreTrailingWhitespace;
+
+            DiffOptions() : algorithm(DiffAlgorithm::Myers), ignoreTrailingWhitespace(false) {}
+        };
+
+        // Lines [originalStart, originalStart + originalLength) of the original were
+        // replaced by [modifiedStart, modifiedStart + modifiedLength) of the modified
+        // text. Line numbers are zero-based; either length may be 0.
+        struct LineChange {
+            int originalStart;
+            int originalLength;
+            int modifiedStart;
+            int modifiedLength;
+
+            LineChange() : originalStart(0), originalLength(0), modifiedStart(0), modifiedLength(0) {}
+            LineChange(int originalStart, int originalLength, int modifiedStart, int modifiedLength)
+                : originalStart(originalStart), originalLength(originalLength),
+                  modifiedStart(modifiedStart), modifiedLength(modifiedLength) {}
+
+            bool operator==(const LineChange& other) const {
+                return originalStart == other.originalStart && originalLength == other.originalLength &&
+                    modifiedStart == other.modifiedStart && modifiedLength == other.modifiedLength;
+            }
+        };
+
+        // Line diff over sequences of line ids, where equal ids mean equal lines
+        class LineDiff {
+        public:
+            // Changes in order, neither overlapping nor adjacent
+            static std::vector<LineChange> compute(const std::vector<uint32_t>& original, const std::vector<uint32_t>& modified,
+                DiffAlgorithm algorithm = DiffAlgorithm::Myers);
+
+            // Compare the lines of two snapshots
+            static std::vector<LineChange> compute(const TextSnapshot& original, const TextSnapshot& modified,
+                const DiffOptions& options = DiffOptions());
+        };
+
+        enum class GutterMarkerKind {
+            Added,
+            Modified,
+            Deleted
+        };
+
+        // Gutter decoration for a run of modified lines. Deleted markers cover no
+        // lines and sit just above line.
+        struct GutterMarker {
+            int line;
+            int lineCount;
+            GutterMarkerKind kind;
+
+            GutterMarker() : line(0), lineCount(0), kind(GutterMarkerKind::Added) {}
+            GutterMarker(int line, int lineCount, GutterMarkerKind kind) : line(line), lineCount(lineCount), kind(kind) {}
+        };
+
+        // Diff of a buffer against its saved contents, for dirty-diff gutters and
+        // "compare with saved". Lines are interned to ids once. Change events mark
+        // the lines they touch, and update re-diffs only that region, widened to
+        // the changes next to it, so typing in a large file costs about as much as
+        // the edited lines.
+        class DirtyDiff {
+        public:
+            DirtyDiff(std::string_view original, const TextSnapshot& modified, const DiffOptions& options = DiffOptions());
+            ~DirtyDiff();
+
+            // New saved contents, after a save or reload; the next update diffs
+            // everything again
+            void setOriginal(std::string_view original);
+
+            // Record a change of the buffer. Every event must be passed, in order.
+            // An update to a snapshot of another version than the last event's
+            // diffs everything again.
+            void noteChange(const TextDocumentChangeEvent& event);
+
+            // Bring the diff up to the snapshot and return it
+            const std::vector<LineChange>& update(const TextSnapshot& modified);
+
+            const std::vector<LineChange>& getChanges() const;
+            std::vector<GutterMarker> getGutterMarkers() const;
+
+        private:
+            // Prevent copying
+            DirtyDiff(const DirtyDiff&) = delete;
+            DirtyDiff& operator=(const DirtyDiff&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,358 @@
+#include "pch.h"
+#include "DirectoryWalker.h"
+#include "FileSystem.h"
+#include "Glob.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+#ifdef _WIN32
+            const char kSeparator = '\\';
+#else
+            const char kSeparator = '/';
+#endif
+
+            // Ignore files read in each directory, later ones taking precedence
+            const char* const kIgnoreFileNames[] = { ".gitignore", ".ignore" };
+
+            std::string joinPath(const std::string& directory, std::string_view name) {
+                std::string path;
+                path.reserve(directory.size() + 1 + name.size());
+                path.append(directory);
+                if (!path.empty() && path.back() != '/' && path.back() != kSeparator) {
+                    path.push_back(kSeparator);
+                }
+                path.append(name);
+                return path;
+            }
+
+            bool matchesAny(const std::vector<Glob>& globs, std::string_view path) {
+                for (const Glob& glob : globs) {
+                    if (glob.matches(path)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            using IgnorePtr = std::shared_ptr<const IgnoreLevel>;
+
+            // Directory still to be listed
+            struct DirectoryTask {
+                std::string directory;
+                std::string relative;
+                IgnorePtr ignores;
+            };
+
+            // Shared with the pool tasks, which may outlive the walker object by the
+            // time they take to return
+            struct WalkState {
+                WalkState(const FileSystem& fileSystem, ThreadPool& pool, const WalkOptions& options, WalkCallback callback)
+                    : fileSystem(fileSystem), pool(pool), options(options), callback(std::move(callback)),
+                      filter(options), cancelled(false), pending(0) {
+                }
+
+                const FileSystem& fileSystem;
+                ThreadPool& pool;
+                WalkOptions options;
+                WalkCallback callback;
+                WalkFilter filter;
+
+                std::atomic<bool> cancelled;
+
+                // Guards the task count and the queues
+                std::mutex mutex;
+                std::condition_variable changed;
+                size_t pending;
+                std::deque<WalkBatch> queue;
+
+                // Directories held back while the queue is full
+                std::deque<DirectoryTask> deferred;
+
+                // Serializes callback invocations
+                std::mutex callbackMutex;
+            };
+
+            using StatePtr = std::shared_ptr<WalkState>;
+
+            void walkDirectory(const StatePtr& state, const std::string& directory, const std::string& relative, IgnorePtr ignores);
+
+            // Without a callback, each directory being listed may add a batch to the
+            // queue, so listing starts only while queued batches and running tasks
+            // leave room. Called with the mutex held.
+            bool hasRoom(const WalkState& state) {
+                return state.callback || state.queue.size() + state.pending < std::max<size_t>(1, state.options.maxQueuedBatches);
+            }
+
+            // Move deferred directories that now have room to ready, counting them as
+            // pending. Called with the mutex held; the caller submits them.
+            void takeDeferred(WalkState& state, std::vector<DirectoryTask>& ready) {
+                while (!state.cancelled && !state.deferred.empty() && hasRoom(state)) {
+                    ready.push_back(std::move(state.deferred.front()));
+                    state.deferred.pop_front();
+                    state.pending++;
+                }
+            }
+
+            // Queue a directory already counted as pending
+            void submitWalk(const StatePtr& state, DirectoryTask task) {
+                state->pool.submit([state, task = std::move(task)] {
+                    if (!state->cancelled) {
+                        walkDirectory(state, task.directory, task.relative, task.ignores);
+                    }
+
+                    std::vector<DirectoryTask> ready;
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->pending--;
+                        takeDeferred(*state, ready);
+                        if (state->pending == 0) {
+                            state->changed.notify_all();
+                        }
+                    }
+                    for (auto& next : ready) {
+                        submitWalk(state, std::move(next));
+                    }
+                });
+            }
+
+            // List a directory on the pool, or defer it while the queue is full. A slow
+            // consumer thereby holds back the walk instead of parking pool threads.
+            void spawnWalk(const StatePtr& state, DirectoryTask task) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!hasRoom(*state)) {
+                        state->deferred.push_back(std::move(task));
+                        return;
+                    }
+                    state->pending++;
+                }
+                submitWalk(state, std::move(task));
+            }
+
+            void deliver(WalkState& state, WalkBatch&& batch) {
+                if (state.callback) {
+                    std::lock_guard<std::mutex> lock(state.callbackMutex);
+                    if (!state.cancelled && !state.callback(batch)) {
+                        state.cancelled = true;
+                    }
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (!state.cancelled) {
+                    state.queue.push_back(std::move(batch));
+                    state.changed.notify_all();
+                }
+            }
+
+            // Read the ignore files among the names found in a directory
+            IgnorePtr readIgnoreFiles(const WalkState& state, const std::string& directory, const std::string& relative,
+                const WalkBatch& found, IgnorePtr parent) {
+                IgnoreRules rules;
+                std::string content;
+                for (const char* fileName : kIgnoreFileNames) {
+                    for (const WalkEntry& entry : found.entries) {
+                        if (!entry.isDirectory && found.getName(entry) == fileName) {
+                            if (state.fileSystem.readFile(joinPath(directory, fileName), content)) {
+                                rules.add(content);
+                            }
+                            break;
+                        }
+                    }
+                }
+
+                if (rules.isEmpty()) {
+                    return parent;
+                }
+                return std::make_shared<const IgnoreLevel>(IgnoreLevel{ relative, std::move(rules), std::move(parent) });
+            }
+
+            void walkDirectory(const StatePtr& state, const std::string& directory, const std::string& relative, IgnorePtr ignores) {
+                // Everything listed goes into found; the batch reuses its names and
+                // keeps the entries that pass the filters
+                WalkBatch found;
+                bool listed = state->fileSystem.forEachEntry(directory, [&found](std::string_view name, EntryType type) {
+                    if (type == EntryType::File || type == EntryType::Directory) {
+                        found.entries.emplace_back(static_cast<uint32_t>(found.names.size()), static_cast<uint32_t>(name.size()), type == EntryType::Directory);
+                        found.names.append(name);
+                    }
+                });
+                if (!listed) {
+                    return;
+                }
+
+                const WalkOptions& options = state->options;
+                if (options.useIgnoreFiles) {
+                    ignores = readIgnoreFiles(*state, directory, relative, found, std::move(ignores));
+                }
+
+                WalkBatch batch;
+                batch.directory = directory;
+                batch.relativeDirectory = relative;
+                batch.ignores = ignores;
+                std::string path = relative;
+                if (!path.empty()) {
+                    path.push_back('/');
+                }
+                size_t prefixLength = path.size();
+
+                for (const WalkEntry& entry : found.entries) {
+                    std::string_view name = found.getName(entry);
+                    path.resize(prefixLength);
+                    path.append(name);
+
+                    if (state->filter.isExcluded(path, entry.isDirectory, ignores.get())) {
+                        continue;
+                    }
+
+                    if (entry.isDirectory) {
+                        spawnWalk(state, DirectoryTask{ joinPath(directory, name), path, ignores });
+                        if (!options.includeDirectories) {
+                            continue;
+                        }
+                    }
+                    else if (!state->filter.isIncluded(path)) {
+                        continue;
+                    }
+                    batch.entries.push_back(entry);
+                }
+
+                if (!batch.entries.empty()) {
+                    batch.names = std::move(found.names);
+                    deliver(*state, std::move(batch));
+                }
+            }
+        }
+
+        WalkFilter::WalkFilter(const WalkOptions& options) {
+            for (const std::string& pattern : options.include) {
+                include.emplace_back(pattern, options.caseSensitive);
+            }
+            for (const std::string& pattern : options.exclude) {
+                exclude.emplace_back(pattern, options.caseSensitive);
+            }
+        }
+
+        WalkFilter::~WalkFilter() {
+        }
+
+        bool WalkFilter::isExcluded(std::string_view path, bool isDirectory, const IgnoreLevel* ignores) const {
+            return matchesAny(exclude, path) || IgnoreLevel::isIgnored(ignores, path, isDirectory);
+        }
+
+        bool WalkFilter::isIncluded(std::string_view path) const {
+            return include.empty() || matchesAny(include, path);
+        }
+
+        std::string WalkBatch::getPath(const WalkEntry& entry) const {
+            return joinPath(directory, getName(entry));
+        }
+
+        std::string WalkBatch::getRelativePath(const WalkEntry& entry) const {
+            std::string path = relativeDirectory;
+            if (!path.empty()) {
+                path.push_back('/');
+            }
+            path.append(getName(entry));
+            return path;
+        }
+
+        class DirectoryWalker::Impl {
+        public:
+            void start(const std::string& directory, const std::string& relative, IgnorePtr ignores) {
+                spawnWalk(state, DirectoryTask{ directory, relative, std::move(ignores) });
+            }
+
+            StatePtr state;
+        };
+
+        DirectoryWalker::DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+            const WalkOptions& options, WalkCallback callback)
+            : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<WalkState>(fileSystem, pool, options, std::move(callback));
+            pImpl->start(root, std::string(), nullptr);
+        }
+
+        DirectoryWalker::DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const WalkBatch& parent, std::string_view name,
+            const WalkOptions& options, WalkCallback callback)
+            : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<WalkState>(fileSystem, pool, options, std::move(callback));
+
+            std::string relative = parent.relativeDirectory;
+            if (!relative.empty()) {
+                relative.push_back('/');
+            }
+            relative.append(name);
+            if (!pImpl->state->filter.isExcluded(relative, true, parent.ignores.get())) {
+                pImpl->start(joinPath(parent.directory, name), relative, parent.ignores);
+            }
+        }
+
+        DirectoryWalker::DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+            const WalkOptions& options)
+            : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<WalkState>(fileSystem, pool, options, nullptr);
+            pImpl->start(root, std::string(), nullptr);
+        }
+
+        DirectoryWalker::~DirectoryWalker() {
+            cancel();
+            wait();
+        }
+
+        bool DirectoryWalker::nextBatch(WalkBatch& batch) {
+            WalkState& state = *pImpl->state;
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&state] {
+                return !state.queue.empty() || state.pending == 0;
+            });
+            if (state.queue.empty()) {
+                return false;
+            }
+
+            batch = std::move(state.queue.front());
+            state.queue.pop_front();
+            std::vector<DirectoryTask> ready;
+            takeDeferred(state, ready);
+            lock.unlock();
+
+            for (auto& task : ready) {
+                submitWalk(pImpl->state, std::move(task));
+            }
+            return true;
+        }
+
+        void DirectoryWalker::cancel() {
+            WalkState& state = *pImpl->state;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.cancelled = true;
+                state.deferred.clear();
+            }
+            state.changed.notify_all();
+        }
+
+        void DirectoryWalker::wait() {
+            WalkState& state = *pImpl->state;
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&state] {
+                return state.pending == 0 && state.deferred.empty();
+            });
+        }
+
+        bool DirectoryWalker::isFinished() const {
+            WalkState& state = *pImpl->state;
+            std::lock_guard<std::mutex> lock(state.mutex);
+            return state.pending == 0 && state.deferred.empty();
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "pch.h"
+#include "Glob.h"
+
+namespace Vune {
+    namespace Core {
+
+        class FileSystem;
+        class ThreadPool;
+
+        struct WalkOptions {
+            // Globs over '/'-separated paths relative to the root. When any are given,
+            // only files matching one are reported; directories are walked regardless.
+            std::vector<std::string> include;
+
+            // Files and directories matching any of these are skipped, and nothing
+            // below a skipped directory is listed
+            std::vector<std::string> exclude;
+
+            // Apply the .gitignore and .ignore files found in the tree, .ignore taking
+            // precedence. Ignored directories are pruned without being listed.
+            bool useIgnoreFiles;
+
+            // Report directories along with files
+            bool includeDirectories;
+
+            // How globs compare letters; defaults to the platform's file names
+            bool caseSensitive;
+
+            // Batches waiting in the queue of a walker without a callback
+            size_t maxQueuedBatches;
+
+            WalkOptions()
+                : include(), exclude{ "**/.git", "**/.hg", "**/.svn" }, useIgnoreFiles(true), includeDirectories(false),
+#ifdef _WIN32
+                  caseSensitive(false),
+#else
+                  caseSensitive(true),
+#endif
+                  maxQueuedBatches(64) {}
+        };
+
+        // Entry of a WalkBatch, as a slice of the batch's name storage
+        struct WalkEntry {
+            uint32_t nameOffset;
+            uint32_t nameLength;
+            bool isDirectory;
+
+            WalkEntry() : nameOffset(0), nameLength(0), isDirectory(false) {}
+            WalkEntry(uint32_t nameOffset, uint32_t nameLength, bool isDirectory)
+                : nameOffset(nameOffset), nameLength(nameLength), isDirectory(isDirectory) {}
+        };
+
+        // Entries found in one directory. Names share one string, so a batch costs a
+        // few allocations however many entries it holds.
+        struct WalkBatch {
+            std::string directory;           // as passed in for the root, joined below it
+            std::string relativeDirectory;   // '/'-separated from the root; empty for the root
+            std::string names;
+            std::vector<WalkEntry> entries;
+
+            // Ignore rules that applied to the entries, for walking on below them
+            std::shared_ptr<const IgnoreLevel> ignores;
+
+            std::string_view getName(const WalkEntry& entry) const {
+                return std::string_view(names).substr(entry.nameOffset, entry.nameLength);
+            }
+
+            std::string getPath(const WalkEntry& entry) const;
+            std::string getRelativePath(const WalkEntry& entry) const;
+        };
+
+        // The include, exclude and ignore-file rules of WalkOptions, as the walker
+        // applies them, for code that meets paths outside of a walk
+        class WalkFilter {
+        public:
+            explicit WalkFilter(const WalkOptions& options);
+            ~WalkFilter();
+
+            // Whether an exclude glob or an ignore rule drops a path relative to the
+            // root; ignores are the rules of its directory and may be null
+            bool isExcluded(std::string_view path, bool isDirectory, const IgnoreLevel* ignores) const;
+
+            // Whether a file passes the include globs
+            bool isIncluded(std::string_view path) const;
+
+        private:
+            std::vector<Glob> include;
+            std::vector<Glob> exclude;
+        };
+
+        // Receives each directory's batch, one call at a time from the pool threads, in
+        // no particular order. Return false to stop the walk.
+        using WalkCallback = std::function<bool(const WalkBatch&)>;
+
+        // Walks a directory tree on a ThreadPool, each directory a task of its own so
+        // that work-stealing spreads the listing over all cores. Entry types come from
+        // the listing itself (FileSystem::forEachEntry), so no file is stat'ed.
+        // Symbolic links are not followed or reported.
+        class DirectoryWalker {
+        public:
+            // Starts walking right away, delivering batches to callback
+            DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+                const WalkOptions& options, WalkCallback callback);
+
+            // Walk below the directory name of an earlier batch as if that walk had gone
+            // on, with its relative paths and ignore rules. Walks nothing when the
+            // directory itself is excluded or ignored.
+            DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const WalkBatch& parent, std::string_view name,
+                const WalkOptions& options, WalkCallback callback);
+
+            // Starts walking right away, queuing batches for nextBatch. No more
+            // directories are listed while the queue is full; pool threads are not held
+            // while waiting for it to drain.
+            DirectoryWalker(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+                const WalkOptions& options);
+
+            // Cancels the walk and waits for the tasks in progress
+            ~DirectoryWalker();
+
+            // Take the next queued batch, blocking until there is one. Returns false
+            // once the walk is over and the queue empty.
+            bool nextBatch(WalkBatch& batch);
+
+            // Stop listing directories; queued batches can still be taken
+            void cancel();
+
+            // Block until the walk has finished or been cancelled. Must not be called
+            // from a thread of the pool, nor while a full queue waits to be drained.
+            void wait();
+
+            bool isFinished() const;
+
+        private:
+            // Prevent copying
+            DirectoryWalker(const DirectoryWalker&) = delete;
+            DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -1,82 +1,981 @@
 #include "pch.h"
 #include "ExtensionHost.h"
+#include "DirectoryWalker.h"
+#include "ExtensionWorker.h"
+#include "IpcChannel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <csignal>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace fs = std::filesystem;
 
 namespace Vune {
     namespace Core {
 
+        namespace {
+            using Clock = std::chrono::steady_clock;
+
+            // Receive timeout of a worker's reader thread, which bounds how long
+            // stopping the reader takes
+            const int kReaderPollMs = 100;
+
+            const char* const kWorkspaceContains = "workspaceContains:";
+
+            int64_t nowMs() {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+            }
+
+            unsigned long currentProcessId() {
+#ifdef _WIN32
+                return GetCurrentProcessId();
+#else
+                return static_cast<unsigned long>(getpid());
+#endif
+            }
+
+#ifdef _WIN32
+            // Quote an argument so CommandLineToArgvW and the C runtime read it back
+            void appendArgument(std::wstring& commandLine, const std::string& argument) {
+                std::wstring wide = fs::u8path(argument).wstring();
+                if (!commandLine.empty()) {
+                    commandLine += L' ';
+                }
+                if (!wide.empty() && wide.find_first_of(L" \t\"") == std::wstring::npos) {
+                    commandLine += wide;
+                    return;
+                }
+
+                commandLine += L'"';
+                size_t backslashes = 0;
+                for (wchar_t c : wide) {
+                    if (c == L'\\') {
+                        ++backslashes;
+                        continue;
+                    }
+                    commandLine.append(c == L'"' ? backslashes * 2 + 1 : backslashes, L'\\');
+                    backslashes = 0;
+                    commandLine += c;
+                }
+                commandLine.append(backslashes * 2, L'\\');
+                commandLine += L'"';
+            }
+#endif
+
+            // Child process running an ExtensionWorker
+            class WorkerProcess {
+            public:
+                WorkerProcess() {
+#ifdef _WIN32
+                    process = nullptr;
+#else
+                    pid = -1;
+                    exited = false;
+#endif
+                }
+
+                ~WorkerProcess() {
+                    kill();
+#ifdef _WIN32
+                    if (process) CloseHandle(process);
+#endif
+                }
+
+                bool start(const std::string& path, const std::vector<std::string>& arguments) {
+                    std::lock_guard<std::mutex> lock(mutex);
+#ifdef _WIN32
+                    std::wstring commandLine;
+                    appendArgument(commandLine, path);
+                    for (const std::string& argument : arguments) {
+                        appendArgument(commandLine, argument);
+                    }
+
+                    STARTUPINFOW startup = {};
+                    startup.cb = sizeof(startup);
+                    PROCESS_INFORMATION info = {};
+                    if (!CreateProcessW(fs::u8path(path).c_str(), &commandLine[0], nullptr, nullptr, FALSE, CREATE_NO_WINDOW,
+                        nullptr, nullptr, &startup, &info)) {
+                        return false;
+                    }
+                    CloseHandle(info.hThread);
+                    process = info.hProcess;
+                    return true;
+#else
+                    std::vector<char*> argv;
+                    argv.push_back(const_cast<char*>(path.c_str()));
+                    for (const std::string& argument : arguments) {
+                        argv.push_back(const_cast<char*>(argument.c_str()));
+                    }
+                    argv.push_back(nullptr);
+                    return posix_spawn(&pid, path.c_str(), nullptr, nullptr, argv.data(), environ) == 0;
+#endif
+                }
+
+                bool isRunning() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return poll(0);
+                }
+
+                // Returns false if the process still runs after timeoutMs
+                bool waitForExit(int timeoutMs) {
+                    std::lock_guard<std::mutex> lock(mutex);
+#ifdef _WIN32
+                    return !process || WaitForSingleObject(process, static_cast<DWORD>(timeoutMs)) != WAIT_TIMEOUT;
+#else
+                    return !poll(timeoutMs);
+#endif
+                }
+
+                void kill() {
+                    std::lock_guard<std::mutex> lock(mutex);
+#ifdef _WIN32
+                    if (process && WaitForSingleObject(process, 0) == WAIT_TIMEOUT) {
+                        TerminateProcess(process, 1);
+                        WaitForSingleObject(process, INFINITE);
+                    }
+#else
+                    if (pid > 0 && !exited) {
+                        ::kill(pid, SIGKILL);
+                        waitpid(pid, nullptr, 0);
+                        exited = true;
+                    }
+#endif
+                }
+
+            private:
+                // Whether the process still runs after up to timeoutMs; reaps it once
+                // it has exited
+                bool poll(int timeoutMs) {
+#ifdef _WIN32
+                    return process && WaitForSingleObject(process, static_cast<DWORD>(timeoutMs)) == WAIT_TIMEOUT;
+#else
+                    if (pid <= 0 || exited) {
+                        return false;
+                    }
+                    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+                    for (;;) {
+                        if (waitpid(pid, nullptr, WNOHANG) != 0) {
+                            exited = true;
+                            return false;
+                        }
+                        if (Clock::now() >= deadline) {
+                            return true;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+#endif
+                }
+
+                std::mutex mutex;
+#ifdef _WIN32
+                HANDLE process;
+#else
+                pid_t pid;
+                bool exited;
+#endif
+            };
+
+            struct Worker {
+                std::unique_ptr<IpcChannel> channel;
+                WorkerProcess process;
+                std::thread reader;
+
+                // Senders are the calling thread and the watchdog
+                std::mutex sendMutex;
+
+                std::atomic<bool> stopping;
+                std::atomic<bool> exited;
+
+                // When a message last arrived, in milliseconds of the steady clock
+                std::atomic<int64_t> lastHeard;
+
+                Worker() : stopping(false), exited(false), lastHeard(nowMs()) {}
+            };
+
+            struct PendingRequest {
+                const Worker* worker;
+                bool done;
+                bool succeeded;
+                std::string result;
+            };
+
+            struct OpenDocument {
+                std::string languageId;
+                TextSnapshot snapshot;
+
+                // The worker's mirror missed a message and waits for the whole
+                // document again
+                bool stale;
+
+                OpenDocument() : languageId(), snapshot(), stale(false) {}
+            };
+
+            struct InstalledExtension {
+                std::string version;
+                std::vector<std::string> activationEvents;
+                std::vector<std::string> dependencies;
+            };
+
+            void addTo(std::unordered_map<std::string, std::vector<std::string>>& table, const std::string& key, const std::string& extensionId) {
+                std::vector<std::string>& extensions = table[key];
+                if (std::find(extensions.begin(), extensions.end(), extensionId) == extensions.end()) {
+                    extensions.push_back(extensionId);
+                }
+            }
+
+            void removeFrom(std::unordered_map<std::string, std::vector<std::string>>& table, const std::string& key, const std::string& extensionId) {
+                auto found = table.find(key);
+                if (found == table.end()) {
+                    return;
+                }
+                std::vector<std::string>& extensions = found->second;
+                extensions.erase(std::remove(extensions.begin(), extensions.end(), extensionId), extensions.end());
+                if (extensions.empty()) {
+                    table.erase(found);
+                }
+            }
+        }
+
         class ExtensionHost::Impl {
         public:
-            Impl() {}
-            
+            Impl(const ExtensionHostOptions& options)
+                : options(options), restartCount(0), gaveUp(false), nextRequestId(1), stopWatchdog(false) {
+                // The worker answers no pings while it serves a call, so a call that
+                // is still within its timeout must not count as a hang
+                this->options.hangTimeoutMs = std::max(this->options.hangTimeoutMs,
+                    this->options.requestTimeoutMs + this->options.heartbeatIntervalMs);
+            }
+
+            // Running worker, started first if there is none. A new worker is sent the
+            // open documents and the active extensions.
+            std::shared_ptr<Worker> ensureWorker() {
+                std::shared_ptr<Worker> stopped;
+                std::lock_guard<std::mutex> lock(workerMutex);
+                if (worker && !worker->exited) {
+                    return worker;
+                }
+                if (worker) {
+                    // Exited between two watchdog checks
+                    stopped = std::move(worker);
+                    stopWorker(*stopped, 0);
+                    if (++restartCount > options.maxRestarts) {
+                        gaveUp = true;
+                    }
+                }
+                if (gaveUp || options.workerPath.empty()) {
+                    return nullptr;
+                }
+
+                auto started = std::make_shared<Worker>();
+                started->channel = IpcChannel::create(options.ringSize);
+                if (!started->channel) {
+                    return nullptr;
+                }
+                std::vector<std::string> arguments = options.workerArguments;
+                arguments.push_back(ExtensionWorker::kCommandLineSwitch);
+                arguments.push_back(started->channel->getName());
+                arguments.push_back(std::to_string(currentProcessId()));
+                if (!started->process.start(options.workerPath, arguments)) {
+                    return nullptr;
+                }
+                Worker* raw = started.get();
+                started->reader = std::thread([this, raw]() { readMessages(*raw); });
+
+                // Messages queue in the channel until the worker is up
+                std::lock_guard<std::mutex> stateLock(stateMutex);
+                for (auto& document : documents) {
+                    sendDocument(*started, document.first, document.second);
+                }
+                IpcWriter writer;
+                for (const std::string& extensionId : activeExtensions) {
+                    // Replies to id 0 are dropped
+                    writer.clear();
+                    writer.writeString(extensionId);
+                    writer.writeString(installedExtensions[extensionId].version);
+                    send(*started, ExtensionMessage::Activate, 0, writer.getBuffer());
+                }
+                worker = started;
+                return worker;
+            }
+
+            std::shared_ptr<Worker> currentWorker() {
+                std::lock_guard<std::mutex> lock(workerMutex);
+                return worker && !worker->exited ? worker : nullptr;
+            }
+
+            // Ask the worker to exit within timeoutMs, or kill it right away with
+            // timeoutMs 0, then fail its requests
+            void stopWorker(Worker& stopped, int timeoutMs) {
+                Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+                if (timeoutMs > 0 && !stopped.exited) {
+                    IpcResult sent;
+                    {
+                        std::lock_guard<std::mutex> lock(stopped.sendMutex);
+                        sent = stopped.channel->send(static_cast<uint16_t>(ExtensionMessage::Shutdown), 0, std::string_view(), timeoutMs);
+                    }
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                    if (sent == IpcResult::Ok && remaining > 0) {
+                        stopped.process.waitForExit(static_cast<int>(remaining));
+                    }
+                }
+                stopped.process.kill();
+                stopped.stopping = true;
+                if (stopped.reader.joinable()) {
+                    stopped.reader.join();
+                }
+                failRequests(stopped);
+            }
+
+            bool send(Worker& target, ExtensionMessage type, uint64_t id, std::string_view payload) {
+                std::lock_guard<std::mutex> lock(target.sendMutex);
+                return target.channel->send(static_cast<uint16_t>(type), id, payload, options.requestTimeoutMs) == IpcResult::Ok;
+            }
+
+            // Send a document whole, as when it was opened; until that succeeds it
+            // stays stale. The caller holds stateMutex, which keeps a document's
+            // messages in order.
+            void sendDocument(Worker& target, const std::string& uri, OpenDocument& document) {
+                IpcWriter writer;
+                writeDocument(writer, uri, document);
+                document.stale = !send(target, ExtensionMessage::OpenDocument, 0, writer.getBuffer());
+            }
+
+            void resendStaleDocuments(Worker& target) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                for (auto& document : documents) {
+                    if (document.second.stale) {
+                        sendDocument(target, document.first, document.second);
+                    }
+                }
+            }
+
+            // Send a request without waiting for the reply; returns its id for
+            // waitForReply. A request that cannot be sent fails when waited for.
+            uint64_t beginRequest(Worker& target, ExtensionMessage type, std::string_view payload) {
+                uint64_t id;
+                {
+                    std::lock_guard<std::mutex> lock(requestMutex);
+                    id = nextRequestId++;
+                    pending[id] = { &target, false, false, std::string() };
+                }
+                if (!send(target, type, id, payload)) {
+                    std::lock_guard<std::mutex> lock(requestMutex);
+                    pending[id].done = true;
+                }
+                return id;
+            }
+
+            // Wait for the reply to a request until the deadline. A hung or dead
+            // worker fails it.
+            bool waitForReply(uint64_t id, Clock::time_point deadline, std::string* result) {
+                std::unique_lock<std::mutex> lock(requestMutex);
+                auto found = pending.find(id);
+                requestDone.wait_until(lock, deadline, [found]() {
+                    return found->second.done;
+                });
+                bool succeeded = found->second.done && found->second.succeeded;
+                if (succeeded && result) {
+                    result->swap(found->second.result);
+                }
+                pending.erase(found);
+                return succeeded;
+            }
+
+            bool request(ExtensionMessage type, std::string_view payload, bool start, std::string* result) {
+                std::shared_ptr<Worker> target = start ? ensureWorker() : currentWorker();
+                if (!target) {
+                    return false;
+                }
+                uint64_t id = beginRequest(*target, type, payload);
+                return waitForReply(id, Clock::now() + std::chrono::milliseconds(options.requestTimeoutMs), result);
+            }
+
+            // Activate extensions with the dependencies they lack. Each round sends
+            // every activation whose dependencies are active and then waits for the
+            // replies, so independent extensions activate concurrently. Returns false
+            // if one of extensionIds failed, for itself or for a dependency.
+            bool activateAll(const std::vector<std::string>& extensionIds) {
+                std::lock_guard<std::mutex> serial(activationMutex);
+
+                // Inactive extensions to activate -> dependencies still to activate
+                std::unordered_map<std::string, std::vector<std::string>> waiting;
+                std::unordered_map<std::string, std::string> versions;
+                std::unordered_set<std::string> failed;
+                {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    std::vector<std::string> stack(extensionIds);
+                    while (!stack.empty()) {
+                        std::string extensionId = std::move(stack.back());
+                        stack.pop_back();
+                        if (activeExtensions.count(extensionId) || waiting.count(extensionId) || failed.count(extensionId)) {
+                            continue;
+                        }
+                        auto installed = installedExtensions.find(extensionId);
+                        if (installed == installedExtensions.end()) {
+                            failed.insert(extensionId);
+                            continue;
+                        }
+                        std::vector<std::string>& dependencies = waiting[extensionId];
+                        for (const std::string& dependency : installed->second.dependencies) {
+                            if (!activeExtensions.count(dependency)) {
+                                dependencies.push_back(dependency);
+                                stack.push_back(dependency);
+                            }
+                        }
+                        versions[extensionId] = installed->second.version;
+                    }
+                }
+
+                std::shared_ptr<Worker> target;
+                std::vector<std::string> ready;
+                std::vector<uint64_t> requests;
+                IpcWriter writer;
+                while (!waiting.empty()) {
+                    ready.clear();
+                    for (auto entry = waiting.begin(); entry != waiting.end();) {
+                        std::vector<std::string>& dependencies = entry->second;
+                        bool dependencyFailed = false;
+                        for (auto dependency = dependencies.begin(); dependency != dependencies.end();) {
+                            if (failed.count(*dependency)) {
+                                dependencyFailed = true;
+                                break;
+                            }
+                            dependency = waiting.count(*dependency) ? dependency + 1 : dependencies.erase(dependency);
+                        }
+                        if (dependencyFailed) {
+                            failed.insert(entry->first);
+                            entry = waiting.erase(entry);
+                            continue;
+                        }
+                        if (dependencies.empty()) {
+                            ready.push_back(entry->first);
+                        }
+                        ++entry;
+                    }
+
+                    // What is left waits on itself through a dependency cycle
+                    if (ready.empty()) {
+                        for (const auto& entry : waiting) {
+                            failed.insert(entry.first);
+                        }
+                        break;
+                    }
+
+                    target = ensureWorker();
+                    if (!target) {
+                        failed.insert(ready.begin(), ready.end());
+                        for (const std::string& extensionId : ready) {
+                            waiting.erase(extensionId);
+                        }
+                        continue;
+                    }
+                    requests.clear();
+                    for (const std::string& extensionId : ready) {
+                        writer.clear();
+                        writer.writeString(extensionId);
+                        writer.writeString(versions[extensionId]);
+                        requests.push_back(beginRequest(*target, ExtensionMessage::Activate, writer.getBuffer()));
+                    }
+                    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(options.requestTimeoutMs);
+                    for (size_t i = 0; i < ready.size(); ++i) {
+                        if (waitForReply(requests[i], deadline, nullptr)) {
+                            std::lock_guard<std::mutex> lock(stateMutex);
+                            activeExtensions.insert(ready[i]);
+                        }
+                        else {
+                            failed.insert(ready[i]);
+                        }
+                        waiting.erase(ready[i]);
+                    }
+                }
+
+                for (const std::string& extensionId : extensionIds) {
+                    if (failed.count(extensionId)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Add or remove an extension under its events in the activation tables
+            void fileActivationEvents(const std::string& extensionId, const std::vector<std::string>& events, bool add) {
+                size_t prefixLength = std::strlen(kWorkspaceContains);
+                for (const std::string& event : events) {
+                    bool pattern = event.compare(0, prefixLength, kWorkspaceContains) == 0;
+                    auto& table = pattern ? workspacePatterns : activationTable;
+                    std::string key = pattern ? event.substr(prefixLength) : event;
+                    if (add) {
+                        addTo(table, key, extensionId);
+                    }
+                    else {
+                        removeFrom(table, key, extensionId);
+                    }
+                }
+            }
+
+            // Extensions filed under an activation event that are not active yet
+            void collectWaiting(const std::string& event, std::vector<std::string>& extensionIds) {
+                auto found = activationTable.find(event);
+                if (found == activationTable.end()) {
+                    return;
+                }
+                for (const std::string& extensionId : found->second) {
+                    if (!activeExtensions.count(extensionId)) {
+                        extensionIds.push_back(extensionId);
+                    }
+                }
+            }
+
+            void failRequests(const Worker& stopped) {
+                std::lock_guard<std::mutex> lock(requestMutex);
+                for (auto& entry : pending) {
+                    if (entry.second.worker == &stopped) {
+                        entry.second.done = true;
+                    }
+                }
+                requestDone.notify_all();
+            }
+
+            void readMessages(Worker& source) {
+                IpcMessage message;
+                while (!source.stopping) {
+                    IpcResult result = source.channel->receive(message, kReaderPollMs);
+                    if (result == IpcResult::Timeout) {
+                        continue;
+                    }
+                    if (result == IpcResult::Closed) {
+                        break;
+                    }
+                    source.lastHeard = nowMs();
+
+                    IpcReader reader(message.payload);
+                    switch (static_cast<ExtensionMessage>(message.type)) {
+                    case ExtensionMessage::Reply: {
+                        uint8_t succeeded = 0;
+                        std::string value;
+                        reader.readU8(succeeded);
+                        reader.readString(value);
+
+                        std::lock_guard<std::mutex> lock(requestMutex);
+                        auto found = pending.find(message.id);
+                        if (found != pending.end()) {
+                            found->second.done = true;
+                            found->second.succeeded = succeeded != 0;
+                            found->second.result.swap(value);
+                            requestDone.notify_all();
+                        }
+                        break;
+                    }
+                    case ExtensionMessage::Notify: {
+                        std::string extensionId, method;
+                        std::string_view params;
+                        if (reader.readString(extensionId) && reader.readString(method) && reader.readStringView(params)) {
+                            ExtensionNotificationHandler handler;
+                            {
+                                std::lock_guard<std::mutex> lock(handlerMutex);
+                                handler = notificationHandler;
+                            }
+                            if (handler) {
+                                handler(extensionId, method, params);
+                            }
+                        }
+                        break;
+                    }
+                    case ExtensionMessage::ResyncDocument: {
+                        // Sent again by the watchdog
+                        std::string uri;
+                        if (reader.readString(uri)) {
+                            std::lock_guard<std::mutex> lock(stateMutex);
+                            auto found = documents.find(uri);
+                            if (found != documents.end()) {
+                                found->second.stale = true;
+                            }
+                        }
+                        watchdogWake.notify_all();
+                        break;
+                    }
+                    default:
+                        break;
+                    }
+                }
+                source.exited = true;
+                failRequests(source);
+            }
+
+            void watch() {
+                std::unique_lock<std::mutex> lock(watchdogMutex);
+                while (!stopWatchdog) {
+                    watchdogWake.wait_for(lock, std::chrono::milliseconds(options.heartbeatIntervalMs));
+                    if (stopWatchdog) {
+                        break;
+                    }
+                    lock.unlock();
+                    checkWorker();
+                    lock.lock();
+                }
+            }
+
+            void checkWorker() {
+                std::shared_ptr<Worker> current;
+                {
+                    std::lock_guard<std::mutex> lock(workerMutex);
+                    current = worker;
+                }
+                if (!current) {
+                    return;
+                }
+
+                bool hung = nowMs() - current->lastHeard > options.hangTimeoutMs;
+                if (hung || current->exited || !current->process.isRunning()) {
+                    {
+                        std::lock_guard<std::mutex> lock(workerMutex);
+                        if (worker != current) {
+                            return;
+                        }
+                        worker.reset();
+                        if (++restartCount > options.maxRestarts) {
+                            gaveUp = true;
+                        }
+                    }
+                    stopWorker(*current, 0);
+                    ensureWorker();
+                    return;
+                }
+
+                // Skip the ping while a request is being sent; the caller's send
+                // times out on its own if the worker stopped reading
+                std::unique_lock<std::mutex> sendLock(current->sendMutex, std::try_to_lock);
+                if (sendLock.owns_lock()) {
+                    current->channel->send(static_cast<uint16_t>(ExtensionMessage::Ping), 0, std::string_view(), 0);
+                    sendLock.unlock();
+                }
+                resendStaleDocuments(*current);
+            }
+
+            static void writeDocument(IpcWriter& writer, const std::string& uri, const OpenDocument& document) {
+                writer.writeString(uri);
+                writer.writeString(document.languageId);
+                writer.writeI32(document.snapshot.getVersion());
+                size_t text = writer.beginString();
+                document.snapshot.forEachChunk([&writer](std::string_view chunk) {
+                    writer.appendToString(chunk);
+                    return true;
+                });
+                writer.endString(text);
+            }
+
+            ExtensionHostOptions options;
+
+            // Guards the extension and document state below
+            std::mutex stateMutex;
+
             // Store installed extensions
-            std::unordered_map<std::string, std::string> installedExtensions; // extensionId -> version
-            
+            std::unordered_map<std::string, InstalledExtension> installedExtensions;
+
             // Store active extensions
             std::unordered_set<std::string> activeExtensions;
+
+            // Activation event -> extensions waiting for it, and workspaceContains
+            // pattern -> extensions
+            std::unordered_map<std::string, std::vector<std::string>> activationTable;
+            std::unordered_map<std::string, std::vector<std::string>> workspacePatterns;
+
+            // One round of activations at a time
+            std::mutex activationMutex;
+
+            std::unordered_map<std::string, OpenDocument> documents;
+
+            // Taken before stateMutex when both are needed
+            std::mutex workerMutex;
+            std::shared_ptr<Worker> worker;
+            int restartCount;
+            bool gaveUp;
+
+            std::mutex requestMutex;
+            std::condition_variable requestDone;
+            std::unordered_map<uint64_t, PendingRequest> pending;
+            uint64_t nextRequestId;
+
+            std::mutex handlerMutex;
+            ExtensionNotificationHandler notificationHandler;
+
+            std::mutex watchdogMutex;
+            std::condition_variable watchdogWake;
+            bool stopWatchdog;
+            std::thread watchdog;
         };
 
-        ExtensionHost::ExtensionHost() : pImpl(std::make_unique<Impl>()) {
+        ExtensionHost::ExtensionHost() : ExtensionHost(ExtensionHostOptions()) {
+        }
+
+        ExtensionHost::ExtensionHost(const ExtensionHostOptions& options) : pImpl(std::make_unique<Impl>(options)) {
+            Impl* impl = pImpl.get();
+            pImpl->watchdog = std::thread([impl]() { impl->watch(); });
         }
 
         ExtensionHost::~ExtensionHost() {
-            // Deactivate all extensions
-            for (const auto& extensionId : pImpl->activeExtensions) {
-                deactivateExtension(extensionId);
+            Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(pImpl->options.shutdownTimeoutMs);
+            {
+                std::lock_guard<std::mutex> lock(pImpl->watchdogMutex);
+                pImpl->stopWatchdog = true;
+            }
+            pImpl->watchdogWake.notify_all();
+            pImpl->watchdog.join();
+
+            // The worker deactivates all extensions at once on its way out and is
+            // killed if that outlasts the deadline
+            std::shared_ptr<Worker> stopped;
+            {
+                std::lock_guard<std::mutex> lock(pImpl->workerMutex);
+                stopped = std::move(pImpl->worker);
+            }
+            if (stopped) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                pImpl->stopWorker(*stopped, static_cast<int>(std::max<int64_t>(remaining, 1)));
             }
         }
 
         bool ExtensionHost::installExtension(const std::string& extensionId, const std::string& version) {
-            // TODO: Implement actual extension installation
-            pImpl->installedExtensions[extensionId] = version;
+            return installExtension(extensionId, version, std::vector<std::string>(), std::vector<std::string>());
+        }
+
+        bool ExtensionHost::installExtension(const std::string& extensionId, const std::string& version,
+            const std::vector<std::string>& activationEvents, const std::vector<std::string>& dependencies) {
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+            InstalledExtension& installed = pImpl->installedExtensions[extensionId];
+            pImpl->fileActivationEvents(extensionId, installed.activationEvents, false);
+            installed.version = version;
+            installed.activationEvents = activationEvents;
+            installed.dependencies = dependencies;
+            pImpl->fileActivationEvents(extensionId, activationEvents, true);
             return true;
         }
 
         bool ExtensionHost::uninstallExtension(const std::string& extensionId) {
             // Deactivate if active
-            if (pImpl->activeExtensions.find(extensionId) != pImpl->activeExtensions.end()) {
-                deactivateExtension(extensionId);
-            }
-            
-            // Remove from installed extensions
+            deactivateExtension(extensionId);
+
+            // Remove from installed extensions and the activation tables
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
             auto it = pImpl->installedExtensions.find(extensionId);
             if (it != pImpl->installedExtensions.end()) {
+                pImpl->fileActivationEvents(extensionId, it->second.activationEvents, false);
                 pImpl->installedExtensions.erase(it);
                 return true;
             }
-            
+
             return false;
         }
 
         std::vector<std::string> ExtensionHost::getInstalledExtensions() const {
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
             std::vector<std::string> result;
             result.reserve(pImpl->installedExtensions.size());
-            
+
             for (const auto& pair : pImpl->installedExtensions) {
                 result.push_back(pair.first);
             }
-            
+
             return result;
         }
 
         bool ExtensionHost::isVSCodeExtensionCompatible(const std::string& extensionId) const {
             // TODO: Implement VS Code extension compatibility check
+            (void)extensionId;
             return true;
         }
 
         bool ExtensionHost::activateExtension(const std::string& extensionId) {
-            // Check if extension is installed
-            if (pImpl->installedExtensions.find(extensionId) == pImpl->installedExtensions.end()) {
-                return false;
-            }
-            
-            // TODO: Implement actual extension activation
-            pImpl->activeExtensions.insert(extensionId);
-            return true;
+            return pImpl->activateAll(std::vector<std::string>(1, extensionId));
         }
 
         void ExtensionHost::deactivateExtension(const std::string& extensionId) {
-            // TODO: Implement actual extension deactivation
-            pImpl->activeExtensions.erase(extensionId);
+            {
+                std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+                if (!pImpl->activeExtensions.erase(extensionId)) {
+                    return;
+                }
+            }
+
+            // A worker that is not running has nothing to deactivate
+            IpcWriter writer;
+            writer.writeString(extensionId);
+            pImpl->request(ExtensionMessage::Deactivate, writer.getBuffer(), false, nullptr);
+        }
+
+        bool ExtensionHost::isExtensionActive(const std::string& extensionId) const {
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+            return pImpl->activeExtensions.count(extensionId) != 0;
+        }
+
+        bool ExtensionHost::fireActivationEvent(const std::string& event) {
+            std::vector<std::string> extensionIds;
+            {
+                std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+                pImpl->collectWaiting(event, extensionIds);
+                size_t colon = event.find(':');
+                if (colon != std::string::npos) {
+                    pImpl->collectWaiting(event.substr(0, colon), extensionIds);
+                }
+            }
+            return extensionIds.empty() || pImpl->activateAll(extensionIds);
+        }
+
+        bool ExtensionHost::activateForWorkspace(const FileSystem& fileSystem, const std::string& folder) {
+            WalkOptions walkOptions;
+            walkOptions.includeDirectories = true;
+
+            // Patterns some inactive extension waits for
+            std::vector<Glob> patterns;
+            std::vector<std::vector<std::string>> waiting;
+            {
+                std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+                for (const auto& entry : pImpl->workspacePatterns) {
+                    std::vector<std::string> extensionIds;
+                    for (const std::string& extensionId : entry.second) {
+                        if (!pImpl->activeExtensions.count(extensionId)) {
+                            extensionIds.push_back(extensionId);
+                        }
+                    }
+                    if (!extensionIds.empty()) {
+                        patterns.emplace_back(entry.first, walkOptions.caseSensitive);
+                        waiting.push_back(std::move(extensionIds));
+                    }
+                }
+            }
+            if (patterns.empty()) {
+                return true;
+            }
+
+            // The walk stops once every pattern has matched
+            std::vector<bool> matched(patterns.size(), false);
+            size_t unmatched = patterns.size();
+            DirectoryWalker walker(fileSystem, ThreadPool::shared(), folder, walkOptions, [&](const WalkBatch& batch) {
+                for (const WalkEntry& entry : batch.entries) {
+                    std::string path = batch.getRelativePath(entry);
+                    for (size_t i = 0; i < patterns.size(); ++i) {
+                        if (!matched[i] && patterns[i].matches(path)) {
+                            matched[i] = true;
+                            --unmatched;
+                        }
+                    }
+                }
+                return unmatched > 0;
+            });
+            walker.wait();
+
+            std::vector<std::string> extensionIds;
+            for (size_t i = 0; i < patterns.size(); ++i) {
+                if (matched[i]) {
+                    extensionIds.insert(extensionIds.end(), waiting[i].begin(), waiting[i].end());
+                }
+            }
+            return extensionIds.empty() || pImpl->activateAll(extensionIds);
+        }
+
+        bool ExtensionHost::callExtension(const std::string& extensionId, const std::string& method, std::string_view params, std::string& result) {
+            {
+                std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+                if (!pImpl->activeExtensions.count(extensionId)) {
+                    return false;
+                }
+            }
+
+            IpcWriter writer;
+            writer.writeString(extensionId);
+            writer.writeString(method);
+            writer.writeString(params);
+            return pImpl->request(ExtensionMessage::Call, writer.getBuffer(), true, &result);
+        }
+
+        void ExtensionHost::openDocument(const std::string& uri, const std::string& languageId, const TextSnapshot& snapshot) {
+            // Under workerMutex, so a restarting worker gets the document exactly once
+            std::lock_guard<std::mutex> workerLock(pImpl->workerMutex);
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+            OpenDocument& document = pImpl->documents[uri];
+            document.languageId = languageId;
+            document.snapshot = snapshot;
+            if (pImpl->worker) {
+                pImpl->sendDocument(*pImpl->worker, uri, document);
+            }
+        }
+
+        void ExtensionHost::changeDocument(const std::string& uri, const TextDocumentChangeEvent& event, const TextSnapshot& snapshot) {
+            std::lock_guard<std::mutex> workerLock(pImpl->workerMutex);
+            std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+            auto found = pImpl->documents.find(uri);
+            if (found == pImpl->documents.end()) {
+                return;
+            }
+            OpenDocument& document = found->second;
+            int baseVersion = document.snapshot.getVersion();
+            document.snapshot = snapshot;
+            if (!pImpl->worker) {
+                return;
+            }
+
+            // A mirror that missed a change gets the whole document instead
+            if (document.stale) {
+                pImpl->sendDocument(*pImpl->worker, uri, document);
+                return;
+            }
+
+            IpcWriter writer;
+            writer.writeString(uri);
+            writer.writeI32(baseVersion);
+            writer.writeI32(snapshot.getVersion());
+            writer.writeU32(static_cast<uint32_t>(event.changes.size()));
+            for (const auto& change : event.changes) {
+                writer.writeI32(change.range.start.line);
+                writer.writeI32(change.range.start.character);
+                writer.writeI32(change.range.end.line);
+                writer.writeI32(change.range.end.character);
+                writer.writeString(change.text);
+            }
+            document.stale = !pImpl->send(*pImpl->worker, ExtensionMessage::ChangeDocument, 0, writer.getBuffer());
+        }
+
+        void ExtensionHost::closeDocument(const std::string& uri) {
+            std::lock_guard<std::mutex> workerLock(pImpl->workerMutex);
+            {
+                std::lock_guard<std::mutex> lock(pImpl->stateMutex);
+                if (!pImpl->documents.erase(uri)) {
+                    return;
+                }
+            }
+            if (pImpl->worker) {
+                IpcWriter writer;
+                writer.writeString(uri);
+                pImpl->send(*pImpl->worker, ExtensionMessage::CloseDocument, 0, writer.getBuffer());
+            }
+        }
+
+        void ExtensionHost::setNotificationHandler(ExtensionNotificationHandler handler) {
+            std::lock_guard<std::mutex> lock(pImpl->handlerMutex);
+            pImpl->notificationHandler = std::move(handler);
+        }
+
+        bool ExtensionHost::isWorkerRunning() const {
+            return pImpl->currentWorker() != nullptr;
+        }
+
+        int ExtensionHost::getWorkerRestartCount() const {
+            std::lock_guard<std::mutex> lock(pImpl->workerMutex);
+            return pImpl->restartCount;
         }
 
     } // namespace Core
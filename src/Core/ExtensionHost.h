@@ -1,28 +1,111 @@
 #pragma once
 
 #include "pch.h"
+#include "TextBuffer.h"
 
 namespace Vune {
     namespace Core {
 
+        class FileSystem;
+
+        struct ExtensionHostOptions {
+            // Executable started as the worker process, given workerArguments and then
+            // ExtensionWorker::kCommandLineSwitch, the channel name and the host's
+            // process id. It must hand those to CoreAPI::runExtensionWorker. Required:
+            // while it is empty no worker starts and every activation fails.
+            std::string workerPath;
+            std::vector<std::string> workerArguments;
+
+            // Bytes of each direction of the shared-memory channel
+            size_t ringSize;
+
+            // Activations, deactivations and calls fail after this long
+            int requestTimeoutMs;
+
+            // The worker is pinged this often and killed and restarted once it has not
+            // answered for hangTimeoutMs. It answers no pings while serving a call, so
+            // hangTimeoutMs is raised to at least requestTimeoutMs plus an interval.
+            int heartbeatIntervalMs;
+            int hangTimeoutMs;
+
+            // Restarts after a hang or crash before the host gives up on the worker
+            int maxRestarts;
+
+            // Destroying the host waits this long for the worker to deactivate its
+            // extensions, then kills it
+            int shutdownTimeoutMs;
+
+            ExtensionHostOptions()
+                : ringSize(1024 * 1024), requestTimeoutMs(5000), heartbeatIntervalMs(500),
+                  hangTimeoutMs(10000), maxRestarts(5), shutdownTimeoutMs(1000) {}
+        };
+
+        using ExtensionNotificationHandler = std::function<void(const std::string& extensionId, const std::string& method,
+            std::string_view params)>;
+
+        // Extensions run in a separate worker process, started on the first
+        // activation, so a slow or crashing extension cannot stall the editor.
+        // Nothing activates eagerly: installing an extension only files its
+        // activation events in a dispatch table, and firing an event activates the
+        // extensions waiting for it, their dependencies first. The
+        // two processes talk over a shared-memory IpcChannel with a binary message
+        // format: documents are sent once when opened and then only as change
+        // deltas, and whole again should the worker's mirror miss one. A watchdog pings the worker; one that hangs or dies is killed and
+        // restarted, and gets the open documents and active extensions back.
         class ExtensionHost {
         public:
             ExtensionHost();
+            explicit ExtensionHost(const ExtensionHostOptions& options);
             ~ExtensionHost();
 
-            // Extension management
+            // Extension management. activationEvents are those of the manifest, such
+            // as "onLanguage:python" or "workspaceContains:**/*.csproj", and
+            // dependencies its extensionDependencies, which activate first.
             bool installExtension(const std::string& extensionId, const std::string& version);
+            bool installExtension(const std::string& extensionId, const std::string& version,
+                const std::vector<std::string>& activationEvents, const std::vector<std::string>& dependencies);
             bool uninstallExtension(const std::string& extensionId);
             std::vector<std::string> getInstalledExtensions() const;
-            
+
             // VS Code extension compatibility
             bool isVSCodeExtensionCompatible(const std::string& extensionId) const;
-            
+
             // Extension execution
             bool activateExtension(const std::string& extensionId);
             void deactivateExtension(const std::string& extensionId);
-            
+            bool isExtensionActive(const std::string& extensionId) const;
+
+            // Activate the extensions waiting for an event: "*" at startup,
+            // "onStartupFinished" after it, "onLanguage:python", "onCommand:<id>" and
+            // so on. An event with an argument also wakes extensions listening for
+            // its bare name. Extensions that do not depend on each other activate
+            // concurrently. Returns false if one of them failed.
+            bool fireActivationEvent(const std::string& event);
+
+            // Fire the workspaceContains events matched by files below a workspace
+            // folder, checking every pattern in one walk of the folder
+            bool activateForWorkspace(const FileSystem& fileSystem, const std::string& folder);
+
+            // Call a method of an active extension and wait for its result
+            bool callExtension(const std::string& extensionId, const std::string& method, std::string_view params, std::string& result);
+
+            // Documents mirrored in the worker. The snapshots are kept to open the
+            // documents again in a restarted worker.
+            void openDocument(const std::string& uri, const std::string& languageId, const TextSnapshot& snapshot);
+            void changeDocument(const std::string& uri, const TextDocumentChangeEvent& event, const TextSnapshot& snapshot);
+            void closeDocument(const std::string& uri);
+
+            // Notifications sent by extensions, called on a thread of the host
+            void setNotificationHandler(ExtensionNotificationHandler handler);
+
+            bool isWorkerRunning() const;
+            int getWorkerRestartCount() const;
+
         private:
+            // Prevent copying
+            ExtensionHost(const ExtensionHost&) = delete;
+            ExtensionHost& operator=(const ExtensionHost&) = delete;
+
             // Implementation details
             class Impl;
             std::unique_ptr<Impl> pImpl;
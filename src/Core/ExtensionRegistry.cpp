@@ -0,0 +1,953 @@
+#include "pch.h"
+#include "ExtensionRegistry.h"
+#include "FileSystem.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            const char kMagic[4] = { 'V', 'E', 'X', 'T' };
+            const uint32_t kFormatVersion = 2;
+
+            const char* const kManifestName = "package.json";
+
+            // Saved layout. Sections follow the header in this order, each starting at
+            // a multiple of 8 bytes.
+            struct Header {
+                char magic[4];
+                uint32_t version;
+                uint32_t extensionCount;
+                uint32_t stringCount;
+                uint32_t supersededCount;
+                uint32_t reserved;
+                uint64_t recordsOffset;
+                uint64_t supersededOffset;  // ExtensionRecord of older versions installed beside a newer one
+                uint64_t stringsOffset;     // table of StringRef
+                uint64_t textOffset;
+                uint64_t totalSize;
+            };
+
+            struct StringRef {
+                uint32_t offset;            // from the start of the text section
+                uint32_t length;
+            };
+
+            // What invalidates a cached manifest
+            struct Stamp {
+                int64_t directoryModified;
+                int64_t manifestModified;
+                uint64_t manifestSize;
+
+                bool operator==(const Stamp& other) const {
+                    return directoryModified == other.directoryModified && manifestModified == other.manifestModified &&
+                        manifestSize == other.manifestSize;
+                }
+            };
+
+            // Sorted by id. Lists are runs of the string table; a contribution takes
+            // two strings, its point and its JSON.
+            struct ExtensionRecord {
+                Stamp stamp;
+                StringRef directory;
+                StringRef id;
+                StringRef name;
+                StringRef publisher;
+                StringRef version;
+                StringRef displayName;
+                StringRef description;
+                StringRef main;
+                StringRef engine;
+                uint32_t firstActivationEvent;
+                uint32_t activationEventCount;
+                uint32_t firstDependency;
+                uint32_t dependencyCount;
+                uint32_t firstContribution;
+                uint32_t contributionCount;
+            };
+
+            struct Entry {
+                Stamp stamp;
+                ExtensionManifest manifest;
+            };
+
+            template <typename T>
+            void appendRaw(std::string& out, const T& value) {
+                out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            void alignTo8(std::string& out) {
+                out.resize((out.size() + 7) & ~static_cast<size_t>(7), '\0');
+            }
+
+            // Whether count items of itemSize fit between an 8-byte aligned offset and
+            // limit, checked by division so a corrupt count cannot wrap
+            bool sectionFits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit) {
+                return offset % 8 == 0 && offset <= limit && count <= (limit - offset) / itemSize;
+            }
+
+            // Size and modification time with a single call, following links;
+            // false if the path does not exist
+            bool statPath(const fs::path& path, uint64_t& size, int64_t& modified, bool& isDirectory) {
+#ifdef _WIN32
+                WIN32_FILE_ATTRIBUTE_DATA data;
+                if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+                    return false;
+                }
+                size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+                modified = int64_t((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime);
+                isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+                struct stat info;
+                if (stat(path.c_str(), &info) != 0) {
+                    return false;
+                }
+                size = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+                modified = int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+                modified = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+                isDirectory = S_ISDIR(info.st_mode);
+#endif
+                return true;
+            }
+
+            int64_t directoryModified(const fs::path& path) {
+                uint64_t size;
+                int64_t modified;
+                bool isDirectory;
+                return statPath(path, size, modified, isDirectory) && isDirectory ? modified : 0;
+            }
+
+            // Dotted numeric versions compare by number, anything else by text
+            bool isNewerVersion(std::string_view version, std::string_view than) {
+                size_t i = 0, j = 0;
+                while (i < version.size() || j < than.size()) {
+                    uint64_t a = 0, b = 0;
+                    bool numeric = false;
+                    for (; i < version.size() && version[i] >= '0' && version[i] <= '9'; ++i, numeric = true) {
+                        a = a * 10 + (version[i] - '0');
+                    }
+                    for (; j < than.size() && than[j] >= '0' && than[j] <= '9'; ++j, numeric = true) {
+                        b = b * 10 + (than[j] - '0');
+                    }
+                    if (!numeric) {
+                        return version.substr(i) > than.substr(j);
+                    }
+                    if (a != b) {
+                        return a > b;
+                    }
+                    if (i < version.size() && version[i] == '.') ++i;
+                    if (j < than.size() && than[j] == '.') ++j;
+                }
+                return false;
+            }
+
+            void appendUtf8(std::string& out, uint32_t codePoint) {
+                if (codePoint < 0x80) {
+                    out += static_cast<char>(codePoint);
+                }
+                else if (codePoint < 0x800) {
+                    out += static_cast<char>(0xC0 | (codePoint >> 6));
+                    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+                }
+                else if (codePoint < 0x10000) {
+                    out += static_cast<char>(0xE0 | (codePoint >> 12));
+                    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+                }
+                else {
+                    out += static_cast<char>(0xF0 | (codePoint >> 18));
+                    out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+                }
+            }
+
+            // Just enough of a JSON reader for manifests: values the registry does not
+            // need are skipped, or kept as their JSON text. Any syntax error leaves
+            // failed set and every further read failing.
+            class JsonReader {
+            public:
+                explicit JsonReader(std::string_view text) : text(text), position(0), failed(false) {
+                    if (text.substr(0, 3) == "\xEF\xBB\xBF") {
+                        position = 3;
+                    }
+                }
+
+                bool hasFailed() const { return failed; }
+
+                char peek() {
+                    skipWhitespace();
+                    return position < text.size() ? text[position] : '\0';
+                }
+
+                bool beginObject() { return expect('{'); }
+                bool beginArray() { return expect('['); }
+
+                // Read the key of the next member, leaving its value to read or skip;
+                // false at the end of the object
+                bool nextMember(std::string& key) {
+                    if (!nextItem('}')) {
+                        return false;
+                    }
+                    return readString(key) && expect(':');
+                }
+
+                // False at the end of the array
+                bool nextElement() {
+                    return nextItem(']');
+                }
+
+                bool readString(std::string& value) {
+                    if (!expect('"')) {
+                        return false;
+                    }
+                    value.clear();
+                    while (position < text.size()) {
+                        char c = text[position++];
+                        if (c == '"') {
+                            return true;
+                        }
+                        if (c != '\\') {
+                            value += c;
+                            continue;
+                        }
+                        if (position >= text.size()) {
+                            break;
+                        }
+                        switch (text[position++]) {
+                        case '"': value += '"'; break;
+                        case '\\': value += '\\'; break;
+                        case '/': value += '/'; break;
+                        case 'b': value += '\b'; break;
+                        case 'f': value += '\f'; break;
+                        case 'n': value += '\n'; break;
+                        case 'r': value += '\r'; break;
+                        case 't': value += '\t'; break;
+                        case 'u': {
+                            uint32_t codePoint;
+                            if (!readHex(codePoint)) {
+                                return fail();
+                            }
+                            uint32_t low;
+                            if (codePoint >= 0xD800 && codePoint < 0xDC00 && text.substr(position, 2) == "\\u") {
+                                position += 2;
+                                if (!readHex(low) || low < 0xDC00 || low >= 0xE000) {
+                                    return fail();
+                                }
+                                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                            }
+                            appendUtf8(value, codePoint);
+                            break;
+                        }
+                        default:
+                            return fail();
+                        }
+                    }
+                    return fail();
+                }
+
+                // A string value, or empty for anything else
+                std::string readStringOrSkip() {
+                    std::string value;
+                    if (peek() == '"') {
+                        readString(value);
+                    }
+                    else {
+                        skipValue();
+                    }
+                    return value;
+                }
+
+                // Strings of an array; a single string counts as an array of one
+                void readStringList(std::vector<std::string>& values) {
+                    if (peek() == '"') {
+                        values.push_back(readStringOrSkip());
+                        return;
+                    }
+                    if (peek() != '[') {
+                        skipValue();
+                        return;
+                    }
+                    beginArray();
+                    while (nextElement()) {
+                        std::string value = readStringOrSkip();
+                        if (!value.empty()) {
+                            values.push_back(std::move(value));
+                        }
+                    }
+                }
+
+                // Skip a value and return its JSON text
+                std::string_view skipValue() {
+                    char c = peek();
+                    size_t start = position;
+                    std::string ignored;
+                    if (c == '"') {
+                        readString(ignored);
+                    }
+                    else if (c == '{') {
+                        beginObject();
+                        while (nextMember(ignored)) {
+                            skipValue();
+                        }
+                    }
+                    else if (c == '[') {
+                        beginArray();
+                        while (nextElement()) {
+                            skipValue();
+                        }
+                    }
+                    else {
+                        // Number, true, false or null
+                        while (position < text.size() && !isWhitespace(text[position]) &&
+                            std::strchr(",:]}\"", text[position]) == nullptr) {
+                            ++position;
+                        }
+                        if (position == start) {
+                            fail();
+                        }
+                    }
+                    return failed ? std::string_view() : text.substr(start, position - start);
+                }
+
+            private:
+                static bool isWhitespace(char c) {
+                    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+                }
+
+                void skipWhitespace() {
+                    while (position < text.size() && isWhitespace(text[position])) {
+                        ++position;
+                    }
+                }
+
+                bool fail() {
+                    failed = true;
+                    position = text.size();
+                    return false;
+                }
+
+                bool expect(char c) {
+                    if (failed || peek() != c) {
+                        return fail();
+                    }
+                    ++position;
+                    return true;
+                }
+
+                // Step over the comma before the next item of an object or array, or
+                // over the bracket that closes it
+                bool nextItem(char close) {
+                    if (failed) {
+                        return false;
+                    }
+                    char c = peek();
+                    if (c == close) {
+                        ++position;
+                        return false;
+                    }
+
+                    // Only the first item follows the opening bracket directly
+                    size_t previous = position;
+                    while (previous > 0 && isWhitespace(text[previous - 1])) {
+                        --previous;
+                    }
+                    if (previous > 0 && (text[previous - 1] == '{' || text[previous - 1] == '[')) {
+                        return true;
+                    }
+                    if (c != ',') {
+                        return fail();
+                    }
+                    ++position;
+                    if (peek() == close) {
+                        return fail();
+                    }
+                    return true;
+                }
+
+                bool readHex(uint32_t& value) {
+                    if (position + 4 > text.size()) {
+                        return false;
+                    }
+                    value = 0;
+                    for (int i = 0; i < 4; ++i) {
+                        char c = text[position++];
+                        value <<= 4;
+                        if (c >= '0' && c <= '9') value |= c - '0';
+                        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+                        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+                        else return false;
+                    }
+                    return true;
+                }
+
+                std::string_view text;
+                size_t position;
+                bool failed;
+            };
+
+            // Ids of the objects of a contribution that take one, such as the command
+            // of each entry of "commands"
+            void readContributedIds(std::string_view json, const char* field, std::vector<std::string>& ids) {
+                JsonReader reader(json);
+                bool isArray = reader.peek() == '[';
+                if (isArray) {
+                    reader.beginArray();
+                }
+                while (!isArray || reader.nextElement()) {
+                    std::string key;
+                    if (reader.peek() == '{') {
+                        reader.beginObject();
+                        while (reader.nextMember(key)) {
+                            if (key == field) {
+                                std::string id = reader.readStringOrSkip();
+                                if (!id.empty()) {
+                                    ids.push_back(std::move(id));
+                                }
+                            }
+                            else {
+                                reader.skipValue();
+                            }
+                        }
+                    }
+                    else {
+                        reader.skipValue();
+                    }
+                    if (!isArray || reader.hasFailed()) {
+                        break;
+                    }
+                }
+            }
+
+            void addImpliedEvents(const char* prefix, const std::vector<std::string>& ids, std::vector<std::string>& events) {
+                for (const std::string& id : ids) {
+                    std::string event = prefix + id;
+                    if (std::find(events.begin(), events.end(), event) == events.end()) {
+                        events.push_back(std::move(event));
+                    }
+                }
+            }
+
+            bool parseManifest(std::string_view json, ExtensionManifest& manifest) {
+                JsonReader reader(json);
+                std::vector<std::string> commands, languages;
+                std::string key;
+                if (!reader.beginObject()) {
+                    return false;
+                }
+                while (reader.nextMember(key)) {
+                    if (key == "name") {
+                        manifest.name = reader.readStringOrSkip();
+                    }
+                    else if (key == "publisher") {
+                        manifest.publisher = reader.readStringOrSkip();
+                    }
+                    else if (key == "version") {
+                        manifest.version = reader.readStringOrSkip();
+                    }
+                    else if (key == "displayName") {
+                        manifest.displayName = reader.readStringOrSkip();
+                    }
+                    else if (key == "description") {
+                        manifest.description = reader.readStringOrSkip();
+                    }
+                    else if (key == "main") {
+                        manifest.main = reader.readStringOrSkip();
+                    }
+                    else if (key == "activationEvents") {
+                        reader.readStringList(manifest.activationEvents);
+                    }
+                    else if (key == "extensionDependencies") {
+                        reader.readStringList(manifest.dependencies);
+                    }
+                    else if (key == "engines" && reader.peek() == '{') {
+                        std::string engine;
+                        reader.beginObject();
+                        while (reader.nextMember(engine)) {
+                            if (engine == "vscode" || (engine == "vune" && manifest.engine.empty())) {
+                                manifest.engine = reader.readStringOrSkip();
+                            }
+                            else {
+                                reader.skipValue();
+                            }
+                        }
+                    }
+                    else if (key == "contributes" && reader.peek() == '{') {
+                        std::string point;
+                        reader.beginObject();
+                        while (reader.nextMember(point)) {
+                            std::string_view value = reader.skipValue();
+                            if (point == "commands") {
+                                readContributedIds(value, "command", commands);
+                            }
+                            else if (point == "languages") {
+                                readContributedIds(value, "id", languages);
+                            }
+                            manifest.contributions.push_back({ point, std::string(value) });
+                        }
+                    }
+                    else {
+                        reader.skipValue();
+                    }
+                }
+                if (reader.hasFailed() || manifest.name.empty()) {
+                    return false;
+                }
+
+                manifest.id = manifest.publisher.empty() ? manifest.name : manifest.publisher + "." + manifest.name;
+                addImpliedEvents("onCommand:", commands, manifest.activationEvents);
+                addImpliedEvents("onLanguage:", languages, manifest.activationEvents);
+                return true;
+            }
+        }
+
+        class ExtensionRegistry::Impl {
+        public:
+            Impl(FileSystem& fileSystem, const std::string& extensionsDirectory)
+                : fileSystem(fileSystem), extensionsDirectory(extensionsDirectory), modified(false) {
+                clear();
+            }
+
+            void clear() {
+                mapped.reset();
+                owned.clear();
+                header = nullptr;
+                records = nullptr;
+                superseded = nullptr;
+                strings = nullptr;
+                text = nullptr;
+            }
+
+            // Point the tables into a cache image; false if it is not one. Records are
+            // read in place, so the image and its sections must be 8-byte aligned.
+            bool attach(const char* data, uint64_t size) {
+                const Header* candidate = reinterpret_cast<const Header*>(data);
+                if (reinterpret_cast<uintptr_t>(data) % 8 != 0 || size < sizeof(Header) ||
+                    std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) != 0 ||
+                    candidate->version != kFormatVersion || candidate->totalSize != size ||
+                    candidate->recordsOffset < sizeof(Header) ||
+                    !sectionFits(candidate->recordsOffset, candidate->extensionCount, sizeof(ExtensionRecord), candidate->supersededOffset) ||
+                    !sectionFits(candidate->supersededOffset, candidate->supersededCount, sizeof(ExtensionRecord), candidate->stringsOffset) ||
+                    !sectionFits(candidate->stringsOffset, candidate->stringCount, sizeof(StringRef), candidate->textOffset) ||
+                    candidate->textOffset > size) {
+                    return false;
+                }
+
+                const ExtensionRecord* candidateRecords = reinterpret_cast<const ExtensionRecord*>(data + candidate->recordsOffset);
+                const ExtensionRecord* candidateSuperseded = reinterpret_cast<const ExtensionRecord*>(data + candidate->supersededOffset);
+                const StringRef* candidateStrings = reinterpret_cast<const StringRef*>(data + candidate->stringsOffset);
+                uint64_t textLength = size - candidate->textOffset;
+                for (uint32_t i = 0; i < candidate->stringCount; ++i) {
+                    if (candidateStrings[i].offset > textLength || candidateStrings[i].length > textLength - candidateStrings[i].offset) {
+                        return false;
+                    }
+                }
+                auto isValid = [candidate, textLength](const ExtensionRecord& record) {
+                    if (record.firstActivationEvent > candidate->stringCount ||
+                        record.activationEventCount > candidate->stringCount - record.firstActivationEvent ||
+                        record.firstDependency > candidate->stringCount ||
+                        record.dependencyCount > candidate->stringCount - record.firstDependency ||
+                        record.firstContribution > candidate->stringCount ||
+                        record.contributionCount > (candidate->stringCount - record.firstContribution) / 2) {
+                        return false;
+                    }
+                    for (const StringRef* ref = &record.directory; ref <= &record.engine; ++ref) {
+                        if (ref->offset > textLength || ref->length > textLength - ref->offset) {
+                            return false;
+                        }
+                    }
+                    return true;
+                };
+                if (!std::all_of(candidateRecords, candidateRecords + candidate->extensionCount, isValid) ||
+                    !std::all_of(candidateSuperseded, candidateSuperseded + candidate->supersededCount, isValid)) {
+                    return false;
+                }
+
+                header = candidate;
+                records = candidateRecords;
+                superseded = candidateSuperseded;
+                strings = candidateStrings;
+                text = data + candidate->textOffset;
+                return true;
+            }
+
+            uint32_t count() const {
+                return header ? header->extensionCount : 0;
+            }
+
+            uint32_t supersededCount() const {
+                return header ? header->supersededCount : 0;
+            }
+
+            bool isSuperseded(const ExtensionRecord* record) const {
+                return record >= superseded && record < superseded + supersededCount();
+            }
+
+            std::string_view view(const StringRef& ref) const {
+                return std::string_view(text + ref.offset, ref.length);
+            }
+
+            std::string_view stringAt(uint32_t index) const {
+                return view(strings[index]);
+            }
+
+            const ExtensionRecord* find(std::string_view extensionId) const {
+                const ExtensionRecord* end = records + count();
+                const ExtensionRecord* found = std::lower_bound(records, end, extensionId,
+                    [this](const ExtensionRecord& record, std::string_view id) { return view(record.id) < id; });
+                return found != end && view(found->id) == extensionId ? found : nullptr;
+            }
+
+            void decode(const ExtensionRecord& record, ExtensionManifest& manifest) const {
+                manifest.id = view(record.id);
+                manifest.directory = view(record.directory);
+                manifest.name = view(record.name);
+                manifest.publisher = view(record.publisher);
+                manifest.version = view(record.version);
+                manifest.displayName = view(record.displayName);
+                manifest.description = view(record.description);
+                manifest.main = view(record.main);
+                manifest.engine = view(record.engine);
+
+                manifest.activationEvents.clear();
+                for (uint32_t i = 0; i < record.activationEventCount; ++i) {
+                    manifest.activationEvents.emplace_back(stringAt(record.firstActivationEvent + i));
+                }
+                manifest.dependencies.clear();
+                for (uint32_t i = 0; i < record.dependencyCount; ++i) {
+                    manifest.dependencies.emplace_back(stringAt(record.firstDependency + i));
+                }
+                manifest.contributions.clear();
+                for (uint32_t i = 0; i < record.contributionCount; ++i) {
+                    uint32_t index = record.firstContribution + 2 * i;
+                    manifest.contributions.push_back({ std::string(stringAt(index)), std::string(stringAt(index + 1)) });
+                }
+            }
+
+            // Replace the contents with an image of entries, sorted here by id, and of
+            // the older versions they supersede
+            void rebuild(std::vector<Entry>& entries, const std::vector<Entry>& supersededEntries) {
+                std::sort(entries.begin(), entries.end(),
+                    [](const Entry& a, const Entry& b) { return a.manifest.id < b.manifest.id; });
+
+                std::string recordSection, supersededSection, stringSection, textSection;
+                uint32_t stringCount = 0;
+                auto addText = [&textSection](const std::string& value) {
+                    StringRef ref = { static_cast<uint32_t>(textSection.size()), static_cast<uint32_t>(value.size()) };
+                    textSection += value;
+                    return ref;
+                };
+                auto addString = [&](const std::string& value) {
+                    appendRaw(stringSection, addText(value));
+                    return stringCount++;
+                };
+
+                auto addRecord = [&](const Entry& entry, std::string& section) {
+                    const ExtensionManifest& manifest = entry.manifest;
+                    ExtensionRecord record = {};
+                    record.stamp = entry.stamp;
+                    record.directory = addText(manifest.directory);
+                    record.id = addText(manifest.id);
+                    record.name = addText(manifest.name);
+                    record.publisher = addText(manifest.publisher);
+                    record.version = addText(manifest.version);
+                    record.displayName = addText(manifest.displayName);
+                    record.description = addText(manifest.description);
+                    record.main = addText(manifest.main);
+                    record.engine = addText(manifest.engine);
+
+                    record.firstActivationEvent = stringCount;
+                    record.activationEventCount = static_cast<uint32_t>(manifest.activationEvents.size());
+                    for (const std::string& event : manifest.activationEvents) {
+                        addString(event);
+                    }
+                    record.firstDependency = stringCount;
+                    record.dependencyCount = static_cast<uint32_t>(manifest.dependencies.size());
+                    for (const std::string& dependency : manifest.dependencies) {
+                        addString(dependency);
+                    }
+                    record.firstContribution = stringCount;
+                    record.contributionCount = static_cast<uint32_t>(manifest.contributions.size());
+                    for (const ExtensionContribution& contribution : manifest.contributions) {
+                        addString(contribution.point);
+                        addString(contribution.json);
+                    }
+                    appendRaw(section, record);
+                };
+                for (const Entry& entry : entries) {
+                    addRecord(entry, recordSection);
+                }
+                for (const Entry& entry : supersededEntries) {
+                    addRecord(entry, supersededSection);
+                }
+
+                Header image = {};
+                std::memcpy(image.magic, kMagic, sizeof(kMagic));
+                image.version = kFormatVersion;
+                image.extensionCount = static_cast<uint32_t>(entries.size());
+                image.stringCount = stringCount;
+                image.supersededCount = static_cast<uint32_t>(supersededEntries.size());
+
+                std::string content;
+                content.reserve(sizeof(Header) + recordSection.size() + supersededSection.size() + stringSection.size() +
+                    textSection.size() + 8);
+                appendRaw(content, image);
+                image.recordsOffset = content.size();
+                content += recordSection;
+                image.supersededOffset = content.size();
+                content += supersededSection;
+                image.stringsOffset = content.size();
+                content += stringSection;
+                alignTo8(content);
+                image.textOffset = content.size();
+                content += textSection;
+                image.totalSize = content.size();
+                std::memcpy(&content[0], &image, sizeof(image));
+
+                clear();
+                owned = std::move(content);
+                attach(owned.data(), owned.size());
+                modified = true;
+            }
+
+            FileSystem& fileSystem;
+            std::string extensionsDirectory;
+
+            // The image is either mapped from the cache or, after a refresh that
+            // changed something, built in memory until it is saved
+            std::shared_ptr<MappedFile> mapped;
+            std::string owned;
+            std::string loadedPath;
+            bool modified;
+
+            const Header* header;
+            const ExtensionRecord* records;
+            const ExtensionRecord* superseded;
+            const StringRef* strings;
+            const char* text;
+        };
+
+        ExtensionRegistry::ExtensionRegistry(FileSystem& fileSystem, const std::string& extensionsDirectory)
+            : pImpl(std::make_unique<Impl>(fileSystem, extensionsDirectory)) {
+        }
+
+        ExtensionRegistry::~ExtensionRegistry() {
+        }
+
+        bool ExtensionRegistry::load(const std::string& cachePath) {
+            TraceScope scope("ExtensionRegistry::load");
+            Impl& impl = *pImpl;
+            impl.clear();
+            impl.loadedPath.clear();
+            impl.modified = false;
+
+            std::shared_ptr<MappedFile> file = impl.fileSystem.mapFile(cachePath);
+            if (!file || !impl.attach(file->data(), file->size())) {
+                impl.clear();
+                return false;
+            }
+            impl.mapped = std::move(file);
+            impl.loadedPath = cachePath;
+            return true;
+        }
+
+        bool ExtensionRegistry::save(const std::string& cachePath) {
+            Impl& impl = *pImpl;
+            if (!impl.modified && impl.mapped && cachePath == impl.loadedPath) {
+                return true;
+            }
+            if (!impl.header) {
+                std::vector<Entry> none;
+                impl.rebuild(none, none);
+            }
+
+            std::string content(reinterpret_cast<const char*>(impl.header), impl.header->totalSize);
+            if (!impl.fileSystem.writeTextFile(cachePath, content)) {
+                return false;
+            }
+            return load(cachePath);
+        }
+
+        size_t ExtensionRegistry::refresh() {
+            TraceScope scope("ExtensionRegistry::refresh");
+            Impl& impl = *pImpl;
+            fs::path root = fs::u8path(impl.extensionsDirectory);
+
+            // Where each cached extension lives, superseded versions included
+            std::unordered_map<std::string_view, const ExtensionRecord*> cached;
+            cached.reserve(impl.count() + impl.supersededCount());
+            for (uint32_t i = 0; i < impl.count(); ++i) {
+                cached.emplace(impl.view(impl.records[i].directory), &impl.records[i]);
+            }
+            for (uint32_t i = 0; i < impl.supersededCount(); ++i) {
+                cached.emplace(impl.view(impl.superseded[i].directory), &impl.superseded[i]);
+            }
+
+            // Listed every time, since a manifest that did not parse is not cached
+            // and its directory has to be checked again
+            std::vector<std::string> directories;
+            impl.fileSystem.forEachEntry(impl.extensionsDirectory, [&directories](std::string_view name, EntryType type) {
+                if (name[0] != '.' && (type == EntryType::Directory || type == EntryType::SymbolicLink)) {
+                    directories.emplace_back(name);
+                }
+            });
+
+            std::vector<Entry> parsed;
+            std::vector<const ExtensionRecord*> kept;
+            for (const std::string& directory : directories) {
+                fs::path path = root / fs::u8path(directory);
+                fs::path manifestPath = path / kManifestName;
+                Entry entry;
+                bool isDirectory;
+                if (!statPath(manifestPath, entry.stamp.manifestSize, entry.stamp.manifestModified, isDirectory) || isDirectory) {
+                    continue;
+                }
+                entry.stamp.directoryModified = directoryModified(path);
+
+                auto found = cached.find(directory);
+                if (found != cached.end() && found->second->stamp == entry.stamp) {
+                    kept.push_back(found->second);
+                    continue;
+                }
+
+                // A manifest that does not parse is left out, and read again by the
+                // next refresh
+                std::string json;
+                if (!impl.fileSystem.readFile(manifestPath.u8string(), json) || !parseManifest(json, entry.manifest)) {
+                    continue;
+                }
+                entry.manifest.directory = directory;
+                parsed.push_back(std::move(entry));
+            }
+
+            // Several versions of an extension can be installed side by side while
+            // an update is pending; the newest wins. The others are cached as
+            // superseded, so no version that was cached is parsed again.
+            const size_t kCached = static_cast<size_t>(-1);
+            struct Winner {
+                std::string_view version;
+                const ExtensionRecord* record;
+                size_t parsedIndex;     // kCached for a cached record
+            };
+            std::unordered_map<std::string_view, Winner> newest;
+            newest.reserve(kept.size() + parsed.size());
+            auto offer = [&newest](std::string_view id, const Winner& candidate) {
+                auto inserted = newest.emplace(id, candidate);
+                if (!inserted.second && isNewerVersion(candidate.version, inserted.first->second.version)) {
+                    inserted.first->second = candidate;
+                }
+            };
+            for (const ExtensionRecord* record : kept) {
+                offer(impl.view(record->id), { impl.view(record->version), record, kCached });
+            }
+            for (size_t i = 0; i < parsed.size(); ++i) {
+                offer(parsed[i].manifest.id, { parsed[i].manifest.version, nullptr, i });
+            }
+
+            // A superseded version that now wins changes the extension as much as a
+            // parsed one does
+            size_t changed = 0;
+            for (const auto& pair : newest) {
+                if (pair.second.parsedIndex != kCached || impl.isSuperseded(pair.second.record)) {
+                    changed++;
+                }
+            }
+            for (uint32_t i = 0; i < impl.count(); ++i) {
+                if (newest.find(impl.view(impl.records[i].id)) == newest.end()) {
+                    changed++;
+                }
+            }
+
+            std::vector<const ExtensionRecord*> keptLosers;
+            std::vector<size_t> parsedLosers;
+            for (const ExtensionRecord* record : kept) {
+                if (newest[impl.view(record->id)].record != record) {
+                    keptLosers.push_back(record);
+                }
+            }
+            for (size_t i = 0; i < parsed.size(); ++i) {
+                if (newest[parsed[i].manifest.id].parsedIndex != i) {
+                    parsedLosers.push_back(i);
+                }
+            }
+            bool supersededChanged = !parsedLosers.empty() || keptLosers.size() != impl.supersededCount() ||
+                !std::all_of(keptLosers.begin(), keptLosers.end(),
+                    [&impl](const ExtensionRecord* record) { return impl.isSuperseded(record); });
+            if (changed == 0 && !supersededChanged && impl.header) {
+                return 0;
+            }
+
+            std::vector<Entry> entries;
+            entries.reserve(newest.size());
+            for (const auto& pair : newest) {
+                Entry entry;
+                if (pair.second.parsedIndex == kCached) {
+                    entry.stamp = pair.second.record->stamp;
+                    impl.decode(*pair.second.record, entry.manifest);
+                }
+                else {
+                    entry = std::move(parsed[pair.second.parsedIndex]);
+                }
+                entries.push_back(std::move(entry));
+            }
+            std::vector<Entry> supersededEntries(keptLosers.size());
+            for (size_t i = 0; i < keptLosers.size(); ++i) {
+                supersededEntries[i].stamp = keptLosers[i]->stamp;
+                impl.decode(*keptLosers[i], supersededEntries[i].manifest);
+            }
+            for (size_t i : parsedLosers) {
+                supersededEntries.push_back(std::move(parsed[i]));
+            }
+            impl.rebuild(entries, supersededEntries);
+            return changed;
+        }
+
+        std::vector<std::string> ExtensionRegistry::getExtensionIds() const {
+            std::vector<std::string> ids;
+            ids.reserve(pImpl->count());
+            for (uint32_t i = 0; i < pImpl->count(); ++i) {
+                ids.emplace_back(pImpl->view(pImpl->records[i].id));
+            }
+            return ids;
+        }
+
+        size_t ExtensionRegistry::getExtensionCount() const {
+            return pImpl->count();
+        }
+
+        bool ExtensionRegistry::hasExtension(const std::string& extensionId) const {
+            return pImpl->find(extensionId) != nullptr;
+        }
+
+        bool ExtensionRegistry::getManifest(const std::string& extensionId, ExtensionManifest& manifest) const {
+            const ExtensionRecord* record = pImpl->find(extensionId);
+            if (!record) {
+                return false;
+            }
+            pImpl->decode(*record, manifest);
+            return true;
+        }
+
+        std::vector<ExtensionManifest> ExtensionRegistry::getManifests() const {
+            std::vector<ExtensionManifest> manifests(pImpl->count());
+            for (uint32_t i = 0; i < pImpl->count(); ++i) {
+                pImpl->decode(pImpl->records[i], manifests[i]);
+            }
+            return manifests;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
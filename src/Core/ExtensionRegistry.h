@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        class FileSystem;
+
+        // Contribution point of a manifest, such as "commands" or "grammars", with its
+        // value as JSON text
+        struct ExtensionContribution {
+            std::string point;
+            std::string json;
+        };
+
+        // What the package.json of an installed extension declares
+        struct ExtensionManifest {
+            std::string id;             // publisher.name, or name without a publisher
+            std::string directory;      // below the extensions directory
+            std::string name;
+            std::string publisher;
+            std::string version;
+            std::string displayName;
+            std::string description;
+            std::string main;
+            std::string engine;         // engines.vscode, or engines.vune
+
+            // Declared events plus those VS Code implies from contributed commands
+            // and languages
+            std::vector<std::string> activationEvents;
+            std::vector<std::string> dependencies;  // extensionDependencies
+            std::vector<ExtensionContribution> contributions;
+        };
+
+        // Installed extensions of an extensions directory, one subdirectory with a
+        // package.json each. Parsed manifests are cached in a binary file that is
+        // memory-mapped as it is, so listing extensions or reading a manifest never
+        // touches JSON. refresh compares each directory's modification time and its
+        // manifest's size and modification time with the cache, and parses only the
+        // manifests that changed. Older versions installed beside a newer one are
+        // cached as well, though only the newest is listed.
+        class ExtensionRegistry {
+        public:
+            ExtensionRegistry(FileSystem& fileSystem, const std::string& extensionsDirectory);
+            ~ExtensionRegistry();
+
+            // Map a saved cache, dropping current contents. Returns false if the file
+            // is missing or not a cache; the registry is then empty.
+            bool load(const std::string& cachePath);
+
+            // Write the cache if anything changed since it was loaded or saved, and
+            // map the result
+            bool save(const std::string& cachePath);
+
+            // Bring the registry in line with the extensions directory. Returns how
+            // many extensions were added, changed or removed.
+            size_t refresh();
+
+            // Sorted by id
+            std::vector<std::string> getExtensionIds() const;
+            size_t getExtensionCount() const;
+
+            bool hasExtension(const std::string& extensionId) const;
+            bool getManifest(const std::string& extensionId, ExtensionManifest& manifest) const;
+            std::vector<ExtensionManifest> getManifests() const;
+
+        private:
+            // Prevent copying
+            ExtensionRegistry(const ExtensionRegistry&) = delete;
+            ExtensionRegistry& operator=(const ExtensionRegistry&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
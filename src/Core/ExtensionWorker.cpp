@@ -0,0 +1,367 @@
+#include "pch.h"
+#include "ExtensionWorker.h"
+#include "IpcChannel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <signal.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // How often an idle worker checks that its host still exists
+            const int kHostCheckIntervalMs = 1000;
+
+            // Activating mostly loads code and reads files, so more activations
+            // than cores can usefully overlap
+            const size_t kMinActivationThreads = 4;
+
+            struct MirroredDocument {
+                std::unique_ptr<TextBuffer> buffer;
+                std::string languageId;
+                int32_t version;
+            };
+        }
+
+        class ExtensionWorker::Impl {
+        public:
+            Impl() : reading(true), hostProcessId(0), pool(std::max<size_t>(kMinActivationThreads, std::thread::hardware_concurrency())), tasks(pool) {
+#ifdef _WIN32
+                hostProcess = nullptr;
+#endif
+            }
+
+            ~Impl() {
+#ifdef _WIN32
+                if (hostProcess) CloseHandle(hostProcess);
+#endif
+            }
+
+            bool isHostAlive() const {
+#ifdef _WIN32
+                return !hostProcess || WaitForSingleObject(hostProcess, 0) == WAIT_TIMEOUT;
+#else
+                return kill(static_cast<pid_t>(hostProcessId), 0) == 0 || errno != ESRCH;
+#endif
+            }
+
+            bool send(ExtensionMessage type, uint64_t id, std::string_view payload) {
+                std::lock_guard<std::mutex> lock(sendMutex);
+                return channel->send(static_cast<uint16_t>(type), id, payload) == IpcResult::Ok;
+            }
+
+            bool reply(uint64_t id, bool succeeded, std::string_view result) {
+                IpcWriter writer;
+                writer.writeU8(succeeded ? 1 : 0);
+                writer.writeString(result);
+                return send(ExtensionMessage::Reply, id, writer.getBuffer());
+            }
+
+            bool isActive(const std::string& extensionId) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                return activeExtensions.count(extensionId) != 0;
+            }
+
+            bool activate(const std::string& extensionId, const std::string& version) {
+                if (isActive(extensionId)) {
+                    return true;
+                }
+                if (activateHandler && !activateHandler(extensionId, version)) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(stateMutex);
+                activeExtensions.insert(extensionId);
+                return true;
+            }
+
+            void deactivate(const std::string& extensionId) {
+                {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    if (!activeExtensions.erase(extensionId)) {
+                        return;
+                    }
+                }
+                if (deactivateHandler) {
+                    deactivateHandler(extensionId);
+                }
+            }
+
+            void openDocument(IpcReader& reader) {
+                std::string uri, text;
+                MirroredDocument document;
+                int32_t version;
+                if (!reader.readString(uri) || !reader.readString(document.languageId) || !reader.readI32(version) ||
+                    !reader.readString(text)) {
+                    return;
+                }
+                document.buffer = std::make_unique<TextBuffer>(std::move(text));
+                document.buffer->setUndoMemoryLimit(0);
+                document.version = version;
+                documents[uri] = std::move(document);
+            }
+
+            // Drop a mirror that missed changes, and ask the host for the whole
+            // document again
+            void resync(const std::string& uri) {
+                documents.erase(uri);
+                IpcWriter writer;
+                writer.writeString(uri);
+                send(ExtensionMessage::ResyncDocument, 0, writer.getBuffer());
+            }
+
+            void changeDocument(IpcReader& reader) {
+                std::string uri;
+                int32_t baseVersion, version;
+                uint32_t count;
+                if (!reader.readString(uri) || !reader.readI32(baseVersion) || !reader.readI32(version) || !reader.readU32(count)) {
+                    return;
+                }
+                auto found = documents.find(uri);
+                if (found == documents.end() || found->second.version != baseVersion) {
+                    resync(uri);
+                    return;
+                }
+
+                TextDocumentChangeEvent event;
+                event.version = version;
+                for (uint32_t i = 0; i < count; ++i) {
+                    TextDocumentContentChange change;
+                    int32_t values[4];
+                    for (int32_t& value : values) {
+                        if (!reader.readI32(value)) {
+                            resync(uri);
+                            return;
+                        }
+                    }
+                    if (!reader.readString(change.text)) {
+                        resync(uri);
+                        return;
+                    }
+                    change.range = Range(values[0], values[1], values[2], values[3]);
+
+                    // Changes apply one after another, each in the coordinates the
+                    // previous one left
+                    TextBuffer& buffer = *found->second.buffer;
+                    change.rangeOffset = buffer.offsetAt(change.range.start);
+                    change.rangeLength = buffer.offsetAt(change.range.end) - change.rangeOffset;
+                    buffer.replace(change.range, change.text);
+                    event.changes.push_back(std::move(change));
+                }
+                found->second.version = version;
+                if (documentHandler) {
+                    documentHandler(uri, event);
+                }
+            }
+
+            // Handle one message; returns false on Shutdown
+            bool dispatch(const IpcMessage& message) {
+                IpcReader reader(message.payload);
+                switch (static_cast<ExtensionMessage>(message.type)) {
+                case ExtensionMessage::Ping:
+                    send(ExtensionMessage::Pong, message.id, std::string_view());
+                    break;
+                case ExtensionMessage::Activate: {
+                    // The host only sends activations together that do not depend
+                    // on each other, so they run side by side
+                    std::string extensionId, version;
+                    if (!reader.readString(extensionId) || !reader.readString(version)) {
+                        reply(message.id, false, std::string_view());
+                        break;
+                    }
+                    uint64_t id = message.id;
+                    tasks.run([this, id, extensionId, version]() {
+                        reply(id, activate(extensionId, version), std::string_view());
+                    });
+                    break;
+                }
+                case ExtensionMessage::Deactivate: {
+                    std::string extensionId;
+                    if (reader.readString(extensionId)) {
+                        deactivate(extensionId);
+                    }
+                    reply(message.id, true, std::string_view());
+                    break;
+                }
+                case ExtensionMessage::Call: {
+                    std::string extensionId, method, result;
+                    std::string_view params;
+                    bool succeeded = reader.readString(extensionId) && reader.readString(method) && reader.readStringView(params) &&
+                        isActive(extensionId) && callHandler && callHandler(extensionId, method, params, result);
+                    reply(message.id, succeeded, result);
+                    break;
+                }
+                case ExtensionMessage::OpenDocument:
+                    openDocument(reader);
+                    break;
+                case ExtensionMessage::ChangeDocument:
+                    changeDocument(reader);
+                    break;
+                case ExtensionMessage::CloseDocument: {
+                    std::string uri;
+                    if (reader.readString(uri)) {
+                        documents.erase(uri);
+                    }
+                    break;
+                }
+                case ExtensionMessage::Shutdown:
+                    return false;
+                default:
+                    break;
+                }
+                return true;
+            }
+
+            // Receive on a thread of its own until the host shuts the worker down or
+            // goes away, so the host's sends never wait on a busy handler
+            void readMessages() {
+                for (;;) {
+                    IpcMessage message;
+                    IpcResult result = channel->receive(message, kHostCheckIntervalMs);
+                    if (result == IpcResult::Timeout) {
+                        if (isHostAlive()) {
+                            continue;
+                        }
+                        result = IpcResult::Closed;
+                    }
+
+                    bool last = result == IpcResult::Closed || message.type == static_cast<uint16_t>(ExtensionMessage::Shutdown);
+                    {
+                        std::lock_guard<std::mutex> lock(queueMutex);
+                        if (result == IpcResult::Ok) {
+                            queue.push_back(std::move(message));
+                        }
+                        if (last) {
+                            reading = false;
+                        }
+                    }
+                    queued.notify_one();
+                    if (last) {
+                        return;
+                    }
+                }
+            }
+
+            // Next message to handle; false once the reader has stopped and the
+            // queue is drained
+            bool nextMessage(IpcMessage& message) {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queued.wait(lock, [this]() { return !queue.empty() || !reading; });
+                if (queue.empty()) {
+                    return false;
+                }
+                message = std::move(queue.front());
+                queue.pop_front();
+                return true;
+            }
+
+            std::unique_ptr<IpcChannel> channel;
+            std::mutex sendMutex;
+
+            std::mutex queueMutex;
+            std::condition_variable queued;
+            std::deque<IpcMessage> queue;
+            bool reading;
+            unsigned long hostProcessId;
+#ifdef _WIN32
+            HANDLE hostProcess;
+#endif
+
+            ActivateHandler activateHandler;
+            DeactivateHandler deactivateHandler;
+            CallHandler callHandler;
+            DocumentHandler documentHandler;
+
+            std::mutex stateMutex;
+            std::unordered_set<std::string> activeExtensions;
+            std::unordered_map<std::string, MirroredDocument> documents;
+
+            // Activations and, at shutdown, deactivations in progress; last, so
+            // its destructor waits for them before the state above goes
+            ThreadPool pool;
+            TaskGroup tasks;
+        };
+
+        ExtensionWorker::ExtensionWorker() : pImpl(std::make_unique<Impl>()) {
+        }
+
+        ExtensionWorker::~ExtensionWorker() {
+        }
+
+        std::unique_ptr<ExtensionWorker> ExtensionWorker::connect(const std::string& channelName, unsigned long hostProcessId) {
+            std::unique_ptr<ExtensionWorker> worker(new ExtensionWorker());
+            Impl& impl = *worker->pImpl;
+            impl.channel = IpcChannel::open(channelName);
+            if (!impl.channel) {
+                return nullptr;
+            }
+            impl.hostProcessId = hostProcessId;
+#ifdef _WIN32
+            impl.hostProcess = OpenProcess(SYNCHRONIZE, FALSE, hostProcessId);
+#endif
+            return worker;
+        }
+
+        void ExtensionWorker::setActivateHandler(ActivateHandler handler) {
+            pImpl->activateHandler = std::move(handler);
+        }
+
+        void ExtensionWorker::setDeactivateHandler(DeactivateHandler handler) {
+            pImpl->deactivateHandler = std::move(handler);
+        }
+
+        void ExtensionWorker::setCallHandler(CallHandler handler) {
+            pImpl->callHandler = std::move(handler);
+        }
+
+        void ExtensionWorker::setDocumentHandler(DocumentHandler handler) {
+            pImpl->documentHandler = std::move(handler);
+        }
+
+        const TextBuffer* ExtensionWorker::getDocument(const std::string& uri) const {
+            auto found = pImpl->documents.find(uri);
+            return found != pImpl->documents.end() ? found->second.buffer.get() : nullptr;
+        }
+
+        bool ExtensionWorker::notify(const std::string& extensionId, const std::string& method, std::string_view params) {
+            IpcWriter writer;
+            writer.writeString(extensionId);
+            writer.writeString(method);
+            writer.writeString(params);
+            return pImpl->send(ExtensionMessage::Notify, 0, writer.getBuffer());
+        }
+
+        int ExtensionWorker::run() {
+            Impl& impl = *pImpl;
+            std::thread reader([&impl]() { impl.readMessages(); });
+            IpcMessage message;
+            while (impl.nextMessage(message) && impl.dispatch(message)) {
+            }
+            reader.join();
+
+            // Deactivate everything at once; the host kills the worker if that
+            // outlasts its shutdown deadline
+            impl.tasks.wait();
+            std::vector<std::string> active;
+            {
+                std::lock_guard<std::mutex> lock(impl.stateMutex);
+                active.assign(impl.activeExtensions.begin(), impl.activeExtensions.end());
+            }
+            for (const std::string& extensionId : active) {
+                impl.tasks.run([&impl, extensionId]() { impl.deactivate(extensionId); });
+            }
+            impl.tasks.wait();
+            impl.documents.clear();
+            impl.channel->close();
+            return 0;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
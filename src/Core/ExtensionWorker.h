@@ -0,0 +1,90 @@
+#pragma once
+
+#include "pch.h"
+#include "TextBuffer.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Messages between an ExtensionHost and its worker process. Payloads are
+        // written with IpcWriter in the order listed; requests carry an id that
+        // their Reply repeats.
+        enum class ExtensionMessage : uint16_t {
+            Reply = 1,          // u8 succeeded, string result
+            Ping,               // answered with a Pong of the same id
+            Pong,
+            Activate,           // request: string extensionId, string version
+            Deactivate,         // request: string extensionId
+            Call,               // request: string extensionId, string method, string params
+            Notify,             // worker to host: string extensionId, string method, string params
+            OpenDocument,       // string uri, string languageId, i32 version, string text
+            ChangeDocument,     // string uri, i32 version changed from, i32 new version, u32 count, then per
+                                // change i32 start line, start character, end line, end character, string text
+            CloseDocument,      // string uri
+            Shutdown,           // deactivate everything and exit
+            ResyncDocument      // worker to host: string uri, whose mirror missed a change; the host
+                                // sends OpenDocument again
+        };
+
+        // Worker side of the extension host: runs in its own process, serves the
+        // requests of the host and mirrors the documents it opens, applying their
+        // changes as deltas. A change that does not continue from the version of
+        // the mirror drops it and has the host send the document again. A thread of
+        // the worker reads the channel, so the host's sends do not wait on a busy
+        // handler. Handlers run on the thread calling run, one message at a time,
+        // pings included: a handler that blocks stops the worker from answering
+        // them, and the host restarts it once that outlasts its hang timeout, which
+        // is always longer than its request timeout. Activate handlers are the
+        // exception: they run on a pool of the worker, several at once when the host
+        // activates independent extensions together. Deactivate handlers run there
+        // too, all at once, when the worker shuts down; a single Deactivate runs on
+        // the thread calling run like any other message.
+        class ExtensionWorker {
+        public:
+            using ActivateHandler = std::function<bool(const std::string& extensionId, const std::string& version)>;
+            using DeactivateHandler = std::function<void(const std::string& extensionId)>;
+            using CallHandler = std::function<bool(const std::string& extensionId, const std::string& method,
+                std::string_view params, std::string& result)>;
+            using DocumentHandler = std::function<void(const std::string& uri, const TextDocumentChangeEvent& event)>;
+
+            // Command line switch the host starts the worker with, followed by the
+            // channel name and the process id of the host
+            static constexpr const char* kCommandLineSwitch = "--extension-worker";
+
+            ~ExtensionWorker();
+
+            // Connect to the host's channel; returns null if it cannot be opened
+            static std::unique_ptr<ExtensionWorker> connect(const std::string& channelName, unsigned long hostProcessId);
+
+            // Without an activate handler every activation succeeds
+            void setActivateHandler(ActivateHandler handler);
+            void setDeactivateHandler(DeactivateHandler handler);
+            void setCallHandler(CallHandler handler);
+
+            // Called after a change is applied to a mirrored document
+            void setDocumentHandler(DocumentHandler handler);
+
+            // Mirror of an open document, or null
+            const TextBuffer* getDocument(const std::string& uri) const;
+
+            // Send a notification to the host; false once the host is gone
+            bool notify(const std::string& extensionId, const std::string& method, std::string_view params);
+
+            // Serve the host until it shuts the worker down or exits. Returns the
+            // process exit code.
+            int run();
+
+        private:
+            ExtensionWorker();
+
+            // Prevent copying
+            ExtensionWorker(const ExtensionWorker&) = delete;
+            ExtensionWorker& operator=(const ExtensionWorker&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
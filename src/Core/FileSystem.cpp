@@ -1,13 +1,66 @@
 #include "pch.h"
 #include "FileSystem.h"
+#include "AtomicFile.h"
+#include "FileWatcher.h"
+#include "Glob.h"
+#include "MappedFile.h"
+#include "TextBuffer.h"
+#include "Trace.h"
 #include <fstream>
 #include <filesystem>
 
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 namespace fs = std::filesystem;
 
 namespace Vune {
     namespace Core {
 
+        namespace {
+            // Stream contents through an AtomicFile, so a failed or interrupted save
+            // leaves the old file in place
+            bool writeAtomically(const std::string& path, const std::function<bool(AtomicFile&)>& write) {
+                std::unique_ptr<AtomicFile> file = AtomicFile::create(path);
+                return file && write(*file) && file->commit();
+            }
+
+            // Fill in a file or directory entry; false for other kinds and errors
+            bool describeEntry(const fs::directory_entry& found, DirectoryEntry& entry) {
+                std::error_code error;
+                
+                // Cached from the directory listing on Windows, so this adds no calls there
+                fs::file_status status = found.symlink_status(error);
+                if (error) {
+                    return false;
+                }
+                
+                entry.path = found.path().u8string();
+                entry.isDirectory = fs::is_directory(status);
+                entry.size = 0;
+                entry.modified = 0;
+                if (entry.isDirectory) {
+                    return true;
+                }
+                if (!fs::is_regular_file(status)) {
+                    return false;
+                }
+                
+                uint64_t size = found.file_size(error);
+                if (!error) {
+                    entry.size = size;
+                }
+                
+                fs::file_time_type modified = found.last_write_time(error);
+                if (!error) {
+                    entry.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+                }
+                return true;
+            }
+        }
+
         class FileSystem::Impl {
         public:
             Impl() {}
@@ -20,41 +73,77 @@ namespace Vune {
         }
 
         bool FileSystem::fileExists(const std::string& path) const {
-            return fs::exists(path) && fs::is_regular_file(path);
+            fs::path native = fs::u8path(path);
+            return fs::exists(native) && fs::is_regular_file(native);
         }
 
         std::string FileSystem::readTextFile(const std::string& path) const {
-            if (!fileExists(path)) {
-                return "";
-            }
+            TraceScope scope("FileSystem::readTextFile", TraceHistogram::FileReadLatency);
             
-            std::ifstream file(path);
+            // Opening fails for a missing file anyway, so no stat beforehand
+            std::ifstream file(fs::u8path(path));
             if (!file.is_open()) {
                 return "";
             }
             
             std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            Trace::addCount(TraceCounter::BytesRead, content.size());
             return content;
         }
 
-        bool FileSystem::writeTextFile(const std::string& path, const std::string& content) {
-            try {
-                std::ofstream file(path);
-                if (!file.is_open()) {
-                    return false;
-                }
-                
-                file << content;
-                return true;
+        bool FileSystem::readFile(const std::string& path, std::string& content) const {
+            TraceScope scope("FileSystem::readFile", TraceHistogram::FileReadLatency);
+            std::ifstream file(fs::u8path(path), std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                return false;
             }
-            catch (const std::exception&) {
+            
+            std::streamoff size = file.tellg();
+            if (size < 0) {
                 return false;
             }
+            
+            content.resize(static_cast<size_t>(size));
+            file.seekg(0);
+            file.read(&content[0], size);
+            content.resize(static_cast<size_t>(file.gcount()));
+            Trace::addCount(TraceCounter::BytesRead, content.size());
+            return true;
+        }
+
+        std::shared_ptr<MappedFile> FileSystem::mapFile(const std::string& path) const {
+            TraceScope scope("FileSystem::mapFile");
+            std::shared_ptr<MappedFile> file = MappedFile::open(path);
+            if (file) {
+                Trace::addCount(TraceCounter::BytesMapped, file->size());
+            }
+            return file;
+        }
+
+        bool FileSystem::writeTextFile(const std::string& path, const std::string& content) {
+            TraceScope scope("FileSystem::writeTextFile");
+            return writeAtomically(path, [&content](AtomicFile& file) {
+                Trace::addCount(TraceCounter::BytesWritten, content.size());
+                return file.write(content.data(), content.size());
+            });
+        }
+
+        bool FileSystem::writeTextFile(const std::string& path, const TextSnapshot& snapshot) {
+            TraceScope scope("FileSystem::writeTextFile");
+            return writeAtomically(path, [&snapshot](AtomicFile& file) {
+                bool written = true;
+                snapshot.forEachChunk([&file, &written](std::string_view chunk) {
+                    Trace::addCount(TraceCounter::BytesWritten, chunk.size());
+                    written = file.write(chunk.data(), chunk.size());
+                    return written;
+                });
+                return written;
+            });
         }
 
         bool FileSystem::deleteFile(const std::string& path) {
             try {
-                return fs::remove(path);
+                return fs::remove(fs::u8path(path));
             }
             catch (const std::exception&) {
                 return false;
@@ -62,12 +151,13 @@ namespace Vune {
         }
 
         bool FileSystem::directoryExists(const std::string& path) const {
-            return fs::exists(path) && fs::is_directory(path);
+            fs::path native = fs::u8path(path);
+            return fs::exists(native) && fs::is_directory(native);
         }
 
         bool FileSystem::createDirectory(const std::string& path) {
             try {
-                return fs::create_directories(path);
+                return fs::create_directories(fs::u8path(path));
             }
             catch (const std::exception&) {
                 return false;
@@ -77,10 +167,10 @@ namespace Vune {
         bool FileSystem::deleteDirectory(const std::string& path, bool recursive) {
             try {
                 if (recursive) {
-                    return fs::remove_all(path) > 0;
+                    return fs::remove_all(fs::u8path(path)) > 0;
                 }
                 else {
-                    return fs::remove(path);
+                    return fs::remove(fs::u8path(path));
                 }
             }
             catch (const std::exception&) {
@@ -95,11 +185,16 @@ namespace Vune {
                 return result;
             }
             
+#ifdef _WIN32
+            Glob glob(pattern, false);
+#else
+            Glob glob(pattern);
+#endif
+            
             try {
-                for (const auto& entry : fs::directory_iterator(directory)) {
-                    if (entry.is_regular_file()) {
-                        // TODO: Implement pattern matching
-                        result.push_back(entry.path().string());
+                for (const auto& entry : fs::directory_iterator(fs::u8path(directory))) {
+                    if (entry.is_regular_file() && glob.matches(entry.path().filename().u8string())) {
+                        result.push_back(entry.path().u8string());
                     }
                 }
             }
@@ -118,9 +213,9 @@ namespace Vune {
             }
             
             try {
-                for (const auto& entry : fs::directory_iterator(directory)) {
+                for (const auto& entry : fs::directory_iterator(fs::u8path(directory))) {
                     if (entry.is_directory()) {
-                        result.push_back(entry.path().string());
+                        result.push_back(entry.path().u8string());
                     }
                 }
             }
@@ -131,9 +226,109 @@ namespace Vune {
             return result;
         }
 
+        std::vector<DirectoryEntry> FileSystem::listEntries(const std::string& directory) const {
+            std::vector<DirectoryEntry> result;
+            std::error_code error;
+            
+            for (fs::directory_iterator it(fs::u8path(directory), fs::directory_options::skip_permission_denied, error), end; !error && it != end; it.increment(error)) {
+                DirectoryEntry entry;
+                if (describeEntry(*it, entry)) {
+                    result.push_back(std::move(entry));
+                }
+            }
+            
+            return result;
+        }
+
+        bool FileSystem::forEachEntry(const std::string& directory, const DirectoryVisitor& visitor) const {
+#ifdef _WIN32
+            WIN32_FIND_DATAW data;
+            HANDLE find = FindFirstFileExW((fs::u8path(directory) / L"*").c_str(), FindExInfoBasic, &data,
+                FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+            if (find == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            
+            do {
+                const wchar_t* name = data.cFileName;
+                if (name[0] == L'.' && (name[1] == 0 || (name[1] == L'.' && name[2] == 0))) {
+                    continue;
+                }
+                
+                EntryType type = EntryType::File;
+                if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+                    type = EntryType::SymbolicLink;
+                }
+                else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                    type = EntryType::Directory;
+                }
+                visitor(fs::path(name).u8string(), type);
+            } while (FindNextFileW(find, &data));
+            
+            FindClose(find);
+            return true;
+#else
+            DIR* handle = opendir(directory.c_str());
+            if (!handle) {
+                return false;
+            }
+            
+            std::string path;
+            while (dirent* found = readdir(handle)) {
+                const char* name = found->d_name;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                    continue;
+                }
+                
+                EntryType type;
+                switch (found->d_type) {
+                case DT_REG:
+                    type = EntryType::File;
+                    break;
+                case DT_DIR:
+                    type = EntryType::Directory;
+                    break;
+                case DT_LNK:
+                    type = EntryType::SymbolicLink;
+                    break;
+                case DT_UNKNOWN: {
+                    // Some file systems do not fill in d_type
+                    struct stat status;
+                    path.assign(directory).append("/").append(name);
+                    if (lstat(path.c_str(), &status) != 0) {
+                        continue;
+                    }
+                    type = S_ISREG(status.st_mode) ? EntryType::File :
+                        S_ISDIR(status.st_mode) ? EntryType::Directory :
+                        S_ISLNK(status.st_mode) ? EntryType::SymbolicLink : EntryType::Other;
+                    break;
+                }
+                default:
+                    type = EntryType::Other;
+                    break;
+                }
+                visitor(name, type);
+            }
+            
+            closedir(handle);
+            return true;
+#endif
+        }
+
+        bool FileSystem::getEntry(const std::string& path, DirectoryEntry& entry) const {
+            std::error_code error;
+            fs::directory_entry found(fs::u8path(path), error);
+            return !error && describeEntry(found, entry);
+        }
+
+        std::unique_ptr<FileWatcher> FileSystem::watch(ThreadPool& pool, const std::string& root, const FileWatcherOptions& options,
+            std::function<void(const std::vector<FileChange>&)> callback) const {
+            return std::make_unique<FileWatcher>(*this, pool, root, options, std::move(callback));
+        }
+
         std::string FileSystem::getAbsolutePath(const std::string& path) const {
             try {
-                return fs::absolute(path).string();
+                return fs::absolute(fs::u8path(path)).u8string();
             }
             catch (const std::exception&) {
                 return path;
@@ -142,9 +337,9 @@ namespace Vune {
 
         std::string FileSystem::combinePaths(const std::string& path1, const std::string& path2) const {
             try {
-                fs::path result = path1;
-                result /= path2;
-                return result.string();
+                fs::path result = fs::u8path(path1);
+                result /= fs::u8path(path2);
+                return result.u8string();
             }
             catch (const std::exception&) {
                 return path1 + "/" + path2;
@@ -153,7 +348,7 @@ namespace Vune {
 
         std::string FileSystem::getFileName(const std::string& path) const {
             try {
-                return fs::path(path).filename().string();
+                return fs::u8path(path).filename().u8string();
             }
             catch (const std::exception&) {
                 return path;
@@ -162,7 +357,7 @@ namespace Vune {
 
         std::string FileSystem::getDirectoryName(const std::string& path) const {
             try {
-                return fs::path(path).parent_path().string();
+                return fs::u8path(path).parent_path().u8string();
             }
             catch (const std::exception&) {
                 return path;
@@ -171,7 +366,7 @@ namespace Vune {
 
         std::string FileSystem::getExtension(const std::string& path) const {
             try {
-                return fs::path(path).extension().string();
+                return fs::u8path(path).extension().u8string();
             }
             catch (const std::exception&) {
                 return "";
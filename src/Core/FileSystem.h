@@ -5,6 +5,37 @@
 namespace Vune {
     namespace Core {
 
+        class FileWatcher;
+        class MappedFile;
+        class TextSnapshot;
+        class ThreadPool;
+        struct FileChange;
+        struct FileWatcherOptions;
+
+        // File or subdirectory found by FileSystem::listEntries
+        struct DirectoryEntry {
+            std::string path;
+            bool isDirectory;
+            uint64_t size;      // 0 for directories
+            int64_t modified;   // last write time in file clock ticks; 0 for directories
+
+            DirectoryEntry() : path(), isDirectory(false), size(0), modified(0) {}
+            DirectoryEntry(const std::string& path, bool isDirectory, uint64_t size, int64_t modified)
+                : path(path), isDirectory(isDirectory), size(size), modified(modified) {}
+        };
+
+        // Kind of a directory entry, as the listing itself reports it
+        enum class EntryType {
+            File,
+            Directory,
+            SymbolicLink,
+            Other
+        };
+
+        // Receives each name in a directory, without its path
+        using DirectoryVisitor = std::function<void(std::string_view name, EntryType type)>;
+
+        // Paths and names are UTF-8 on every platform
         class FileSystem {
         public:
             FileSystem();
@@ -13,16 +44,45 @@ namespace Vune {
             // File operations
             bool fileExists(const std::string& path) const;
             std::string readTextFile(const std::string& path) const;
+            
+            // Read a whole file as bytes, reusing the capacity of content
+            bool readFile(const std::string& path, std::string& content) const;
+            
+            std::shared_ptr<MappedFile> mapFile(const std::string& path) const;
+            
+            // Writes replace the file atomically once flushed to disk (see AtomicFile)
             bool writeTextFile(const std::string& path, const std::string& content);
+            
+            // Stream a buffer snapshot to disk chunk by chunk, never building the whole text
+            bool writeTextFile(const std::string& path, const TextSnapshot& snapshot);
             bool deleteFile(const std::string& path);
             
             // Directory operations
             bool directoryExists(const std::string& path) const;
             bool createDirectory(const std::string& path);
             bool deleteDirectory(const std::string& path, bool recursive = false);
+            
+            // Files whose names match a glob pattern (see Glob)
             std::vector<std::string> listFiles(const std::string& directory, const std::string& pattern = "*") const;
             std::vector<std::string> listDirectories(const std::string& directory) const;
             
+            // Regular files and subdirectories in one pass over the directory; symbolic
+            // links are not followed
+            std::vector<DirectoryEntry> listEntries(const std::string& directory) const;
+            
+            // Visit every name in a directory with the type from the listing (d_type or
+            // the find data), so nothing is stat'ed unless the file system leaves the
+            // type out. Returns false if the directory cannot be opened.
+            bool forEachEntry(const std::string& directory, const DirectoryVisitor& visitor) const;
+            
+            // Describe a single file or directory; false if it does not exist
+            bool getEntry(const std::string& path, DirectoryEntry& entry) const;
+            
+            // Watch a directory tree for changes until the watcher is destroyed (see
+            // FileWatcher)
+            std::unique_ptr<FileWatcher> watch(ThreadPool& pool, const std::string& root, const FileWatcherOptions& options,
+                std::function<void(const std::vector<FileChange>&)> callback) const;
+            
             // Path operations
             std::string getAbsolutePath(const std::string& path) const;
             std::string combinePaths(const std::string& path1, const std::string& path2) const;
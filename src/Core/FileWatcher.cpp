@@ -0,0 +1,711 @@
+#include "pch.h"
+#include "FileWatcher.h"
+#include "FileSystem.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <filesystem>
+#elif defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            using Clock = std::chrono::steady_clock;
+
+            // Bytes of events read at once
+            const size_t kEventBufferSize = 64 * 1024;
+
+            std::string joinRelative(const std::string& directory, std::string_view name) {
+                std::string path = directory;
+                if (!path.empty()) {
+                    path.push_back('/');
+                }
+                path.append(name);
+                return path;
+            }
+
+            // Merges changes per path until they are delivered, keeping the order in
+            // which paths first changed
+            class ChangeCoalescer {
+            public:
+                ChangeCoalescer() : count(0) {}
+
+                void add(const std::string& path, FileChangeType type, bool isDirectory) {
+                    Clock::time_point now = Clock::now();
+                    if (count == 0) {
+                        first = now;
+                    }
+                    last = now;
+
+                    auto& index = type == FileChangeType::Rescan ? rescans : paths;
+                    auto found = index.find(path);
+                    if (found == index.end()) {
+                        index.emplace(path, changes.size());
+                        changes.emplace_back(path, type, isDirectory);
+                        count++;
+                        return;
+                    }
+
+                    FileChange& change = changes[found->second];
+                    change.isDirectory = isDirectory;
+                    if (change.type == FileChangeType::Created && type == FileChangeType::Deleted) {
+                        // Came and went within the batch
+                        change.path.clear();
+                        index.erase(found);
+                        count--;
+                    }
+                    else if (change.type == FileChangeType::Created) {
+                        // Still new, whatever happened to it since
+                    }
+                    else if (type == FileChangeType::Created) {
+                        // Replaced: deleted or changed, then created again
+                        change.type = FileChangeType::Changed;
+                    }
+                    else {
+                        change.type = type;
+                    }
+                }
+
+                bool isEmpty() const {
+                    return count == 0;
+                }
+
+                Clock::time_point dueTime(const FileWatcherOptions& options) const {
+                    return std::min(last + std::chrono::milliseconds(options.debounceMilliseconds),
+                        first + std::chrono::milliseconds(options.maxDelayMilliseconds));
+                }
+
+                std::vector<FileChange> take() {
+                    std::vector<FileChange> result;
+                    result.reserve(count);
+                    for (FileChange& change : changes) {
+                        if (!change.path.empty()) {
+                            result.push_back(std::move(change));
+                        }
+                    }
+
+                    changes.clear();
+                    paths.clear();
+                    rescans.clear();
+                    count = 0;
+                    return result;
+                }
+
+            private:
+                std::vector<FileChange> changes;
+                std::unordered_map<std::string, size_t> paths;
+                std::unordered_map<std::string, size_t> rescans;
+                size_t count;
+                Clock::time_point first;
+                Clock::time_point last;
+            };
+        }
+
+        class FileWatcher::Impl {
+        public:
+            Impl(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+                const FileWatcherOptions& options, FileChangeCallback callback)
+                : fileSystem(fileSystem), pool(pool), root(root), options(options), callback(std::move(callback)),
+                  filter(options.files), walkOptions(options.files), stopping(false), watching(false), overflows(0) {
+                // Walks report directories too, so every directory gets a watch
+                walkOptions.includeDirectories = true;
+            }
+
+            // Deliver the changes that are due; returns when the next are
+            Clock::time_point deliver() {
+                std::vector<FileChange> due;
+                Clock::time_point next = Clock::time_point::max();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!changes.isEmpty()) {
+                        next = changes.dueTime(options);
+                        if (next <= Clock::now()) {
+                            due = changes.take();
+                            next = Clock::time_point::max();
+                        }
+                    }
+                }
+
+                if (!due.empty()) {
+                    callback(due);
+                }
+                return next;
+            }
+
+            static int millisecondsUntil(Clock::time_point time) {
+                if (time == Clock::time_point::max()) {
+                    return -1;
+                }
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(time - Clock::now()).count();
+                return remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+            }
+
+            const FileSystem& fileSystem;
+            ThreadPool& pool;
+            std::string root;
+            FileWatcherOptions options;
+            FileChangeCallback callback;
+            WalkFilter filter;
+            WalkOptions walkOptions;
+
+            std::atomic<bool> stopping;
+            bool watching;
+            std::thread thread;
+
+            // Guards the changes and the watch tables
+            mutable std::mutex mutex;
+            ChangeCoalescer changes;
+            size_t overflows;
+
+#if defined(__linux__)
+            static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+            void start() {
+                inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (inotifyFd < 0 || wakeFd < 0) {
+                    return;
+                }
+
+                WalkBatch top;
+                top.directory = root;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // A root refused for lack of watches is retried like any other
+                    watching = addWatch(top) || !unwatched.empty();
+                }
+                if (!watching) {
+                    return;
+                }
+
+                initialWalk = walk(top, std::string_view(), false);
+                thread = std::thread([this] {
+                    run();
+                });
+            }
+
+            void stop() {
+                stopping = true;
+                if (thread.joinable()) {
+                    wake();
+                    thread.join();
+                }
+
+                // Walk callbacks use the watch tables, so finish them first
+                initialWalk.reset();
+                walks.clear();
+                if (inotifyFd >= 0) {
+                    close(inotifyFd);
+                }
+                if (wakeFd >= 0) {
+                    close(wakeFd);
+                }
+            }
+
+            void wake() {
+                if (wakeFd >= 0) {
+                    uint64_t one = 1;
+                    ssize_t written = write(wakeFd, &one, sizeof(one));
+                    (void)written;
+                }
+            }
+
+            // Watch the directory of an entry-less batch; the caller holds the mutex.
+            // A directory the system refuses for lack of watches is kept for retrying.
+            bool addWatch(const WalkBatch& directory) {
+                auto watched = watches.find(directory.directory);
+                if (watched != watches.end()) {
+                    // Ignore files of the directory itself arrive with its own batch
+                    directories[watched->second].ignores = directory.ignores;
+                    return true;
+                }
+
+                int descriptor = inotify_add_watch(inotifyFd, directory.directory.c_str(), kWatchMask);
+                if (descriptor < 0) {
+                    if (errno == ENOSPC || errno == ENOMEM) {
+                        unwatched[directory.directory] = directory;
+                    }
+                    return false;
+                }
+
+                unwatched.erase(directory.directory);
+                directories[descriptor] = directory;
+                watches[directory.directory] = descriptor;
+                return true;
+            }
+
+            // Entry-less batch describing a subdirectory found in a batch
+            static WalkBatch subdirectory(const WalkBatch& parent, std::string_view name) {
+                WalkBatch directory;
+                directory.directory = parent.directory;
+                if (directory.directory.empty() || directory.directory.back() != '/') {
+                    directory.directory.push_back('/');
+                }
+                directory.directory.append(name);
+                directory.relativeDirectory = joinRelative(parent.relativeDirectory, name);
+                directory.ignores = parent.ignores;
+                return directory;
+            }
+
+            // Watch every directory below name in parent, or below parent itself when
+            // name is empty. New directories report what they contain as created,
+            // subdirectories included, since each of them appeared as well.
+            std::unique_ptr<DirectoryWalker> walk(const WalkBatch& parent, std::string_view name, bool reportContents) {
+                WalkCallback visit = [this, reportContents](const WalkBatch& batch) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        WalkBatch self;
+                        self.directory = batch.directory;
+                        self.relativeDirectory = batch.relativeDirectory;
+                        self.ignores = batch.ignores;
+                        addWatch(self);
+
+                        for (const WalkEntry& entry : batch.entries) {
+                            if (entry.isDirectory) {
+                                addWatch(subdirectory(batch, batch.getName(entry)));
+                            }
+                            if (reportContents) {
+                                changes.add(batch.getPath(entry), FileChangeType::Created, entry.isDirectory);
+                            }
+                        }
+                    }
+                    if (reportContents) {
+                        wake();
+                    }
+                    return !stopping;
+                };
+
+                if (name.empty()) {
+                    return std::make_unique<DirectoryWalker>(fileSystem, pool, parent.directory, walkOptions, visit);
+                }
+                return std::make_unique<DirectoryWalker>(fileSystem, pool, parent, name, walkOptions, visit);
+            }
+
+            // Watch every directory below one described by subdirectory(), or by the
+            // root batch
+            std::unique_ptr<DirectoryWalker> walkBelow(const WalkBatch& directory, bool reportContents) {
+                if (directory.relativeDirectory.empty()) {
+                    return walk(directory, std::string_view(), reportContents);
+                }
+
+                size_t slash = directory.relativeDirectory.rfind('/');
+                std::string name = directory.relativeDirectory.substr(slash == std::string::npos ? 0 : slash + 1);
+                WalkBatch parent;
+                parent.directory = directory.directory.substr(0, directory.directory.size() - name.size() - 1);
+                parent.relativeDirectory = slash == std::string::npos ? std::string() : directory.relativeDirectory.substr(0, slash);
+                parent.ignores = directory.ignores;
+                return walk(parent, name, reportContents);
+            }
+
+            // Drop the watches of a directory and everything below it; the caller
+            // holds the mutex
+            void removeSubtree(const std::string& path) {
+                // Siblings such as "foo-bar" sort between "foo" and "foo/", so the
+                // directory itself is found exactly and its descendants from "foo/" on
+                std::string prefix = path + "/";
+                auto below = [&prefix](const std::string& other) {
+                    return other.compare(0, prefix.size(), prefix) == 0;
+                };
+                auto dropWatch = [this](std::map<std::string, int>::iterator it) {
+                    inotify_rm_watch(inotifyFd, it->second);
+                    directories.erase(it->second);
+                    return watches.erase(it);
+                };
+
+                auto found = watches.find(path);
+                if (found != watches.end()) {
+                    dropWatch(found);
+                }
+                for (auto it = watches.lower_bound(prefix); it != watches.end() && below(it->first);) {
+                    it = dropWatch(it);
+                }
+                unwatched.erase(path);
+                for (auto it = unwatched.lower_bound(prefix); it != unwatched.end() && below(it->first);) {
+                    it = unwatched.erase(it);
+                }
+            }
+
+            void handleEvent(const inotify_event& event) {
+                if (event.mask & IN_Q_OVERFLOW) {
+                    // Anything may have been missed, new directories included
+                    overflows++;
+                    changes.add(root, FileChangeType::Rescan, true);
+                    WalkBatch top;
+                    top.directory = root;
+                    walks.push_back(walk(top, std::string_view(), false));
+                    return;
+                }
+
+                auto found = directories.find(event.wd);
+                if (found == directories.end()) {
+                    return;
+                }
+
+                if (event.mask & IN_IGNORED) {
+                    auto watched = watches.find(found->second.directory);
+                    if (watched != watches.end() && watched->second == event.wd) {
+                        watches.erase(watched);
+                    }
+                    directories.erase(found);
+                    return;
+                }
+
+                // Events of a directory itself are reported by its parent, except for
+                // the root
+                if (event.len == 0) {
+                    if ((event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && found->second.relativeDirectory.empty()) {
+                        changes.add(root, FileChangeType::Deleted, true);
+                    }
+                    return;
+                }
+
+                // Copied, as adding watches may move the table's entries
+                WalkBatch directory = found->second;
+                std::string_view name(event.name);
+                std::string relative = joinRelative(directory.relativeDirectory, name);
+                bool isDirectory = (event.mask & IN_ISDIR) != 0;
+                if (filter.isExcluded(relative, isDirectory, directory.ignores.get())) {
+                    return;
+                }
+
+                WalkBatch child = subdirectory(directory, name);
+                if (isDirectory) {
+                    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                        // Watch it right away, then pick up what it already holds
+                        changes.add(child.directory, FileChangeType::Created, true);
+                        addWatch(child);
+                        walks.push_back(walk(directory, name, true));
+                    }
+                    else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        changes.add(child.directory, FileChangeType::Deleted, true);
+                        removeSubtree(child.directory);
+                    }
+                    return;
+                }
+
+                if (!filter.isIncluded(relative)) {
+                    return;
+                }
+                if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                    changes.add(child.directory, FileChangeType::Created, false);
+                }
+                else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    changes.add(child.directory, FileChangeType::Deleted, false);
+                }
+                else if (event.mask & (IN_MODIFY | IN_ATTRIB)) {
+                    changes.add(child.directory, FileChangeType::Changed, false);
+                }
+            }
+
+            void readEvents() {
+                alignas(inotify_event) char buffer[kEventBufferSize];
+                while (true) {
+                    ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+                    if (length <= 0) {
+                        break;
+                    }
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (ssize_t offset = 0; offset < length;) {
+                        const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                        handleEvent(*event);
+                        offset += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+
+            // Try refused directories again; those that get a watch now may have
+            // missed changes, and subdirectories created meanwhile have no watch yet
+            void retryUnwatched() {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::vector<WalkBatch> retry;
+                for (auto& entry : unwatched) {
+                    retry.push_back(entry.second);
+                }
+                for (const WalkBatch& directory : retry) {
+                    if (addWatch(directory)) {
+                        changes.add(directory.directory, FileChangeType::Rescan, true);
+                        walks.push_back(walkBelow(directory, false));
+                    }
+                }
+            }
+
+            void run() {
+                Clock::time_point nextRetry = Clock::now() + std::chrono::milliseconds(options.retryMilliseconds);
+                while (!stopping) {
+                    Clock::time_point next = deliver();
+                    bool anyUnwatched;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        anyUnwatched = !unwatched.empty();
+                    }
+                    if (anyUnwatched) {
+                        next = std::min(next, nextRetry);
+                    }
+
+                    pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+                    if (poll(fds, 2, millisecondsUntil(next)) < 0 && errno != EINTR) {
+                        break;
+                    }
+
+                    if (fds[1].revents & POLLIN) {
+                        uint64_t count;
+                        ssize_t drained = read(wakeFd, &count, sizeof(count));
+                        (void)drained;
+                    }
+                    if (fds[0].revents & POLLIN) {
+                        readEvents();
+                    }
+
+                    // Walks that are over no longer need their walker
+                    for (auto it = walks.begin(); it != walks.end();) {
+                        it = (*it)->isFinished() ? walks.erase(it) : it + 1;
+                    }
+
+                    if (anyUnwatched && Clock::now() >= nextRetry) {
+                        retryUnwatched();
+                        nextRetry = Clock::now() + std::chrono::milliseconds(options.retryMilliseconds);
+                    }
+                }
+            }
+
+            void waitUntilReady() {
+                if (initialWalk) {
+                    initialWalk->wait();
+                }
+            }
+
+            FileWatcherStatus getStatus() const {
+                std::lock_guard<std::mutex> lock(mutex);
+                FileWatcherStatus status;
+                status.watchedDirectories = watches.size();
+                status.unwatchedDirectories = unwatched.size();
+                status.overflows = overflows;
+                return status;
+            }
+
+            int inotifyFd = -1;
+            int wakeFd = -1;
+
+            // Watched directories by descriptor, as entry-less batches that carry the
+            // relative path and ignore rules, and descriptors by path
+            std::unordered_map<int, WalkBatch> directories;
+            std::map<std::string, int> watches;
+            std::map<std::string, WalkBatch> unwatched;
+
+            // Walks adding watches; only the watcher's thread changes walks
+            std::unique_ptr<DirectoryWalker> initialWalk;
+            std::vector<std::unique_ptr<DirectoryWalker>> walks;
+#elif defined(_WIN32)
+            static constexpr DWORD kNotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION;
+
+            void start() {
+                directoryHandle = CreateFileW(std::filesystem::u8path(root).c_str(), FILE_LIST_DIRECTORY,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+                wakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+                readEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+                if (directoryHandle == INVALID_HANDLE_VALUE || !wakeEvent || !readEvent) {
+                    return;
+                }
+
+                watching = true;
+                thread = std::thread([this] {
+                    run();
+                });
+            }
+
+            void stop() {
+                stopping = true;
+                if (thread.joinable()) {
+                    wake();
+                    thread.join();
+                }
+                if (directoryHandle != INVALID_HANDLE_VALUE) {
+                    CloseHandle(directoryHandle);
+                }
+                if (wakeEvent) {
+                    CloseHandle(wakeEvent);
+                }
+                if (readEvent) {
+                    CloseHandle(readEvent);
+                }
+            }
+
+            void wake() {
+                if (wakeEvent) {
+                    SetEvent(wakeEvent);
+                }
+            }
+
+            // The one watch covers excluded directories too, so check every directory
+            // on the way down
+            bool isExcluded(const std::string& relative, bool isDirectory) const {
+                for (size_t slash = relative.find('/'); slash != std::string::npos; slash = relative.find('/', slash + 1)) {
+                    if (filter.isExcluded(std::string_view(relative).substr(0, slash), true, nullptr)) {
+                        return true;
+                    }
+                }
+                return filter.isExcluded(relative, isDirectory, nullptr) || (!isDirectory && !filter.isIncluded(relative));
+            }
+
+            void handleEvents(const char* buffer) {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const char* position = buffer;;) {
+                    const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(position);
+                    std::wstring name(info->FileName, info->FileNameLength / sizeof(wchar_t));
+                    // Paths are UTF-8; the narrow conversion would throw on names outside
+                    // the ANSI code page
+                    std::string relative = std::filesystem::path(name).u8string();
+                    for (char& c : relative) {
+                        if (c == '\\') {
+                            c = '/';
+                        }
+                    }
+
+                    std::string path = (std::filesystem::u8path(root) / name).u8string();
+                    DWORD attributes = GetFileAttributesW(std::filesystem::u8path(path).c_str());
+                    bool isDirectory = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+
+                    if (!isExcluded(relative, isDirectory)) {
+                        switch (info->Action) {
+                        case FILE_ACTION_ADDED:
+                        case FILE_ACTION_RENAMED_NEW_NAME:
+                            changes.add(path, FileChangeType::Created, isDirectory);
+                            break;
+                        case FILE_ACTION_REMOVED:
+                        case FILE_ACTION_RENAMED_OLD_NAME:
+                            changes.add(path, FileChangeType::Deleted, isDirectory);
+                            break;
+                        case FILE_ACTION_MODIFIED:
+                            if (!isDirectory) {
+                                changes.add(path, FileChangeType::Changed, false);
+                            }
+                            break;
+                        }
+                    }
+
+                    if (info->NextEntryOffset == 0) {
+                        break;
+                    }
+                    position += info->NextEntryOffset;
+                }
+            }
+
+            void run() {
+                std::vector<DWORD> buffer(kEventBufferSize / sizeof(DWORD));
+                OVERLAPPED overlapped = {};
+                overlapped.hEvent = readEvent;
+                bool reading = false;
+
+                while (!stopping) {
+                    if (!reading) {
+                        reading = ReadDirectoryChangesW(directoryHandle, buffer.data(), static_cast<DWORD>(kEventBufferSize), TRUE,
+                            kNotifyFilter, nullptr, &overlapped, nullptr) != 0;
+                        if (!reading) {
+                            break;
+                        }
+                    }
+
+                    HANDLE handles[2] = { readEvent, wakeEvent };
+                    int timeout = millisecondsUntil(deliver());
+                    DWORD waited = WaitForMultipleObjects(2, handles, FALSE, timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
+                    if (waited != WAIT_OBJECT_0) {
+                        continue;
+                    }
+
+                    DWORD length = 0;
+                    reading = false;
+                    if (!GetOverlappedResult(directoryHandle, &overlapped, &length, FALSE)) {
+                        break;
+                    }
+                    if (length == 0) {
+                        // The system's buffer overflowed and the events are lost
+                        std::lock_guard<std::mutex> lock(mutex);
+                        overflows++;
+                        changes.add(root, FileChangeType::Rescan, true);
+                        continue;
+                    }
+                    handleEvents(reinterpret_cast<const char*>(buffer.data()));
+                }
+
+                if (reading) {
+                    CancelIoEx(directoryHandle, &overlapped);
+                    DWORD length;
+                    GetOverlappedResult(directoryHandle, &overlapped, &length, TRUE);
+                }
+            }
+
+            void waitUntilReady() {
+            }
+
+            FileWatcherStatus getStatus() const {
+                std::lock_guard<std::mutex> lock(mutex);
+                FileWatcherStatus status;
+                status.watchedDirectories = watching ? 1 : 0;
+                status.overflows = overflows;
+                return status;
+            }
+
+            HANDLE directoryHandle = INVALID_HANDLE_VALUE;
+            HANDLE wakeEvent = nullptr;
+            HANDLE readEvent = nullptr;
+#else
+            // No watch backend on this platform
+            void start() {
+            }
+
+            void stop() {
+            }
+
+            void wake() {
+            }
+
+            void waitUntilReady() {
+            }
+
+            FileWatcherStatus getStatus() const {
+                return FileWatcherStatus();
+            }
+#endif
+        };
+
+        FileWatcher::FileWatcher(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+            const FileWatcherOptions& options, FileChangeCallback callback)
+            : pImpl(std::make_unique<Impl>(fileSystem, pool, root, options, std::move(callback))) {
+            pImpl->start();
+        }
+
+        FileWatcher::~FileWatcher() {
+            pImpl->stop();
+        }
+
+        bool FileWatcher::isWatching() const {
+            return pImpl->watching;
+        }
+
+        void FileWatcher::waitUntilReady() {
+            pImpl->waitUntilReady();
+        }
+
+        FileWatcherStatus FileWatcher::getStatus() const {
+            return pImpl->getStatus();
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "pch.h"
+#include "DirectoryWalker.h"
+
+namespace Vune {
+    namespace Core {
+
+        class FileSystem;
+        class ThreadPool;
+
+        enum class FileChangeType {
+            Created,
+            Changed,
+            Deleted,
+
+            // Events under the path were lost, for instance to a queue overflow or a
+            // directory that could not be watched for a while; rescan it
+            Rescan
+        };
+
+        // A directory that appears or disappears is reported itself; the files of a
+        // new directory are reported as created, while those of a deleted one may not
+        // be reported at all
+        struct FileChange {
+            std::string path;
+            FileChangeType type;
+            bool isDirectory;
+
+            FileChange() : path(), type(FileChangeType::Changed), isDirectory(false) {}
+            FileChange(const std::string& path, FileChangeType type, bool isDirectory)
+                : path(path), type(type), isDirectory(isDirectory) {}
+        };
+
+        // Receives coalesced changes, one call at a time from the watcher's thread
+        using FileChangeCallback = std::function<void(const std::vector<FileChange>&)>;
+
+        struct FileWatcherOptions {
+            // Which files and directories to watch. Excluded and ignored directories
+            // get no watch at all, so a node_modules costs nothing.
+            WalkOptions files;
+
+            // Changes are delivered once none has arrived for this long...
+            int debounceMilliseconds;
+
+            // ...or once the oldest has waited this long, during a steady stream
+            int maxDelayMilliseconds;
+
+            // How often directories that could not be watched are tried again
+            int retryMilliseconds;
+
+            FileWatcherOptions()
+                : files(), debounceMilliseconds(50), maxDelayMilliseconds(500), retryMilliseconds(5000) {}
+        };
+
+        struct FileWatcherStatus {
+            size_t watchedDirectories;
+            size_t unwatchedDirectories;   // refused by the system, such as at the watch limit
+            size_t overflows;              // times the event queue overflowed
+
+            FileWatcherStatus() : watchedDirectories(0), unwatchedDirectories(0), overflows(0) {}
+        };
+
+        // Watches a directory tree and reports changes in batches. A burst, such as a
+        // checkout touching thousands of files, is coalesced per path: created and
+        // then deleted is dropped, deleted and then created becomes changed, and so on.
+        //
+        // On Linux every directory gets an inotify watch, added by a DirectoryWalker
+        // and for new directories as they appear, whose contents are then reported as
+        // created since they may predate the watch. When the queue overflows, the tree
+        // is walked again for missing watches and a Rescan of the root is reported.
+        // Directories refused a watch are retried; once they get one, their subtree is
+        // walked for missing watches and a Rescan of them is reported.
+        //
+        // On Windows a single recursive ReadDirectoryChangesW watch covers the tree;
+        // exclude globs filter its events but ignore files do not.
+        class FileWatcher {
+        public:
+            // Starts watching right away; watches are added in the background
+            FileWatcher(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+                const FileWatcherOptions& options, FileChangeCallback callback);
+
+            // Stops watching and waits for the watcher's thread
+            ~FileWatcher();
+
+            // False if watching could not start, for instance on an unsupported
+            // platform or when the root does not exist
+            bool isWatching() const;
+
+            // Block until the tree has its initial watches. Changes made before are
+            // not necessarily reported. Must not be called from a thread of the pool.
+            void waitUntilReady();
+
+            FileWatcherStatus getStatus() const;
+
+        private:
+            // Prevent copying
+            FileWatcher(const FileWatcher&) = delete;
+            FileWatcher& operator=(const FileWatcher&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,552 @@
+#include "pch.h"
+#include "FuzzyFinder.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <climits>
+#include <mutex>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Paths scored by one pool task
+            const size_t kChunkSize = 16 * 1024;
+
+            // Paths up to 64 bytes long are matched with one bit mask per query
+            // character, for queries of up to kMaxMaskedQuery characters
+            const size_t kMaxMaskedQuery = 32;
+            const size_t kPadding = 64;
+
+            const int kNoMatch = INT_MIN;
+            const int kScoreMatch = 16;
+            const int kScoreGapStart = -3;
+            const int kScoreGapExtension = -1;
+            const int kBonusSeparator = 10;     // right after a path separator
+            const int kBonusBoundary = 8;       // after '_', '-', '.', a space or other punctuation
+            const int kBonusCamelCase = 7;
+            const int kBonusConsecutive = 5;
+            const int kBonusFileName = 24;      // whole match inside the file name
+
+            inline bool isLower(char c) {
+                return c >= 'a' && c <= 'z';
+            }
+
+            inline bool isUpper(char c) {
+                return c >= 'A' && c <= 'Z';
+            }
+
+            inline bool isAlphanumeric(char c) {
+                return isLower(c) || isUpper(c) || (c >= '0' && c <= '9') || static_cast<unsigned char>(c) >= 0x80;
+            }
+
+            // ASCII lowercase, with backslashes turned into slashes so either separator
+            // in a query matches both
+            inline char fold(char c) {
+                return isUpper(c) ? static_cast<char>(c + ('a' - 'A')) : c == '\\' ? '/' : c;
+            }
+
+            // Letters and digits get a bit each, everything else shares the rest
+            inline uint64_t characterBit(char folded) {
+                unsigned char c = static_cast<unsigned char>(folded);
+                if (c >= 'a' && c <= 'z') {
+                    return 1ull << (c - 'a');
+                }
+                if (c >= '0' && c <= '9') {
+                    return 1ull << (26 + c - '0');
+                }
+                return 1ull << (36 + c % 28);
+            }
+
+            struct Query {
+                std::string text;       // spaces removed, and folded unless case-sensitive
+                bool caseSensitive;
+                uint64_t bag;           // characterBit of every character
+            };
+
+            Query parseQuery(const std::string& query) {
+                Query result{ std::string(), false, 0 };
+                for (char c : query) {
+                    result.caseSensitive |= isUpper(c);
+                }
+                for (char c : query) {
+                    if (c != ' ') {
+                        result.text.push_back(result.caseSensitive ? c : fold(c));
+                        result.bag |= characterBit(fold(c));
+                    }
+                }
+                return result;
+            }
+
+            // Whether every match of later also matches earlier, so the matches of
+            // earlier are all later needs to look at
+            bool narrows(const Query& earlier, const Query& later) {
+                if (earlier.caseSensitive && !later.caseSensitive) {
+                    return false;
+                }
+
+                size_t found = 0;
+                for (char c : later.text) {
+                    if (found < earlier.text.size() && (earlier.caseSensitive ? c : fold(c)) == earlier.text[found]) {
+                        found++;
+                    }
+                }
+                return found == earlier.text.size();
+            }
+
+            int bonusAt(const char* path, size_t position) {
+                if (position == 0) {
+                    return kBonusSeparator;
+                }
+
+                char previous = path[position - 1];
+                char current = path[position];
+                if (previous == '/' || previous == '\\') {
+                    return kBonusSeparator;
+                }
+                if (!isAlphanumeric(previous) && isAlphanumeric(current)) {
+                    return kBonusBoundary;
+                }
+                if (isLower(previous) && isUpper(current)) {
+                    return kBonusCamelCase;
+                }
+                return 0;
+            }
+
+            // Offsets of the characters of the shortest match window: where the
+            // earliest complete match ends, back to the latest start that still fits,
+            // then forward again. Returns false if text is not a subsequence.
+            bool locateScalar(const char* haystack, size_t length, const std::string& text, int* positions) {
+                size_t end = 0;
+                for (char c : text) {
+                    while (end < length && haystack[end] != c) {
+                        ++end;
+                    }
+                    if (end == length) {
+                        return false;
+                    }
+                    ++end;
+                }
+
+                size_t start = end;
+                for (size_t i = text.size(); i-- > 0;) {
+                    while (haystack[--start] != text[i]) {
+                    }
+                }
+
+                for (size_t i = 0, position = start; i < text.size(); ++i, ++position) {
+                    while (haystack[position] != text[i]) {
+                        ++position;
+                    }
+                    positions[i] = static_cast<int>(position);
+                }
+                return true;
+            }
+
+            // The same for a path of at most 64 bytes, given a mask per query character
+            // of where it occurs, so each step is a bit scan
+            bool locateMasked(const uint64_t* masks, size_t length, size_t count, int* positions) {
+                const uint64_t valid = length >= 64 ? ~0ull : (1ull << length) - 1;
+                auto after = [valid](unsigned position) {
+                    return position >= 63 ? 0 : valid & (~0ull << (position + 1));
+                };
+
+                uint64_t allowed = valid;
+                unsigned end = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    uint64_t candidates = masks[i] & allowed;
+                    if (!candidates) {
+                        return false;
+                    }
+                    end = countTrailingZeros(candidates);
+                    allowed = after(end);
+                }
+
+                uint64_t before = end >= 63 ? ~0ull : (2ull << end) - 1;
+                unsigned start = end;
+                for (size_t i = count; i-- > 0;) {
+                    start = highestSetBit(masks[i] & before);
+                    before = (1ull << start) - 1;
+                }
+
+                allowed = valid & (~0ull << start);
+                for (size_t i = 0; i < count; ++i) {
+                    unsigned position = countTrailingZeros(masks[i] & allowed);
+                    positions[i] = static_cast<int>(position);
+                    allowed = after(position);
+                }
+                return true;
+            }
+
+            int scorePositions(const char* path, size_t length, const int* positions, size_t count) {
+                int score = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    int bonus = bonusAt(path, positions[i]);
+                    if (i > 0 && positions[i] == positions[i - 1] + 1) {
+                        bonus = std::max(bonus, kBonusConsecutive);
+                    }
+                    else if (i > 0) {
+                        score += kScoreGapStart + kScoreGapExtension * (positions[i] - positions[i - 1] - 2);
+                    }
+                    score += kScoreMatch + (i == 0 ? bonus * 2 : bonus);
+                }
+
+                size_t nameStart = length;
+                while (nameStart > 0 && path[nameStart - 1] != '/' && path[nameStart - 1] != '\\') {
+                    --nameStart;
+                }
+                if (static_cast<size_t>(positions[0]) >= nameStart) {
+                    score += kBonusFileName;
+                }
+                return score;
+            }
+
+            // Bit i of masks[k] is set when byte i of the 64 at data equals query[k]
+            using MaskFunction = void(*)(const char*, const char*, size_t, uint64_t*);
+
+            void masksScalar(const char* data, const char* query, size_t queryLength, uint64_t* masks) {
+                for (size_t k = 0; k < queryLength; ++k) {
+                    uint64_t mask = 0;
+                    for (size_t i = 0; i < 64; ++i) {
+                        mask |= static_cast<uint64_t>(data[i] == query[k]) << i;
+                    }
+                    masks[k] = mask;
+                }
+            }
+
+            // Indexes of the masks that contain every bit of required, appended to out;
+            // returns how many
+            using FilterFunction = size_t(*)(const uint64_t*, size_t, uint64_t, uint32_t, uint32_t*);
+
+            size_t filterScalar(const uint64_t* bags, size_t count, uint64_t required, uint32_t first, uint32_t* out) {
+                size_t found = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    out[found] = first + static_cast<uint32_t>(i);
+                    found += (bags[i] & required) == required;
+                }
+                return found;
+            }
+
+#ifdef VUNE_X86
+            VUNE_TARGET("sse2")
+            size_t filterSse2(const uint64_t* bags, size_t count, uint64_t required, uint32_t first, uint32_t* out) {
+                const __m128i wanted = _mm_set1_epi64x(static_cast<long long>(required));
+                const __m128i zero = _mm_setzero_si128();
+
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 2 <= count; i += 2) {
+                    // Bits wanted but missing; a lane passes when all of it is zero
+                    __m128i missing = _mm_andnot_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bags + i)), wanted);
+                    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero)));
+                    out[found] = first + static_cast<uint32_t>(i);
+                    found += (mask & 0xFF) == 0xFF;
+                    out[found] = first + static_cast<uint32_t>(i + 1);
+                    found += (mask >> 8) == 0xFF;
+                }
+
+                return found + filterScalar(bags + i, count - i, required, first + static_cast<uint32_t>(i), out + found);
+            }
+
+            VUNE_TARGET("avx2")
+            size_t filterAvx2(const uint64_t* bags, size_t count, uint64_t required, uint32_t first, uint32_t* out) {
+                const __m256i wanted = _mm256_set1_epi64x(static_cast<long long>(required));
+                const __m256i zero = _mm256_setzero_si256();
+
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    __m256i missing = _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bags + i)), wanted);
+                    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(missing, zero))));
+                    while (mask) {
+                        out[found++] = first + static_cast<uint32_t>(i + countTrailingZeros(mask));
+                        mask &= mask - 1;
+                    }
+                }
+
+                return found + filterScalar(bags + i, count - i, required, first + static_cast<uint32_t>(i), out + found);
+            }
+
+            VUNE_TARGET("sse2")
+            void masksSse2(const char* data, const char* query, size_t queryLength, uint64_t* masks) {
+                __m128i blocks[4];
+                for (int b = 0; b < 4; ++b) {
+                    blocks[b] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + b * 16));
+                }
+
+                for (size_t k = 0; k < queryLength; ++k) {
+                    const __m128i c = _mm_set1_epi8(query[k]);
+                    uint64_t mask = 0;
+                    for (int b = 0; b < 4; ++b) {
+                        mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(blocks[b], c)))) << (b * 16);
+                    }
+                    masks[k] = mask;
+                }
+            }
+
+            VUNE_TARGET("avx2")
+            void masksAvx2(const char* data, const char* query, size_t queryLength, uint64_t* masks) {
+                const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+                const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+
+                for (size_t k = 0; k < queryLength; ++k) {
+                    const __m256i c = _mm256_set1_epi8(query[k]);
+                    uint32_t lowMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, c)));
+                    uint32_t highMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, c)));
+                    masks[k] = static_cast<uint64_t>(highMask) << 32 | lowMask;
+                }
+            }
+#endif
+
+            struct MatchImplementation {
+                FilterFunction filter;
+                MaskFunction masks;
+            };
+
+            const MatchImplementation& selectImplementation() {
+                static const MatchImplementation implementation = []() -> MatchImplementation {
+#ifdef VUNE_X86
+                    if (CpuFeatures::hasAvx2()) {
+                        return { filterAvx2, masksAvx2 };
+                    }
+                    if (CpuFeatures::hasSse2()) {
+                        return { filterSse2, masksSse2 };
+                    }
+#endif
+                    return { filterScalar, masksScalar };
+                }();
+                return implementation;
+            }
+        }
+
+        class FuzzyFinder::Impl {
+        public:
+            Impl() : offsets(1, 0), cacheValid(false) {}
+
+            void add(const std::vector<std::string>& paths) {
+                text.resize(offsets.back());
+                foldedText.resize(offsets.back());
+                for (const auto& path : paths) {
+                    uint64_t bag = 0;
+                    for (char c : path) {
+                        char folded = fold(c);
+                        foldedText.push_back(folded);
+                        bag |= characterBit(folded);
+                    }
+                    text += path;
+                    offsets.push_back(static_cast<uint32_t>(text.size()));
+                    bags.push_back(bag);
+                }
+
+                text.append(kPadding, '\0');
+                foldedText.append(kPadding, '\0');
+                cacheValid = false;
+            }
+
+            size_t count() const {
+                return bags.size();
+            }
+
+            uint32_t lengthOf(uint32_t index) const {
+                return offsets[index + 1] - offsets[index];
+            }
+
+            // Score of a path, or kNoMatch
+            int score(uint32_t index, const Query& query, std::vector<int>* positions) const {
+                const char* path = text.data() + offsets[index];
+                const char* haystack = query.caseSensitive ? path : foldedText.data() + offsets[index];
+                size_t length = lengthOf(index);
+                size_t count = query.text.size();
+
+                thread_local std::vector<int> located;
+                located.resize(count);
+                bool found;
+                if (length <= 64 && count <= kMaxMaskedQuery) {
+                    uint64_t masks[kMaxMaskedQuery];
+                    selectImplementation().masks(haystack, query.text.data(), count, masks);
+                    found = locateMasked(masks, length, count, located.data());
+                }
+                else {
+                    found = locateScalar(haystack, length, query.text, located.data());
+                }
+
+                if (!found) {
+                    return kNoMatch;
+                }
+                if (positions) {
+                    positions->assign(located.begin(), located.end());
+                }
+                return scorePositions(path, length, located.data(), count);
+            }
+
+
+            // Higher score, then shorter path, then earlier index
+            bool better(const FuzzyMatch& left, const FuzzyMatch& right) const {
+                if (left.score != right.score) {
+                    return left.score > right.score;
+                }
+                uint32_t leftLength = lengthOf(left.index);
+                uint32_t rightLength = lengthOf(right.index);
+                return leftLength != rightLength ? leftLength < rightLength : left.index < right.index;
+            }
+
+            // Keep only the best limit matches, unordered
+            void keepBest(std::vector<FuzzyMatch>& matches, size_t limit) const {
+                if (matches.size() > limit) {
+                    auto compare = [this](const FuzzyMatch& left, const FuzzyMatch& right) {
+                        return better(left, right);
+                    };
+                    std::nth_element(matches.begin(), matches.begin() + limit, matches.end(), compare);
+                    matches.resize(limit);
+                }
+            }
+
+            // Arena of every path, and a copy folded for matching; both end in
+            // kPadding zero bytes so 64-byte loads at any path stay inside
+            std::string text;
+            std::string foldedText;
+            std::vector<uint32_t> offsets;  // start of each path, then the end
+            std::vector<uint64_t> bags;     // characterBit of every character of a path
+
+            // Every path the last query matched, ascending
+            bool cacheValid;
+            Query cachedQuery;
+            std::vector<uint32_t> cachedMatches;
+
+            std::mutex mutex;
+        };
+
+        FuzzyFinder::FuzzyFinder() : pImpl(std::make_unique<Impl>()) {
+        }
+
+        FuzzyFinder::~FuzzyFinder() {
+        }
+
+        void FuzzyFinder::setPaths(const std::vector<std::string>& paths) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            pImpl->text.clear();
+            pImpl->foldedText.clear();
+            pImpl->offsets.assign(1, 0);
+            pImpl->bags.clear();
+            pImpl->add(paths);
+        }
+
+        void FuzzyFinder::addPaths(const std::vector<std::string>& paths) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            pImpl->add(paths);
+        }
+
+        size_t FuzzyFinder::getPathCount() const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            return pImpl->count();
+        }
+
+        std::string FuzzyFinder::getPath(uint32_t index) const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            if (index >= pImpl->count()) {
+                return "";
+            }
+            return pImpl->text.substr(pImpl->offsets[index], pImpl->lengthOf(index));
+        }
+
+        std::vector<FuzzyMatch> FuzzyFinder::find(ThreadPool& pool, const std::string& query, size_t maxResults) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            Impl& impl = *pImpl;
+            Query parsed = parseQuery(query);
+            std::vector<FuzzyMatch> result;
+
+            if (parsed.text.empty()) {
+                for (uint32_t index = 0; index < impl.count() && result.size() < maxResults; ++index) {
+                    result.emplace_back(index, 0);
+                }
+                return result;
+            }
+
+            // Search the previous matches if this query can only narrow them
+            bool reuse = impl.cacheValid && narrows(impl.cachedQuery, parsed);
+            size_t total = reuse ? impl.cachedMatches.size() : impl.count();
+            size_t chunkCount = (total + kChunkSize - 1) / kChunkSize;
+
+            struct Chunk {
+                std::vector<uint32_t> matched;
+                std::vector<FuzzyMatch> best;
+            };
+            std::vector<Chunk> chunks(chunkCount);
+
+            {
+                TaskGroup group(pool);
+                for (size_t c = 0; c < chunkCount; ++c) {
+                    group.run([&, c] {
+                        size_t first = c * kChunkSize;
+                        size_t count = std::min(kChunkSize, total - first);
+                        thread_local std::vector<uint32_t> candidates;
+                        candidates.resize(count);
+
+                        size_t found;
+                        if (reuse) {
+                            found = 0;
+                            for (size_t i = 0; i < count; ++i) {
+                                uint32_t index = impl.cachedMatches[first + i];
+                                candidates[found] = index;
+                                found += (impl.bags[index] & parsed.bag) == parsed.bag;
+                            }
+                        }
+                        else {
+                            found = selectImplementation().filter(impl.bags.data() + first, count, parsed.bag, static_cast<uint32_t>(first), candidates.data());
+                        }
+
+                        // The best matches so far form a heap with the worst of them on top
+                        Chunk& chunk = chunks[c];
+                        auto better = [&impl](const FuzzyMatch& left, const FuzzyMatch& right) {
+                            return impl.better(left, right);
+                        };
+                        for (size_t i = 0; i < found; ++i) {
+                            int score = impl.score(candidates[i], parsed, nullptr);
+                            if (score == kNoMatch) {
+                                continue;
+                            }
+
+                            chunk.matched.push_back(candidates[i]);
+                            FuzzyMatch match(candidates[i], score);
+                            if (chunk.best.size() < maxResults) {
+                                chunk.best.push_back(match);
+                                std::push_heap(chunk.best.begin(), chunk.best.end(), better);
+                            }
+                            else if (maxResults > 0 && better(match, chunk.best.front())) {
+                                std::pop_heap(chunk.best.begin(), chunk.best.end(), better);
+                                chunk.best.back() = match;
+                                std::push_heap(chunk.best.begin(), chunk.best.end(), better);
+                            }
+                        }
+                    });
+                }
+                group.wait();
+            }
+
+            std::vector<uint32_t> matched;
+            for (auto& chunk : chunks) {
+                matched.insert(matched.end(), chunk.matched.begin(), chunk.matched.end());
+                result.insert(result.end(), chunk.best.begin(), chunk.best.end());
+            }
+            impl.cachedQuery = parsed;
+            impl.cachedMatches.swap(matched);
+            impl.cacheValid = true;
+
+            impl.keepBest(result, maxResults);
+            std::sort(result.begin(), result.end(), [&impl](const FuzzyMatch& left, const FuzzyMatch& right) {
+                return impl.better(left, right);
+            });
+            return result;
+        }
+
+        std::vector<int> FuzzyFinder::getMatchPositions(const std::string& query, uint32_t index) const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            std::vector<int> positions;
+            if (index < pImpl->count() && pImpl->score(index, parseQuery(query), &positions) == kNoMatch) {
+                positions.clear();
+            }
+            return positions;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        class ThreadPool;
+
+        struct FuzzyMatch {
+            uint32_t index;     // into the finder's paths
+            int score;          // higher is better
+
+            FuzzyMatch() : index(0), score(0) {}
+            FuzzyMatch(uint32_t index, int score) : index(index), score(score) {}
+        };
+
+        // Quick-open matcher over workspace paths. A path matches when the query's
+        // characters appear in it in order; matches at word starts, in the file name
+        // and next to each other score higher. Queries are case-insensitive unless they
+        // contain an uppercase letter, and spaces in them are ignored.
+        //
+        // Paths live in one packed arena next to a 64-bit mask of the characters each
+        // one contains. A vectorized pass over the masks rejects most paths before any
+        // of their bytes are read, and the rest are scored in parallel chunks, each
+        // keeping only its best results. When a query extends the previous one, only
+        // the previous matches are searched again.
+        class FuzzyFinder {
+        public:
+            FuzzyFinder();
+            ~FuzzyFinder();
+
+            // Replace the paths; indexes in results refer to this list
+            void setPaths(const std::vector<std::string>& paths);
+
+            // Append paths after the current ones
+            void addPaths(const std::vector<std::string>& paths);
+
+            size_t getPathCount() const;
+            std::string getPath(uint32_t index) const;
+
+            // The best maxResults matches, best first
+            std::vector<FuzzyMatch> find(ThreadPool& pool, const std::string& query, size_t maxResults);
+
+            // Byte offsets in a path of the characters a query matched, for
+            // highlighting; empty if it does not match
+            std::vector<int> getMatchPositions(const std::string& query, uint32_t index) const;
+
+        private:
+            // Prevent copying
+            FuzzyFinder(const FuzzyFinder&) = delete;
+            FuzzyFinder& operator=(const FuzzyFinder&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
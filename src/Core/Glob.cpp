@@ -0,0 +1,384 @@
+#include "pch.h"
+#include "Glob.h"
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            inline char toLower(char c) {
+                return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+            }
+
+            inline bool sameCharacter(char a, char b, bool caseSensitive) {
+                return caseSensitive ? a == b : toLower(a) == toLower(b);
+            }
+
+            bool isSpecial(char c) {
+                return c == '*' || c == '?' || c == '[' || c == '\\';
+            }
+
+            // Index of the bracket closing a character class opened at start, or npos
+            size_t findClassEnd(std::string_view pattern, size_t start) {
+                size_t i = start + 1;
+                if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^')) {
+                    ++i;
+                }
+                // A leading ']' is a member, not the end
+                if (i < pattern.size() && pattern[i] == ']') {
+                    ++i;
+                }
+                for (; i < pattern.size(); ++i) {
+                    if (pattern[i] == ']') {
+                        return i;
+                    }
+                }
+                return std::string_view::npos;
+            }
+
+            bool matchClass(std::string_view members, char c, bool caseSensitive) {
+                bool negated = !members.empty() && (members[0] == '!' || members[0] == '^');
+                if (negated) {
+                    members.remove_prefix(1);
+                }
+
+                bool found = false;
+                for (size_t i = 0; i < members.size() && !found; ++i) {
+                    if (i + 2 < members.size() && members[i + 1] == '-') {
+                        char low = members[i];
+                        char high = members[i + 2];
+                        found = (c >= low && c <= high) ||
+                            (!caseSensitive && ((toLower(c) >= toLower(low) && toLower(c) <= toLower(high))));
+                        i += 2;
+                    }
+                    else {
+                        found = sameCharacter(members[i], c, caseSensitive);
+                    }
+                }
+                return found != negated;
+            }
+
+            // Match one pattern character at p against c; sets length to the pattern
+            // characters it used
+            bool matchCharacter(std::string_view pattern, size_t p, char c, bool caseSensitive, size_t& length) {
+                char expected = pattern[p];
+                length = 1;
+                if (expected == '?') {
+                    return true;
+                }
+                if (expected == '[') {
+                    size_t end = findClassEnd(pattern, p);
+                    if (end != std::string_view::npos) {
+                        length = end - p + 1;
+                        return matchClass(pattern.substr(p + 1, end - p - 1), c, caseSensitive);
+                    }
+                }
+                else if (expected == '\\' && p + 1 < pattern.size()) {
+                    expected = pattern[p + 1];
+                    length = 2;
+                }
+                return sameCharacter(expected, c, caseSensitive);
+            }
+
+            // Match one segment, where any run of stars is a single star. Only the
+            // latest star is retried, which is enough since every other element
+            // takes exactly one character, so this runs in O(pattern * name).
+            bool matchSegment(std::string_view pattern, std::string_view name, bool caseSensitive) {
+                size_t p = 0;
+                size_t s = 0;
+                size_t star = std::string_view::npos;
+                size_t mark = 0;
+                size_t length = 0;
+                while (s < name.size()) {
+                    if (p < pattern.size() && pattern[p] == '*') {
+                        while (p < pattern.size() && pattern[p] == '*') {
+                            ++p;
+                        }
+                        star = p;
+                        mark = s;
+                    }
+                    else if (p < pattern.size() && matchCharacter(pattern, p, name[s], caseSensitive, length)) {
+                        p += length;
+                        ++s;
+                    }
+                    else if (star != std::string_view::npos) {
+                        p = star;
+                        s = ++mark;
+                    }
+                    else {
+                        return false;
+                    }
+                }
+                while (p < pattern.size() && pattern[p] == '*') {
+                    ++p;
+                }
+                return p == pattern.size();
+            }
+
+            // Start of the segment after the one at position, or npos after the last
+            size_t nextSegment(std::string_view text, size_t position) {
+                size_t slash = text.find('/', position);
+                return slash == std::string_view::npos ? slash : slash + 1;
+            }
+
+            // Match segment by segment. A segment that is exactly "**" spans any
+            // number of path segments, and at the end at least one; elsewhere "**"
+            // is an ordinary star and stays within its segment. Like the star within
+            // a segment, only the latest "**" is retried.
+            bool matchGlob(std::string_view pattern, std::string_view path, bool caseSensitive) {
+                const size_t done = std::string_view::npos;
+                size_t p = 0;
+                size_t s = 0;
+                size_t globstar = done;
+                size_t mark = 0;
+                while (true) {
+                    if (p != done) {
+                        size_t next = nextSegment(pattern, p);
+                        std::string_view segment = pattern.substr(p, next == done ? done : next - 1 - p);
+                        if (segment == "**") {
+                            if (next == done) {
+                                return s != done;
+                            }
+                            globstar = next;
+                            mark = s;
+                            p = next;
+                            continue;
+                        }
+                        if (s != done) {
+                            size_t after = nextSegment(path, s);
+                            if (matchSegment(segment, path.substr(s, after == done ? done : after - 1 - s), caseSensitive)) {
+                                p = next;
+                                s = after;
+                                continue;
+                            }
+                        }
+                    }
+                    else if (s == done) {
+                        return true;
+                    }
+
+                    // Let the latest "**" take one more segment
+                    if (globstar == done || mark == done) {
+                        return false;
+                    }
+                    mark = nextSegment(path, mark);
+                    p = globstar;
+                    s = mark;
+                }
+            }
+
+            // Replace the first brace group with each of its alternatives, recursively
+            void expandBraces(const std::string& pattern, std::vector<std::string>& result) {
+                size_t open = std::string::npos;
+                size_t close = std::string::npos;
+                std::vector<size_t> commas;
+                int depth = 0;
+                for (size_t i = 0; i < pattern.size() && close == std::string::npos; ++i) {
+                    char c = pattern[i];
+                    if (c == '\\') {
+                        ++i;
+                    }
+                    else if (c == '{') {
+                        if (depth++ == 0) {
+                            open = i;
+                        }
+                    }
+                    else if (c == ',' && depth == 1) {
+                        commas.push_back(i);
+                    }
+                    else if (c == '}' && depth > 0 && --depth == 0) {
+                        close = i;
+                    }
+                }
+
+                if (close == std::string::npos) {
+                    result.push_back(pattern);
+                    return;
+                }
+
+                std::string prefix = pattern.substr(0, open);
+                std::string suffix = pattern.substr(close + 1);
+                commas.push_back(close);
+                size_t start = open + 1;
+                for (size_t comma : commas) {
+                    expandBraces(prefix + pattern.substr(start, comma - start) + suffix, result);
+                    start = comma + 1;
+                }
+            }
+
+            bool endsWith(std::string_view text, std::string_view suffix, bool caseSensitive) {
+                if (text.size() < suffix.size()) {
+                    return false;
+                }
+                text.remove_prefix(text.size() - suffix.size());
+                if (caseSensitive) {
+                    return text == suffix;
+                }
+                for (size_t i = 0; i < suffix.size(); ++i) {
+                    if (toLower(text[i]) != toLower(suffix[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool hasSpecial(std::string_view text) {
+                for (char c : text) {
+                    if (isSpecial(c)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+
+        Glob::Glob() : pattern(), caseSensitive(true), alternatives() {
+        }
+
+        Glob::Glob(const std::string& pattern, bool caseSensitive)
+            : pattern(pattern), caseSensitive(caseSensitive), alternatives() {
+            std::vector<std::string> expanded;
+            expandBraces(pattern, expanded);
+
+            for (std::string& text : expanded) {
+                Alternative alternative;
+                std::string_view view = text;
+
+                // "**/name" and "**/*.ext" reduce to string tests when the rest is literal
+                bool anyDepth = view.compare(0, 3, "**/") == 0;
+                size_t tailStart = anyDepth && view.size() > 3 && view[3] == '*' ? 4 : 3;
+                bool literalTail = anyDepth && !hasSpecial(view.substr(tailStart)) && view.find('/', tailStart) == std::string_view::npos;
+                if (!hasSpecial(view)) {
+                    alternative.kind = Alternative::Literal;
+                    alternative.text = text;
+                }
+                else if (literalTail && tailStart == 3) {
+                    alternative.kind = Alternative::Name;
+                    alternative.text = text.substr(2);
+                }
+                else if (literalTail) {
+                    alternative.kind = Alternative::Suffix;
+                    alternative.text = text.substr(tailStart);
+                }
+                else {
+                    alternative.kind = Alternative::General;
+                    alternative.text = std::move(text);
+                }
+                alternatives.push_back(std::move(alternative));
+            }
+        }
+
+        bool Glob::matches(std::string_view path) const {
+            for (const Alternative& alternative : alternatives) {
+                switch (alternative.kind) {
+                case Alternative::Literal:
+                    if (path.size() == alternative.text.size() && endsWith(path, alternative.text, caseSensitive)) {
+                        return true;
+                    }
+                    break;
+                case Alternative::Name:
+                    // text is "/name": the whole path, or its last segment
+                    if ((path.size() + 1 == alternative.text.size() && endsWith(path, std::string_view(alternative.text).substr(1), caseSensitive)) ||
+                        endsWith(path, alternative.text, caseSensitive)) {
+                        return true;
+                    }
+                    break;
+                case Alternative::Suffix:
+                    if (endsWith(path, alternative.text, caseSensitive)) {
+                        return true;
+                    }
+                    break;
+                case Alternative::General:
+                    if (matchGlob(alternative.text, path, caseSensitive)) {
+                        return true;
+                    }
+                    break;
+                }
+            }
+            return false;
+        }
+
+        void IgnoreRules::add(std::string_view content) {
+            while (!content.empty()) {
+                size_t lineEnd = content.find('\n');
+                std::string_view line = content.substr(0, lineEnd);
+                content.remove_prefix(lineEnd == std::string_view::npos ? content.size() : lineEnd + 1);
+
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+
+                // Trailing spaces are dropped unless escaped
+                while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+                    line.remove_suffix(1);
+                }
+                if (line.empty() || line[0] == '#') {
+                    continue;
+                }
+
+                Rule rule;
+                rule.negated = line[0] == '!';
+                if (rule.negated) {
+                    line.remove_prefix(1);
+                }
+                else if (line[0] == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!')) {
+                    line.remove_prefix(1);
+                }
+
+                rule.directoryOnly = !line.empty() && line.back() == '/';
+                if (rule.directoryOnly) {
+                    line.remove_suffix(1);
+                }
+                if (line.empty()) {
+                    continue;
+                }
+
+                std::string pattern;
+                if (line[0] == '/') {
+                    pattern.assign(line.substr(1));
+                }
+                else if (line.find('/') != std::string_view::npos) {
+                    pattern.assign(line);
+                }
+                else {
+                    pattern = "**/";
+                    pattern.append(line);
+                }
+
+                // Braces are literal in ignore files
+                std::string escaped;
+                for (char c : pattern) {
+                    if (c == '{' || c == '}' || c == ',') {
+                        escaped.push_back('\\');
+                    }
+                    escaped.push_back(c);
+                }
+                rule.glob = Glob(escaped);
+                rules.push_back(std::move(rule));
+            }
+        }
+
+        IgnoreRules::Match IgnoreRules::match(std::string_view path, bool isDirectory) const {
+            for (auto it = rules.rbegin(); it != rules.rend(); ++it) {
+                if (it->directoryOnly && !isDirectory) {
+                    continue;
+                }
+                if (it->glob.matches(path)) {
+                    return it->negated ? Match::Included : Match::Ignored;
+                }
+            }
+            return Match::None;
+        }
+
+        bool IgnoreLevel::isIgnored(const IgnoreLevel* level, std::string_view path, bool isDirectory) {
+            for (; level; level = level->parent.get()) {
+                std::string_view below = level->base.empty() ? path : path.substr(level->base.size() + 1);
+                IgnoreRules::Match match = level->rules.match(below, isDirectory);
+                if (match != IgnoreRules::Match::None) {
+                    return match == IgnoreRules::Match::Ignored;
+                }
+            }
+            return false;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Compiled glob pattern over '/'-separated relative paths:
+        //   *      any run of characters within one path segment
+        //   **     as a whole segment, any number of segments ("a/**/b", "**/x");
+        //          at the end at least one ("x/**"); elsewhere the same as *
+        //   ?      one character other than '/'
+        //   [a-z]  one character of a class; [!a-z] or [^a-z] negates it
+        //   {a,b}  either alternative; braces may nest
+        //   \x     x taken literally
+        class Glob {
+        public:
+            Glob();
+            explicit Glob(const std::string& pattern, bool caseSensitive = true);
+
+            bool matches(std::string_view path) const;
+
+            const std::string& getPattern() const { return pattern; }
+
+        private:
+            // One brace alternative, with a shortcut when it needs no backtracking
+            struct Alternative {
+                enum Kind { Literal, Name, Suffix, General };
+
+                Kind kind;
+                std::string text;   // the whole pattern, or its literal tail
+            };
+
+            std::string pattern;
+            bool caseSensitive;
+            std::vector<Alternative> alternatives;
+        };
+
+        // Rules of one .gitignore-style file. A rule without a slash (other than a
+        // trailing one) matches a name at any depth below the file's directory; one
+        // with a slash is anchored to that directory. A trailing slash limits a rule to
+        // directories, and a leading '!' re-includes what earlier rules ignored. The
+        // last matching rule decides.
+        class IgnoreRules {
+        public:
+            enum class Match { None, Ignored, Included };
+
+            // Parse the contents of an ignore file
+            void add(std::string_view content);
+
+            bool isEmpty() const { return rules.empty(); }
+
+            // Match a '/'-separated path relative to the ignore file's directory
+            Match match(std::string_view path, bool isDirectory) const;
+
+        private:
+            struct Rule {
+                Glob glob;
+                bool negated;
+                bool directoryOnly;
+            };
+
+            std::vector<Rule> rules;
+        };
+
+        // Ignore rules of one directory, linked to those of the directories above it.
+        // Subdirectories share the chain, so each ignore file is read once.
+        struct IgnoreLevel {
+            std::string base;   // '/'-separated directory of the ignore files
+            IgnoreRules rules;
+            std::shared_ptr<const IgnoreLevel> parent;
+
+            // Whether a path below level's directory is ignored; the deepest directory
+            // with a matching rule decides. level may be null.
+            static bool isIgnored(const IgnoreLevel* level, std::string_view path, bool isDirectory);
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
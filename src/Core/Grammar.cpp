@@ -0,0 +1,281 @@
+#include "pch.h"
+#include "Grammar.h"
+#include <deque>
+#include <regex>
+#include <set>
+#include <stdexcept>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Rule with its expressions compiled and includes resolved
+            struct CompiledRule {
+                bool isSpan;
+                std::regex match;   // the begin expression of a span
+                std::regex end;
+                int scope;          // -1 keeps the enclosing scope
+                std::vector<const CompiledRule*> patterns;
+            };
+
+            // Stack of open spans. Lines that end in the same spans share a state.
+            class SpanState : public TokenizerState {
+            public:
+                SpanState(std::shared_ptr<const SpanState> parent, const CompiledRule* rule, int scope)
+                    : parent(std::move(parent)), rule(rule), scope(scope), depth(this->parent ? this->parent->depth + 1 : 0) {
+                }
+
+                bool equals(const TokenizerState& other) const override {
+                    const SpanState* right = dynamic_cast<const SpanState*>(&other);
+                    if (!right || right->depth != depth) {
+                        return false;
+                    }
+
+                    for (const SpanState* left = this; left && left != right; left = left->parent.get(), right = right->parent.get()) {
+                        if (left->rule != right->rule || left->scope != right->scope) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                std::shared_ptr<const SpanState> parent;
+                const CompiledRule* rule;
+                int scope;
+                size_t depth;
+            };
+
+            // Where an expression next matches in the line; searched lazily and reused
+            // while the cursor has not passed the match
+            struct CachedMatch {
+                bool searched;
+                bool found;
+                size_t start;
+                size_t end;
+            };
+
+            void appendToken(std::vector<Token>& tokens, size_t lineTokens, size_t start, int scope) {
+                if (tokens.size() > lineTokens) {
+                    Token& last = tokens.back();
+                    if (last.scope == scope) {
+                        return;
+                    }
+                    if (last.start == static_cast<int>(start)) {
+                        last.scope = scope;
+                        if (tokens.size() > lineTokens + 1 && tokens[tokens.size() - 2].scope == scope) {
+                            tokens.pop_back();
+                        }
+                        return;
+                    }
+                }
+                tokens.emplace_back(static_cast<int>(start), scope);
+            }
+        }
+
+        class RegexGrammar::Impl {
+        public:
+            Impl(const std::string& scopeName, std::vector<Rule> patterns, std::map<std::string, Rule> repository)
+                : patterns(std::move(patterns)), repository(std::move(repository)) {
+                internScope(scopeName);
+
+                std::set<const Rule*> expanding;
+                resolvePatterns(this->patterns, rootPatterns, expanding);
+                initialState = std::make_shared<SpanState>(nullptr, nullptr, 0);
+            }
+
+            int internScope(const std::string& name) {
+                if (name.empty()) {
+                    return -1;
+                }
+
+                auto found = scopeIds.find(name);
+                if (found != scopeIds.end()) {
+                    return found->second;
+                }
+
+                int id = static_cast<int>(scopeNames.size());
+                scopeNames.push_back(name);
+                scopeIds.emplace(name, id);
+                return id;
+            }
+
+            const CompiledRule* compile(const Rule& rule) {
+                auto found = compiled.find(&rule);
+                if (found != compiled.end()) {
+                    return found->second;
+                }
+
+                auto flags = std::regex::ECMAScript | std::regex::optimize;
+                rules.emplace_back();
+                CompiledRule& result = rules.back();
+                result.isSpan = !rule.begin.empty();
+                result.match = std::regex(result.isSpan ? rule.begin : rule.match, flags);
+                if (result.isSpan) {
+                    result.end = std::regex(rule.end, flags);
+                }
+                result.scope = internScope(rule.scope);
+
+                // Registered before its patterns so spans can contain themselves
+                compiled.emplace(&rule, &result);
+                if (result.isSpan) {
+                    std::set<const Rule*> expanding;
+                    resolvePatterns(rule.patterns, result.patterns, expanding);
+                }
+                return &result;
+            }
+
+            // Flatten includes and groups into a list of compiled rules
+            void resolvePatterns(const std::vector<Rule>& source, std::vector<const CompiledRule*>& target, std::set<const Rule*>& expanding) {
+                for (const auto& rule : source) {
+                    const Rule* resolved = &rule;
+                    if (!rule.include.empty()) {
+                        if (rule.include == "$self") {
+                            if (expanding.insert(&rule).second) {
+                                resolvePatterns(patterns, target, expanding);
+                            }
+                            continue;
+                        }
+
+                        auto found = repository.find(rule.include[0] == '#' ? rule.include.substr(1) : rule.include);
+                        if (found == repository.end()) {
+                            throw std::invalid_argument("Unknown grammar include: " + rule.include);
+                        }
+                        resolved = &found->second;
+                    }
+
+                    if (!resolved->match.empty() || !resolved->begin.empty()) {
+                        target.push_back(compile(*resolved));
+                    }
+                    else if (expanding.insert(resolved).second) {
+                        resolvePatterns(resolved->patterns, target, expanding);
+                    }
+                }
+            }
+
+            std::vector<Rule> patterns;
+            std::map<std::string, Rule> repository;
+            std::deque<CompiledRule> rules;
+            std::map<const Rule*, const CompiledRule*> compiled;
+            std::vector<const CompiledRule*> rootPatterns;
+            std::vector<std::string> scopeNames;
+            std::unordered_map<std::string, int> scopeIds;
+            std::shared_ptr<const SpanState> initialState;
+        };
+
+        RegexGrammar::RegexGrammar(const std::string& scopeName, std::vector<Rule> patterns, std::map<std::string, Rule> repository)
+            : pImpl(std::make_unique<Impl>(scopeName, std::move(patterns), std::move(repository))) {
+        }
+
+        RegexGrammar::~RegexGrammar() {
+        }
+
+        TokenizerStatePtr RegexGrammar::getInitialState() const {
+            return pImpl->initialState;
+        }
+
+        TokenizerStatePtr RegexGrammar::tokenizeLine(std::string_view line, const TokenizerStatePtr& state, std::vector<Token>& tokens) const {
+            auto span = std::dynamic_pointer_cast<const SpanState>(state);
+            if (!span) {
+                span = pImpl->initialState;
+            }
+
+            const char* begin = line.data();
+            const char* end = begin + line.size();
+            size_t lineTokens = tokens.size();
+            size_t position = 0;
+            size_t zeroLengthAt = static_cast<size_t>(-1);
+
+            // Slot 0 is the end of the open span, then its patterns in priority order
+            std::vector<CachedMatch> cache;
+            std::cmatch match;
+
+            while (true) {
+                const std::vector<const CompiledRule*>& patterns = span->rule ? span->rule->patterns : pImpl->rootPatterns;
+                if (cache.empty()) {
+                    cache.assign(patterns.size() + 1, CachedMatch{ false, false, 0, 0 });
+                }
+
+                // Earliest match wins; ties go to the end of the span, then to rule order
+                size_t best = cache.size();
+                for (size_t i = 0; i < cache.size(); ++i) {
+                    if (i == 0 && !span->rule) {
+                        continue;
+                    }
+
+                    CachedMatch& cached = cache[i];
+                    if (!cached.searched || (cached.found && cached.start < position)) {
+                        const std::regex& expression = i == 0 ? span->rule->end : patterns[i - 1]->match;
+                        auto flags = position > 0 ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+                        cached.searched = true;
+                        cached.found = std::regex_search(begin + position, end, match, expression, flags);
+                        if (cached.found) {
+                            cached.start = position + static_cast<size_t>(match.position(0));
+                            cached.end = cached.start + static_cast<size_t>(match.length(0));
+                        }
+                    }
+
+                    if (cached.found && (best == cache.size() || cached.start < cache[best].start)) {
+                        best = i;
+                    }
+                }
+
+                if (best == cache.size()) {
+                    if (position < line.size()) {
+                        appendToken(tokens, lineTokens, position, span->scope);
+                    }
+                    break;
+                }
+
+                CachedMatch found = cache[best];
+                if (found.start > position) {
+                    appendToken(tokens, lineTokens, position, span->scope);
+                }
+
+                // A second empty match at the same place would loop; step over a byte
+                if (found.start == found.end) {
+                    if (found.start == zeroLengthAt || (best > 0 && !patterns[best - 1]->isSpan)) {
+                        if (found.start >= line.size()) {
+                            break;
+                        }
+                        appendToken(tokens, lineTokens, found.start, span->scope);
+                        position = found.start + 1;
+                        cache[best].searched = false;
+                        continue;
+                    }
+                    zeroLengthAt = found.start;
+                }
+
+                if (best == 0) {
+                    // The closing delimiter belongs to the span
+                    appendToken(tokens, lineTokens, found.start, span->scope);
+                    span = span->parent;
+                    cache.clear();
+                }
+                else {
+                    const CompiledRule* rule = patterns[best - 1];
+                    int scope = rule->scope >= 0 ? rule->scope : span->scope;
+                    appendToken(tokens, lineTokens, found.start, scope);
+                    if (rule->isSpan) {
+                        span = std::make_shared<SpanState>(span, rule, scope);
+                        cache.clear();
+                    }
+                }
+
+                if (found.end < line.size() && found.end > found.start) {
+                    appendToken(tokens, lineTokens, found.end, span->scope);
+                }
+                position = found.end;
+            }
+
+            return span;
+        }
+
+        std::string RegexGrammar::getScopeName(int scope) const {
+            if (scope < 0 || static_cast<size_t>(scope) >= pImpl->scopeNames.size()) {
+                return "";
+            }
+            return pImpl->scopeNames[scope];
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
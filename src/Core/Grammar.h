@@ -0,0 +1,94 @@
+#pragma once
+
+#include "pch.h"
+#include <map>
+
+namespace Vune {
+    namespace Core {
+
+        // Token covering a line from start up to the next token's start
+        struct Token {
+            int start;
+            int scope;
+
+            Token() : start(0), scope(0) {}
+            Token(int start, int scope) : start(start), scope(scope) {}
+
+            bool operator==(const Token& other) const {
+                return start == other.start && scope == other.scope;
+            }
+        };
+
+        // Lexer state at the end of a line. States are immutable, so a line cache can
+        // share them between lines and threads.
+        class TokenizerState {
+        public:
+            virtual ~TokenizerState() {}
+
+            // Equal states make the following lines tokenize the same way
+            virtual bool equals(const TokenizerState& other) const = 0;
+        };
+
+        using TokenizerStatePtr = std::shared_ptr<const TokenizerState>;
+
+        // Language grammar. Implementations must allow concurrent calls, since lines
+        // are tokenized on background threads.
+        class Grammar {
+        public:
+            virtual ~Grammar() {}
+
+            // State before the first line
+            virtual TokenizerStatePtr getInitialState() const = 0;
+
+            // Append the tokens of one line (without its line break) in order of start
+            // and return the state at its end
+            virtual TokenizerStatePtr tokenizeLine(std::string_view line, const TokenizerStatePtr& state, std::vector<Token>& tokens) const = 0;
+
+            // Name of a scope id found in tokens, e.g. "string.quoted.double"
+            virtual std::string getScopeName(int scope) const = 0;
+        };
+
+        // TextMate-style grammar built from regular expression rules (ECMAScript
+        // syntax). A match rule gives its scope to each match. A begin/end rule opens
+        // a span at begin that lasts until end, possibly on a later line, and only
+        // its own patterns apply inside it.
+        class RegexGrammar : public Grammar {
+        public:
+            struct Rule {
+                std::string match;
+                std::string begin;
+                std::string end;
+
+                // Scope of the match or span; empty keeps the enclosing scope
+                std::string scope;
+
+                // Rules that apply inside a begin/end span. Without match or begin, the
+                // rule is just a group of these patterns.
+                std::vector<Rule> patterns;
+
+                // Name of a repository rule, or "$self" for the top-level patterns, to
+                // use in place of this rule
+                std::string include;
+            };
+
+            // Throws std::regex_error if a rule does not compile, and
+            // std::invalid_argument if an include names no repository rule
+            RegexGrammar(const std::string& scopeName, std::vector<Rule> patterns, std::map<std::string, Rule> repository = {});
+            ~RegexGrammar();
+
+            TokenizerStatePtr getInitialState() const override;
+            TokenizerStatePtr tokenizeLine(std::string_view line, const TokenizerStatePtr& state, std::vector<Token>& tokens) const override;
+            std::string getScopeName(int scope) const override;
+
+        private:
+            // Prevent copying
+            RegexGrammar(const RegexGrammar&) = delete;
+            RegexGrammar& operator=(const RegexGrammar&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
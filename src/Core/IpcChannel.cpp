@@ -0,0 +1,645 @@
+#include "pch.h"
+#include "IpcChannel.h"
+#include "CpuFeatures.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            using Clock = std::chrono::steady_clock;
+
+            const uint32_t kMagic = 0x43504956; // "VIPC"
+            const size_t kMinRingSize = 64 * 1024;
+
+            // How long a receiver spins before it sleeps
+            const std::chrono::microseconds kSpinTime(50);
+
+            // Record flags
+            const uint16_t kMoreFragments = 1;
+            const uint16_t kPadding = 2;
+            const uint16_t kAbandoned = 4;     // drop the fragments read so far
+
+            static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address-free atomics");
+            static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory needs address-free atomics");
+
+            // Control block of one direction. Positions count bytes ever written and
+            // read; each is written by one side only, on its own cache line.
+            struct RingControl {
+                alignas(64) std::atomic<uint64_t> writePosition;
+                alignas(64) std::atomic<uint64_t> readPosition;
+
+                // Bumped after every write; the receiver sleeps on it
+                alignas(64) std::atomic<uint32_t> signal;
+                std::atomic<uint32_t> sleeping;
+            };
+
+            struct SharedHeader {
+                uint32_t magic;
+                uint32_t ringSize;
+                std::atomic<uint32_t> closed[2];
+                RingControl rings[2];
+            };
+
+            // Records start on 16-byte boundaries, so a record header never wraps
+            struct RecordHeader {
+                uint32_t size;
+                uint16_t type;
+                uint16_t flags;
+                uint64_t id;
+            };
+            static_assert(sizeof(RecordHeader) == 16, "unexpected record header size");
+
+            size_t recordSize(size_t payloadSize) {
+                return (sizeof(RecordHeader) + payloadSize + 15) & ~static_cast<size_t>(15);
+            }
+
+            size_t dataOffset() {
+                return (sizeof(SharedHeader) + 63) & ~static_cast<size_t>(63);
+            }
+
+            std::string uniqueName() {
+                static std::atomic<uint32_t> counter(0);
+#ifdef _WIN32
+                unsigned long processId = GetCurrentProcessId();
+#else
+                unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+                auto ticks = Clock::now().time_since_epoch().count();
+                return "vune-ipc-" + std::to_string(processId) + "-" + std::to_string(counter++) + "-" +
+                    std::to_string(static_cast<uint64_t>(ticks) & 0xffffff);
+            }
+
+            void pause() {
+#if VUNE_X86
+                _mm_pause();
+#else
+                std::this_thread::yield();
+#endif
+            }
+
+            void writeLittleEndian(std::string& buffer, uint64_t value, size_t size) {
+                for (size_t i = 0; i < size; ++i) {
+                    buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+                }
+            }
+        }
+
+        void IpcWriter::writeU8(uint8_t value) {
+            buffer.push_back(static_cast<char>(value));
+        }
+
+        void IpcWriter::writeU32(uint32_t value) {
+            writeLittleEndian(buffer, value, 4);
+        }
+
+        void IpcWriter::writeI32(int32_t value) {
+            writeLittleEndian(buffer, static_cast<uint32_t>(value), 4);
+        }
+
+        void IpcWriter::writeU64(uint64_t value) {
+            writeLittleEndian(buffer, value, 8);
+        }
+
+        void IpcWriter::writeString(std::string_view value) {
+            writeU32(static_cast<uint32_t>(value.size()));
+            buffer.append(value.data(), value.size());
+        }
+
+        size_t IpcWriter::beginString() {
+            size_t offset = buffer.size();
+            writeU32(0);
+            return offset;
+        }
+
+        void IpcWriter::appendToString(std::string_view part) {
+            buffer.append(part.data(), part.size());
+        }
+
+        void IpcWriter::endString(size_t offset) {
+            uint32_t size = static_cast<uint32_t>(buffer.size() - offset - 4);
+            for (size_t i = 0; i < 4; ++i) {
+                buffer[offset + i] = static_cast<char>((size >> (8 * i)) & 0xff);
+            }
+        }
+
+        const std::string& IpcWriter::getBuffer() const {
+            return buffer;
+        }
+
+        void IpcWriter::clear() {
+            buffer.clear();
+        }
+
+        IpcReader::IpcReader(std::string_view data) : data(data), position(0) {
+        }
+
+        bool IpcReader::readLittleEndian(size_t size, uint64_t& value) {
+            if (data.size() - position < size) {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < size; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(data[position + i])) << (8 * i);
+            }
+            position += size;
+            return true;
+        }
+
+        bool IpcReader::readU8(uint8_t& value) {
+            uint64_t bits;
+            if (!readLittleEndian(1, bits)) {
+                return false;
+            }
+            value = static_cast<uint8_t>(bits);
+            return true;
+        }
+
+        bool IpcReader::readU32(uint32_t& value) {
+            uint64_t bits;
+            if (!readLittleEndian(4, bits)) {
+                return false;
+            }
+            value = static_cast<uint32_t>(bits);
+            return true;
+        }
+
+        bool IpcReader::readI32(int32_t& value) {
+            uint32_t bits;
+            if (!readU32(bits)) {
+                return false;
+            }
+            value = static_cast<int32_t>(bits);
+            return true;
+        }
+
+        bool IpcReader::readU64(uint64_t& value) {
+            return readLittleEndian(8, value);
+        }
+
+        bool IpcReader::readString(std::string& value) {
+            std::string_view view;
+            if (!readStringView(view)) {
+                return false;
+            }
+            value.assign(view.data(), view.size());
+            return true;
+        }
+
+        bool IpcReader::readStringView(std::string_view& value) {
+            size_t start = position;
+            uint32_t size;
+            if (!readU32(size)) {
+                return false;
+            }
+            if (data.size() - position < size) {
+                position = start;
+                return false;
+            }
+            value = data.substr(position, size);
+            position += size;
+            return true;
+        }
+
+        bool IpcReader::atEnd() const {
+            return position == data.size();
+        }
+
+        class IpcChannel::Impl {
+        public:
+            Impl() : side(0), header(nullptr), ringSize(0), interrupted(false), assembling(false) {
+#ifdef _WIN32
+                mapping = nullptr;
+                events[0] = events[1] = nullptr;
+#else
+                descriptor = -1;
+                mapLength = 0;
+#endif
+            }
+
+            ~Impl() {
+#ifdef _WIN32
+                if (header) UnmapViewOfFile(header);
+                if (mapping) CloseHandle(mapping);
+                for (HANDLE event : events) {
+                    if (event) CloseHandle(event);
+                }
+#else
+                if (header) munmap(header, mapLength);
+                if (descriptor >= 0) ::close(descriptor);
+                if (side == 0 && !name.empty()) shm_unlink(("/" + name).c_str());
+#endif
+            }
+
+            bool map(size_t length, bool create) {
+#ifdef _WIN32
+                std::wstring wideName(name.begin(), name.end());
+                std::wstring objectName = L"Local\\" + wideName;
+                if (create) {
+                    uint64_t size = length;
+                    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), objectName.c_str());
+                    if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+                        return false;
+                    }
+                }
+                else {
+                    mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, objectName.c_str());
+                }
+                if (!mapping) {
+                    return false;
+                }
+                header = static_cast<SharedHeader*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+                if (!header) {
+                    return false;
+                }
+
+                // One auto-reset event per ring wakes its sleeping receiver
+                for (int i = 0; i < 2; ++i) {
+                    std::wstring eventName = objectName + L"." + std::to_wstring(i);
+                    events[i] = create ? CreateEventW(nullptr, FALSE, FALSE, eventName.c_str())
+                        : OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, eventName.c_str());
+                    if (!events[i]) {
+                        return false;
+                    }
+                }
+                return true;
+#else
+                std::string objectName = "/" + name;
+                descriptor = create ? shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)
+                    : shm_open(objectName.c_str(), O_RDWR, 0);
+                if (descriptor < 0) {
+                    return false;
+                }
+                if (create) {
+                    if (ftruncate(descriptor, static_cast<off_t>(length)) != 0) {
+                        return false;
+                    }
+                }
+                else {
+                    struct stat status;
+                    if (fstat(descriptor, &status) != 0 || static_cast<size_t>(status.st_size) < dataOffset()) {
+                        return false;
+                    }
+                    length = static_cast<size_t>(status.st_size);
+                }
+                void* view = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+                if (view == MAP_FAILED) {
+                    return false;
+                }
+                header = static_cast<SharedHeader*>(view);
+                mapLength = length;
+                return true;
+#endif
+            }
+
+            uint8_t* ringData(int ring) const {
+                return reinterpret_cast<uint8_t*>(header) + dataOffset() + static_cast<size_t>(ring) * ringSize;
+            }
+
+            bool peerClosed() const {
+                return header->closed[1 - side].load(std::memory_order_acquire) != 0;
+            }
+
+            void wake(int ring) {
+#ifdef _WIN32
+                SetEvent(events[ring]);
+#elif defined(__linux__)
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->rings[ring].signal), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+                (void)ring;
+#endif
+            }
+
+            // Sleep until the signal of the ring moves past value or the timeout ends
+            void sleep(int ring, uint32_t value, std::chrono::microseconds timeout) {
+#ifdef _WIN32
+                (void)value;
+                DWORD milliseconds = static_cast<DWORD>((timeout.count() + 999) / 1000);
+                WaitForSingleObject(events[ring], milliseconds);
+#elif defined(__linux__)
+                struct timespec relative;
+                relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+                relative.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->rings[ring].signal), FUTEX_WAIT, value, &relative, nullptr, 0);
+#else
+                // No cross-process wait primitive; poll
+                (void)value;
+                std::this_thread::sleep_for(std::min(timeout, std::chrono::microseconds(100)));
+#endif
+            }
+
+            // Wait for the incoming ring to move past read. Returns false once the
+            // deadline passes.
+            bool waitForData(uint64_t read, bool hasDeadline, Clock::time_point deadline) {
+                int ring = 1 - side;
+                RingControl& control = header->rings[ring];
+
+                // On a single processor spinning only delays the sender
+                static const bool spin = std::thread::hardware_concurrency() > 1;
+                if (spin) {
+                    Clock::time_point spinEnd = Clock::now() + kSpinTime;
+                    if (hasDeadline) {
+                        spinEnd = std::min(spinEnd, deadline);
+                    }
+                    do {
+                        for (int i = 0; i < 64; ++i) {
+                            if (control.writePosition.load(std::memory_order_acquire) != read) {
+                                return true;
+                            }
+                            pause();
+                        }
+                    } while (Clock::now() < spinEnd);
+                }
+
+                // The sender reads sleeping after bumping signal, so either it sees
+                // the flag or the signal read below is already past its write
+                control.sleeping.store(1, std::memory_order_seq_cst);
+                uint32_t signal = control.signal.load(std::memory_order_seq_cst);
+                if (control.writePosition.load(std::memory_order_acquire) == read && !peerClosed()) {
+                    std::chrono::microseconds timeout(1000000);
+                    if (hasDeadline) {
+                        auto now = Clock::now();
+                        if (now >= deadline) {
+                            control.sleeping.store(0, std::memory_order_relaxed);
+                            return false;
+                        }
+                        timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::microseconds>(deadline - now) + std::chrono::microseconds(1));
+                    }
+                    sleep(ring, signal, timeout);
+                }
+                control.sleeping.store(0, std::memory_order_relaxed);
+                return !hasDeadline || Clock::now() < deadline || control.writePosition.load(std::memory_order_acquire) != read;
+            }
+
+            IpcResult writeRecord(uint16_t type, uint64_t id, uint16_t flags, std::string_view payload,
+                bool hasDeadline, Clock::time_point deadline) {
+                RingControl& control = header->rings[side];
+                uint8_t* data = ringData(side);
+                uint64_t write = control.writePosition.load(std::memory_order_relaxed);
+                size_t size = recordSize(payload.size());
+                size_t position = static_cast<size_t>(write & (ringSize - 1));
+                size_t padding = position + size > ringSize ? ringSize - position : 0;
+
+                for (int attempt = 0;; ++attempt) {
+                    uint64_t read = control.readPosition.load(std::memory_order_acquire);
+                    if (ringSize - (write - read) >= padding + size) {
+                        break;
+                    }
+                    if (peerClosed()) {
+                        return IpcResult::Closed;
+                    }
+                    if (hasDeadline && Clock::now() >= deadline) {
+                        return IpcResult::Timeout;
+                    }
+
+                    // A full ring is rare; back off instead of signalling
+                    if (attempt < 64) {
+                        pause();
+                    }
+                    else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(attempt < 1024 ? 0 : 100));
+                    }
+                }
+
+                if (padding) {
+                    RecordHeader skip = { static_cast<uint32_t>(padding - sizeof(RecordHeader)), 0, kPadding, 0 };
+                    std::memcpy(data + position, &skip, sizeof(skip));
+                    write += padding;
+                    position = 0;
+                }
+                RecordHeader record = { static_cast<uint32_t>(payload.size()), type, flags, id };
+                std::memcpy(data + position, &record, sizeof(record));
+                if (!payload.empty()) {
+                    std::memcpy(data + position + sizeof(record), payload.data(), payload.size());
+                }
+                control.writePosition.store(write + size, std::memory_order_release);
+
+                control.signal.fetch_add(1, std::memory_order_seq_cst);
+                if (control.sleeping.load(std::memory_order_seq_cst)) {
+                    wake(side);
+                }
+                return IpcResult::Ok;
+            }
+
+            std::string name;
+
+            // The creator is side 0 and writes ring 0; the other side writes ring 1
+            int side;
+            SharedHeader* header;
+            size_t ringSize;
+
+            // A send stopped after some fragments of its message; the next one first
+            // tells the receiver to drop them
+            bool interrupted;
+
+            // Fragments of a message read so far
+            IpcMessage partial;
+            bool assembling;
+
+#ifdef _WIN32
+            HANDLE mapping;
+            HANDLE events[2];
+#else
+            int descriptor;
+            size_t mapLength;
+#endif
+        };
+
+        IpcChannel::IpcChannel() : pImpl(std::make_unique<Impl>()) {
+        }
+
+        IpcChannel::~IpcChannel() {
+            if (pImpl->header) {
+                close();
+            }
+        }
+
+        std::unique_ptr<IpcChannel> IpcChannel::create(size_t ringSize) {
+            size_t size = kMinRingSize;
+            while (size < ringSize) {
+                size <<= 1;
+                if (size > (static_cast<size_t>(1) << 30)) {
+                    return nullptr;
+                }
+            }
+
+            std::unique_ptr<IpcChannel> channel(new IpcChannel());
+            Impl& impl = *channel->pImpl;
+            impl.name = uniqueName();
+            impl.side = 0;
+            impl.ringSize = size;
+            if (!impl.map(dataOffset() + 2 * size, true)) {
+                return nullptr;
+            }
+
+            SharedHeader* header = new (impl.header) SharedHeader();
+            header->ringSize = static_cast<uint32_t>(size);
+            for (int i = 0; i < 2; ++i) {
+                header->closed[i].store(0, std::memory_order_relaxed);
+                header->rings[i].writePosition.store(0, std::memory_order_relaxed);
+                header->rings[i].readPosition.store(0, std::memory_order_relaxed);
+                header->rings[i].signal.store(0, std::memory_order_relaxed);
+                header->rings[i].sleeping.store(0, std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            header->magic = kMagic;
+            return channel;
+        }
+
+        std::unique_ptr<IpcChannel> IpcChannel::open(const std::string& name) {
+            std::unique_ptr<IpcChannel> channel(new IpcChannel());
+            Impl& impl = *channel->pImpl;
+            impl.name = name;
+            impl.side = 1;
+            if (!impl.map(0, false)) {
+                impl.name.clear();
+                return nullptr;
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t size = impl.header->ringSize;
+            if (impl.header->magic != kMagic || size < kMinRingSize || (size & (size - 1)) != 0) {
+                return nullptr;
+            }
+#ifndef _WIN32
+            if (impl.mapLength < dataOffset() + 2 * static_cast<size_t>(size)) {
+                return nullptr;
+            }
+#endif
+            impl.ringSize = size;
+            return channel;
+        }
+
+        const std::string& IpcChannel::getName() const {
+            return pImpl->name;
+        }
+
+        IpcResult IpcChannel::send(uint16_t type, uint64_t id, std::string_view payload, int timeoutMs) {
+            Impl& impl = *pImpl;
+            if (impl.peerClosed() || impl.header->closed[impl.side].load(std::memory_order_relaxed)) {
+                return IpcResult::Closed;
+            }
+
+            bool hasDeadline = timeoutMs >= 0;
+            Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(hasDeadline ? timeoutMs : 0);
+            if (impl.interrupted) {
+                IpcResult result = impl.writeRecord(0, 0, kAbandoned, std::string_view(), hasDeadline, deadline);
+                if (result != IpcResult::Ok) {
+                    return result;
+                }
+                impl.interrupted = false;
+            }
+
+            size_t maxFragment = impl.ringSize / 4 - sizeof(RecordHeader);
+            size_t offset = 0;
+            do {
+                size_t size = std::min(payload.size() - offset, maxFragment);
+                uint16_t flags = offset + size < payload.size() ? kMoreFragments : 0;
+                IpcResult result = impl.writeRecord(type, id, flags, payload.substr(offset, size), hasDeadline, deadline);
+                if (result != IpcResult::Ok) {
+                    impl.interrupted = offset > 0;
+                    return result;
+                }
+                offset += size;
+            } while (offset < payload.size());
+            return IpcResult::Ok;
+        }
+
+        IpcResult IpcChannel::receive(IpcMessage& message, int timeoutMs) {
+            Impl& impl = *pImpl;
+            RingControl& control = impl.header->rings[1 - impl.side];
+            const uint8_t* data = impl.ringData(1 - impl.side);
+            bool hasDeadline = timeoutMs >= 0;
+            Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(hasDeadline ? timeoutMs : 0);
+
+            for (;;) {
+                uint64_t read = control.readPosition.load(std::memory_order_relaxed);
+                uint64_t write = control.writePosition.load(std::memory_order_acquire);
+                if (read == write) {
+                    if (impl.peerClosed()) {
+                        return IpcResult::Closed;
+                    }
+                    if (!impl.waitForData(read, hasDeadline, deadline)) {
+                        return IpcResult::Timeout;
+                    }
+                    continue;
+                }
+
+                size_t position = static_cast<size_t>(read & (impl.ringSize - 1));
+                RecordHeader record;
+                std::memcpy(&record, data + position, sizeof(record));
+                size_t size = (record.flags & kPadding) ? sizeof(RecordHeader) + record.size : recordSize(record.size);
+
+                // The peer is another process; a record it cannot have written means
+                // the memory is corrupt
+                if (size > write - read || position + size > impl.ringSize) {
+                    return IpcResult::Closed;
+                }
+
+                if (record.flags & kAbandoned) {
+                    control.readPosition.store(read + size, std::memory_order_release);
+                    impl.assembling = false;
+                    impl.partial.payload.clear();
+                    continue;
+                }
+                if (!(record.flags & kPadding)) {
+                    if (!impl.assembling) {
+                        impl.partial.type = record.type;
+                        impl.partial.id = record.id;
+                        impl.partial.payload.clear();
+                    }
+                    impl.partial.payload.append(reinterpret_cast<const char*>(data + position + sizeof(record)), record.size);
+                }
+                control.readPosition.store(read + size, std::memory_order_release);
+
+                if (record.flags & kPadding) {
+                    continue;
+                }
+                if (record.flags & kMoreFragments) {
+                    impl.assembling = true;
+                    continue;
+                }
+                impl.assembling = false;
+                message.type = impl.partial.type;
+                message.id = impl.partial.id;
+                message.payload.swap(impl.partial.payload);
+                return IpcResult::Ok;
+            }
+        }
+
+        void IpcChannel::close() {
+            Impl& impl = *pImpl;
+            impl.header->closed[impl.side].store(1, std::memory_order_seq_cst);
+
+            // Wake the peer if it sleeps on the ring this side writes
+            RingControl& control = impl.header->rings[impl.side];
+            control.signal.fetch_add(1, std::memory_order_seq_cst);
+            if (control.sleeping.load(std::memory_order_seq_cst)) {
+                impl.wake(impl.side);
+            }
+        }
+
+        bool IpcChannel::isPeerClosed() const {
+            return pImpl->peerClosed();
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
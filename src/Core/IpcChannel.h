@@ -0,0 +1,118 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Message received from an IpcChannel
+        struct IpcMessage {
+            uint16_t type;
+            uint64_t id;
+            std::string payload;
+
+            IpcMessage() : type(0), id(0) {}
+        };
+
+        // Builds a message payload. Integers are little-endian at fixed width and
+        // strings are prefixed with their byte length, so nothing is escaped.
+        class IpcWriter {
+        public:
+            void writeU8(uint8_t value);
+            void writeU32(uint32_t value);
+            void writeI32(int32_t value);
+            void writeU64(uint64_t value);
+            void writeString(std::string_view value);
+
+            // Append a string whose parts are written separately; returns the
+            // offset to pass to endString once they are
+            size_t beginString();
+            void appendToString(std::string_view part);
+            void endString(size_t offset);
+
+            const std::string& getBuffer() const;
+            void clear();
+
+        private:
+            std::string buffer;
+        };
+
+        // Reads a payload built by an IpcWriter. A read past the end fails and
+        // leaves the value unchanged.
+        class IpcReader {
+        public:
+            explicit IpcReader(std::string_view data);
+
+            bool readU8(uint8_t& value);
+            bool readU32(uint32_t& value);
+            bool readI32(int32_t& value);
+            bool readU64(uint64_t& value);
+            bool readString(std::string& value);
+
+            // View into the payload, valid as long as it is
+            bool readStringView(std::string_view& value);
+
+            bool atEnd() const;
+
+        private:
+            bool readLittleEndian(size_t size, uint64_t& value);
+
+            std::string_view data;
+            size_t position;
+        };
+
+        enum class IpcResult {
+            Ok,
+            Timeout,
+            Closed
+        };
+
+        // Duplex message channel between two processes through shared memory: one
+        // lock-free ring per direction, with a single producer and a single consumer
+        // each. A receiver with nothing to read spins for a few microseconds before it
+        // sleeps, and a sender only signals the OS when the receiver sleeps, so a
+        // round trip between two awake processes stays in the tens of microseconds.
+        // Messages larger than a quarter of a ring are split into fragments and
+        // reassembled. Each side may send from one thread and receive from one
+        // thread at a time.
+        class IpcChannel {
+        public:
+            ~IpcChannel();
+
+            // Create a channel with two rings of ringSize bytes, rounded up to a power
+            // of two of at least 64 KiB. Returns null on failure.
+            static std::unique_ptr<IpcChannel> create(size_t ringSize = 1024 * 1024);
+
+            // Connect to a channel by the name its creator reports; null on failure
+            static std::unique_ptr<IpcChannel> open(const std::string& name);
+
+            const std::string& getName() const;
+
+            // Waits while the ring is full; timeoutMs -1 waits indefinitely. A
+            // timeout can leave the first fragments of a large message sent; the
+            // next send has the receiver drop them, so they never join another
+            // message.
+            IpcResult send(uint16_t type, uint64_t id, std::string_view payload, int timeoutMs = -1);
+
+            // Wait up to timeoutMs for the next message; -1 waits indefinitely
+            IpcResult receive(IpcMessage& message, int timeoutMs = -1);
+
+            // Tell the peer no more messages follow. Its receive returns Closed once it
+            // has read what was sent, and its send returns Closed right away.
+            void close();
+            bool isPeerClosed() const;
+
+        private:
+            IpcChannel();
+
+            // Prevent copying
+            IpcChannel(const IpcChannel&) = delete;
+            IpcChannel& operator=(const IpcChannel&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,744 @@
+#include "pch.h"
+#include "LargeFile.h"
+#include "AtomicFile.h"
+#include "LineScanner.h"
+#include "MappingGuard.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // The start of every kCheckpointInterval-th line is kept; reaching any
+            // other line scans forward over fewer lines than that
+            const uint64_t kCheckpointInterval = 256;
+
+            // Views are mapped from multiples of this, the coarsest allocation
+            // granularity of the supported systems
+            const size_t kGranularity = 64 * 1024;
+
+            // Indexing starts with slices this large and doubles them from there
+            const size_t kFirstChunkSize = 1024 * 1024;
+
+            // Line starts within a slice are 32-bit
+            const size_t kMaxChunkSize = 1024 * 1024 * 1024;
+
+            const uint64_t kEndOfFile = static_cast<uint64_t>(-1);
+
+            // Mapped bytes of a file, unmapped with the last reference. Reads past a
+            // truncation find zeros rather than raising SIGBUS, and mark it damaged.
+            class FileView {
+            public:
+                FileView(void* base, size_t baseLength, size_t skip, size_t length)
+                    : base(base), baseLength(baseLength), bytes(static_cast<const char*>(base) + skip), length(length),
+                      guard(std::make_unique<MappingGuard>(base, baseLength)) {}
+
+                ~FileView() {
+                    guard.reset();
+#ifdef _WIN32
+                    UnmapViewOfFile(base);
+#else
+                    munmap(base, baseLength);
+#endif
+                }
+
+                const char* data() const { return bytes; }
+                size_t size() const { return length; }
+
+                // Whether a read so far found part of the view gone
+                bool isDamaged() const { return guard->isDamaged(); }
+
+            private:
+                // Prevent copying
+                FileView(const FileView&) = delete;
+                FileView& operator=(const FileView&) = delete;
+
+                void* base;
+                size_t baseLength;
+                const char* bytes;
+                size_t length;
+                std::unique_ptr<MappingGuard> guard;
+            };
+
+            // A file held open so views of it can be mapped on demand. Its size is
+            // fixed at open; later appends are not seen.
+            //
+            // A file may shrink while it is read, as a log rotated by copytruncate
+            // does. Views then read zeros past the new end; readers check isIntact
+            // with the view once they have read it, and drop what they read if it
+            // returns false.
+            class ViewSource {
+            public:
+                ~ViewSource() {
+#ifdef _WIN32
+                    if (mapping) CloseHandle(mapping);
+                    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+                    if (descriptor >= 0) close(descriptor);
+#endif
+                }
+
+                // Returns null if the file cannot be opened
+                static std::shared_ptr<ViewSource> open(const std::string& path) {
+                    std::shared_ptr<ViewSource> source(new ViewSource());
+
+#ifdef _WIN32
+                    // Writers are let in, so a log can keep growing while it is viewed
+                    source->file = CreateFileW(fs::u8path(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+                    if (source->file == INVALID_HANDLE_VALUE) {
+                        return nullptr;
+                    }
+
+                    LARGE_INTEGER fileSize;
+                    if (!GetFileSizeEx(source->file, &fileSize)) {
+                        return nullptr;
+                    }
+                    source->length = static_cast<uint64_t>(fileSize.QuadPart);
+                    if (source->length == 0) {
+                        return source;
+                    }
+
+                    source->mapping = CreateFileMappingW(source->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (!source->mapping) {
+                        return nullptr;
+                    }
+#else
+                    source->descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (source->descriptor < 0) {
+                        return nullptr;
+                    }
+
+                    struct stat info;
+                    if (fstat(source->descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+                        return nullptr;
+                    }
+                    source->length = static_cast<uint64_t>(info.st_size);
+#endif
+                    return source;
+                }
+
+                uint64_t size() const { return length; }
+
+                // Whether the file still holds the bytes seen at open. Once it has
+                // shrunk, it stays false.
+                bool isIntact() const {
+                    if (truncated) {
+                        return false;
+                    }
+#ifdef _WIN32
+                    // Mapped files cannot be truncated on Windows
+                    return true;
+#else
+                    struct stat info;
+                    if (fstat(descriptor, &info) != 0 || static_cast<uint64_t>(info.st_size) < length) {
+                        truncated = true;
+                        return false;
+                    }
+                    return true;
+#endif
+                }
+
+                // isIntact, also taking a view found damaged as proof of a truncation
+                bool isIntact(const FileView& view) const {
+                    if (view.isDamaged()) {
+                        truncated = true;
+                    }
+                    return isIntact();
+                }
+
+                // Map length bytes from offset, which need not be aligned; returns null
+                // on failure
+                std::shared_ptr<const FileView> map(uint64_t offset, size_t length) const {
+                    if (length == 0 || offset + length > this->length) {
+                        return nullptr;
+                    }
+
+                    uint64_t aligned = offset - offset % kGranularity;
+                    size_t skip = static_cast<size_t>(offset - aligned);
+#ifdef _WIN32
+                    void* base = MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(aligned >> 32),
+                        static_cast<DWORD>(aligned), skip + length);
+                    if (!base) {
+                        return nullptr;
+                    }
+#else
+                    void* base = mmap(nullptr, skip + length, PROT_READ, MAP_PRIVATE, descriptor, static_cast<off_t>(aligned));
+                    if (base == MAP_FAILED) {
+                        return nullptr;
+                    }
+#endif
+                    return std::make_shared<const FileView>(base, skip + length, skip, length);
+                }
+
+            private:
+#ifdef _WIN32
+                ViewSource() : file(INVALID_HANDLE_VALUE), mapping(nullptr), length(0), truncated(false) {}
+
+                HANDLE file;
+                HANDLE mapping;
+#else
+                ViewSource() : descriptor(-1), length(0), truncated(false) {}
+
+                int descriptor;
+#endif
+                uint64_t length;
+                mutable std::atomic<bool> truncated;
+            };
+
+            // Line index shared with the pool task building it
+            struct IndexState {
+                IndexState(std::shared_ptr<ViewSource> source, size_t chunkSize)
+                    : source(std::move(source)), chunkSize(chunkSize), cancelled(false), checkpoints(1, 0),
+                      lineBreaks(0), indexedBytes(0), lineFeeds(0), carriageReturnLineFeeds(0),
+                      complete(false), failed(false), running(true) {}
+
+                const std::shared_ptr<ViewSource> source;
+                const size_t chunkSize;
+                std::atomic<bool> cancelled;
+
+                // Guards everything below
+                std::mutex mutex;
+                std::condition_variable changed;
+
+                // Start of line i * kCheckpointInterval at index i
+                std::vector<uint64_t> checkpoints;
+                uint64_t lineBreaks;
+                uint64_t indexedBytes;
+                uint64_t lineFeeds;
+                uint64_t carriageReturnLineFeeds;
+                bool complete;
+                bool failed;
+                bool running;
+
+                // Lines whose end is known; caller holds the lock
+                uint64_t readableLines() const {
+                    return complete ? lineBreaks + 1 : lineBreaks;
+                }
+            };
+
+            void buildIndex(IndexState& state) {
+                const ViewSource& source = *state.source;
+                uint64_t size = source.size();
+                uint64_t offset = 0;
+                size_t chunkSize = std::min(kFirstChunkSize, state.chunkSize);
+                std::vector<uint32_t> lineStarts;
+                bool failed = false;
+
+                while (offset < size && !state.cancelled) {
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(chunkSize, size - offset));
+                    std::shared_ptr<const FileView> view = source.isIntact() ? source.map(offset, length) : nullptr;
+                    if (!view) {
+                        failed = true;
+                        break;
+                    }
+
+                    // Leave a trailing '\r' to the next slice, which sees whether a
+                    // '\n' follows it
+                    if (offset + length < size && view->data()[length - 1] == '\r') {
+                        --length;
+                    }
+
+                    lineStarts.clear();
+                    LineBreakCounts counts = LineScanner::scan(view->data(), length, &lineStarts);
+                    if (!source.isIntact(*view)) {
+                        failed = true;
+                        break;
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(state.mutex);
+                        for (uint32_t start : lineStarts) {
+                            if (++state.lineBreaks % kCheckpointInterval == 0) {
+                                state.checkpoints.push_back(offset + start);
+                            }
+                        }
+                        state.lineFeeds += counts.lineFeeds;
+                        state.carriageReturnLineFeeds += counts.carriageReturnLineFeeds;
+                        state.indexedBytes = offset + length;
+                    }
+                    state.changed.notify_all();
+
+                    offset += length;
+                    chunkSize = std::min(chunkSize * 2, state.chunkSize);
+                }
+
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.complete = !state.cancelled && !failed;
+                state.failed = failed;
+                state.running = false;
+                state.changed.notify_all();
+            }
+
+            // First '\n' or '\r' in [begin, end), or end
+            const char* findLineBreak(const char* begin, const char* end) {
+                const char* lineFeed = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+                const char* limit = lineFeed ? lineFeed : end;
+                const char* carriageReturn = static_cast<const char*>(std::memchr(begin, '\r', limit - begin));
+                return carriageReturn ? carriageReturn : limit;
+            }
+        }
+
+        class LargeFile::Impl {
+        public:
+            Impl() : useClock(0), overlayBytes(0) {}
+
+            // Original lines replaced by edited ones. Each patch covers at least one
+            // original line; patches are sorted and do not overlap.
+            struct Patch {
+                uint64_t firstLine;
+                uint64_t lineCount;
+                std::vector<std::string> lines;
+            };
+
+            // Where a line of the edited document comes from
+            struct Location {
+                bool inPatch;
+                size_t patch;
+                size_t index;               // within the patch
+                uint64_t originalLine;      // when not in a patch
+            };
+
+            struct Window {
+                std::shared_ptr<const FileView> view;
+                uint64_t lastUse;
+            };
+
+            // Window holding offset, mapping it if needed; null on failure or once the
+            // file has shrunk, when the windows can no longer be read safely
+            std::shared_ptr<const FileView> window(uint64_t offset) const {
+                if (!source->isIntact()) {
+                    windows.clear();
+                    return nullptr;
+                }
+
+                uint64_t index = offset / options.windowSize;
+                auto found = windows.find(index);
+                if (found != windows.end()) {
+                    found->second.lastUse = ++useClock;
+                    return found->second.view;
+                }
+
+                size_t maxWindows = std::max<size_t>(2, options.memoryBudget / options.windowSize);
+                if (windows.size() >= maxWindows) {
+                    auto oldest = std::min_element(windows.begin(), windows.end(), [](const auto& left, const auto& right) {
+                        return left.second.lastUse < right.second.lastUse;
+                    });
+                    windows.erase(oldest);
+                }
+
+                uint64_t start = index * options.windowSize;
+                size_t length = static_cast<size_t>(std::min<uint64_t>(options.windowSize, source->size() - start));
+                std::shared_ptr<const FileView> view = source->map(start, length);
+                if (view) {
+                    windows[index] = { view, ++useClock };
+                }
+                return view;
+            }
+
+            // Read the original line starting at start, appending its text if asked.
+            // Returns the start of the next line, or kEndOfFile after the last one.
+            uint64_t scanLine(uint64_t start, std::string* text) const {
+                uint64_t size = source->size();
+                for (uint64_t offset = start; offset < size;) {
+                    std::shared_ptr<const FileView> view = window(offset);
+                    if (!view) {
+                        return kEndOfFile;
+                    }
+
+                    uint64_t base = offset - offset % options.windowSize;
+                    const char* begin = view->data() + (offset - base);
+                    const char* end = view->data() + view->size();
+                    const char* lineBreak = findLineBreak(begin, end);
+                    if (text) {
+                        text->append(begin, lineBreak);
+                    }
+                    if (!source->isIntact(*view)) {
+                        return kEndOfFile;
+                    }
+                    if (lineBreak == end) {
+                        offset = base + view->size();
+                        continue;
+                    }
+
+                    uint64_t breakOffset = base + static_cast<uint64_t>(lineBreak - view->data());
+                    if (*lineBreak == '\n') {
+                        return breakOffset + 1;
+                    }
+
+                    // A "\r\n" may straddle two windows
+                    bool pair;
+                    if (lineBreak + 1 < end) {
+                        pair = lineBreak[1] == '\n';
+                    }
+                    else {
+                        std::shared_ptr<const FileView> next = breakOffset + 1 < size ? window(breakOffset + 1) : nullptr;
+                        pair = next && next->data()[0] == '\n' && source->isIntact(*next);
+                    }
+                    return breakOffset + (pair ? 2 : 1);
+                }
+                return kEndOfFile;
+            }
+
+            // Offset of an original line; false if the index has not reached it
+            bool originalLineStart(uint64_t line, uint64_t& offset) const {
+                {
+                    std::lock_guard<std::mutex> lock(index->mutex);
+                    if (line > index->lineBreaks) {
+                        return false;
+                    }
+                    offset = index->checkpoints[line / kCheckpointInterval];
+                }
+
+                for (uint64_t skipped = 0; skipped < line % kCheckpointInterval; ++skipped) {
+                    offset = scanLine(offset, nullptr);
+                    if (offset == kEndOfFile) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            uint64_t readableOriginalLines() const {
+                std::lock_guard<std::mutex> lock(index->mutex);
+                return index->readableLines();
+            }
+
+            // Lines added by the edits, less those removed
+            int64_t lineShift() const {
+                int64_t shift = 0;
+                for (const Patch& patch : patches) {
+                    shift += static_cast<int64_t>(patch.lines.size()) - static_cast<int64_t>(patch.lineCount);
+                }
+                return shift;
+            }
+
+            Location locate(uint64_t line) const {
+                int64_t shift = 0;
+                for (size_t i = 0; i < patches.size(); ++i) {
+                    const Patch& patch = patches[i];
+                    uint64_t patchStart = patch.firstLine + shift;
+                    if (line < patchStart) {
+                        break;
+                    }
+                    if (line < patchStart + patch.lines.size()) {
+                        return { true, i, static_cast<size_t>(line - patchStart), 0 };
+                    }
+                    shift += static_cast<int64_t>(patch.lines.size()) - static_cast<int64_t>(patch.lineCount);
+                }
+                return { false, 0, 0, line - shift };
+            }
+
+            static size_t bytesOf(const std::vector<std::string>& lines) {
+                size_t bytes = 0;
+                for (const auto& line : lines) {
+                    bytes += line.size();
+                }
+                return bytes;
+            }
+
+            // Copy [start, end) of the original file, mapping it slice by slice so the
+            // reading windows are left alone. last is set to the final byte copied.
+            bool copyOriginal(AtomicFile& file, uint64_t start, uint64_t end, char& last) const {
+                for (uint64_t offset = start; offset < end;) {
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(options.indexChunkSize, end - offset));
+                    std::shared_ptr<const FileView> view = source->isIntact() ? source->map(offset, length) : nullptr;
+                    if (!view || !file.write(view->data(), view->size()) || !source->isIntact(*view)) {
+                        return false;
+                    }
+                    last = view->data()[length - 1];
+                    offset += length;
+                }
+                return true;
+            }
+
+            std::string path;
+            LargeFileOptions options;
+            std::shared_ptr<ViewSource> source;
+            std::shared_ptr<IndexState> index;
+
+            // Windows held for reading, least recently used dropped first
+            mutable std::unordered_map<uint64_t, Window> windows;
+            mutable uint64_t useClock;
+
+            std::vector<Patch> patches;
+            size_t overlayBytes;
+        };
+
+        LargeFile::LargeFile() : pImpl(std::make_unique<Impl>()) {
+        }
+
+        LargeFile::~LargeFile() {
+            IndexState& index = *pImpl->index;
+            index.cancelled = true;
+
+            std::unique_lock<std::mutex> lock(index.mutex);
+            index.changed.wait(lock, [&index] {
+                return !index.running;
+            });
+        }
+
+        std::unique_ptr<LargeFile> LargeFile::open(ThreadPool& pool, const std::string& path, const LargeFileOptions& options) {
+            std::shared_ptr<ViewSource> source = ViewSource::open(path);
+            if (!source) {
+                return nullptr;
+            }
+
+            std::unique_ptr<LargeFile> result(new LargeFile());
+            Impl& impl = *result->pImpl;
+            impl.path = path;
+            impl.options = options;
+            impl.options.windowSize = std::max<size_t>(1, (options.windowSize + kGranularity - 1) / kGranularity) * kGranularity;
+            impl.options.indexChunkSize = std::min(std::max(options.indexChunkSize, kGranularity), kMaxChunkSize);
+            impl.source = source;
+            impl.index = std::make_shared<IndexState>(source, impl.options.indexChunkSize);
+
+            std::shared_ptr<IndexState> index = impl.index;
+            pool.submit([index] {
+                buildIndex(*index);
+            });
+            return result;
+        }
+
+        const std::string& LargeFile::getPath() const {
+            return pImpl->path;
+        }
+
+        uint64_t LargeFile::getLineCount() const {
+            return pImpl->readableOriginalLines() + pImpl->lineShift();
+        }
+
+        bool LargeFile::isIndexComplete() const {
+            std::lock_guard<std::mutex> lock(pImpl->index->mutex);
+            return pImpl->index->complete;
+        }
+
+        void LargeFile::waitForLines(uint64_t count) const {
+            // Edits that added lines make fewer original ones necessary
+            int64_t shift = pImpl->lineShift();
+            uint64_t needed;
+            if (shift >= 0) {
+                needed = count > static_cast<uint64_t>(shift) ? count - shift : 0;
+            }
+            else {
+                needed = std::max(count, count + static_cast<uint64_t>(-shift));
+            }
+
+            IndexState& index = *pImpl->index;
+            std::unique_lock<std::mutex> lock(index.mutex);
+            index.changed.wait(lock, [&index, needed] {
+                return !index.running || index.readableLines() >= needed;
+            });
+        }
+
+        bool LargeFile::getLine(uint64_t line, std::string& text) const {
+            Impl::Location location = pImpl->locate(line);
+            if (location.inPatch) {
+                text = pImpl->patches[location.patch].lines[location.index];
+                return true;
+            }
+
+            uint64_t start;
+            if (location.originalLine >= pImpl->readableOriginalLines() || !pImpl->originalLineStart(location.originalLine, start)) {
+                return false;
+            }
+
+            text.clear();
+            pImpl->scanLine(start, &text);
+
+            // A file that shrank may have cut the line short
+            return pImpl->source->isIntact();
+        }
+
+        size_t LargeFile::getLines(uint64_t first, size_t count, std::vector<std::string>& lines) const {
+            lines.resize(count);
+            uint64_t readable = pImpl->readableOriginalLines();
+
+            // Consecutive original lines continue from where the last one ended
+            uint64_t nextOriginal = kEndOfFile;
+            uint64_t offset = 0;
+            size_t read = 0;
+            for (; read < count; ++read) {
+                Impl::Location location = pImpl->locate(first + read);
+                if (location.inPatch) {
+                    lines[read] = pImpl->patches[location.patch].lines[location.index];
+                    continue;
+                }
+
+                if (location.originalLine >= readable) {
+                    break;
+                }
+                if (location.originalLine != nextOriginal && !pImpl->originalLineStart(location.originalLine, offset)) {
+                    break;
+                }
+
+                lines[read].clear();
+                offset = pImpl->scanLine(offset, &lines[read]);
+                if (!pImpl->source->isIntact()) {
+                    break;
+                }
+                nextOriginal = location.originalLine + 1;
+            }
+
+            lines.resize(read);
+            return read;
+        }
+
+        bool LargeFile::replace(uint64_t startLine, size_t startCharacter, uint64_t endLine, size_t endCharacter, const std::string& text) {
+            std::string first, last;
+            if (endLine < startLine || !getLine(startLine, first) || !getLine(endLine, last)) {
+                return false;
+            }
+
+            startCharacter = std::min(startCharacter, first.size());
+            endCharacter = std::min(endCharacter, last.size());
+            if (startLine == endLine && endCharacter < startCharacter) {
+                return false;
+            }
+
+            // The edited lines, split at any kind of line break
+            std::string joined = first.substr(0, startCharacter) + text + last.substr(endCharacter);
+            std::vector<std::string> lines(1);
+            for (size_t i = 0; i < joined.size(); ++i) {
+                char c = joined[i];
+                if (c != '\r' && c != '\n') {
+                    lines.back().push_back(c);
+                    continue;
+                }
+                if (c == '\r' && i + 1 < joined.size() && joined[i + 1] == '\n') {
+                    ++i;
+                }
+                lines.emplace_back();
+            }
+
+            // Merge with the patches the edit starts or ends in, and drop those it covers
+            std::vector<Impl::Patch>& patches = pImpl->patches;
+            Impl::Location start = pImpl->locate(startLine);
+            Impl::Location end = pImpl->locate(endLine);
+
+            Impl::Patch merged;
+            merged.firstLine = start.inPatch ? patches[start.patch].firstLine : start.originalLine;
+            uint64_t originalEnd = end.inPatch ? patches[end.patch].firstLine + patches[end.patch].lineCount : end.originalLine + 1;
+            merged.lineCount = originalEnd - merged.firstLine;
+            if (start.inPatch) {
+                const auto& kept = patches[start.patch].lines;
+                merged.lines.assign(kept.begin(), kept.begin() + start.index);
+            }
+            merged.lines.insert(merged.lines.end(), std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+            if (end.inPatch) {
+                const auto& kept = patches[end.patch].lines;
+                merged.lines.insert(merged.lines.end(), kept.begin() + end.index + 1, kept.end());
+            }
+
+            auto byFirstLine = [](const Impl::Patch& patch, uint64_t line) {
+                return patch.firstLine < line;
+            };
+            auto from = std::lower_bound(patches.begin(), patches.end(), merged.firstLine, byFirstLine);
+            auto to = std::lower_bound(from, patches.end(), originalEnd, byFirstLine);
+
+            size_t removedBytes = 0;
+            for (auto patch = from; patch != to; ++patch) {
+                removedBytes += Impl::bytesOf(patch->lines);
+            }
+            size_t overlayBytes = pImpl->overlayBytes - removedBytes + Impl::bytesOf(merged.lines);
+            if (overlayBytes > pImpl->options.maxOverlayBytes) {
+                return false;
+            }
+
+            patches.insert(patches.erase(from, to), std::move(merged));
+            pImpl->overlayBytes = overlayBytes;
+            return true;
+        }
+
+        bool LargeFile::isModified() const {
+            return !pImpl->patches.empty();
+        }
+
+        bool LargeFile::save(const std::string& path) const {
+            std::unique_ptr<AtomicFile> file = AtomicFile::create(path);
+            if (!file) {
+                return false;
+            }
+
+            const char* lineBreak;
+            {
+                std::lock_guard<std::mutex> lock(pImpl->index->mutex);
+                lineBreak = pImpl->index->carriageReturnLineFeeds > pImpl->index->lineFeeds ? "\r\n" : "\n";
+            }
+
+            // Last byte written. A "\n" written right after a lone "\r" of the original
+            // would join it into one break, so such a break is written as "\r\n".
+            char last = 0;
+            auto writeBreak = [&file, &last, lineBreak]() {
+                const char* text = last == '\r' && lineBreak[0] == '\n' ? "\r\n" : lineBreak;
+                last = '\n';
+                return file->write(text, std::strlen(text));
+            };
+
+            uint64_t size = pImpl->source->size();
+            uint64_t copied = 0;
+            for (const Impl::Patch& patch : pImpl->patches) {
+                uint64_t start;
+                if (!pImpl->originalLineStart(patch.firstLine, start) || !pImpl->copyOriginal(*file, copied, start, last)) {
+                    return false;
+                }
+
+                for (size_t i = 0; i < patch.lines.size(); ++i) {
+                    if (i > 0 && !writeBreak()) {
+                        return false;
+                    }
+                    if (!file->write(patch.lines[i].data(), patch.lines[i].size())) {
+                        return false;
+                    }
+                    if (!patch.lines[i].empty()) {
+                        last = patch.lines[i].back();
+                    }
+                }
+
+                // Keep the break after the patch unless it replaced the last line
+                if (pImpl->originalLineStart(patch.firstLine + patch.lineCount, copied)) {
+                    if (!writeBreak()) {
+                        return false;
+                    }
+                }
+                else {
+                    copied = size;
+                }
+            }
+
+            return pImpl->copyOriginal(*file, copied, size, last) && pImpl->source->isIntact() && file->commit();
+        }
+
+        LargeFileStatus LargeFile::getStatus() const {
+            LargeFileStatus status;
+            status.size = pImpl->source->size();
+            {
+                std::lock_guard<std::mutex> lock(pImpl->index->mutex);
+                status.indexedBytes = pImpl->index->indexedBytes;
+                status.indexComplete = pImpl->index->complete;
+                status.indexFailed = pImpl->index->failed;
+            }
+            status.truncated = !pImpl->source->isIntact();
+            for (const auto& window : pImpl->windows) {
+                status.mappedBytes += window.second.view->size();
+            }
+            status.overlayBytes = pImpl->overlayBytes;
+            return status;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        class ThreadPool;
+
+        struct LargeFileOptions {
+            // Bytes mapped per window; rounded up to a multiple of 64 KiB
+            size_t windowSize;
+
+            // Windows kept mapped for reading. At least two are always kept, so a
+            // line crossing a window boundary can be read.
+            size_t memoryBudget;
+
+            // Text of edited lines the overlay may hold; edits past it are refused
+            size_t maxOverlayBytes;
+
+            // Largest slice the background index maps at once. Indexing starts with
+            // small slices so the first screens are ready quickly.
+            size_t indexChunkSize;
+
+            LargeFileOptions()
+                : windowSize(4 * 1024 * 1024), memoryBudget(256 * 1024 * 1024),
+                  maxOverlayBytes(16 * 1024 * 1024), indexChunkSize(16 * 1024 * 1024) {}
+        };
+
+        struct LargeFileStatus {
+            uint64_t size;              // of the file on disk
+            uint64_t indexedBytes;
+            bool indexComplete;
+            bool indexFailed;           // a slice could not be mapped; lines after it are unknown
+            bool truncated;             // the file shrank on disk, so nothing more is read from it
+            size_t mappedBytes;         // windows held for reading
+            size_t overlayBytes;
+
+            LargeFileStatus()
+                : size(0), indexedBytes(0), indexComplete(false), indexFailed(false), truncated(false), mappedBytes(0), overlayBytes(0) {}
+        };
+
+        // Read-mostly view of a file too large for a TextBuffer, such as a multi-GB
+        // log. Nothing is read up front: lines are paged in through fixed-size mapped
+        // windows, the least recently used of which are unmapped to stay within the
+        // memory budget. A pool task indexes line breaks in the background, keeping
+        // the start of every 256th line, and lines become readable as it passes them.
+        // Small edits replace whole lines in an overlay and are written out by save.
+        // Lines end at "\n", "\r\n" or a lone "\r", as in a TextBuffer, and are
+        // returned without their break. Use from one thread; only indexing runs
+        // concurrently.
+        //
+        // If the file shrinks while open, as a log truncated for rotation does, reads
+        // and saves fail from then on, those under way at the time included; reopen
+        // it to go on.
+        class LargeFile {
+        public:
+            // Cancels indexing and waits for it to stop
+            ~LargeFile();
+
+            // Open a file and start indexing it; returns null if it cannot be opened
+            static std::unique_ptr<LargeFile> open(ThreadPool& pool, const std::string& path,
+                const LargeFileOptions& options = LargeFileOptions());
+
+            const std::string& getPath() const;
+
+            // Lines readable so far, edits included. Final once the index is complete.
+            uint64_t getLineCount() const;
+
+            bool isIndexComplete() const;
+
+            // Block until count lines are readable or the index is complete. Must not
+            // be called from a thread of the pool.
+            void waitForLines(uint64_t count) const;
+
+            // Returns false if the line is not indexed yet or does not exist
+            bool getLine(uint64_t line, std::string& text) const;
+
+            // Read up to count lines from first into lines, replacing their contents.
+            // Returns the number read, which is short where the index stops.
+            size_t getLines(uint64_t first, size_t count, std::vector<std::string>& lines) const;
+
+            // Replace the text between two positions, whose lines must be readable.
+            // Characters count bytes and are clamped to the line. Returns false if a
+            // position is out of range or the overlay is full.
+            bool replace(uint64_t startLine, size_t startCharacter, uint64_t endLine, size_t endCharacter, const std::string& text);
+
+            bool isModified() const;
+
+            // Write the file with its edits through an AtomicFile. Unedited stretches
+            // are copied as they are; edited lines use the dominant line ending seen
+            // so far. The view keeps reading the original contents afterwards.
+            bool save(const std::string& path) const;
+
+            LargeFileStatus getStatus() const;
+
+        private:
+            LargeFile();
+
+            // Prevent copying
+            LargeFile(const LargeFile&) = delete;
+            LargeFile& operator=(const LargeFile&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
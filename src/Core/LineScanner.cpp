@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "LineScanner.h"
+#include "CpuFeatures.h"
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            using ScanFunction = LineBreakCounts(*)(const char*, size_t, std::vector<uint32_t>*);
+
+            // Classify the break at position, which holds '\n' or '\r'
+            inline void recordBreak(const char* data, size_t length, size_t position, LineBreakCounts& counts, std::vector<uint32_t>* lineStarts) {
+                if (data[position] == '\n') {
+                    if (position > 0 && data[position - 1] == '\r') {
+                        ++counts.carriageReturnLineFeeds;
+                    }
+                    else {
+                        ++counts.lineFeeds;
+                    }
+                }
+                else if (position + 1 < length && data[position + 1] == '\n') {
+                    // First half of "\r\n"; the '\n' records the break
+                    return;
+                }
+                else {
+                    ++counts.carriageReturns;
+                }
+
+                if (lineStarts) {
+                    lineStarts->push_back(static_cast<uint32_t>(position + 1));
+                }
+            }
+
+            // Walk the set bits of a block's match mask in order
+            inline void recordBlock(const char* data, size_t length, size_t base, uint32_t mask, LineBreakCounts& counts, std::vector<uint32_t>* lineStarts) {
+                while (mask) {
+                    recordBreak(data, length, base + countTrailingZeros(mask), counts, lineStarts);
+                    mask &= mask - 1;
+                }
+            }
+
+            void scanTail(const char* data, size_t length, size_t position, LineBreakCounts& counts, std::vector<uint32_t>* lineStarts) {
+                for (; position < length; ++position) {
+                    if (data[position] == '\n' || data[position] == '\r') {
+                        recordBreak(data, length, position, counts, lineStarts);
+                    }
+                }
+            }
+
+            LineBreakCounts scanScalar(const char* data, size_t length, std::vector<uint32_t>* lineStarts) {
+                LineBreakCounts counts;
+                scanTail(data, length, 0, counts, lineStarts);
+                return counts;
+            }
+
+#ifdef VUNE_X86
+            VUNE_TARGET("sse2")
+            LineBreakCounts scanSse2(const char* data, size_t length, std::vector<uint32_t>* lineStarts) {
+                LineBreakCounts counts;
+                const __m128i lineFeed = _mm_set1_epi8('\n');
+                const __m128i carriageReturn = _mm_set1_epi8('\r');
+
+                size_t position = 0;
+                for (; position + 16 <= length; position += 16) {
+                    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+                    __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, lineFeed), _mm_cmpeq_epi8(block, carriageReturn));
+                    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+                    if (mask) {
+                        recordBlock(data, length, position, mask, counts, lineStarts);
+                    }
+                }
+
+                scanTail(data, length, position, counts, lineStarts);
+                return counts;
+            }
+
+            VUNE_TARGET("avx2")
+            LineBreakCounts scanAvx2(const char* data, size_t length, std::vector<uint32_t>* lineStarts) {
+                LineBreakCounts counts;
+                const __m256i lineFeed = _mm256_set1_epi8('\n');
+                const __m256i carriageReturn = _mm256_set1_epi8('\r');
+
+                size_t position = 0;
+                for (; position + 32 <= length; position += 32) {
+                    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+                    __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(block, lineFeed), _mm256_cmpeq_epi8(block, carriageReturn));
+                    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+                    if (mask) {
+                        recordBlock(data, length, position, mask, counts, lineStarts);
+                    }
+                }
+
+                scanTail(data, length, position, counts, lineStarts);
+                return counts;
+            }
+#endif
+
+            struct ScanImplementation {
+                ScanFunction function;
+                const char* name;
+            };
+
+            const ScanImplementation& selectImplementation() {
+                static const ScanImplementation implementation = []() -> ScanImplementation {
+#ifdef VUNE_X86
+                    if (CpuFeatures::hasAvx2()) {
+                        return { scanAvx2, "avx2" };
+                    }
+                    if (CpuFeatures::hasSse2()) {
+                        return { scanSse2, "sse2" };
+                    }
+#endif
+                    return { scanScalar, "scalar" };
+                }();
+                return implementation;
+            }
+        }
+
+        LineBreakCounts LineScanner::scan(const char* data, size_t length, std::vector<uint32_t>* lineStarts) {
+            return selectImplementation().function(data, length, lineStarts);
+        }
+
+        const char* LineScanner::implementationName() {
+            return selectImplementation().name;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
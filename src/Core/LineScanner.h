@@ -0,0 +1,34 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Number of each kind of line break found by a scan
+        struct LineBreakCounts {
+            size_t lineFeeds;                   // "\n"
+            size_t carriageReturnLineFeeds;     // "\r\n"
+            size_t carriageReturns;             // lone "\r"
+
+            LineBreakCounts() : lineFeeds(0), carriageReturnLineFeeds(0), carriageReturns(0) {}
+
+            size_t total() const {
+                return lineFeeds + carriageReturnLineFeeds + carriageReturns;
+            }
+        };
+
+        // Vectorized line break scanner. The widest implementation the CPU supports
+        // (AVX2, SSE2 or scalar) is picked on first use.
+        class LineScanner {
+        public:
+            // Find every "\n", "\r\n" and lone "\r" in one pass. When lineStarts is given,
+            // the offset just past each break is appended to it; offsets must fit in 32 bits.
+            static LineBreakCounts scan(const char* data, size_t length, std::vector<uint32_t>* lineStarts = nullptr);
+
+            // Name of the implementation in use, for diagnostics
+            static const char* implementationName();
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "pch.h"
+#include "LiteralSearcher.h"
+#include "CpuFeatures.h"
+#include <cstring>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            using FindFunction = size_t(*)(const char*, size_t, const char*, size_t, bool);
+
+            inline char toLower(char c) {
+                return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+            }
+
+            inline bool isLetter(char c) {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            }
+
+            // Compare text against a pattern that is lowercased when ignoring case
+            inline bool matchesAt(const char* text, const char* pattern, size_t length, bool caseSensitive) {
+                if (caseSensitive) {
+                    return std::memcmp(text, pattern, length) == 0;
+                }
+                for (size_t i = 0; i < length; ++i) {
+                    if (toLower(text[i]) != pattern[i]) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            size_t findTail(const char* data, size_t length, size_t position, const char* pattern, size_t patternLength, bool caseSensitive) {
+                for (; position + patternLength <= length; ++position) {
+                    if (matchesAt(data + position, pattern, patternLength, caseSensitive)) {
+                        return position;
+                    }
+                }
+                return LiteralSearcher::npos;
+            }
+
+            size_t findScalar(const char* data, size_t length, const char* pattern, size_t patternLength, bool caseSensitive) {
+                if (!caseSensitive && isLetter(pattern[0])) {
+                    return findTail(data, length, 0, pattern, patternLength, caseSensitive);
+                }
+
+                // Let memchr skip to each occurrence of the first byte
+                const char* end = data + length;
+                for (const char* position = data; position + patternLength <= end; ++position) {
+                    position = static_cast<const char*>(std::memchr(position, pattern[0], end - position));
+                    if (!position || position + patternLength > end) {
+                        break;
+                    }
+                    if (matchesAt(position, pattern, patternLength, caseSensitive)) {
+                        return static_cast<size_t>(position - data);
+                    }
+                }
+                return LiteralSearcher::npos;
+            }
+
+            // Bits to OR into text bytes before comparing them with a pattern byte, so
+            // both cases of a letter compare equal when ignoring case
+            inline char foldMask(char c, bool caseSensitive) {
+                return !caseSensitive && isLetter(c) ? 0x20 : 0;
+            }
+
+#ifdef VUNE_X86
+            VUNE_TARGET("sse2")
+            size_t findSse2(const char* data, size_t length, const char* pattern, size_t patternLength, bool caseSensitive) {
+                const char first = pattern[0];
+                const char last = pattern[patternLength - 1];
+                const __m128i firstByte = _mm_set1_epi8(first);
+                const __m128i lastByte = _mm_set1_epi8(last);
+                const __m128i firstFold = _mm_set1_epi8(foldMask(first, caseSensitive));
+                const __m128i lastFold = _mm_set1_epi8(foldMask(last, caseSensitive));
+
+                size_t position = 0;
+                for (; position + patternLength - 1 + 16 <= length; position += 16) {
+                    __m128i blockFirst = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position)), firstFold);
+                    __m128i blockLast = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position + patternLength - 1)), lastFold);
+                    __m128i candidates = _mm_and_si128(_mm_cmpeq_epi8(blockFirst, firstByte), _mm_cmpeq_epi8(blockLast, lastByte));
+                    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(candidates));
+                    while (mask) {
+                        size_t candidate = position + countTrailingZeros(mask);
+                        if (matchesAt(data + candidate, pattern, patternLength, caseSensitive)) {
+                            return candidate;
+                        }
+                        mask &= mask - 1;
+                    }
+                }
+
+                return findTail(data, length, position, pattern, patternLength, caseSensitive);
+            }
+
+            VUNE_TARGET("avx2")
+            size_t findAvx2(const char* data, size_t length, const char* pattern, size_t patternLength, bool caseSensitive) {
+                const char first = pattern[0];
+                const char last = pattern[patternLength - 1];
+                const __m256i firstByte = _mm256_set1_epi8(first);
+                const __m256i lastByte = _mm256_set1_epi8(last);
+                const __m256i firstFold = _mm256_set1_epi8(foldMask(first, caseSensitive));
+                const __m256i lastFold = _mm256_set1_epi8(foldMask(last, caseSensitive));
+
+                size_t position = 0;
+                for (; position + patternLength - 1 + 32 <= length; position += 32) {
+                    __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position)), firstFold);
+                    __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position + patternLength - 1)), lastFold);
+                    __m256i candidates = _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, firstByte), _mm256_cmpeq_epi8(blockLast, lastByte));
+                    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(candidates));
+                    while (mask) {
+                        size_t candidate = position + countTrailingZeros(mask);
+                        if (matchesAt(data + candidate, pattern, patternLength, caseSensitive)) {
+                            return candidate;
+                        }
+                        mask &= mask - 1;
+                    }
+                }
+
+                return findTail(data, length, position, pattern, patternLength, caseSensitive);
+            }
+#endif
+
+            struct FindImplementation {
+                FindFunction function;
+                const char* name;
+            };
+
+            const FindImplementation& selectImplementation() {
+                static const FindImplementation implementation = []() -> FindImplementation {
+#ifdef VUNE_X86
+                    if (CpuFeatures::hasAvx2()) {
+                        return { findAvx2, "avx2" };
+                    }
+                    if (CpuFeatures::hasSse2()) {
+                        return { findSse2, "sse2" };
+                    }
+#endif
+                    return { findScalar, "scalar" };
+                }();
+                return implementation;
+            }
+        }
+
+        LiteralSearcher::LiteralSearcher(const std::string& pattern, bool caseSensitive)
+            : pattern(pattern), caseSensitive(caseSensitive) {
+            if (!caseSensitive) {
+                for (char& c : this->pattern) {
+                    c = toLower(c);
+                }
+            }
+        }
+
+        size_t LiteralSearcher::find(const char* data, size_t length) const {
+            if (pattern.empty() || length < pattern.size()) {
+                return npos;
+            }
+            return selectImplementation().function(data, length, pattern.data(), pattern.size(), caseSensitive);
+        }
+
+        const char* LiteralSearcher::implementationName() {
+            return selectImplementation().name;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
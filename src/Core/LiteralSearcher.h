@@ -0,0 +1,35 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Vectorized search for a fixed string. Blocks of text are compared against the
+        // first and last byte of the pattern at once, and only positions where both
+        // match are verified. The widest implementation the CPU supports (AVX2, SSE2 or
+        // scalar) is picked on first use. Case folding covers ASCII letters only.
+        class LiteralSearcher {
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            LiteralSearcher(const std::string& pattern, bool caseSensitive);
+
+            size_t getPatternLength() const { return pattern.size(); }
+            bool isCaseSensitive() const { return caseSensitive; }
+
+            // Offset of the first match in [data, data + length), or npos. An empty
+            // pattern matches nowhere.
+            size_t find(const char* data, size_t length) const;
+
+            // Name of the implementation in use, for diagnostics
+            static const char* implementationName();
+
+        private:
+            // Lowercased when the search ignores case
+            std::string pattern;
+            bool caseSensitive;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "MappedFile.h"
+#include "MappingGuard.h"
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Vune {
+    namespace Core {
+
+        class MappedFile::Impl {
+        public:
+#ifdef _WIN32
+            Impl() : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr) {}
+
+            ~Impl() {
+                if (view) UnmapViewOfFile(view);
+                if (mapping) CloseHandle(mapping);
+                if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            }
+
+            HANDLE file;
+            HANDLE mapping;
+            LPVOID view;
+#else
+            Impl() : descriptor(-1), view(nullptr), viewLength(0) {}
+
+            ~Impl() {
+                guard.reset();
+                if (view) munmap(view, viewLength);
+                if (descriptor >= 0) close(descriptor);
+            }
+
+            int descriptor;
+            void* view;
+            size_t viewLength;
+            std::unique_ptr<MappingGuard> guard;
+#endif
+        };
+
+        MappedFile::MappedFile() : bytes(nullptr), length(0), pImpl(std::make_unique<Impl>()) {
+        }
+
+        MappedFile::~MappedFile() {
+        }
+
+        std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+            std::shared_ptr<MappedFile> result(new MappedFile());
+            Impl& impl = *result->pImpl;
+
+#ifdef _WIN32
+            // Other programs may keep writing the file; while it is mapped Windows
+            // refuses to truncate it, and renaming over or deleting it leaves the
+            // view as it was
+            impl.file = CreateFileW(fs::u8path(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (impl.file == INVALID_HANDLE_VALUE) {
+                return nullptr;
+            }
+
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(impl.file, &fileSize)) {
+                return nullptr;
+            }
+            if (fileSize.QuadPart == 0) {
+                return result;
+            }
+
+            impl.mapping = CreateFileMappingW(impl.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!impl.mapping) {
+                return nullptr;
+            }
+
+            impl.view = MapViewOfFile(impl.mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!impl.view) {
+                return nullptr;
+            }
+
+            result->bytes = static_cast<const char*>(impl.view);
+            result->length = static_cast<size_t>(fileSize.QuadPart);
+#else
+            impl.descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (impl.descriptor < 0) {
+                return nullptr;
+            }
+
+            struct stat info;
+            if (fstat(impl.descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+                return nullptr;
+            }
+            if (info.st_size == 0) {
+                return result;
+            }
+
+            // A private read-only mapping. It is not a snapshot: pages follow writes made
+            // to the file in place, and the guard turns those lost to a truncation into
+            // zeros rather than a fault.
+            void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, impl.descriptor, 0);
+            if (view == MAP_FAILED) {
+                return nullptr;
+            }
+
+            impl.view = view;
+            impl.viewLength = static_cast<size_t>(info.st_size);
+            impl.guard = std::make_unique<MappingGuard>(view, impl.viewLength);
+            result->bytes = static_cast<const char*>(view);
+            result->length = impl.viewLength;
+#endif
+
+            return result;
+        }
+
+        bool MappedFile::isIntact() const {
+#ifdef _WIN32
+            return true;
+#else
+            return !pImpl->guard || !pImpl->guard->isDamaged();
+#endif
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
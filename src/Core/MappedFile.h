@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Read-only memory mapping of a whole file. The view stays valid for the
+        // lifetime of the object, so whatever references its bytes should share it.
+        //
+        // The bytes follow the file on disk. Saves through AtomicFile replace the file
+        // and leave them alone, but a file rewritten in place shows the new bytes.
+        // Other programs may still write it, on Windows too. Bytes lost when another
+        // process truncates the file read as zeros (see MappingGuard) instead of
+        // crashing, and isIntact turns false.
+        class MappedFile {
+        public:
+            ~MappedFile();
+
+            // Map a file; returns null if it cannot be opened or mapped
+            static std::shared_ptr<MappedFile> open(const std::string& path);
+
+            const char* data() const { return bytes; }
+            size_t size() const { return length; }
+
+            // False once a read found part of the file truncated away
+            bool isIntact() const;
+
+        private:
+            MappedFile();
+
+            // Prevent copying
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            const char* bytes;
+            size_t length;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "MappingGuard.h"
+#include <atomic>
+#include <mutex>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+#ifdef _WIN32
+        MappingGuard::MappingGuard(const void*, size_t) : slot(-1) {
+        }
+
+        MappingGuard::~MappingGuard() {
+        }
+
+        bool MappingGuard::isDamaged() const {
+            return false;
+        }
+#else
+        namespace {
+            // Ranges guarded at once. The handler cannot lock, so they live in a fixed
+            // table of atomics; it scans the whole table only on a fault.
+            const int kSlotCount = 4096;
+
+            struct Slot {
+                std::atomic<bool> used;
+                std::atomic<uintptr_t> begin;       // 0 while the slot is being filled or emptied
+                std::atomic<uintptr_t> end;
+                std::atomic<bool> damaged;
+            };
+
+            Slot slots[kSlotCount];
+            std::atomic<int> nextSlot(0);
+            uintptr_t pageSize;
+            struct sigaction previousAction;
+
+            void handleBusError(int signal, siginfo_t* info, void* context) {
+                uintptr_t address = reinterpret_cast<uintptr_t>(info->si_addr);
+                for (Slot& slot : slots) {
+                    uintptr_t begin = slot.begin.load(std::memory_order_acquire);
+                    if (begin == 0 || address < begin || address >= slot.end.load(std::memory_order_relaxed)) {
+                        continue;
+                    }
+
+                    // The faulting read is retried once this returns, and now finds zeros
+                    void* page = reinterpret_cast<void*>(address & ~(pageSize - 1));
+                    if (mmap(page, pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+                        slot.damaged.store(true, std::memory_order_relaxed);
+                        return;
+                    }
+                    break;
+                }
+
+                if (previousAction.sa_flags & SA_SIGINFO) {
+                    previousAction.sa_sigaction(signal, info, context);
+                }
+                else if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN) {
+                    previousAction.sa_handler(signal);
+                }
+                else {
+                    // The read faults again with the default action, which ends the process
+                    struct sigaction defaultAction = {};
+                    defaultAction.sa_handler = SIG_DFL;
+                    sigaction(SIGBUS, &defaultAction, nullptr);
+                }
+            }
+
+            void installHandler() {
+                static std::once_flag installed;
+                std::call_once(installed, []() {
+                    pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+                    struct sigaction action = {};
+                    action.sa_sigaction = handleBusError;
+                    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+                    sigemptyset(&action.sa_mask);
+                    sigaction(SIGBUS, &action, &previousAction);
+                });
+            }
+        }
+
+        MappingGuard::MappingGuard(const void* base, size_t length) : slot(-1) {
+            if (!base || length == 0) {
+                return;
+            }
+            installHandler();
+
+            int start = nextSlot.load(std::memory_order_relaxed);
+            for (int i = 0; i < kSlotCount; ++i) {
+                int index = (start + i) % kSlotCount;
+                bool expected = false;
+                if (slots[index].used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    Slot& claimed = slots[index];
+                    claimed.damaged.store(false, std::memory_order_relaxed);
+                    claimed.end.store(reinterpret_cast<uintptr_t>(base) + length, std::memory_order_relaxed);
+                    claimed.begin.store(reinterpret_cast<uintptr_t>(base), std::memory_order_release);
+                    nextSlot.store((index + 1) % kSlotCount, std::memory_order_relaxed);
+                    slot = index;
+                    return;
+                }
+            }
+        }
+
+        MappingGuard::~MappingGuard() {
+            if (slot >= 0) {
+                slots[slot].begin.store(0, std::memory_order_release);
+                slots[slot].used.store(false, std::memory_order_release);
+            }
+        }
+
+        bool MappingGuard::isDamaged() const {
+            return slot >= 0 && slots[slot].damaged.load(std::memory_order_relaxed);
+        }
+#endif
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Keeps reads of a file mapping from crashing when the file shrinks under
+        // it. On POSIX systems touching a mapped page past the end of a truncated
+        // file raises SIGBUS; within a guarded range the handler maps a zero-filled
+        // page over the lost one instead, so the read sees zeros, and marks the
+        // range damaged. Faults anywhere else go to the previous handler. Windows
+        // refuses to truncate a mapped file, so there nothing needs guarding.
+        class MappingGuard {
+        public:
+            // Guard length bytes from base until destroyed, which must happen before
+            // they are unmapped. Ranges beyond a fixed number stay unguarded.
+            MappingGuard(const void* base, size_t length);
+            ~MappingGuard();
+
+            // Whether a read found part of the range gone
+            bool isDamaged() const;
+
+        private:
+            // Prevent copying
+            MappingGuard(const MappingGuard&) = delete;
+            MappingGuard& operator=(const MappingGuard&) = delete;
+
+            int slot;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
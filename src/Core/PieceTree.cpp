@@ -0,0 +1,760 @@
+#include "pch.h"
+#include "PieceTree.h"
+#include "LineScanner.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Pieces in the add buffer never exceed one add chunk, so splitting them can
+            // afford to rescan their bytes. Larger inserts get a sealed, indexed chunk.
+            const size_t kAddChunkCapacity = 64 * 1024;
+            const size_t kLargeInsertThreshold = 16 * 1024;
+
+            using NodePtr = PieceTree::NodePtr;
+
+            // Node plus its shared_ptr control block
+            const size_t kNodeFootprint = sizeof(PieceNode) + 2 * sizeof(void*);
+
+            // Nodes built on this thread, used to measure what an edit allocated
+            thread_local size_t nodesCreated = 0;
+
+            size_t lengthOf(const NodePtr& node) {
+                return node ? node->length : 0;
+            }
+
+            size_t lineBreaksOf(const NodePtr& node) {
+                return node ? node->lineBreaks : 0;
+            }
+
+            size_t pieceCountOf(const NodePtr& node) {
+                return node ? node->pieceCount : 0;
+            }
+
+            NodePtr makeNode(const Piece& piece, const NodePtr& left, const NodePtr& right, uint32_t priority) {
+                auto node = std::make_shared<PieceNode>();
+                ++nodesCreated;
+                Trace::addCount(TraceCounter::Allocations);
+                node->piece = piece;
+                node->left = left;
+                node->right = right;
+                node->priority = priority;
+                node->length = lengthOf(left) + piece.length + lengthOf(right);
+                node->lineBreaks = lineBreaksOf(left) + piece.lineBreaks + lineBreaksOf(right);
+                node->pieceCount = pieceCountOf(left) + 1 + pieceCountOf(right);
+                return node;
+            }
+
+            NodePtr merge(const NodePtr& left, const NodePtr& right) {
+                if (!left) return right;
+                if (!right) return left;
+
+                if (left->priority >= right->priority) {
+                    return makeNode(left->piece, left->left, merge(left->right, right), left->priority);
+                }
+                return makeNode(right->piece, merge(left, right->left), right->right, right->priority);
+            }
+
+            // Split into the first offset bytes and the rest, cutting a piece if needed
+            void split(const NodePtr& node, size_t offset, NodePtr& left, NodePtr& right) {
+                if (!node || offset == 0) {
+                    left = nullptr;
+                    right = node;
+                    return;
+                }
+                if (offset >= node->length) {
+                    left = node;
+                    right = nullptr;
+                    return;
+                }
+
+                size_t leftLength = lengthOf(node->left);
+                size_t pieceEnd = leftLength + node->piece.length;
+
+                if (offset <= leftLength) {
+                    NodePtr rest;
+                    split(node->left, offset, left, rest);
+                    right = makeNode(node->piece, rest, node->right, node->priority);
+                }
+                else if (offset >= pieceEnd) {
+                    NodePtr rest;
+                    split(node->right, offset - pieceEnd, rest, right);
+                    left = makeNode(node->piece, node->left, rest, node->priority);
+                }
+                else {
+                    const Piece& piece = node->piece;
+                    size_t cut = offset - leftLength;
+
+                    Piece head = piece;
+                    head.length = cut;
+                    head.lineBreaks = piece.chunk->countLineBreaks(piece.start, cut);
+
+                    Piece tail = piece;
+                    tail.start = piece.start + cut;
+                    tail.length = piece.length - cut;
+                    tail.lineBreaks = piece.lineBreaks - head.lineBreaks;
+
+                    left = makeNode(head, node->left, nullptr, node->priority);
+                    right = makeNode(tail, nullptr, node->right, node->priority);
+                }
+            }
+
+            // Length of the next chunk of text. Sealed chunks index line starts with
+            // 32-bit offsets, so longer text is split, keeping "\r\n" pairs together.
+            size_t nextChunkLength(const char* text, size_t length) {
+                size_t chunkLength = std::min(length, TextChunk::kMaxSealedLength);
+                if (chunkLength < length && text[chunkLength - 1] == '\r') {
+                    --chunkLength;
+                }
+                return chunkLength;
+            }
+
+            // Grow the last piece in place when the new text directly follows it in the
+            // same chunk, which is what sequential typing produces. Returns null otherwise.
+            NodePtr extendLastPiece(const NodePtr& node, const Piece& addition) {
+                if (!node) {
+                    return nullptr;
+                }
+
+                if (node->right) {
+                    NodePtr right = extendLastPiece(node->right, addition);
+                    return right ? makeNode(node->piece, node->left, right, node->priority) : nullptr;
+                }
+
+                const Piece& last = node->piece;
+                if (last.chunk != addition.chunk || last.start + last.length != addition.start) {
+                    return nullptr;
+                }
+
+                Piece extended = last;
+                extended.length += addition.length;
+                extended.lineBreaks += addition.lineBreaks;
+                return makeNode(extended, node->left, nullptr, node->priority);
+            }
+
+            // Offset just past the n-th (1-based) line break
+            size_t offsetAfterLineBreak(const NodePtr& root, size_t n) {
+                size_t base = 0;
+                const PieceNode* node = root.get();
+
+                while (node) {
+                    size_t leftBreaks = lineBreaksOf(node->left);
+                    if (n <= leftBreaks) {
+                        node = node->left.get();
+                        continue;
+                    }
+
+                    n -= leftBreaks;
+                    base += lengthOf(node->left);
+
+                    const Piece& piece = node->piece;
+                    if (n <= piece.lineBreaks) {
+                        size_t lineBreak = piece.chunk->findLineBreak(piece.start, piece.length, n - 1);
+                        return base + (lineBreak - piece.start) + 1;
+                    }
+
+                    n -= piece.lineBreaks;
+                    base += piece.length;
+                    node = node->right.get();
+                }
+
+                return base;
+            }
+
+            // Number of line breaks in [0, offset)
+            size_t lineBreaksBefore(const NodePtr& root, size_t offset) {
+                size_t count = 0;
+                const PieceNode* node = root.get();
+
+                while (node && offset > 0) {
+                    size_t leftLength = lengthOf(node->left);
+                    if (offset <= leftLength) {
+                        node = node->left.get();
+                        continue;
+                    }
+
+                    count += lineBreaksOf(node->left);
+                    offset -= leftLength;
+
+                    const Piece& piece = node->piece;
+                    if (offset <= piece.length) {
+                        return count + piece.chunk->countLineBreaks(piece.start, offset);
+                    }
+
+                    count += piece.lineBreaks;
+                    offset -= piece.length;
+                    node = node->right.get();
+                }
+
+                return count;
+            }
+
+            // Find the piece holding the byte just before offset (0 < offset <= length),
+            // along with the document offset and line breaks that precede it
+            const Piece* findPiece(const NodePtr& root, size_t offset, size_t& pieceOffset, size_t& pieceLineBreaks) {
+                pieceOffset = 0;
+                pieceLineBreaks = 0;
+                const PieceNode* node = root.get();
+
+                while (node) {
+                    size_t leftLength = lengthOf(node->left);
+                    if (offset <= leftLength) {
+                        node = node->left.get();
+                        continue;
+                    }
+
+                    offset -= leftLength;
+                    pieceOffset += leftLength;
+                    pieceLineBreaks += lineBreaksOf(node->left);
+
+                    if (offset <= node->piece.length) {
+                        return &node->piece;
+                    }
+
+                    offset -= node->piece.length;
+                    pieceOffset += node->piece.length;
+                    pieceLineBreaks += node->piece.lineBreaks;
+                    node = node->right.get();
+                }
+
+                return nullptr;
+            }
+
+            // Line and column of an offset that falls inside (or at the end of) piece
+            void resolveOffset(const Piece& piece, size_t pieceOffset, size_t pieceLineBreaks, size_t pieceLineStart,
+                size_t offset, size_t lineBreakLength, size_t& line, size_t& column) {
+                size_t lastLineBreak = 0;
+                size_t relative = offset - pieceOffset;
+                size_t breaks = piece.chunk->countLineBreaks(piece.start, relative, lastLineBreak);
+                size_t lineStart = breaks > 0 ? pieceOffset + (lastLineBreak - piece.start) + 1 : pieceLineStart;
+
+                line = pieceLineBreaks + breaks;
+                column = offset - lineStart;
+
+                // An offset between '\r' and '\n' belongs to the end of the line
+                if (lineBreakLength > 1 && column > 0 && piece.chunk->data()[piece.start + relative - 1] == '\r') {
+                    --column;
+                }
+            }
+
+            void collectPieces(const NodePtr& root, std::vector<Piece>& pieces) {
+                std::vector<const PieceNode*> stack;
+                const PieceNode* node = root.get();
+
+                while (node || !stack.empty()) {
+                    while (node) {
+                        stack.push_back(node);
+                        node = node->left.get();
+                    }
+                    node = stack.back();
+                    stack.pop_back();
+                    pieces.push_back(node->piece);
+                    node = node->right.get();
+                }
+            }
+
+            NodePtr buildFromCartesian(const std::vector<Piece>& pieces, const std::vector<uint32_t>& priorities,
+                const std::vector<int>& left, const std::vector<int>& right, int index) {
+                if (index < 0) {
+                    return nullptr;
+                }
+                NodePtr leftChild = buildFromCartesian(pieces, priorities, left, right, left[index]);
+                NodePtr rightChild = buildFromCartesian(pieces, priorities, left, right, right[index]);
+                return makeNode(pieces[index], leftChild, rightChild, priorities[index]);
+            }
+
+            void appendRange(const PieceNode* node, size_t start, size_t end, std::string& out) {
+                if (!node || start >= end) {
+                    return;
+                }
+
+                size_t leftLength = lengthOf(node->left);
+                size_t pieceEnd = leftLength + node->piece.length;
+
+                if (start < leftLength) {
+                    appendRange(node->left.get(), start, std::min(end, leftLength), out);
+                }
+
+                if (start < pieceEnd && end > leftLength) {
+                    size_t from = std::max(start, leftLength) - leftLength;
+                    size_t to = std::min(end, pieceEnd) - leftLength;
+                    out.append(node->piece.chunk->data() + node->piece.start + from, to - from);
+                }
+
+                if (end > pieceEnd) {
+                    appendRange(node->right.get(), start > pieceEnd ? start - pieceEnd : 0, end - pieceEnd, out);
+                }
+            }
+        }
+
+        TextChunk::TextChunk(std::string text)
+            : bytes(nullptr), size(0), capacity(0), sealed(true) {
+            auto storage = std::make_shared<std::string>(std::move(text));
+            bytes = storage->data();
+            size = storage->size();
+            capacity = size;
+            owner = std::move(storage);
+            Trace::addCount(TraceCounter::Allocations);
+            indexLineStarts();
+        }
+
+        TextChunk::TextChunk(std::shared_ptr<const void> owner, const char* data, size_t length)
+            : owner(std::move(owner)), bytes(data), size(length), capacity(length), sealed(true) {
+            Trace::addCount(TraceCounter::Allocations);
+            indexLineStarts();
+        }
+
+        TextChunk::TextChunk(size_t capacity)
+            : appendStorage(new char[capacity]), bytes(nullptr), size(0), capacity(capacity), sealed(false) {
+            Trace::addCount(TraceCounter::Allocations);
+            bytes = appendStorage.get();
+        }
+
+        std::shared_ptr<TextChunk> TextChunk::createAppendable(size_t capacity) {
+            return std::shared_ptr<TextChunk>(new TextChunk(capacity));
+        }
+
+        void TextChunk::indexLineStarts() {
+            LineScanner::scan(bytes, size, &lineStarts);
+        }
+
+        size_t TextChunk::append(const char* text, size_t length) {
+            size_t start = size;
+            std::memcpy(appendStorage.get() + start, text, length);
+            size += length;
+            return start;
+        }
+
+        size_t TextChunk::countLineBreaks(size_t start, size_t length) const {
+            if (sealed) {
+                // A '\n' at p starts a line at p + 1
+                auto first = std::lower_bound(lineStarts.begin(), lineStarts.end(), start + 1);
+                auto last = std::lower_bound(first, lineStarts.end(), start + length + 1);
+                return static_cast<size_t>(last - first);
+            }
+
+            return static_cast<size_t>(std::count(bytes + start, bytes + start + length, '\n'));
+        }
+
+        size_t TextChunk::countLineBreaks(size_t start, size_t length, size_t& lastLineBreak) const {
+            if (sealed) {
+                auto first = std::lower_bound(lineStarts.begin(), lineStarts.end(), start + 1);
+                auto last = std::lower_bound(first, lineStarts.end(), start + length + 1);
+                if (last != first) {
+                    lastLineBreak = *(last - 1) - 1;
+                }
+                return static_cast<size_t>(last - first);
+            }
+
+            size_t count = 0;
+            for (size_t i = start; i < start + length; ++i) {
+                if (bytes[i] == '\n') {
+                    lastLineBreak = i;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        size_t TextChunk::findLineBreak(size_t start, size_t length, size_t n) const {
+            if (sealed) {
+                auto first = std::lower_bound(lineStarts.begin(), lineStarts.end(), start + 1);
+                return *(first + n) - 1;
+            }
+
+            const char* position = bytes + start;
+            const char* end = position + length;
+            while (true) {
+                position = static_cast<const char*>(std::memchr(position, '\n', end - position));
+                if (n == 0) {
+                    return static_cast<size_t>(position - bytes);
+                }
+                --n;
+                ++position;
+            }
+        }
+
+        PieceTree::PieceTree() : randomState(0x9E3779B9u), lineBreakLength(1), footprint(0) {
+        }
+
+        PieceTree::PieceTree(std::string text) : randomState(0x9E3779B9u), lineBreakLength(1), footprint(0) {
+            setText(std::move(text));
+        }
+
+        void PieceTree::setText(std::string text) {
+            auto storage = std::make_shared<std::string>(std::move(text));
+            const char* data = storage->data();
+            size_t length = storage->size();
+            setText(std::move(storage), data, length);
+        }
+
+        void PieceTree::setText(std::shared_ptr<const void> owner, const char* data, size_t length) {
+            root = nullptr;
+            addChunk = nullptr;
+            size_t nodesBefore = nodesCreated;
+
+            // The initial content is used in place: one piece per sealed chunk
+            for (size_t start = 0, chunkLength = 0; start < length; start += chunkLength) {
+                chunkLength = nextChunkLength(data + start, length - start);
+                auto chunk = std::make_shared<TextChunk>(owner, data + start, chunkLength);
+
+                Piece piece;
+                piece.chunk = chunk;
+                piece.start = 0;
+                piece.length = chunkLength;
+                piece.lineBreaks = chunk->countLineBreaks(0, chunkLength);
+                root = merge(root, makeNode(piece, nullptr, nullptr, nextPriority()));
+            }
+
+            footprint += (nodesCreated - nodesBefore) * kNodeFootprint + length;
+        }
+
+        void PieceTree::setLineBreakLength(size_t length) {
+            lineBreakLength = length;
+        }
+
+        size_t PieceTree::getLength() const {
+            return lengthOf(root);
+        }
+
+        size_t PieceTree::getLineCount() const {
+            return lineBreaksOf(root) + 1;
+        }
+
+        size_t PieceTree::getLineStart(size_t line) const {
+            if (line == 0) {
+                return 0;
+            }
+            return offsetAfterLineBreak(root, line);
+        }
+
+        size_t PieceTree::getLineLength(size_t line) const {
+            size_t start = getLineStart(line);
+            if (line + 1 >= getLineCount()) {
+                return getLength() - start;
+            }
+            return getLineStart(line + 1) - lineBreakLength - start;
+        }
+
+        size_t PieceTree::getLineAt(size_t offset) const {
+            return lineBreaksBefore(root, std::min(offset, getLength()));
+        }
+
+        void PieceTree::getLineAndColumn(size_t offset, size_t& line, size_t& column) const {
+            offset = std::min(offset, getLength());
+            if (offset == 0) {
+                line = 0;
+                column = 0;
+                return;
+            }
+
+            size_t pieceOffset, pieceLineBreaks;
+            const Piece* piece = findPiece(root, offset, pieceOffset, pieceLineBreaks);
+            resolveOffset(*piece, pieceOffset, pieceLineBreaks, getLineStart(pieceLineBreaks), offset, lineBreakLength, line, column);
+        }
+
+        void PieceTree::getLinesAndColumns(const std::vector<size_t>& offsets, std::vector<size_t>& lines, std::vector<size_t>& columns) const {
+            lines.resize(offsets.size());
+            columns.resize(offsets.size());
+
+            size_t length = getLength();
+            const Piece* piece = nullptr;
+            size_t pieceOffset = 0;
+            size_t pieceLineBreaks = 0;
+            size_t pieceLineStart = 0;
+
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                size_t offset = std::min(offsets[i], length);
+                if (offset == 0) {
+                    lines[i] = 0;
+                    columns[i] = 0;
+                    continue;
+                }
+
+                if (!piece || offset <= pieceOffset || offset > pieceOffset + piece->length) {
+                    piece = findPiece(root, offset, pieceOffset, pieceLineBreaks);
+                    pieceLineStart = getLineStart(pieceLineBreaks);
+                }
+
+                resolveOffset(*piece, pieceOffset, pieceLineBreaks, pieceLineStart, offset, lineBreakLength, lines[i], columns[i]);
+            }
+        }
+
+        std::string PieceTree::getText() const {
+            return getText(0, getLength());
+        }
+
+        std::string PieceTree::getText(size_t start, size_t end) const {
+            return getText(root, start, end);
+        }
+
+        std::string PieceTree::getText(const NodePtr& root, size_t start, size_t end) {
+            std::string result;
+            end = std::min(end, lengthOf(root));
+            if (start < end) {
+                result.reserve(end - start);
+                appendRange(root.get(), start, end, result);
+            }
+            return result;
+        }
+
+        void PieceTree::insert(size_t offset, const char* text, size_t length) {
+            if (length == 0) {
+                return;
+            }
+
+            size_t nodesBefore = nodesCreated;
+            NodePtr left, right;
+            split(root, std::min(offset, getLength()), left, right);
+
+            for (size_t start = 0, chunkLength = 0; start < length; start += chunkLength) {
+                chunkLength = nextChunkLength(text + start, length - start);
+                Piece piece = storeText(text + start, chunkLength);
+                NodePtr extended = extendLastPiece(left, piece);
+                left = extended ? extended : merge(left, makeNode(piece, nullptr, nullptr, nextPriority()));
+            }
+
+            root = merge(left, right);
+            footprint += (nodesCreated - nodesBefore) * kNodeFootprint + length;
+        }
+
+        void PieceTree::remove(size_t offset, size_t length) {
+            if (length == 0 || offset >= getLength()) {
+                return;
+            }
+
+            size_t nodesBefore = nodesCreated;
+            NodePtr left, rest, removed, right;
+            split(root, offset, left, rest);
+            split(rest, length, removed, right);
+            root = merge(left, right);
+            footprint += (nodesCreated - nodesBefore) * kNodeFootprint;
+        }
+
+        void PieceTree::applyEdits(const std::vector<Edit>& edits) {
+            if (edits.empty()) {
+                return;
+            }
+
+            // Splitting per edit costs O(k log n); rebuilding costs O(n + k). Pick the
+            // cheaper one for this batch.
+            size_t pieces = pieceCountOf(root);
+            size_t depth = 1;
+            while ((size_t(1) << depth) < pieces + 1) {
+                ++depth;
+            }
+
+            if (edits.size() * depth * 2 < pieces + edits.size()) {
+                // Back to front, so earlier offsets stay valid
+                for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+                    remove(it->offset, it->length);
+                    insert(it->offset, it->text, it->textLength);
+                }
+                return;
+            }
+
+            rebuild(edits);
+        }
+
+        void PieceTree::rebuild(const std::vector<Edit>& edits) {
+            size_t nodesBefore = nodesCreated;
+            size_t storedBytes = 0;
+
+            std::vector<Piece> pieces;
+            pieces.reserve(pieceCountOf(root));
+            collectPieces(root, pieces);
+
+            std::vector<Piece> result;
+            result.reserve(pieces.size() + edits.size() * 2);
+
+            // Cursor over the old pieces: index plus offset into that piece
+            size_t index = 0;
+            size_t within = 0;
+            size_t position = 0;
+
+            auto advance = [&](size_t target, bool keep) {
+                while (position < target && index < pieces.size()) {
+                    const Piece& piece = pieces[index];
+                    size_t take = std::min(piece.length - within, target - position);
+
+                    if (keep) {
+                        if (within == 0 && take == piece.length) {
+                            result.push_back(piece);
+                        }
+                        else {
+                            Piece slice = piece;
+                            slice.start = piece.start + within;
+                            slice.length = take;
+                            slice.lineBreaks = piece.chunk->countLineBreaks(slice.start, take);
+                            result.push_back(slice);
+                        }
+                    }
+
+                    position += take;
+                    within += take;
+                    if (within == piece.length) {
+                        ++index;
+                        within = 0;
+                    }
+                }
+            };
+
+            for (const auto& edit : edits) {
+                advance(edit.offset, true);
+
+                for (size_t start = 0, chunkLength = 0; start < edit.textLength; start += chunkLength) {
+                    chunkLength = nextChunkLength(edit.text + start, edit.textLength - start);
+                    Piece piece = storeText(edit.text + start, chunkLength);
+                    storedBytes += chunkLength;
+
+                    // Consecutive inserts land next to each other in the add buffer
+                    if (!result.empty() && result.back().chunk == piece.chunk &&
+                        result.back().start + result.back().length == piece.start) {
+                        result.back().length += piece.length;
+                        result.back().lineBreaks += piece.lineBreaks;
+                    }
+                    else {
+                        result.push_back(piece);
+                    }
+                }
+
+                advance(edit.offset + edit.length, false);
+            }
+            advance(getLength(), true);
+
+            // Build a treap over the new sequence in linear time: a Cartesian tree on
+            // fresh random priorities, found with a stack over the right spine
+            std::vector<uint32_t> priorities(result.size());
+            std::vector<int> left(result.size(), -1);
+            std::vector<int> right(result.size(), -1);
+            std::vector<int> spine;
+
+            for (size_t i = 0; i < result.size(); ++i) {
+                priorities[i] = nextPriority();
+                int last = -1;
+                while (!spine.empty() && priorities[spine.back()] < priorities[i]) {
+                    last = spine.back();
+                    spine.pop_back();
+                }
+                left[i] = last;
+                if (!spine.empty()) {
+                    right[spine.back()] = static_cast<int>(i);
+                }
+                spine.push_back(static_cast<int>(i));
+            }
+
+            root = spine.empty() ? nullptr : buildFromCartesian(result, priorities, left, right, spine.front());
+            footprint += (nodesCreated - nodesBefore) * kNodeFootprint + storedBytes;
+        }
+
+        Piece PieceTree::storeText(const char* text, size_t length) {
+            Piece piece;
+            piece.length = length;
+
+            if (length > kLargeInsertThreshold) {
+                auto chunk = std::make_shared<TextChunk>(std::string(text, length));
+                piece.chunk = chunk;
+                piece.start = 0;
+                piece.lineBreaks = chunk->countLineBreaks(0, length);
+                return piece;
+            }
+
+            if (!addChunk || addChunk->remainingCapacity() < length) {
+                addChunk = TextChunk::createAppendable(kAddChunkCapacity);
+            }
+
+            piece.chunk = addChunk;
+            piece.start = addChunk->append(text, length);
+            piece.lineBreaks = addChunk->countLineBreaks(piece.start, length);
+            return piece;
+        }
+
+        PieceWalker::PieceWalker() : start(0) {
+        }
+
+        PieceWalker::PieceWalker(PieceTree::NodePtr root, size_t offset) : root(std::move(root)), start(0) {
+            const PieceNode* node = this->root.get();
+
+            while (node) {
+                path.push_back(node);
+                size_t leftLength = lengthOf(node->left);
+                if (offset < leftLength) {
+                    node = node->left.get();
+                    continue;
+                }
+
+                offset -= leftLength;
+                start += leftLength;
+                if (offset < node->piece.length) {
+                    return;
+                }
+
+                offset -= node->piece.length;
+                start += node->piece.length;
+                node = node->right.get();
+            }
+
+            path.clear();
+        }
+
+        std::string_view PieceWalker::getText() const {
+            const Piece& piece = getPiece();
+            return std::string_view(piece.chunk->data() + piece.start, piece.length);
+        }
+
+        void PieceWalker::next() {
+            start += getPiece().length;
+
+            const PieceNode* node = path.back()->right.get();
+            if (node) {
+                while (node) {
+                    path.push_back(node);
+                    node = node->left.get();
+                }
+                return;
+            }
+
+            // Climb past every node whose right subtree was just finished
+            const PieceNode* child = path.back();
+            path.pop_back();
+            while (!path.empty() && path.back()->right.get() == child) {
+                child = path.back();
+                path.pop_back();
+            }
+        }
+
+        void PieceWalker::previous() {
+            const PieceNode* node = path.back()->left.get();
+            if (node) {
+                while (node) {
+                    path.push_back(node);
+                    node = node->right.get();
+                }
+                start -= getPiece().length;
+                return;
+            }
+
+            const PieceNode* child = path.back();
+            path.pop_back();
+            while (!path.empty() && path.back()->left.get() == child) {
+                child = path.back();
+                path.pop_back();
+            }
+            if (!path.empty()) {
+                start -= getPiece().length;
+            }
+        }
+
+        uint32_t PieceTree::nextPriority() {
+            // xorshift32; priorities only need to be well spread, not unpredictable
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+            return randomState;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
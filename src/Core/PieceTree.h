@@ -0,0 +1,184 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Block of text that pieces point into. A sealed chunk is immutable and keeps
+        // an index of its line starts. An appendable chunk (the add buffer) only ever
+        // grows at the end, so bytes already referenced by a piece never move. Reads
+        // stay within the pieces that reference a chunk, so other threads can read
+        // pieces of a saved root while the editing thread appends.
+        class TextChunk {
+        public:
+            // Sealed chunks index line starts with 32-bit offsets, so longer content is
+            // split across several chunks
+            static constexpr size_t kMaxSealedLength = 0x40000000;
+
+            // Sealed chunk owning the given text
+            explicit TextChunk(std::string text);
+
+            // Sealed chunk over bytes kept alive by owner, such as a file mapping
+            TextChunk(std::shared_ptr<const void> owner, const char* data, size_t length);
+
+            // Appendable chunk with a fixed capacity
+            static std::shared_ptr<TextChunk> createAppendable(size_t capacity);
+
+            const char* data() const { return bytes; }
+            bool isSealed() const { return sealed; }
+            size_t remainingCapacity() const { return capacity - size; }
+
+            // Append text to an appendable chunk and return the offset it was stored at
+            size_t append(const char* text, size_t length);
+
+            // Number of line breaks in [start, start + length)
+            size_t countLineBreaks(size_t start, size_t length) const;
+
+            // Same, also reporting the chunk offset of the last one found
+            size_t countLineBreaks(size_t start, size_t length, size_t& lastLineBreak) const;
+
+            // Chunk offset of the n-th (0-based) line break in [start, start + length)
+            size_t findLineBreak(size_t start, size_t length, size_t n) const;
+
+        private:
+            TextChunk(size_t capacity);
+
+            void indexLineStarts();
+
+            std::shared_ptr<const void> owner;
+            std::unique_ptr<char[]> appendStorage;
+            const char* bytes;
+            size_t size;
+            size_t capacity;
+            bool sealed;
+            std::vector<uint32_t> lineStarts;
+        };
+
+        // Span of a chunk that forms part of the document
+        struct Piece {
+            std::shared_ptr<const TextChunk> chunk;
+            size_t start;
+            size_t length;
+            size_t lineBreaks;
+        };
+
+        // Treap node augmented with subtree totals. Nodes are never modified once
+        // built; edits copy the path from the root instead.
+        struct PieceNode {
+            Piece piece;
+            std::shared_ptr<const PieceNode> left;
+            std::shared_ptr<const PieceNode> right;
+            uint32_t priority;
+            size_t length;
+            size_t lineBreaks;
+            size_t pieceCount;
+        };
+
+        // Piece tree storage for TextBuffer. The document is the in-order concatenation
+        // of the pieces; edits and line lookups cost O(log n) in the number of pieces.
+        // Line breaks are '\n', or "\r\n" in CRLF documents; only the '\n' is counted.
+        class PieceTree {
+        public:
+            using NodePtr = std::shared_ptr<const PieceNode>;
+
+            // Replace length bytes at offset with text
+            struct Edit {
+                size_t offset;
+                size_t length;
+                const char* text;
+                size_t textLength;
+            };
+
+            PieceTree();
+            explicit PieceTree(std::string text);
+
+            // Replace the whole document
+            void setText(std::string text);
+
+            // Replace the whole document with bytes kept alive by owner, without copying
+            void setText(std::shared_ptr<const void> owner, const char* data, size_t length);
+
+            // Length of the line break sequence: 1 for "\n", 2 for "\r\n"
+            void setLineBreakLength(size_t length);
+
+            // Document metrics
+            size_t getLength() const;
+            size_t getLineCount() const;
+
+            // Line lookups
+            size_t getLineStart(size_t line) const;
+            size_t getLineLength(size_t line) const;
+            size_t getLineAt(size_t offset) const;
+            void getLineAndColumn(size_t offset, size_t& line, size_t& column) const;
+
+            // Convert offsets to line/column pairs. Ascending offsets are resolved in a
+            // single pass that reuses the piece found for the previous offset.
+            void getLinesAndColumns(const std::vector<size_t>& offsets, std::vector<size_t>& lines, std::vector<size_t>& columns) const;
+
+            // Read text
+            std::string getText() const;
+            std::string getText(size_t start, size_t end) const;
+
+            // Read text from a saved root
+            static std::string getText(const NodePtr& root, size_t start, size_t end);
+
+            // Edit text
+            void insert(size_t offset, const char* text, size_t length);
+            void remove(size_t offset, size_t length);
+
+            // Apply non-overlapping edits given in ascending offset order, all relative
+            // to the current text. Large batches rebuild the tree in one linear pass.
+            void applyEdits(const std::vector<Edit>& edits);
+
+            // The tree is persistent: a saved root stays a complete, unchanged document
+            NodePtr getRoot() const { return root; }
+            void setRoot(NodePtr value) { root = std::move(value); }
+
+            // Approximate bytes allocated so far for new nodes and stored text. The
+            // difference across an edit is what keeping its old root alive costs.
+            size_t getFootprint() const { return footprint; }
+
+        private:
+            void rebuild(const std::vector<Edit>& edits);
+            // Store at most TextChunk::kMaxSealedLength bytes as one piece
+            Piece storeText(const char* text, size_t length);
+            uint32_t nextPriority();
+
+            NodePtr root;
+            std::shared_ptr<TextChunk> addChunk;
+            uint32_t randomState;
+            size_t lineBreakLength;
+            size_t footprint;
+        };
+
+        // In-order walk over the pieces of a saved root, in either direction. It keeps
+        // the path from the root, so stepping to a neighbouring piece is amortized O(1),
+        // and holds the root, so the bytes of every piece stay alive.
+        class PieceWalker {
+        public:
+            PieceWalker();
+
+            // On the piece containing offset; an offset on a piece boundary selects the
+            // later piece. Offsets at or past the end leave the walker invalid.
+            PieceWalker(PieceTree::NodePtr root, size_t offset);
+
+            // False once the walk has stepped off either end
+            bool isValid() const { return !path.empty(); }
+
+            // Current piece, its bytes and the document offset it starts at
+            const Piece& getPiece() const { return path.back()->piece; }
+            std::string_view getText() const;
+            size_t getStart() const { return start; }
+
+            void next();
+            void previous();
+
+        private:
+            PieceTree::NodePtr root;
+            std::vector<const PieceNode*> path;
+            size_t start;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
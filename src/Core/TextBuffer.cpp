@@ -1,103 +1,939 @@
 #include "pch.h"
 #include "TextBuffer.h"
+#include "PieceTree.h"
+#include "MappedFile.h"
+#include "LineScanner.h"
+#include "Trace.h"
+#include "UndoHistory.h"
+#include "Utf8.h"
 #include <algorithm>
-#include <sstream>
+#include <cstring>
+#include <limits>
+#include <mutex>
 
 namespace Vune {
     namespace Core {
 
+        namespace {
+            const char* lineBreakOf(EndOfLine eol) {
+                return eol == EndOfLine::CRLF ? "\r\n" : "\n";
+            }
+
+            // The style with the most breaks wins; lone '\r' breaks are converted to LF
+            EndOfLine dominantEndOfLine(const LineBreakCounts& counts) {
+                return counts.carriageReturnLineFeeds > counts.lineFeeds ? EndOfLine::CRLF : EndOfLine::LF;
+            }
+
+            bool usesOnly(const LineBreakCounts& counts, EndOfLine eol) {
+                size_t matching = eol == EndOfLine::CRLF ? counts.carriageReturnLineFeeds : counts.lineFeeds;
+                return matching == counts.total();
+            }
+
+            // Rewrite every "\n", "\r\n" and lone "\r" as the document line ending
+            std::string normalizeLineEndings(const char* data, size_t length, EndOfLine eol) {
+                const char* lineBreak = lineBreakOf(eol);
+                std::string result;
+                result.reserve(length + length / 32);
+
+                for (size_t i = 0; i < length; ++i) {
+                    char c = data[i];
+                    if (c != '\r' && c != '\n') {
+                        result.push_back(c);
+                        continue;
+                    }
+                    if (c == '\r' && i + 1 < length && data[i + 1] == '\n') {
+                        ++i;
+                    }
+                    result.append(lineBreak);
+                }
+                return result;
+            }
+
+            // Reads shared by TextBuffer and TextSnapshot
+            bool isValidPositionIn(const PieceTree& tree, const Position& position) {
+                if (position.line < 0 || static_cast<size_t>(position.line) >= tree.getLineCount()) {
+                    return false;
+                }
+                
+                if (position.character < 0) {
+                    return false;
+                }
+                
+                // Allow position at the end of the line
+                return static_cast<size_t>(position.character) <= tree.getLineLength(position.line);
+            }
+
+            bool isValidRangeIn(const PieceTree& tree, const Range& range) {
+                return isValidPositionIn(tree, range.start) && isValidPositionIn(tree, range.end) && (range.start <= range.end);
+            }
+
+            int offsetIn(const PieceTree& tree, const Position& position) {
+                if (!isValidPositionIn(tree, position)) {
+                    return 0;
+                }
+                
+                return static_cast<int>(tree.getLineStart(position.line)) + position.character;
+            }
+
+            Position positionIn(const PieceTree& tree, int offset) {
+                if (offset <= 0) {
+                    return Position(0, 0);
+                }
+                
+                // Offsets beyond the end of the document clamp to the end
+                size_t line, character;
+                tree.getLineAndColumn(static_cast<size_t>(offset), line, character);
+                return Position(static_cast<int>(line), static_cast<int>(character));
+            }
+
+            std::vector<Position> positionsIn(const PieceTree& tree, const std::vector<int>& offsets) {
+                std::vector<size_t> clamped;
+                clamped.reserve(offsets.size());
+                for (int offset : offsets) {
+                    clamped.push_back(offset > 0 ? static_cast<size_t>(offset) : 0);
+                }
+                
+                std::vector<size_t> lines, columns;
+                tree.getLinesAndColumns(clamped, lines, columns);
+                
+                std::vector<Position> result;
+                result.reserve(offsets.size());
+                for (size_t i = 0; i < offsets.size(); ++i) {
+                    result.emplace_back(static_cast<int>(lines[i]), static_cast<int>(columns[i]));
+                }
+                return result;
+            }
+
+            std::string lineIn(const PieceTree& tree, int line) {
+                if (line < 0 || static_cast<size_t>(line) >= tree.getLineCount()) {
+                    return "";
+                }
+                
+                size_t start = tree.getLineStart(line);
+                return tree.getText(start, start + tree.getLineLength(line));
+            }
+
+            std::string textInRange(const PieceTree& tree, const Range& range) {
+                if (!isValidRangeIn(tree, range)) {
+                    return "";
+                }
+                
+                return tree.getText(offsetIn(tree, range.start), offsetIn(tree, range.end));
+            }
+
+            // View of [start, end), pointing into the tree's storage when a single piece
+            // holds it and copied into scratch otherwise
+            std::string_view viewIn(const PieceTree& tree, size_t start, size_t end, std::string& scratch) {
+                if (start >= end) {
+                    return std::string_view();
+                }
+                
+                PieceWalker walker(tree.getRoot(), start);
+                if (walker.isValid() && end <= walker.getStart() + walker.getPiece().length) {
+                    return walker.getText().substr(start - walker.getStart(), end - start);
+                }
+                
+                scratch = tree.getText(start, end);
+                return scratch;
+            }
+
+            std::string_view lineViewIn(const PieceTree& tree, int line, std::string& scratch) {
+                if (line < 0 || static_cast<size_t>(line) >= tree.getLineCount()) {
+                    return std::string_view();
+                }
+                
+                size_t start = tree.getLineStart(line);
+                return viewIn(tree, start, start + tree.getLineLength(line), scratch);
+            }
+
+            std::string_view rangeViewIn(const PieceTree& tree, const Range& range, std::string& scratch) {
+                if (!isValidRangeIn(tree, range)) {
+                    return std::string_view();
+                }
+                
+                return viewIn(tree, offsetIn(tree, range.start), offsetIn(tree, range.end), scratch);
+            }
+
+            void forEachChunkIn(const PieceTree& tree, size_t start, size_t end, const TextChunkVisitor& visitor) {
+                for (PieceWalker walker(tree.getRoot(), start); walker.isValid() && walker.getStart() < end; walker.next()) {
+                    std::string_view text = walker.getText();
+                    size_t from = start > walker.getStart() ? start - walker.getStart() : 0;
+                    size_t to = std::min(text.size(), end - walker.getStart());
+                    if (!visitor(text.substr(from, to - from))) {
+                        return;
+                    }
+                }
+            }
+
+            void forEachChunkIn(const PieceTree& tree, const Range& range, const TextChunkVisitor& visitor) {
+                if (isValidRangeIn(tree, range)) {
+                    forEachChunkIn(tree, offsetIn(tree, range.start), offsetIn(tree, range.end), visitor);
+                }
+            }
+
+            bool isAsciiIn(const PieceTree::NodePtr& root, size_t start, size_t end) {
+                for (PieceWalker walker(root, start); walker.isValid() && walker.getStart() < end; walker.next()) {
+                    std::string_view text = walker.getText();
+                    size_t from = start > walker.getStart() ? start - walker.getStart() : 0;
+                    size_t to = std::min(text.size(), end - walker.getStart());
+                    if (!Utf8::isAscii(text.data() + from, to - from)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Column tables of recently converted lines, built on first use. The
+            // cache is simply emptied when it grows past kMaxLines.
+            class ColumnCache {
+            public:
+                static constexpr size_t kMaxLines = 4096;
+
+                std::shared_ptr<const LineColumns> get(const PieceTree& tree, int line) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        auto found = lines.find(line);
+                        if (found != lines.end()) {
+                            return found->second;
+                        }
+                    }
+
+                    // Built outside the lock so other lines can be read meanwhile
+                    std::string scratch;
+                    auto columns = std::make_shared<const LineColumns>(lineViewIn(tree, line, scratch));
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (lines.size() >= kMaxLines) {
+                        lines.clear();
+                    }
+                    lines[line] = columns;
+                    return columns;
+                }
+
+                void forget(int line) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    lines.erase(line);
+                }
+
+                // Drop the tables of line and every line after it
+                void forgetFrom(int line) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (auto entry = lines.begin(); entry != lines.end();) {
+                        entry = entry->first >= line ? lines.erase(entry) : std::next(entry);
+                    }
+                }
+
+                void clear() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    lines.clear();
+                }
+
+            private:
+                std::mutex mutex;
+                std::unordered_map<int, std::shared_ptr<const LineColumns>> lines;
+            };
+
+            // Lines outside the document are returned unchanged. A document known to
+            // be ASCII needs no tables at all.
+            Position convertIn(const PieceTree& tree, ColumnCache& cache, bool ascii, const Position& position, ColumnEncoding from, ColumnEncoding to) {
+                if (position.line < 0 || static_cast<size_t>(position.line) >= tree.getLineCount()) {
+                    return position;
+                }
+
+                Position result(position.line, 0);
+                if (position.character <= 0) {
+                    return result;
+                }
+                
+                if (ascii) {
+                    result.character = std::min(position.character, static_cast<int>(tree.getLineLength(position.line)));
+                }
+                else {
+                    result.character = cache.get(tree, position.line)->convert(position.character, from, to);
+                }
+                return result;
+            }
+
+            std::vector<Position> convertAllIn(const PieceTree& tree, ColumnCache& cache, bool ascii, const std::vector<Position>& positions, ColumnEncoding from, ColumnEncoding to) {
+                std::vector<Position> result;
+                result.reserve(positions.size());
+                for (const auto& position : positions) {
+                    result.push_back(convertIn(tree, cache, ascii, position, from, to));
+                }
+                return result;
+            }
+        }
+
+        // The tree is a copy of the buffer's, sharing its root. Nodes and the chunk
+        // bytes they reference are never modified, and const reads keep no state, so
+        // concurrent readers need no locks. Only the column cache is shared
+        // mutable state, and it locks itself.
+        class TextSnapshot::Impl {
+        public:
+            Impl(const PieceTree& tree, EndOfLine eol, int version, bool ascii) : tree(tree), eol(eol), version(version), ascii(ascii) {
+            }
+            
+            const PieceTree tree;
+            const EndOfLine eol;
+            const int version;
+            const bool ascii;
+            mutable ColumnCache columns;
+        };
+
+        TextSnapshot::TextSnapshot() : pImpl(std::make_shared<const Impl>(PieceTree(), EndOfLine::LF, 0, true)) {
+        }
+
+        TextSnapshot::TextSnapshot(std::shared_ptr<const Impl> impl) : pImpl(std::move(impl)) {
+        }
+
+        int TextSnapshot::getVersion() const {
+            return pImpl->version;
+        }
+
+        EndOfLine TextSnapshot::getEndOfLine() const {
+            return pImpl->eol;
+        }
+
+        std::string TextSnapshot::getText() const {
+            return pImpl->tree.getText();
+        }
+
+        std::string TextSnapshot::getLine(int line) const {
+            return lineIn(pImpl->tree, line);
+        }
+
+        std::string TextSnapshot::getTextInRange(const Range& range) const {
+            return textInRange(pImpl->tree, range);
+        }
+
+        int TextSnapshot::getLineCount() const {
+            return static_cast<int>(pImpl->tree.getLineCount());
+        }
+
+        Position TextSnapshot::positionAt(int offset) const {
+            return positionIn(pImpl->tree, offset);
+        }
+
+        int TextSnapshot::offsetAt(const Position& position) const {
+            return offsetIn(pImpl->tree, position);
+        }
+
+        std::vector<Position> TextSnapshot::positionsAt(const std::vector<int>& offsets) const {
+            return positionsIn(pImpl->tree, offsets);
+        }
+
+        Position TextSnapshot::convertPosition(const Position& position, ColumnEncoding from, ColumnEncoding to) const {
+            if (from == to) {
+                return position;
+            }
+            return convertIn(pImpl->tree, pImpl->columns, pImpl->ascii, position, from, to);
+        }
+
+        std::vector<Position> TextSnapshot::convertPositions(const std::vector<Position>& positions, ColumnEncoding from, ColumnEncoding to) const {
+            if (from == to) {
+                return positions;
+            }
+            return convertAllIn(pImpl->tree, pImpl->columns, pImpl->ascii, positions, from, to);
+        }
+
+        int TextSnapshot::getLength() const {
+            return static_cast<int>(pImpl->tree.getLength());
+        }
+
+        std::string_view TextSnapshot::getLineView(int line, std::string& scratch) const {
+            return lineViewIn(pImpl->tree, line, scratch);
+        }
+
+        std::string_view TextSnapshot::getTextInRangeView(const Range& range, std::string& scratch) const {
+            return rangeViewIn(pImpl->tree, range, scratch);
+        }
+
+        void TextSnapshot::forEachChunk(const TextChunkVisitor& visitor) const {
+            forEachChunkIn(pImpl->tree, 0, pImpl->tree.getLength(), visitor);
+        }
+
+        void TextSnapshot::forEachChunk(const Range& range, const TextChunkVisitor& visitor) const {
+            forEachChunkIn(pImpl->tree, range, visitor);
+        }
+
+        TextCursor TextSnapshot::cursor() const {
+            return TextCursor(std::make_unique<TextCursor::Impl>(*this, 0, pImpl->tree.getLength()));
+        }
+
+        TextCursor TextSnapshot::cursor(const Range& range) const {
+            if (!isValidRange(range)) {
+                return TextCursor(std::make_unique<TextCursor::Impl>(*this, 0, 0));
+            }
+            
+            size_t start = offsetIn(pImpl->tree, range.start);
+            size_t end = offsetIn(pImpl->tree, range.end);
+            return TextCursor(std::make_unique<TextCursor::Impl>(*this, start, end));
+        }
+
+        bool TextSnapshot::isValidPosition(const Position& position) const {
+            return isValidPositionIn(pImpl->tree, position);
+        }
+
+        bool TextSnapshot::isValidRange(const Range& range) const {
+            return isValidRangeIn(pImpl->tree, range);
+        }
+
+        // The walker stays on the piece holding offset whenever offset is before the
+        // end of the range. At the end it may sit on the piece the range ends in.
+        class TextCursor::Impl {
+        public:
+            Impl(const TextSnapshot& snapshot, size_t start, size_t end)
+                : snapshot(snapshot), rangeStart(start), rangeEnd(end), offset(start) {
+                const PieceTree& tree = snapshot.pImpl->tree;
+                size_t length = tree.getLength();
+                walker = PieceWalker(tree.getRoot(), start < length || start == 0 ? start : start - 1);
+            }
+            
+            size_t pieceEnd() const {
+                return walker.getStart() + walker.getPiece().length;
+            }
+            
+            void settle() {
+                if (offset < rangeEnd && offset == pieceEnd()) {
+                    walker.next();
+                }
+            }
+            
+            // Move onto the nearest '\n' before the cursor, or to the range start
+            bool findPreviousLineBreak() {
+                while (offset > rangeStart) {
+                    if (offset == walker.getStart()) {
+                        walker.previous();
+                    }
+                    
+                    std::string_view text = walker.getText();
+                    size_t low = std::max(walker.getStart(), rangeStart);
+                    for (size_t i = offset; i > low; --i) {
+                        if (text[i - 1 - walker.getStart()] == '\n') {
+                            offset = i - 1;
+                            return true;
+                        }
+                    }
+                    offset = low;
+                }
+                return false;
+            }
+            
+            TextSnapshot snapshot;
+            size_t rangeStart;
+            size_t rangeEnd;
+            size_t offset;
+            PieceWalker walker;
+        };
+
+        TextCursor::TextCursor(std::unique_ptr<Impl> impl) : pImpl(std::move(impl)) {
+        }
+
+        TextCursor::TextCursor(TextCursor&& other) noexcept = default;
+
+        TextCursor& TextCursor::operator=(TextCursor&& other) noexcept = default;
+
+        TextCursor::~TextCursor() {
+        }
+
+        int TextCursor::getOffset() const {
+            return static_cast<int>(pImpl->offset);
+        }
+
+        Position TextCursor::getPosition() const {
+            return pImpl->snapshot.positionAt(static_cast<int>(pImpl->offset));
+        }
+
+        bool TextCursor::atStart() const {
+            return pImpl->offset == pImpl->rangeStart;
+        }
+
+        bool TextCursor::atEnd() const {
+            return pImpl->offset == pImpl->rangeEnd;
+        }
+
+        char TextCursor::getChar() const {
+            return pImpl->walker.getText()[pImpl->offset - pImpl->walker.getStart()];
+        }
+
+        std::string_view TextCursor::getChunk() const {
+            if (atEnd()) {
+                return std::string_view();
+            }
+            
+            size_t end = std::min(pImpl->pieceEnd(), pImpl->rangeEnd);
+            return pImpl->walker.getText().substr(pImpl->offset - pImpl->walker.getStart(), end - pImpl->offset);
+        }
+
+        bool TextCursor::next() {
+            if (atEnd()) {
+                return false;
+            }
+            
+            ++pImpl->offset;
+            pImpl->settle();
+            return true;
+        }
+
+        bool TextCursor::previous() {
+            if (atStart()) {
+                return false;
+            }
+            
+            if (pImpl->offset == pImpl->walker.getStart()) {
+                pImpl->walker.previous();
+            }
+            --pImpl->offset;
+            return true;
+        }
+
+        bool TextCursor::nextChunk() {
+            if (atEnd()) {
+                return false;
+            }
+            
+            pImpl->offset = std::min(pImpl->pieceEnd(), pImpl->rangeEnd);
+            pImpl->settle();
+            return true;
+        }
+
+        bool TextCursor::nextLine() {
+            for (; !atEnd(); nextChunk()) {
+                std::string_view chunk = getChunk();
+                const char* lineBreak = static_cast<const char*>(std::memchr(chunk.data(), '\n', chunk.size()));
+                if (lineBreak) {
+                    pImpl->offset += static_cast<size_t>(lineBreak - chunk.data()) + 1;
+                    pImpl->settle();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool TextCursor::previousLine() {
+            // Find the break that ends the previous line, then the one before that
+            if (!pImpl->findPreviousLineBreak()) {
+                return false;
+            }
+            
+            if (pImpl->findPreviousLineBreak()) {
+                next();
+            }
+            return true;
+        }
+
+        void TextDocumentChangeEvent::merge(const TextDocumentChangeEvent& next) {
+            for (const auto& change : next.changes) {
+                if (!changes.empty()) {
+                    TextDocumentContentChange& last = changes.back();
+                    
+                    // Replaces the tail of the text last inserted, or continues after it
+                    if (change.rangeOffset >= last.rangeOffset && change.rangeOffset + change.rangeLength == last.newEndOffset()) {
+                        last.text.resize(change.rangeOffset - last.rangeOffset);
+                        last.text += change.text;
+                        continue;
+                    }
+                    
+                    // Ends where the last change started; that text was left untouched
+                    if (change.rangeOffset + change.rangeLength == last.rangeOffset) {
+                        last.range.start = change.range.start;
+                        last.rangeOffset = change.rangeOffset;
+                        last.rangeLength += change.rangeLength;
+                        last.text.insert(0, change.text);
+                        continue;
+                    }
+                }
+                
+                changes.push_back(change);
+            }
+            
+            version = next.version;
+            isUndo = isUndo && next.isUndo;
+            isRedo = isRedo && next.isRedo;
+        }
+
         class TextBuffer::Impl {
         public:
-            explicit Impl(const std::string& text) {
-                setText(text);
+            explicit Impl(std::string text) : editFootprint(0), version(0), nextListenerId(1) {
+                LineBreakCounts counts = LineScanner::scan(text.data(), text.size());
+                setEndOfLine(dominantEndOfLine(counts));
+                checkEncoding(text.data(), text.size());
+                
+                if (usesOnly(counts, eol)) {
+                    tree.setText(std::move(text));
+                }
+                else {
+                    tree.setText(normalizeLineEndings(text.data(), text.size(), eol));
+                }
+            }
+            
+            explicit Impl(const std::shared_ptr<const MappedFile>& file) : editFootprint(0), version(0), nextListenerId(1) {
+                setEndOfLine(EndOfLine::LF);
+                checkEncoding(nullptr, 0);
+                if (!file || file->size() == 0) {
+                    return;
+                }
+                
+                LineBreakCounts counts = LineScanner::scan(file->data(), file->size());
+                setEndOfLine(dominantEndOfLine(counts));
+                checkEncoding(file->data(), file->size());
+                
+                // Only content with mixed line endings has to be copied
+                if (usesOnly(counts, eol)) {
+                    tree.setText(file, file->data(), file->size());
+                }
+                else {
+                    tree.setText(normalizeLineEndings(file->data(), file->size(), eol));
+                }
+            }
+            
+            void setEndOfLine(EndOfLine value) {
+                eol = value;
+                tree.setLineBreakLength(eol == EndOfLine::CRLF ? 2 : 1);
+            }
+            
+            // Line ending normalization leaves both answers as they are
+            void checkEncoding(const char* data, size_t length) {
+                ascii = Utf8::isAscii(data, length);
+                validUtf8 = ascii || Utf8::isValid(data, length);
+            }
+            
+            // Bring inserted text to the document line ending, copying only if needed
+            void insert(size_t offset, const std::string& text) {
+                LineBreakCounts counts = LineScanner::scan(text.data(), text.size());
+                if (usesOnly(counts, eol)) {
+                    tree.insert(offset, text.data(), text.size());
+                    return;
+                }
+                
+                std::string normalized = normalizeLineEndings(text.data(), text.size(), eol);
+                tree.insert(offset, normalized.data(), normalized.size());
+            }
+            
+            static constexpr size_t kInvalidOffset = static_cast<size_t>(-1);
+            
+            // Convert positions to offsets, marking invalid ones with kInvalidOffset.
+            // Each line is looked up once, and the start of the following line is kept,
+            // so positions in ascending order cost one tree descent per line.
+            bool resolveOffsets(const std::vector<Position>& positions, std::vector<size_t>& offsets) const {
+                offsets.clear();
+                offsets.reserve(positions.size());
+                
+                size_t lineCount = tree.getLineCount();
+                size_t lineBreakLength = eol == EndOfLine::CRLF ? 2 : 1;
+                size_t cachedLine = static_cast<size_t>(-1);
+                size_t lineStart = 0;
+                size_t nextLineStart = 0;
+                bool allValid = true;
+                
+                for (const auto& position : positions) {
+                    if (position.line < 0 || static_cast<size_t>(position.line) >= lineCount || position.character < 0) {
+                        offsets.push_back(kInvalidOffset);
+                        allValid = false;
+                        continue;
+                    }
+                    
+                    size_t line = static_cast<size_t>(position.line);
+                    if (line != cachedLine) {
+                        lineStart = line == cachedLine + 1 ? nextLineStart : tree.getLineStart(line);
+                        nextLineStart = line + 1 < lineCount ? tree.getLineStart(line + 1) : tree.getLength() + lineBreakLength;
+                        cachedLine = line;
+                    }
+                    
+                    if (static_cast<size_t>(position.character) > nextLineStart - lineBreakLength - lineStart) {
+                        offsets.push_back(kInvalidOffset);
+                        allValid = false;
+                        continue;
+                    }
+                    
+                    offsets.push_back(lineStart + position.character);
+                }
+                
+                return allValid;
+            }
+            
+            Position getEndPosition() const {
+                size_t lastLine = tree.getLineCount() - 1;
+                return Position(static_cast<int>(lastLine), static_cast<int>(tree.getLineLength(lastLine)));
             }
             
-            void setText(const std::string& text) {
-                lines.clear();
-                std::istringstream stream(text);
-                std::string line;
+            // Change record for an edit that replaced [start, end) with length bytes,
+            // taken once the edit has been applied
+            UndoHistory::Change describeChange(const Range& range, size_t start, size_t end, size_t length) const {
+                size_t line, column;
+                tree.getLineAndColumn(start + length, line, column);
+                
+                UndoHistory::Change change;
+                change.oldRange = range;
+                change.oldOffset = start;
+                change.oldLength = end - start;
+                change.newRange = Range(range.start, Position(static_cast<int>(line), static_cast<int>(column)));
+                change.newOffset = start;
+                change.newLength = length;
+                return change;
+            }
+            
+            // Bracket a mutation so it is recorded as one undo entry and announced to
+            // listeners. The event is only built when a listener or the caller wants it.
+            void beginEdit() {
+                editStart = { tree.getRoot(), eol };
+                editFootprint = tree.getFootprint();
+            }
+            
+            void endEdit(std::vector<UndoHistory::Change> changes, TextDocumentChangeEvent* event = nullptr) {
+                UndoHistory::Step step;
+                step.before = std::move(editStart);
+                step.after = { tree.getRoot(), eol };
+                step.changes = std::move(changes);
+                size_t cost = tree.getFootprint() - editFootprint + step.changes.size() * sizeof(UndoHistory::Change);
+                
+                publish(&step, 1, false, false, event);
+                history.record(std::move(step), cost);
+                editStart.root = nullptr;
+            }
+            
+            // Advance the version and describe the steps to listeners. Undone steps are
+            // listed newest first. Within a step changes go back to front, so each one
+            // applies to the coordinates left by those before it.
+            void publish(const UndoHistory::Step* steps, size_t count, bool isUndo, bool isRedo, TextDocumentChangeEvent* result) {
+                ++version;
+                Trace::addCount(TraceCounter::Edits);
+                updateColumns(steps, count, isUndo);
+                if (listeners.empty() && result == nullptr) {
+                    return;
+                }
+                
+                TextDocumentChangeEvent event;
+                event.version = version;
+                event.isUndo = isUndo;
+                event.isRedo = isRedo;
                 
-                while (std::getline(stream, line)) {
-                    // Check if the line ends with \r (Windows line ending in a \r\n sequence)
-                    if (!line.empty() && line.back() == '\r') {
-                        line.pop_back();
+                for (size_t i = 0; i < count; ++i) {
+                    const UndoHistory::Step& step = steps[isUndo ? count - 1 - i : i];
+                    for (auto change = step.changes.rbegin(); change != step.changes.rend(); ++change) {
+                        TextDocumentContentChange content;
+                        if (isUndo) {
+                            content.range = change->newRange;
+                            content.rangeOffset = static_cast<int>(change->newOffset);
+                            content.rangeLength = static_cast<int>(change->newLength);
+                            content.text = PieceTree::getText(step.before.root, change->oldOffset, change->oldOffset + change->oldLength);
+                        }
+                        else {
+                            content.range = change->oldRange;
+                            content.rangeOffset = static_cast<int>(change->oldOffset);
+                            content.rangeLength = static_cast<int>(change->oldLength);
+                            content.text = PieceTree::getText(step.after.root, change->newOffset, change->newOffset + change->newLength);
+                        }
+                        event.changes.push_back(std::move(content));
                     }
-                    lines.push_back(line);
                 }
                 
-                // Handle the case where the last line doesn't end with a newline
-                if (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
-                    lines.push_back("");
+                // Walk a copy so a listener can remove itself
+                auto current = listeners;
+                for (const auto& listener : current) {
+                    listener.second(event);
+                }
+                
+                if (result != nullptr) {
+                    *result = std::move(event);
                 }
             }
             
-            std::string getText() const {
-                std::ostringstream result;
-                for (size_t i = 0; i < lines.size(); ++i) {
-                    result << lines[i];
-                    if (i < lines.size() - 1) {
-                        result << "\n";
+            // Drop the column tables of changed lines. Tables of later lines are kept
+            // only if no line was added or removed. The document stays known to be
+            // ASCII while all inserted text is.
+            void updateColumns(const UndoHistory::Step* steps, size_t count, bool isUndo) {
+                bool linesMoved = false;
+                int firstLine = std::numeric_limits<int>::max();
+                for (size_t i = 0; i < count; ++i) {
+                    const UndoHistory::Step& step = steps[i];
+                    for (const auto& change : step.changes) {
+                        const Range& removed = isUndo ? change.newRange : change.oldRange;
+                        const Range& inserted = isUndo ? change.oldRange : change.newRange;
+                        linesMoved = linesMoved || removed.start.line != removed.end.line || inserted.start.line != inserted.end.line;
+                        firstLine = std::min(firstLine, removed.start.line);
+                        
+                        if (ascii) {
+                            ascii = isUndo
+                                ? isAsciiIn(step.before.root, change.oldOffset, change.oldOffset + change.oldLength)
+                                : isAsciiIn(step.after.root, change.newOffset, change.newOffset + change.newLength);
+                        }
+                    }
+                }
+                
+                if (linesMoved) {
+                    columns.forgetFrom(firstLine);
+                    return;
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    for (const auto& change : steps[i].changes) {
+                        columns.forget(change.oldRange.start.line);
                     }
                 }
-                return result.str();
             }
             
-            std::vector<std::string> lines;
+            void restore(const UndoHistory::State& state) {
+                tree.setRoot(state.root);
+                setEndOfLine(state.eol);
+            }
+            
+            PieceTree tree;
+            EndOfLine eol;
+            UndoHistory history;
+            UndoHistory::State editStart;
+            size_t editFootprint;
+            int version;
+            std::vector<std::pair<int, TextChangeListener>> listeners;
+            int nextListenerId;
+            bool ascii;
+            bool validUtf8;
+            ColumnCache columns;
         };
 
         TextBuffer::TextBuffer() : pImpl(std::make_unique<Impl>("")) {
         }
 
-        TextBuffer::TextBuffer(const std::string& text) : pImpl(std::make_unique<Impl>(text)) {
+        TextBuffer::TextBuffer(std::string text) : pImpl(std::make_unique<Impl>(std::move(text))) {
+        }
+
+        TextBuffer::TextBuffer(std::shared_ptr<const MappedFile> file) : pImpl(std::make_unique<Impl>(file)) {
         }
 
         TextBuffer::~TextBuffer() {
         }
 
         std::string TextBuffer::getText() const {
-            return pImpl->getText();
+            return pImpl->tree.getText();
         }
 
         std::string TextBuffer::getLine(int line) const {
-            if (line < 0 || line >= getLineCount()) {
-                return "";
-            }
-            
-            return pImpl->lines[line];
+            return lineIn(pImpl->tree, line);
         }
 
         std::string TextBuffer::getTextInRange(const Range& range) const {
-            if (!isValidRange(range)) {
-                return "";
-            }
-            
-            if (range.start.line == range.end.line) {
-                // Single line
-                const std::string& line = pImpl->lines[range.start.line];
-                return line.substr(range.start.character, range.end.character - range.start.character);
+            return textInRange(pImpl->tree, range);
+        }
+
+        int TextBuffer::getLineCount() const {
+            return static_cast<int>(pImpl->tree.getLineCount());
+        }
+
+        std::string_view TextBuffer::getLineView(int line, std::string& scratch) const {
+            return lineViewIn(pImpl->tree, line, scratch);
+        }
+
+        std::string_view TextBuffer::getTextInRangeView(const Range& range, std::string& scratch) const {
+            return rangeViewIn(pImpl->tree, range, scratch);
+        }
+
+        void TextBuffer::forEachChunk(const TextChunkVisitor& visitor) const {
+            forEachChunkIn(pImpl->tree, 0, pImpl->tree.getLength(), visitor);
+        }
+
+        void TextBuffer::forEachChunk(const Range& range, const TextChunkVisitor& visitor) const {
+            forEachChunkIn(pImpl->tree, range, visitor);
+        }
+
+        TextCursor TextBuffer::cursor() const {
+            return snapshot().cursor();
+        }
+
+        TextCursor TextBuffer::cursor(const Range& range) const {
+            return snapshot().cursor(range);
+        }
+
+        EndOfLine TextBuffer::getEndOfLine() const {
+            return pImpl->eol;
+        }
+
+        void TextBuffer::setEndOfLine(EndOfLine eol) {
+            if (eol == pImpl->eol) {
+                return;
             }
             
-            // Multiple lines
-            std::ostringstream result;
-            
-            // First line
-            const std::string& firstLine = pImpl->lines[range.start.line];
-            result << firstLine.substr(range.start.character);
+            // Every line break changes, so the change covers the whole document
+            std::string text = pImpl->tree.getText();
+            UndoHistory::Change change;
+            change.oldRange = Range(Position(0, 0), pImpl->getEndPosition());
+            change.oldOffset = 0;
+            change.oldLength = text.size();
             
-            // Middle lines
-            for (int i = range.start.line + 1; i < range.end.line; ++i) {
-                result << "\n" << pImpl->lines[i];
+            pImpl->beginEdit();
+            pImpl->setEndOfLine(eol);
+            pImpl->tree.setText(normalizeLineEndings(text.data(), text.size(), eol));
+            change.newRange = Range(Position(0, 0), pImpl->getEndPosition());
+            change.newOffset = 0;
+            change.newLength = pImpl->tree.getLength();
+            pImpl->endEdit({ change });
+        }
+
+        bool TextBuffer::undo() {
+            TraceScope scope("TextBuffer::undo", TraceHistogram::EditLatency);
+            const UndoHistory::Entry* entry = pImpl->history.undo();
+            if (entry == nullptr) {
+                return false;
             }
             
-            // Last line
-            const std::string& lastLine = pImpl->lines[range.end.line];
-            result << "\n" << lastLine.substr(0, range.end.character);
+            pImpl->restore(entry->steps.front().before);
+            pImpl->publish(entry->steps.data(), entry->steps.size(), true, false, nullptr);
+            return true;
+        }
+
+        bool TextBuffer::redo() {
+            TraceScope scope("TextBuffer::redo", TraceHistogram::EditLatency);
+            const UndoHistory::Entry* entry = pImpl->history.redo();
+            if (entry == nullptr) {
+                return false;
+            }
             
-            return result.str();
+            pImpl->restore(entry->steps.back().after);
+            pImpl->publish(entry->steps.data(), entry->steps.size(), false, true, nullptr);
+            return true;
         }
 
-        int TextBuffer::getLineCount() const {
-            return static_cast<int>(pImpl->lines.size());
+        bool TextBuffer::canUndo() const {
+            return pImpl->history.canUndo();
+        }
+
+        bool TextBuffer::canRedo() const {
+            return pImpl->history.canRedo();
+        }
+
+        void TextBuffer::beginUndoGroup() {
+            pImpl->history.beginGroup();
+        }
+
+        void TextBuffer::endUndoGroup() {
+            pImpl->history.endGroup();
+        }
+
+        void TextBuffer::setUndoMemoryLimit(size_t bytes) {
+            pImpl->history.setMemoryLimit(bytes);
+        }
+
+        void TextBuffer::clearUndoHistory() {
+            pImpl->history.clear();
+        }
+
+        int TextBuffer::getVersion() const {
+            return pImpl->version;
+        }
+
+        int TextBuffer::addChangeListener(TextChangeListener listener) {
+            int id = pImpl->nextListenerId++;
+            pImpl->listeners.emplace_back(id, std::move(listener));
+            return id;
+        }
+
+        void TextBuffer::removeChangeListener(int id) {
+            auto& listeners = pImpl->listeners;
+            listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [id](const std::pair<int, TextChangeListener>& listener) {
+                return listener.first == id;
+            }), listeners.end());
+        }
+
+        TextSnapshot TextBuffer::snapshot() const {
+            return TextSnapshot(std::make_shared<const TextSnapshot::Impl>(pImpl->tree, pImpl->eol, pImpl->version, pImpl->ascii));
         }
 
         void TextBuffer::applyEdit(const TextEdit& edit) {
@@ -108,79 +944,156 @@ namespace Vune {
             replace(edit.range, edit.newText);
         }
 
-        void TextBuffer::applyEdits(const std::vector<TextEdit>& edits) {
-            // Sort edits in reverse order to avoid position changes
-            std::vector<TextEdit> sortedEdits = edits;
-            std::sort(sortedEdits.begin(), sortedEdits.end(), [](const TextEdit& a, const TextEdit& b) {
-                if (a.range.start.line != b.range.start.line) {
-                    return a.range.start.line > b.range.start.line;
-                }
-                if (a.range.start.character != b.range.start.character) {
-                    return a.range.start.character > b.range.start.character;
+        ApplyEditsResult TextBuffer::applyEdits(const std::vector<TextEdit>& edits) {
+            TraceScope scope("TextBuffer::applyEdits", TraceHistogram::EditLatency);
+            ApplyEditsResult result;
+            result.applied = false;
+            
+            // Order by range, keeping the given order for inserts at the same position
+            std::vector<size_t> order(edits.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                if (edits[i].range.end < edits[i].range.start) {
+                    return result;
                 }
-                if (a.range.end.line != b.range.end.line) {
-                    return a.range.end.line < b.range.end.line;
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&edits](size_t a, size_t b) {
+                const Range& left = edits[a].range;
+                const Range& right = edits[b].range;
+                if (left.start != right.start) {
+                    return left.start < right.start;
                 }
-                return a.range.end.character < b.range.end.character;
+                return left.end < right.end;
             });
             
-            for (const auto& edit : sortedEdits) {
-                applyEdit(edit);
+            // Overlapping edits have no well-defined result, so the batch is rejected
+            for (size_t i = 1; i < order.size(); ++i) {
+                if (edits[order[i]].range.start < edits[order[i - 1]].range.end) {
+                    return result;
+                }
             }
-        }
-
-        void TextBuffer::insert(const Position& position, const std::string& text) {
-            if (!isValidPosition(position)) {
-                return;
+            
+            if (edits.empty()) {
+                result.applied = true;
+                return result;
             }
             
-            if (text.empty()) {
-                return;
+            std::vector<Position> positions;
+            positions.reserve(edits.size() * 2);
+            for (size_t index : order) {
+                positions.push_back(edits[index].range.start);
+                positions.push_back(edits[index].range.end);
+            }
+            std::vector<size_t> offsets;
+            if (!pImpl->resolveOffsets(positions, offsets)) {
+                return result;
             }
             
-            // Split the text into lines
-            std::vector<std::string> newLines;
-            std::istringstream stream(text);
-            std::string line;
+            // Texts already in the document line ending are used in place
+            std::vector<std::string> normalizedTexts;
+            normalizedTexts.reserve(edits.size());
+            std::vector<PieceTree::Edit> treeEdits;
+            treeEdits.reserve(edits.size());
+            std::vector<std::string> removedTexts;
+            removedTexts.reserve(edits.size());
             
-            while (std::getline(stream, line)) {
-                // Check if the line ends with \r (Windows line ending in a \r\n sequence)
-                if (!line.empty() && line.back() == '\r') {
-                    line.pop_back();
+            for (size_t i = 0; i < order.size(); ++i) {
+                const std::string& text = edits[order[i]].newText;
+                PieceTree::Edit edit;
+                edit.offset = offsets[i * 2];
+                edit.length = offsets[i * 2 + 1] - offsets[i * 2];
+                edit.text = text.data();
+                edit.textLength = text.size();
+                
+                if (!usesOnly(LineScanner::scan(text.data(), text.size()), pImpl->eol)) {
+                    normalizedTexts.push_back(normalizeLineEndings(text.data(), text.size(), pImpl->eol));
+                    edit.text = normalizedTexts.back().data();
+                    edit.textLength = normalizedTexts.back().size();
                 }
-                newLines.push_back(line);
+                
+                removedTexts.push_back(pImpl->tree.getText(edit.offset, edit.offset + edit.length));
+                treeEdits.push_back(edit);
             }
             
-            // Handle the case where the last line doesn't end with a newline
-            if (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
-                newLines.push_back("");
-            }
+            result.applied = true;
             
-            if (newLines.empty()) {
-                return;
-            }
+            // Where each inserted text ends up, for the inverse edits and the undo
+            // record. Shifts are tracked as edits are walked in order, without
+            // touching the tree.
+            result.inverseEdits.reserve(edits.size());
+            std::vector<UndoHistory::Change> changes;
+            changes.reserve(edits.size());
+            int lineDelta = 0;
+            int shiftedLine = -1;
+            int characterDelta = 0;
+            size_t offsetDelta = 0;
             
-            // Insert the text
-            if (newLines.size() == 1) {
-                // Single line insert
-                std::string& currentLine = pImpl->lines[position.line];
-                currentLine.insert(position.character, newLines[0]);
-            }
-            else {
-                // Multi-line insert
-                std::string& currentLine = pImpl->lines[position.line];
-                std::string beforeInsert = currentLine.substr(0, position.character);
-                std::string afterInsert = currentLine.substr(position.character);
+            for (size_t i = 0; i < order.size(); ++i) {
+                const Range& range = edits[order[i]].range;
+                const PieceTree::Edit& edit = treeEdits[i];
+                
+                int startCharacter = range.start.character + (range.start.line == shiftedLine ? characterDelta : 0);
+                Position newStart(range.start.line + lineDelta, startCharacter);
+                
+                const char* textEnd = edit.text + edit.textLength;
+                int lineBreaks = static_cast<int>(std::count(edit.text, textEnd, '\n'));
+                Position newEnd = newStart;
+                if (lineBreaks == 0) {
+                    newEnd.character += static_cast<int>(edit.textLength);
+                }
+                else {
+                    const char* lastLine = edit.text;
+                    for (const char* c = edit.text; c < textEnd; ++c) {
+                        if (*c == '\n') {
+                            lastLine = c + 1;
+                        }
+                    }
+                    newEnd = Position(newStart.line + lineBreaks, static_cast<int>(textEnd - lastLine));
+                }
                 
-                // Update the first line
-                pImpl->lines[position.line] = beforeInsert + newLines[0];
+                result.inverseEdits.emplace_back(Range(newStart, newEnd), removedTexts[i]);
                 
-                // Insert the middle lines
-                pImpl->lines.insert(pImpl->lines.begin() + position.line + 1, newLines.begin() + 1, newLines.end() - 1);
+                if (edit.length > 0 || edit.textLength > 0) {
+                    UndoHistory::Change change;
+                    change.oldRange = range;
+                    change.oldOffset = edit.offset;
+                    change.oldLength = edit.length;
+                    change.newRange = Range(newStart, newEnd);
+                    change.newOffset = edit.offset + offsetDelta;
+                    change.newLength = edit.textLength;
+                    changes.push_back(change);
+                }
                 
-                // Insert the last line with the remainder of the original line
-                pImpl->lines.insert(pImpl->lines.begin() + position.line + newLines.size() - 1, newLines.back() + afterInsert);
+                lineDelta += lineBreaks - (range.end.line - range.start.line);
+                shiftedLine = range.end.line;
+                characterDelta = newEnd.character - range.end.character;
+                offsetDelta += edit.textLength - edit.length;
+            }
+            
+            if (!changes.empty()) {
+                pImpl->beginEdit();
+                pImpl->tree.applyEdits(treeEdits);
+                pImpl->endEdit(std::move(changes), &result.changeEvent);
             }
+            
+            return result;
+        }
+
+        void TextBuffer::insert(const Position& position, const std::string& text) {
+            TraceScope scope("TextBuffer::insert", TraceHistogram::EditLatency);
+            if (!isValidPosition(position)) {
+                return;
+            }
+            
+            if (text.empty()) {
+                return;
+            }
+            
+            size_t offset = offsetAt(position);
+            size_t lengthBefore = pImpl->tree.getLength();
+            pImpl->beginEdit();
+            pImpl->insert(offset, text);
+            pImpl->endEdit({ pImpl->describeChange(Range(position, position), offset, offset, pImpl->tree.getLength() - lengthBefore) });
         }
 
         void TextBuffer::remove(const Range& range) {
@@ -188,91 +1101,77 @@ namespace Vune {
         }
 
         void TextBuffer::replace(const Range& range, const std::string& text) {
+            TraceScope scope("TextBuffer::replace", TraceHistogram::EditLatency);
             if (!isValidRange(range)) {
                 return;
             }
             
-            // Remove the text in the range
-            if (range.start.line == range.end.line) {
-                // Single line
-                std::string& line = pImpl->lines[range.start.line];
-                line.erase(range.start.character, range.end.character - range.start.character);
-            }
-            else {
-                // Multiple lines
-                std::string& firstLine = pImpl->lines[range.start.line];
-                std::string& lastLine = pImpl->lines[range.end.line];
-                
-                // Keep the part of the first line before the range start
-                std::string newLine = firstLine.substr(0, range.start.character);
-                
-                // Append the part of the last line after the range end
-                newLine += lastLine.substr(range.end.character);
-                
-                // Update the first line
-                firstLine = newLine;
-                
-                // Remove the lines in between
-                pImpl->lines.erase(pImpl->lines.begin() + range.start.line + 1, pImpl->lines.begin() + range.end.line + 1);
+            int start = offsetAt(range.start);
+            int end = offsetAt(range.end);
+            if (start == end && text.empty()) {
+                return;
             }
             
+            size_t lengthBefore = pImpl->tree.getLength();
+            pImpl->beginEdit();
+            pImpl->tree.remove(start, end - start);
+            
             // Insert the new text
             if (!text.empty()) {
-                insert(range.start, text);
+                pImpl->insert(start, text);
             }
+            size_t length = pImpl->tree.getLength() + (end - start) - lengthBefore;
+            pImpl->endEdit({ pImpl->describeChange(range, start, end, length) });
         }
 
         Position TextBuffer::positionAt(int offset) const {
-            if (offset <= 0) {
-                return Position(0, 0);
-            }
-            
-            int currentOffset = 0;
-            for (int i = 0; i < getLineCount(); ++i) {
-                const std::string& line = pImpl->lines[i];
-                int lineLength = static_cast<int>(line.length());
-                
-                if (currentOffset + lineLength >= offset) {
-                    return Position(i, offset - currentOffset);
-                }
-                
-                currentOffset += lineLength + 1; // +1 for the newline
-            }
-            
-            // If we get here, the offset is beyond the end of the document
-            int lastLine = getLineCount() - 1;
-            return Position(lastLine, static_cast<int>(pImpl->lines[lastLine].length()));
+            return positionIn(pImpl->tree, offset);
         }
 
         int TextBuffer::offsetAt(const Position& position) const {
-            if (!isValidPosition(position)) {
-                return 0;
-            }
+            return offsetIn(pImpl->tree, position);
+        }
+
+        std::vector<Position> TextBuffer::positionsAt(const std::vector<int>& offsets) const {
+            return positionsIn(pImpl->tree, offsets);
+        }
+
+        std::vector<int> TextBuffer::offsetsAt(const std::vector<Position>& positions) const {
+            std::vector<size_t> offsets;
+            pImpl->resolveOffsets(positions, offsets);
             
-            int offset = 0;
-            for (int i = 0; i < position.line; ++i) {
-                offset += static_cast<int>(pImpl->lines[i].length()) + 1; // +1 for the newline
+            std::vector<int> result;
+            result.reserve(positions.size());
+            for (size_t offset : offsets) {
+                result.push_back(offset == Impl::kInvalidOffset ? 0 : static_cast<int>(offset));
             }
-            
-            offset += std::min(position.character, static_cast<int>(pImpl->lines[position.line].length()));
-            return offset;
+            return result;
         }
 
-        bool TextBuffer::isValidPosition(const Position& position) const {
-            if (position.line < 0 || position.line >= getLineCount()) {
-                return false;
+        Position TextBuffer::convertPosition(const Position& position, ColumnEncoding from, ColumnEncoding to) const {
+            if (from == to) {
+                return position;
             }
-            
-            if (position.character < 0) {
-                return false;
+            return convertIn(pImpl->tree, pImpl->columns, pImpl->ascii, position, from, to);
+        }
+
+        std::vector<Position> TextBuffer::convertPositions(const std::vector<Position>& positions, ColumnEncoding from, ColumnEncoding to) const {
+            if (from == to) {
+                return positions;
             }
-            
-            // Allow position at the end of the line
-            return position.character <= static_cast<int>(pImpl->lines[position.line].length());
+            return convertAllIn(pImpl->tree, pImpl->columns, pImpl->ascii, positions, from, to);
+        }
+
+        bool TextBuffer::isValidUtf8() const {
+            return pImpl->validUtf8;
+        }
+
+        bool TextBuffer::isValidPosition(const Position& position) const {
+            return isValidPositionIn(pImpl->tree, position);
         }
 
         bool TextBuffer::isValidRange(const Range& range) const {
-            return isValidPosition(range.start) && isValidPosition(range.end) && (range.start <= range.end);
+            return isValidRangeIn(pImpl->tree, range);
         }
 
     } // namespace Core
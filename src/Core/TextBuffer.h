@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch.h"
+#include "Utf8.h"
 
 namespace Vune {
     namespace Core {
@@ -68,16 +69,188 @@ namespace Vune {
             TextEdit(const Range& range, const std::string& newText) : range(range), newText(newText) {}
         };
 
-        // Text document change event
+        // One replaced range within a change event. Before the change the range covers
+        // [rangeOffset, rangeOffset + rangeLength); afterwards the new text covers
+        // [rangeOffset, newEndOffset()).
+        struct TextDocumentContentChange {
+            Range range;
+            int rangeOffset;
+            int rangeLength;
+            std::string text;
+            
+            TextDocumentContentChange() : range(), rangeOffset(0), rangeLength(0), text() {}
+            
+            int newEndOffset() const {
+                return rangeOffset + static_cast<int>(text.size());
+            }
+        };
+
+        // Text document change event. Changes apply one after another in list order,
+        // each in the coordinates left by the ones before it.
         struct TextDocumentChangeEvent {
-            std::vector<TextEdit> changes;
+            // Buffer version after the change
+            int version;
+            std::vector<TextDocumentContentChange> changes;
+            bool isUndo;
+            bool isRedo;
+            
+            TextDocumentChangeEvent() : version(0), changes(), isUndo(false), isRedo(false) {}
+            
+            // Fold a later event into this one. A change that continues or extends the
+            // last pending change (typing, backspacing) is merged into it, so a burst
+            // of keystrokes coalesces into a single change.
+            void merge(const TextDocumentChangeEvent& next);
+        };
+
+        using TextChangeListener = std::function<void(const TextDocumentChangeEvent&)>;
+
+        // Outcome of TextBuffer::applyEdits
+        struct ApplyEditsResult {
+            // False when an edit range was invalid or two edits overlapped; the
+            // buffer is left unchanged in that case
+            bool applied;
+            
+            // Edits that restore the previous text, in post-edit coordinates
+            std::vector<TextEdit> inverseEdits;
+            
+            // The event sent to listeners, with changes last in the document first.
+            // Empty if the edits left the text as it was.
+            TextDocumentChangeEvent changeEvent;
+        };
+
+        // Line ending used by a document
+        enum class EndOfLine {
+            LF,
+            CRLF
+        };
+
+        class MappedFile;
+
+        // Receives consecutive pieces of text; return false to stop early
+        using TextChunkVisitor = std::function<bool(std::string_view)>;
+
+        // Cursor over a range of text that moves by byte, line or chunk without copying.
+        // It holds the snapshot it reads, so it is unaffected by later edits. Moving to
+        // a neighbouring chunk is amortized O(1); line moves scan for line breaks.
+        class TextCursor {
+        public:
+            TextCursor(TextCursor&& other) noexcept;
+            TextCursor& operator=(TextCursor&& other) noexcept;
+            ~TextCursor();
+            
+            // Offset and position of the cursor in the document
+            int getOffset() const;
+            Position getPosition() const;
+            
+            bool atStart() const;
+            bool atEnd() const;
+            
+            // Byte at the cursor; only valid when not at the end
+            char getChar() const;
+            
+            // Contiguous bytes from the cursor to the end of its chunk or of the range.
+            // Empty at the end.
+            std::string_view getChunk() const;
+            
+            // Step one byte; returns false without moving at either end of the range
+            bool next();
+            bool previous();
+            
+            // Move to the start of the next chunk; returns false if already at the end
+            bool nextChunk();
+            
+            // Move to the start of the next or previous line. When there is no such line
+            // in the range the cursor moves to the end or start and returns false.
+            bool nextLine();
+            bool previousLine();
+            
+        private:
+            friend class TextSnapshot;
+            
+            class Impl;
+            explicit TextCursor(std::unique_ptr<Impl> impl);
+            std::unique_ptr<Impl> pImpl;
+        };
+
+        // Immutable view of a TextBuffer at one version. It shares the piece tree with
+        // the buffer, so taking and copying one costs O(1). Snapshots can be read from
+        // any number of threads while the buffer keeps changing.
+        class TextSnapshot {
+        public:
+            // Empty document at version 0
+            TextSnapshot();
+            
+            // Buffer version the snapshot was taken at
+            int getVersion() const;
+            
+            EndOfLine getEndOfLine() const;
+            
+            // Get the entire text
+            std::string getText() const;
+            
+            // Get a specific line
+            std::string getLine(int line) const;
+            
+            // Get a range of text
+            std::string getTextInRange(const Range& range) const;
+            
+            // Length of the text in bytes
+            int getLength() const;
+            
+            // Get the number of lines
+            int getLineCount() const;
+            
+            // Views of a line or range that point into the snapshot's storage when the
+            // text is contiguous, and are built in scratch otherwise. They stay valid
+            // while both the snapshot and scratch do.
+            std::string_view getLineView(int line, std::string& scratch) const;
+            std::string_view getTextInRangeView(const Range& range, std::string& scratch) const;
+            
+            // Visit the text in document order as views into the snapshot's storage
+            void forEachChunk(const TextChunkVisitor& visitor) const;
+            void forEachChunk(const Range& range, const TextChunkVisitor& visitor) const;
+            
+            // Cursor at the start of the range; an invalid range gives an empty cursor
+            TextCursor cursor() const;
+            TextCursor cursor(const Range& range) const;
+            
+            // Get position at offset
+            Position positionAt(int offset) const;
+            
+            // Get offset at position
+            int offsetAt(const Position& position) const;
+            
+            // Batch conversion; sorted input is converted in a single pass
+            std::vector<Position> positionsAt(const std::vector<int>& offsets) const;
+            
+            // Convert the character of a position between column units, as on
+            // TextBuffer. Tables are cached per snapshot and safe to share.
+            Position convertPosition(const Position& position, ColumnEncoding from, ColumnEncoding to) const;
+            std::vector<Position> convertPositions(const std::vector<Position>& positions, ColumnEncoding from, ColumnEncoding to) const;
+            
+            // Check if position is valid
+            bool isValidPosition(const Position& position) const;
+            
+            // Check if range is valid
+            bool isValidRange(const Range& range) const;
+            
+        private:
+            friend class TextBuffer;
+            friend class TextCursor;
+            
+            class Impl;
+            explicit TextSnapshot(std::shared_ptr<const Impl> impl);
+            std::shared_ptr<const Impl> pImpl;
         };
 
         // Text buffer class for efficient text editing
         class TextBuffer {
         public:
             TextBuffer();
-            explicit TextBuffer(const std::string& text);
+            explicit TextBuffer(std::string text);
+            
+            // Use a mapped file as the original content without copying it
+            explicit TextBuffer(std::shared_ptr<const MappedFile> file);
             ~TextBuffer();
             
             // Get the entire text
@@ -92,9 +265,24 @@ namespace Vune {
             // Get the number of lines
             int getLineCount() const;
             
-            // Apply edits
+            // Zero-copy reads as on TextSnapshot. Views into the buffer are only valid
+            // until it next changes; take a snapshot or cursor to read across edits.
+            std::string_view getLineView(int line, std::string& scratch) const;
+            std::string_view getTextInRangeView(const Range& range, std::string& scratch) const;
+            void forEachChunk(const TextChunkVisitor& visitor) const;
+            void forEachChunk(const Range& range, const TextChunkVisitor& visitor) const;
+            TextCursor cursor() const;
+            TextCursor cursor(const Range& range) const;
+            
+            // Line ending of the document. It is detected from the dominant style at load,
+            // and inserted text is converted to it, so getText reproduces the file.
+            EndOfLine getEndOfLine() const;
+            void setEndOfLine(EndOfLine eol);
+            
+            // Apply edits. A batch is applied in one pass as a single undo step; ranges
+            // refer to the text before the batch and must not overlap.
             void applyEdit(const TextEdit& edit);
-            void applyEdits(const std::vector<TextEdit>& edits);
+            ApplyEditsResult applyEdits(const std::vector<TextEdit>& edits);
             
             // Insert text at position
             void insert(const Position& position, const std::string& text);
@@ -111,6 +299,48 @@ namespace Vune {
             // Get offset at position
             int offsetAt(const Position& position) const;
             
+            // Batch conversions; sorted input is converted in a single pass
+            std::vector<Position> positionsAt(const std::vector<int>& offsets) const;
+            std::vector<int> offsetsAt(const std::vector<Position>& positions) const;
+            
+            // Convert the character of a position between column units. Everything
+            // else in the buffer counts UTF-8 bytes; the UI and language servers
+            // count UTF-16 units. Non-ASCII lines get a table on first use, so a
+            // conversion costs O(log n) in the line length; while the document is
+            // all ASCII no tables are built. Lines outside the document are
+            // returned unchanged.
+            Position convertPosition(const Position& position, ColumnEncoding from, ColumnEncoding to) const;
+            std::vector<Position> convertPositions(const std::vector<Position>& positions, ColumnEncoding from, ColumnEncoding to) const;
+            
+            // Whether the text was well-formed UTF-8 when loaded. Malformed bytes
+            // are kept as they are and count as one character each.
+            bool isValidUtf8() const;
+            
+            // Undo/redo. Each edit is one step; edits between beginUndoGroup and
+            // endUndoGroup (and the edits of one applyEdits call) form a single step.
+            bool undo();
+            bool redo();
+            bool canUndo() const;
+            bool canRedo() const;
+            void beginUndoGroup();
+            void endUndoGroup();
+            
+            // Oldest undo steps are dropped once history holds more than this many bytes
+            void setUndoMemoryLimit(size_t bytes);
+            void clearUndoHistory();
+            
+            // Version of the text, incremented by every change including undo and redo
+            int getVersion() const;
+            
+            // Listeners are called synchronously after each change and must not modify
+            // the buffer. Returns an id for removeChangeListener.
+            int addChangeListener(TextChangeListener listener);
+            void removeChangeListener(int id);
+            
+            // Read-only view of the current text for use on other threads. Only the
+            // editing thread may call this; the snapshot is unaffected by later edits.
+            TextSnapshot snapshot() const;
+            
             // Check if position is valid
             bool isValidPosition(const Position& position) const;
             
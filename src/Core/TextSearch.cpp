@@ -0,0 +1,355 @@
+#include "pch.h"
+#include "TextSearch.h"
+#include "LiteralSearcher.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <regex>
+#include <thread>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Matches handed to a callback at once
+            const size_t kBatchSize = 1024;
+
+            // Chunks at least this long are scanned in place; shorter ones, such as
+            // typed text, are gathered into one buffer first
+            const size_t kDirectScanLength = 4096;
+            const size_t kGatherLength = 64 * 1024;
+
+            // Regular expressions run over blocks of whole lines of about this size
+            const size_t kRegexBlockLength = 1024 * 1024;
+
+            // Receives each match as it is found; groups are only given in regex mode
+            using MatchReport = std::function<bool(size_t offset, size_t length, const std::cmatch* groups)>;
+
+            // Converts found offsets to positions in batches, with a single pass over
+            // the line index per batch
+            class MatchBatcher {
+            public:
+                MatchBatcher(const TextSnapshot& snapshot, const SearchMatchCallback& callback)
+                    : snapshot(snapshot), callback(callback) {
+                    offsets.reserve(kBatchSize * 2);
+                }
+
+                bool add(size_t offset, size_t length) {
+                    offsets.push_back(static_cast<int>(offset));
+                    offsets.push_back(static_cast<int>(offset + length));
+                    return offsets.size() < kBatchSize * 2 || flush();
+                }
+
+                bool flush() {
+                    if (offsets.empty()) {
+                        return true;
+                    }
+
+                    std::vector<Position> positions = snapshot.positionsAt(offsets);
+                    std::vector<SearchMatch> matches(offsets.size() / 2);
+                    for (size_t i = 0; i < matches.size(); ++i) {
+                        matches[i].offset = offsets[i * 2];
+                        matches[i].length = offsets[i * 2 + 1] - offsets[i * 2];
+                        matches[i].range = Range(positions[i * 2], positions[i * 2 + 1]);
+                    }
+                    offsets.clear();
+                    return callback(matches);
+                }
+
+            private:
+                const TextSnapshot& snapshot;
+                const SearchMatchCallback& callback;
+                std::vector<int> offsets;
+            };
+        }
+
+        class TextSearch::Impl {
+        public:
+            explicit Impl(const SearchOptions& options) : options(options) {
+                if (options.isRegex) {
+                    auto flags = std::regex::ECMAScript | std::regex::optimize;
+                    if (!options.caseSensitive) {
+                        flags |= std::regex::icase;
+                    }
+                    expression = std::regex(options.pattern, flags);
+                }
+                else {
+                    literal = std::make_unique<LiteralSearcher>(options.pattern, options.caseSensitive);
+                }
+            }
+
+            // Report matches that start at or after start, until report returns false.
+            // Returns false if it was stopped.
+            bool scan(const TextSnapshot& snapshot, size_t start, const MatchReport& report) const {
+                if (options.pattern.empty()) {
+                    return true;
+                }
+                return options.isRegex ? scanRegex(snapshot, start, report) : scanLiteral(snapshot, start, report);
+            }
+
+            bool scanLiteral(const TextSnapshot& snapshot, size_t start, const MatchReport& report) const {
+                const size_t length = literal->getPatternLength();
+                size_t nextAllowed = start;
+
+                // Scan bytes that begin at document offset base, reporting matches that
+                // start before limit. Searching resumes past each match, so none overlap.
+                auto scanBuffer = [&](const char* data, size_t size, size_t base, size_t limit) {
+                    size_t position = nextAllowed > base ? nextAllowed - base : 0;
+                    while (position < size) {
+                        size_t found = literal->find(data + position, size - position);
+                        if (found == LiteralSearcher::npos || base + position + found >= limit) {
+                            break;
+                        }
+
+                        size_t offset = base + position + found;
+                        if (!report(offset, length, nullptr)) {
+                            return false;
+                        }
+                        nextAllowed = offset + length;
+                        position = nextAllowed - base;
+                    }
+                    return true;
+                };
+
+                // Gathered text not scanned yet, plus the last length - 1 bytes of what
+                // was, where a match running into later text could start
+                std::string pending;
+                size_t pendingStart = start;
+
+                auto keepTail = [&](std::string_view text, size_t textStart) {
+                    size_t keep = std::min(text.size(), length - 1);
+                    pending.assign(text.substr(text.size() - keep));
+                    pendingStart = textStart + text.size() - keep;
+                };
+
+                Range range(snapshot.positionAt(static_cast<int>(start)), snapshot.positionAt(snapshot.getLength()));
+                for (TextCursor cursor = snapshot.cursor(range); !cursor.atEnd(); cursor.nextChunk()) {
+                    std::string_view chunk = cursor.getChunk();
+                    size_t chunkStart = static_cast<size_t>(cursor.getOffset());
+
+                    if (chunk.size() < kDirectScanLength) {
+                        pending.append(chunk);
+                        if (pending.size() >= kGatherLength) {
+                            if (!scanBuffer(pending.data(), pending.size(), pendingStart, LiteralSearcher::npos)) {
+                                return false;
+                            }
+                            std::string scanned = std::move(pending);
+                            keepTail(scanned, pendingStart);
+                        }
+                        continue;
+                    }
+
+                    // Matches that start in gathered text and end in this chunk, then the
+                    // chunk itself without copying it
+                    pending.append(chunk.substr(0, length - 1));
+                    if (!scanBuffer(pending.data(), pending.size(), pendingStart, chunkStart) ||
+                        !scanBuffer(chunk.data(), chunk.size(), chunkStart, LiteralSearcher::npos)) {
+                        return false;
+                    }
+                    keepTail(chunk, chunkStart);
+                }
+
+                return scanBuffer(pending.data(), pending.size(), pendingStart, LiteralSearcher::npos);
+            }
+
+            bool scanRegex(const TextSnapshot& snapshot, size_t start, const MatchReport& report) const {
+                Position startPosition = snapshot.positionAt(static_cast<int>(start));
+                size_t blockStart = static_cast<size_t>(snapshot.offsetAt(Position(startPosition.line, 0)));
+                std::string block;
+
+                auto scanLine = [&](const char* begin, const char* end, size_t base) {
+                    std::cmatch match;
+                    auto flags = std::regex_constants::match_default;
+                    for (const char* position = begin; position <= end;) {
+                        if (!std::regex_search(position, end, match, expression, flags)) {
+                            break;
+                        }
+
+                        size_t offset = base + static_cast<size_t>(match[0].first - begin);
+                        size_t length = static_cast<size_t>(match.length(0));
+                        if (offset >= start && !report(offset, length, &match)) {
+                            return false;
+                        }
+
+                        position = match[0].second;
+                        if (length == 0) {
+                            if (position == end) {
+                                break;
+                            }
+                            ++position;
+                        }
+                        flags = std::regex_constants::match_prev_avail;
+                    }
+                    return true;
+                };
+
+                // Match each complete line in the block, and at the end the last line too,
+                // leaving only an unfinished line behind
+                auto scanLines = [&](bool atEnd) {
+                    size_t lineStart = 0;
+                    while (true) {
+                        const char* lineBreak = static_cast<const char*>(std::memchr(block.data() + lineStart, '\n', block.size() - lineStart));
+                        if (!lineBreak && !atEnd) {
+                            break;
+                        }
+
+                        size_t lineEnd = lineBreak ? static_cast<size_t>(lineBreak - block.data()) : block.size();
+                        size_t contentEnd = lineEnd > lineStart && block[lineEnd - 1] == '\r' ? lineEnd - 1 : lineEnd;
+                        if (!scanLine(block.data() + lineStart, block.data() + contentEnd, blockStart + lineStart)) {
+                            return false;
+                        }
+
+                        lineStart = lineBreak ? lineEnd + 1 : block.size();
+                        if (!lineBreak) {
+                            break;
+                        }
+                    }
+
+                    block.erase(0, lineStart);
+                    blockStart += lineStart;
+                    return true;
+                };
+
+                Range range(Position(startPosition.line, 0), snapshot.positionAt(snapshot.getLength()));
+                for (TextCursor cursor = snapshot.cursor(range); !cursor.atEnd(); cursor.nextChunk()) {
+                    block.append(cursor.getChunk());
+                    if (block.size() >= kRegexBlockLength && !scanLines(false)) {
+                        return false;
+                    }
+                }
+                return scanLines(true);
+            }
+
+            SearchOptions options;
+            std::unique_ptr<LiteralSearcher> literal;
+            std::regex expression;
+        };
+
+        TextSearch::TextSearch(const SearchOptions& options) : pImpl(std::make_unique<Impl>(options)) {
+        }
+
+        TextSearch::~TextSearch() {
+        }
+
+        const SearchOptions& TextSearch::getOptions() const {
+            return pImpl->options;
+        }
+
+        void TextSearch::findAll(const TextSnapshot& snapshot, const SearchMatchCallback& callback) const {
+            MatchBatcher batcher(snapshot, callback);
+            bool completed = pImpl->scan(snapshot, 0, [&batcher](size_t offset, size_t length, const std::cmatch*) {
+                return batcher.add(offset, length);
+            });
+            if (completed) {
+                batcher.flush();
+            }
+        }
+
+        std::vector<SearchMatch> TextSearch::findAll(const TextSnapshot& snapshot) const {
+            std::vector<SearchMatch> result;
+            findAll(snapshot, [&result](const std::vector<SearchMatch>& matches) {
+                result.insert(result.end(), matches.begin(), matches.end());
+                return true;
+            });
+            return result;
+        }
+
+        bool TextSearch::findNext(const TextSnapshot& snapshot, int offset, SearchMatch& match) const {
+            bool found = false;
+            auto takeFirst = [&](size_t matchOffset, size_t length, const std::cmatch*) {
+                match.offset = static_cast<int>(matchOffset);
+                match.length = static_cast<int>(length);
+                found = true;
+                return false;
+            };
+
+            size_t start = offset > 0 ? static_cast<size_t>(offset) : 0;
+            pImpl->scan(snapshot, start, takeFirst);
+            if (!found && start > 0) {
+                pImpl->scan(snapshot, 0, takeFirst);
+            }
+            if (!found) {
+                return false;
+            }
+
+            std::vector<Position> positions = snapshot.positionsAt({ match.offset, match.offset + match.length });
+            match.range = Range(positions[0], positions[1]);
+            return true;
+        }
+
+        ApplyEditsResult TextSearch::replaceAll(TextBuffer& buffer, const std::string& replacement) const {
+            TextSnapshot snapshot = buffer.snapshot();
+            std::vector<int> offsets;
+            std::vector<std::string> texts;
+
+            pImpl->scan(snapshot, 0, [&](size_t offset, size_t length, const std::cmatch* groups) {
+                offsets.push_back(static_cast<int>(offset));
+                offsets.push_back(static_cast<int>(offset + length));
+                if (groups) {
+                    texts.push_back(groups->format(replacement));
+                }
+                return true;
+            });
+
+            std::vector<Position> positions = snapshot.positionsAt(offsets);
+            std::vector<TextEdit> edits;
+            edits.reserve(positions.size() / 2);
+            for (size_t i = 0; i < positions.size() / 2; ++i) {
+                edits.emplace_back(Range(positions[i * 2], positions[i * 2 + 1]), texts.empty() ? replacement : texts[i]);
+            }
+            return buffer.applyEdits(edits);
+        }
+
+        class SearchTask::Impl {
+        public:
+            Impl(std::shared_ptr<const TextSearch> search, TextSnapshot snapshot, SearchMatchCallback callback)
+                : cancelled(false), finished(false) {
+                worker = std::thread([this, search, snapshot, callback] {
+                    search->findAll(snapshot, [this, &callback](const std::vector<SearchMatch>& matches) {
+                        return !cancelled && callback(matches) && !cancelled;
+                    });
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished = true;
+                    done.notify_all();
+                });
+            }
+
+            ~Impl() {
+                cancelled = true;
+                worker.join();
+            }
+
+            std::atomic<bool> cancelled;
+            mutable std::mutex mutex;
+            std::condition_variable done;
+            bool finished;
+            std::thread worker;
+        };
+
+        SearchTask::SearchTask(std::shared_ptr<const TextSearch> search, TextSnapshot snapshot, SearchMatchCallback callback)
+            : pImpl(std::make_unique<Impl>(std::move(search), std::move(snapshot), std::move(callback))) {
+        }
+
+        SearchTask::~SearchTask() {
+        }
+
+        void SearchTask::cancel() {
+            pImpl->cancelled = true;
+        }
+
+        void SearchTask::wait() {
+            std::unique_lock<std::mutex> lock(pImpl->mutex);
+            pImpl->done.wait(lock, [this] {
+                return pImpl->finished;
+            });
+        }
+
+        bool SearchTask::isFinished() const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            return pImpl->finished;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pch.h"
+#include "TextBuffer.h"
+
+namespace Vune {
+    namespace Core {
+
+        // What to look for
+        struct SearchOptions {
+            std::string pattern;
+            bool caseSensitive;
+
+            // ECMAScript regular expression instead of a literal string
+            bool isRegex;
+
+            SearchOptions() : pattern(), caseSensitive(true), isRegex(false) {}
+            SearchOptions(const std::string& pattern, bool caseSensitive, bool isRegex)
+                : pattern(pattern), caseSensitive(caseSensitive), isRegex(isRegex) {}
+        };
+
+        // One match, as an offset range and as positions
+        struct SearchMatch {
+            int offset;
+            int length;
+            Range range;
+
+            SearchMatch() : offset(0), length(0), range() {}
+        };
+
+        // Receives matches in document order, in batches; return false to stop
+        using SearchMatchCallback = std::function<bool(const std::vector<SearchMatch>&)>;
+
+        // Search over buffer snapshots. Literal patterns are found with a vectorized
+        // scan directly over piece storage, and may span pieces and lines. Regular
+        // expressions are matched line by line and do not span line breaks. Matches do
+        // not overlap. A search is immutable and can be shared between threads.
+        class TextSearch {
+        public:
+            // Throws std::regex_error if a regular expression does not compile
+            explicit TextSearch(const SearchOptions& options);
+            ~TextSearch();
+
+            const SearchOptions& getOptions() const;
+
+            // Every match, reported in batches as the scan goes
+            void findAll(const TextSnapshot& snapshot, const SearchMatchCallback& callback) const;
+            std::vector<SearchMatch> findAll(const TextSnapshot& snapshot) const;
+
+            // First match starting at or after offset, wrapping around to the start.
+            // Returns false if there is no match at all.
+            bool findNext(const TextSnapshot& snapshot, int offset, SearchMatch& match) const;
+
+            // Replace every match in one applyEdits batch, which is one undo step. In
+            // regex mode, $1, $& and the other ECMAScript escapes in replacement refer
+            // to each match.
+            ApplyEditsResult replaceAll(TextBuffer& buffer, const std::string& replacement) const;
+
+        private:
+            // Prevent copying
+            TextSearch(const TextSearch&) = delete;
+            TextSearch& operator=(const TextSearch&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+        // Runs TextSearch::findAll on a background thread. Batches are delivered on that
+        // thread. Destroying the task cancels it and waits for the thread.
+        class SearchTask {
+        public:
+            SearchTask(std::shared_ptr<const TextSearch> search, TextSnapshot snapshot, SearchMatchCallback callback);
+            ~SearchTask();
+
+            // Stop after the batch in progress
+            void cancel();
+
+            // Block until the search has finished or been cancelled
+            void wait();
+
+            bool isFinished() const;
+
+        private:
+            // Prevent copying
+            SearchTask(const SearchTask&) = delete;
+            SearchTask& operator=(const SearchTask&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
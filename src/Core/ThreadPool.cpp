@@ -0,0 +1,224 @@
+#include "pch.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Pool and index of the worker running on this thread
+            thread_local const void* currentPool = nullptr;
+            thread_local size_t currentIndex = 0;
+        }
+
+        class ThreadPool::Impl {
+        public:
+            struct Worker {
+                std::mutex mutex;
+                std::deque<std::function<void()>> tasks;
+            };
+
+            explicit Impl(size_t threadCount) : queued(0), nextQueue(0), stopping(false) {
+                if (threadCount == 0) {
+                    threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+                }
+
+                for (size_t i = 0; i < threadCount; ++i) {
+                    workers.push_back(std::make_unique<Worker>());
+                }
+                for (size_t i = 0; i < threadCount; ++i) {
+                    threads.emplace_back([this, i] {
+                        run(i);
+                    });
+                }
+            }
+
+            ~Impl() {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    stopping = true;
+                }
+                wake.notify_all();
+
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+            }
+
+            void submit(std::function<void()> task) {
+                size_t index = currentPool == this ? currentIndex : nextQueue++ % workers.size();
+
+                // Counted before the push, so a worker that takes the task right away
+                // cannot take the count below zero, and before taking the sleep lock, so
+                // a worker about to wait sees it
+                queued++;
+                {
+                    std::lock_guard<std::mutex> lock(workers[index]->mutex);
+                    workers[index]->tasks.push_back(std::move(task));
+                }
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                }
+                wake.notify_one();
+            }
+
+            // Newest task of the worker's own queue, else the oldest of another's
+            bool take(size_t index, std::function<void()>& task) {
+                {
+                    Worker& own = *workers[index];
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (!own.tasks.empty()) {
+                        task = std::move(own.tasks.back());
+                        own.tasks.pop_back();
+                        queued--;
+                        return true;
+                    }
+                }
+
+                for (size_t i = 1; i < workers.size(); ++i) {
+                    Worker& victim = *workers[(index + i) % workers.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.tasks.empty()) {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        queued--;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void run(size_t index) {
+                currentPool = this;
+                currentIndex = index;
+                Trace::setThreadName("ThreadPool worker " + std::to_string(index));
+
+                std::function<void()> task;
+                while (true) {
+                    if (take(index, task)) {
+                        task();
+                        task = nullptr;
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    wake.wait(lock, [this] {
+                        return queued > 0 || stopping;
+                    });
+                    if (stopping && queued == 0) {
+                        return;
+                    }
+                }
+            }
+
+            std::vector<std::unique_ptr<Worker>> workers;
+            std::vector<std::thread> threads;
+            std::atomic<size_t> queued;
+            std::atomic<size_t> nextQueue;
+
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+            bool stopping;
+        };
+
+        ThreadPool::ThreadPool(size_t threadCount) : pImpl(std::make_unique<Impl>(threadCount)) {
+        }
+
+        ThreadPool::~ThreadPool() {
+        }
+
+        void ThreadPool::submit(std::function<void()> task) {
+            pImpl->submit(std::move(task));
+        }
+
+        size_t ThreadPool::getThreadCount() const {
+            return pImpl->threads.size();
+        }
+
+        int ThreadPool::getCurrentThreadIndex() const {
+            return currentPool == pImpl.get() ? static_cast<int>(currentIndex) : -1;
+        }
+
+        ThreadPool& ThreadPool::shared() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        // Shared with the tasks, so the last one can signal after the group is gone
+        class TaskGroup::Impl {
+        public:
+            explicit Impl(ThreadPool& pool) : pool(pool), pending(0) {}
+
+            // Block until every task has run and take the first error, if any
+            std::exception_ptr finish() {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this] {
+                    return pending == 0;
+                });
+                std::exception_ptr taken = std::move(error);
+                error = nullptr;
+                return taken;
+            }
+
+            ThreadPool& pool;
+            mutable std::mutex mutex;
+            std::condition_variable done;
+            size_t pending;
+            std::exception_ptr error;       // first thrown by a task
+        };
+
+        TaskGroup::TaskGroup(ThreadPool& pool) : pImpl(std::make_shared<Impl>(pool)) {
+        }
+
+        TaskGroup::~TaskGroup() {
+            // An error nobody waited for is dropped
+            pImpl->finish();
+        }
+
+        void TaskGroup::run(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(pImpl->mutex);
+                pImpl->pending++;
+            }
+
+            pImpl->pool.submit([impl = pImpl, task = std::move(task)] {
+                // The task is counted off however it ends, so a throw cannot leave
+                // wait blocked; the error goes to wait instead of the worker
+                std::exception_ptr error;
+                try {
+                    task();
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(impl->mutex);
+                if (error && !impl->error) {
+                    impl->error = error;
+                }
+                if (--impl->pending == 0) {
+                    impl->done.notify_all();
+                }
+            });
+        }
+
+        void TaskGroup::wait() {
+            std::exception_ptr error = pImpl->finish();
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        bool TaskGroup::isFinished() const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            return pImpl->pending == 0;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Fixed set of worker threads with a task queue per worker. A worker runs the
+        // newest task of its own queue first and, when that is empty, steals the oldest
+        // task from another worker, so tasks that spawn more tasks (a directory walk,
+        // for example) spread over every core without a shared queue to contend on.
+        class ThreadPool {
+        public:
+            // threadCount 0 uses one thread per hardware thread
+            explicit ThreadPool(size_t threadCount = 0);
+
+            // Runs every queued task, then joins the workers
+            ~ThreadPool();
+
+            // Queue a task. Called from a worker, the task goes to that worker's own
+            // queue; otherwise queues are filled in turn. A task that throws ends the
+            // process; run it through a TaskGroup to get the error back.
+            void submit(std::function<void()> task);
+
+            size_t getThreadCount() const;
+
+            // Index of the calling worker of this pool, or -1 for other threads
+            int getCurrentThreadIndex() const;
+
+            // Pool shared by Core services, created on first use
+            static ThreadPool& shared();
+
+        private:
+            // Prevent copying
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+        // Set of pool tasks that can be waited for together. Tasks may add more tasks
+        // to their own group.
+        class TaskGroup {
+        public:
+            explicit TaskGroup(ThreadPool& pool);
+
+            // Waits for the tasks still running
+            ~TaskGroup();
+
+            void run(std::function<void()> task);
+
+            // Block until every task has run, then rethrow the first exception a task
+            // threw since the last wait. Must not be called from a thread of the
+            // pool, which the wait could deadlock.
+            void wait();
+
+            bool isFinished() const;
+
+        private:
+            // Prevent copying
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::shared_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
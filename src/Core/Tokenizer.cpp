@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "Tokenizer.h"
+#include "TextBuffer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Lines tokenized between progress callbacks during long passes
+            const size_t kNotifyInterval = 1024;
+        }
+
+        class Tokenizer::Impl {
+        public:
+            struct Line {
+                std::vector<Token> tokens;
+                TokenizerStatePtr endState;
+                bool dirty;
+
+                Line() : dirty(true) {}
+            };
+
+            Impl(TextBuffer& buffer, std::shared_ptr<const Grammar> grammar)
+                : buffer(buffer), grammar(std::move(grammar)), snapshot(buffer.snapshot()),
+                  lines(snapshot.getLineCount()), dirtyCount(lines.size()), firstDirty(0), generation(0), stopping(false) {
+                listenerId = buffer.addChangeListener([this](const TextDocumentChangeEvent& event) {
+                    onChange(event);
+                });
+                worker = std::thread([this] { run(); });
+            }
+
+            ~Impl() {
+                buffer.removeChangeListener(listenerId);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                workAvailable.notify_all();
+                worker.join();
+            }
+
+            // Shift cached lines to follow the edit and mark the changed ones. Lines
+            // after the edit keep their state; they are revisited only if the state
+            // reaching them turns out different.
+            void onChange(const TextDocumentChangeEvent& event) {
+                TextSnapshot current = buffer.snapshot();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (const auto& change : event.changes) {
+                        size_t line = static_cast<size_t>(change.range.start.line);
+                        size_t removed = static_cast<size_t>(change.range.end.line - change.range.start.line);
+                        size_t inserted = static_cast<size_t>(std::count(change.text.begin(), change.text.end(), '\n'));
+
+                        // Entries are removed or added at the start of the edit, so the
+                        // entry of its last line moves to the new last line, and that line
+                        // converges only if it ends as the old one did
+                        auto first = lines.begin() + line;
+                        if (removed > inserted) {
+                            auto last = first + (removed - inserted);
+                            dirtyCount -= static_cast<size_t>(std::count_if(first, last, [](const Line& entry) {
+                                return entry.dirty;
+                            }));
+                            lines.erase(first, last);
+                        }
+                        else if (inserted > removed) {
+                            lines.insert(first, inserted - removed, Line());
+                            dirtyCount += inserted - removed;
+                        }
+                        for (size_t i = line; i <= line + inserted; ++i) {
+                            markDirty(i);
+                        }
+                        firstDirty = std::min(firstDirty, line);
+                    }
+
+                    snapshot = std::move(current);
+                    ++generation;
+                }
+                workAvailable.notify_one();
+            }
+
+            void markDirty(size_t line) {
+                if (!lines[line].dirty) {
+                    lines[line].dirty = true;
+                    ++dirtyCount;
+                }
+            }
+
+            // Lines before firstDirty are all tokenized for the current text. The count
+            // saves walking the rest of the file once a change has converged.
+            size_t findDirtyLine() {
+                if (dirtyCount == 0) {
+                    firstDirty = lines.size();
+                }
+                while (firstDirty < lines.size() && !lines[firstDirty].dirty) {
+                    ++firstDirty;
+                }
+                return firstDirty;
+            }
+
+            void run() {
+                std::unique_lock<std::mutex> lock(mutex);
+                std::string scratch;
+                std::vector<Token> tokens;
+                size_t changedFirst = 0;
+                size_t changedLast = 0;
+                size_t changedCount = 0;
+
+                while (!stopping) {
+                    size_t line = findDirtyLine();
+                    bool idle = line == lines.size();
+
+                    if (changedCount > 0 && (idle || changedCount >= kNotifyInterval)) {
+                        TokensChangedCallback notify = callback;
+                        int first = static_cast<int>(changedFirst);
+                        int last = static_cast<int>(std::min(changedLast, lines.size() - 1));
+                        changedCount = 0;
+                        if (notify) {
+                            lock.unlock();
+                            notify(first, last);
+                            lock.lock();
+                        }
+                        continue;
+                    }
+
+                    if (idle) {
+                        idleReached.notify_all();
+                        workAvailable.wait(lock, [this] {
+                            return stopping || firstDirty < lines.size();
+                        });
+                        continue;
+                    }
+
+                    TextSnapshot current = snapshot;
+                    uint64_t started = generation;
+                    TokenizerStatePtr state = line == 0 ? grammar->getInitialState() : lines[line - 1].endState;
+                    lock.unlock();
+
+                    tokens.clear();
+                    TokenizerStatePtr endState = grammar->tokenizeLine(current.getLineView(static_cast<int>(line), scratch), state, tokens);
+
+                    lock.lock();
+                    if (started != generation) {
+                        // Lines moved while this one was tokenized; start over
+                        continue;
+                    }
+
+                    // Once a line ends in the state it ended in before, the lines after
+                    // it are still right
+                    Line& entry = lines[line];
+                    bool converged = entry.endState && entry.endState->equals(*endState);
+                    entry.tokens.swap(tokens);
+                    entry.endState = std::move(endState);
+                    entry.dirty = false;
+                    --dirtyCount;
+                    if (!converged && line + 1 < lines.size()) {
+                        markDirty(line + 1);
+                    }
+                    firstDirty = line + 1;
+
+                    changedFirst = changedCount == 0 ? line : std::min(changedFirst, line);
+                    changedLast = changedCount == 0 ? line : std::max(changedLast, line);
+                    ++changedCount;
+                }
+            }
+
+            TextBuffer& buffer;
+            std::shared_ptr<const Grammar> grammar;
+            int listenerId;
+
+            // Everything below is guarded by mutex
+            mutable std::mutex mutex;
+            mutable std::condition_variable workAvailable;
+            mutable std::condition_variable idleReached;
+            TextSnapshot snapshot;
+            std::vector<Line> lines;
+            size_t dirtyCount;
+            size_t firstDirty;
+            uint64_t generation;
+            bool stopping;
+            TokensChangedCallback callback;
+
+            std::thread worker;
+        };
+
+        Tokenizer::Tokenizer(TextBuffer& buffer, std::shared_ptr<const Grammar> grammar)
+            : pImpl(std::make_unique<Impl>(buffer, std::move(grammar))) {
+        }
+
+        Tokenizer::~Tokenizer() {
+        }
+
+        const Grammar& Tokenizer::getGrammar() const {
+            return *pImpl->grammar;
+        }
+
+        bool Tokenizer::getLineTokens(int line, std::vector<Token>& tokens) const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            if (line < 0 || static_cast<size_t>(line) >= pImpl->lines.size()) {
+                tokens.clear();
+                return false;
+            }
+
+            tokens = pImpl->lines[line].tokens;
+            return static_cast<size_t>(line) < pImpl->firstDirty;
+        }
+
+        bool Tokenizer::isIdle() const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            return pImpl->firstDirty >= pImpl->lines.size();
+        }
+
+        void Tokenizer::waitUntilIdle() const {
+            std::unique_lock<std::mutex> lock(pImpl->mutex);
+            pImpl->idleReached.wait(lock, [this] {
+                return pImpl->firstDirty >= pImpl->lines.size();
+            });
+        }
+
+        void Tokenizer::setTokensChangedCallback(TokensChangedCallback callback) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            pImpl->callback = std::move(callback);
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
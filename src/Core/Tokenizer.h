@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pch.h"
+#include "Grammar.h"
+
+namespace Vune {
+    namespace Core {
+
+        class TextBuffer;
+
+        // Lines whose tokens changed, called on the tokenizer thread
+        using TokensChangedCallback = std::function<void(int firstLine, int lastLine)>;
+
+        // Keeps syntax tokens of a TextBuffer up to date. The end state of every line is
+        // cached; after a change, lines are re-tokenized from the first changed one
+        // until the state they end in matches the cached one again. That work runs on a
+        // background thread against a snapshot, so edits never wait for it.
+        class Tokenizer {
+        public:
+            // Listens to the buffer, which must outlive the tokenizer. Construct and
+            // destroy it on the thread that edits the buffer.
+            Tokenizer(TextBuffer& buffer, std::shared_ptr<const Grammar> grammar);
+            ~Tokenizer();
+
+            const Grammar& getGrammar() const;
+
+            // Copy the tokens of a line. Returns false if the line changed since it was
+            // last tokenized; the tokens are then stale, or empty for new lines.
+            bool getLineTokens(int line, std::vector<Token>& tokens) const;
+
+            // Whether every line is tokenized for the current text
+            bool isIdle() const;
+
+            // Block until every line is tokenized for the current text
+            void waitUntilIdle() const;
+
+            void setTokensChangedCallback(TokensChangedCallback callback);
+
+        private:
+            // Prevent copying
+            Tokenizer(const Tokenizer&) = delete;
+            Tokenizer& operator=(const Tokenizer&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include "pch.h"
+#include "Trace.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace Vune {
+    namespace Core {
+
+        std::atomic<bool> Trace::enabled(false);
+
+        namespace {
+            // Spans kept per thread; a power of two
+            const uint64_t kEventsPerThread = 64 * 1024;
+
+            const size_t kCounterCount = static_cast<size_t>(TraceCounter::Count);
+            const size_t kHistogramCount = static_cast<size_t>(TraceHistogram::Count);
+
+            // Bucket i holds durations in [2^i, 2^(i+1)) nanoseconds
+            const size_t kBucketCount = 64;
+
+            const char* const kCounterNames[kCounterCount] = {
+                "Edits", "Allocations", "BytesRead", "BytesWritten", "BytesMapped"
+            };
+
+            const char* const kHistogramNames[kHistogramCount] = {
+                "EditLatency", "FileReadLatency"
+            };
+
+            struct TraceEvent {
+                std::atomic<const char*> name;
+                std::atomic<uint64_t> start;
+                std::atomic<uint64_t> duration;
+            };
+
+            struct HistogramSlots {
+                std::atomic<uint64_t> buckets[kBucketCount];
+                std::atomic<uint64_t> sum;
+            };
+
+            // Where the last clear left a thread
+            struct Baseline {
+                uint64_t events;
+                uint64_t counters[kCounterCount];
+                uint64_t buckets[kHistogramCount][kBucketCount];
+                uint64_t sums[kHistogramCount];
+            };
+
+            // Everything one thread records. Only that thread writes the atomics, with
+            // plain loads and stores rather than read-modify-writes; readers may see
+            // them at any time. When the thread exits, the entry goes to the next
+            // thread that records, which carries on in the same lane of the export.
+            struct ThreadTrace {
+                uint32_t threadId;
+                std::string name;                   // guarded by the registry mutex
+                Baseline baseline;                  // guarded by the registry mutex
+
+                // Allocated by the thread on its first span. A span at index i is in
+                // slot i % kEventsPerThread; claimed runs ahead of written while a
+                // slot is being overwritten.
+                std::unique_ptr<TraceEvent[]> eventStorage;
+                std::atomic<TraceEvent*> events;
+                std::atomic<uint64_t> claimed;
+                std::atomic<uint64_t> written;
+
+                std::atomic<uint64_t> counters[kCounterCount];
+                HistogramSlots histograms[kHistogramCount];
+
+                explicit ThreadTrace(uint32_t threadId) : threadId(threadId), baseline(), events(nullptr), claimed(0), written(0) {
+                    for (auto& counter : counters) {
+                        counter.store(0, std::memory_order_relaxed);
+                    }
+                    for (auto& histogram : histograms) {
+                        for (auto& bucket : histogram.buckets) {
+                            bucket.store(0, std::memory_order_relaxed);
+                        }
+                        histogram.sum.store(0, std::memory_order_relaxed);
+                    }
+                }
+            };
+
+            struct Registry {
+                std::mutex mutex;
+                std::vector<std::unique_ptr<ThreadTrace>> threads;
+                std::vector<ThreadTrace*> unused;   // left by exited threads
+                uint64_t epoch;                     // start of exported time; spans before it are dropped
+
+                Registry() : epoch(0) {}
+            };
+
+            // Never destroyed: threads of static pools may still record during exit
+            Registry& registry() {
+                static Registry* instance = new Registry();
+                return *instance;
+            }
+
+            // The calling thread's entry, taken on its first record and handed back
+            // when it exits
+            struct ThreadSlot {
+                ThreadTrace* trace;
+                std::string name;                   // given before the entry was taken
+
+                ThreadSlot() : trace(nullptr) {}
+
+                ~ThreadSlot() {
+                    if (trace) {
+                        Registry& traces = registry();
+                        std::lock_guard<std::mutex> lock(traces.mutex);
+                        traces.unused.push_back(trace);
+                        trace = nullptr;
+                    }
+                }
+            };
+
+            thread_local ThreadSlot currentSlot;
+
+            ThreadTrace& currentThread() {
+                ThreadSlot& slot = currentSlot;
+                if (!slot.trace) {
+                    Registry& traces = registry();
+                    std::lock_guard<std::mutex> lock(traces.mutex);
+                    if (!traces.unused.empty()) {
+                        slot.trace = traces.unused.back();
+                        traces.unused.pop_back();
+                    }
+                    else {
+                        traces.threads.push_back(std::make_unique<ThreadTrace>(static_cast<uint32_t>(traces.threads.size() + 1)));
+                        slot.trace = traces.threads.back().get();
+                    }
+                    slot.trace->name = slot.name;
+                }
+                return *slot.trace;
+            }
+
+            void increase(std::atomic<uint64_t>& value, uint64_t amount) {
+                value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+
+            uint64_t bucketLimit(size_t bucket) {
+                return bucket + 1 < 64 ? (uint64_t(1) << (bucket + 1)) - 1 : UINT64_MAX;
+            }
+
+            void summarize(const uint64_t* buckets, uint64_t sum, TraceHistogramSummary& summary) {
+                summary = TraceHistogramSummary();
+                summary.sum = sum;
+                for (size_t i = 0; i < kBucketCount; ++i) {
+                    summary.count += buckets[i];
+                }
+                uint64_t seen = 0;
+                for (size_t i = 0; i < kBucketCount; ++i) {
+                    if (buckets[i] == 0) {
+                        continue;
+                    }
+                    seen += buckets[i];
+                    if (summary.p50 == 0 && seen * 100 >= summary.count * 50) summary.p50 = bucketLimit(i);
+                    if (summary.p90 == 0 && seen * 100 >= summary.count * 90) summary.p90 = bucketLimit(i);
+                    if (summary.p99 == 0 && seen * 100 >= summary.count * 99) summary.p99 = bucketLimit(i);
+                    summary.max = bucketLimit(i);
+                }
+            }
+
+            // Caller holds the registry mutex
+            TraceHistogramSummary histogramSince(const Registry& traces, TraceHistogram histogram) {
+                size_t index = static_cast<size_t>(histogram);
+                uint64_t buckets[kBucketCount] = {};
+                uint64_t sum = 0;
+                for (const auto& thread : traces.threads) {
+                    const HistogramSlots& slots = thread->histograms[index];
+                    for (size_t i = 0; i < kBucketCount; ++i) {
+                        buckets[i] += slots.buckets[i].load(std::memory_order_relaxed) - thread->baseline.buckets[index][i];
+                    }
+                    sum += slots.sum.load(std::memory_order_relaxed) - thread->baseline.sums[index];
+                }
+                TraceHistogramSummary summary;
+                summarize(buckets, sum, summary);
+                return summary;
+            }
+
+            // Caller holds the registry mutex
+            uint64_t countSince(const Registry& traces, TraceCounter counter) {
+                size_t index = static_cast<size_t>(counter);
+                uint64_t total = 0;
+                for (const auto& thread : traces.threads) {
+                    total += thread->counters[index].load(std::memory_order_relaxed) - thread->baseline.counters[index];
+                }
+                return total;
+            }
+
+            void appendJsonString(std::string& out, std::string_view text) {
+                out += '"';
+                for (char c : text) {
+                    if (c == '"' || c == '\\') {
+                        out += '\\';
+                        out += c;
+                    }
+                    else if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                        out += escaped;
+                    }
+                    else {
+                        out += c;
+                    }
+                }
+                out += '"';
+            }
+
+            // Chrome traces count time in microseconds
+            void appendMicroseconds(std::string& out, uint64_t nanoseconds) {
+                char text[32];
+                snprintf(text, sizeof(text), "%llu.%03u", static_cast<unsigned long long>(nanoseconds / 1000),
+                    static_cast<unsigned>(nanoseconds % 1000));
+                out += text;
+            }
+
+            unsigned long currentProcessId() {
+#ifdef _WIN32
+                return GetCurrentProcessId();
+#else
+                return static_cast<unsigned long>(getpid());
+#endif
+            }
+
+            struct Span {
+                const char* name;
+                uint64_t start;
+                uint64_t duration;
+            };
+        }
+
+        void Trace::setEnabled(bool enable) {
+            if (enable) {
+                Registry& traces = registry();
+                std::lock_guard<std::mutex> lock(traces.mutex);
+                if (traces.epoch == 0) {
+                    traces.epoch = now();
+                }
+            }
+            enabled.store(enable, std::memory_order_relaxed);
+        }
+
+        void Trace::clear() {
+            Registry& traces = registry();
+            std::lock_guard<std::mutex> lock(traces.mutex);
+            traces.epoch = now();
+            for (auto& thread : traces.threads) {
+                Baseline& baseline = thread->baseline;
+                baseline.events = thread->written.load(std::memory_order_acquire);
+                for (size_t i = 0; i < kCounterCount; ++i) {
+                    baseline.counters[i] = thread->counters[i].load(std::memory_order_relaxed);
+                }
+                for (size_t h = 0; h < kHistogramCount; ++h) {
+                    for (size_t i = 0; i < kBucketCount; ++i) {
+                        baseline.buckets[h][i] = thread->histograms[h].buckets[i].load(std::memory_order_relaxed);
+                    }
+                    baseline.sums[h] = thread->histograms[h].sum.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        uint64_t Trace::now() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void Trace::recordSpan(const char* name, uint64_t start, uint64_t end) {
+            if (!isEnabled()) {
+                return;
+            }
+
+            ThreadTrace& thread = currentThread();
+            TraceEvent* events = thread.events.load(std::memory_order_relaxed);
+            if (!events) {
+                thread.eventStorage.reset(new TraceEvent[kEventsPerThread]);
+                events = thread.eventStorage.get();
+                thread.events.store(events, std::memory_order_release);
+            }
+
+            // Claim the slot before overwriting it, so a reader copying the ring at
+            // the same time knows to drop what it read there
+            uint64_t index = thread.written.load(std::memory_order_relaxed);
+            thread.claimed.store(index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            TraceEvent& event = events[index & (kEventsPerThread - 1)];
+            event.name.store(name, std::memory_order_relaxed);
+            event.start.store(start, std::memory_order_relaxed);
+            event.duration.store(end > start ? end - start : 0, std::memory_order_relaxed);
+            thread.written.store(index + 1, std::memory_order_release);
+        }
+
+        void Trace::addCountEnabled(TraceCounter counter, uint64_t amount) {
+            increase(currentThread().counters[static_cast<size_t>(counter)], amount);
+        }
+
+        void Trace::addSampleEnabled(TraceHistogram histogram, uint64_t nanoseconds) {
+            HistogramSlots& slots = currentThread().histograms[static_cast<size_t>(histogram)];
+            increase(slots.buckets[highestSetBit(nanoseconds | 1)], 1);
+            increase(slots.sum, nanoseconds);
+        }
+
+        uint64_t Trace::getCount(TraceCounter counter) {
+            Registry& traces = registry();
+            std::lock_guard<std::mutex> lock(traces.mutex);
+            return countSince(traces, counter);
+        }
+
+        TraceHistogramSummary Trace::getHistogram(TraceHistogram histogram) {
+            Registry& traces = registry();
+            std::lock_guard<std::mutex> lock(traces.mutex);
+            return histogramSince(traces, histogram);
+        }
+
+        void Trace::setThreadName(const std::string& name) {
+            // Kept for the entry the thread takes once it records, so threads that
+            // never record while tracing is enabled take none
+            ThreadSlot& slot = currentSlot;
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            slot.name = name;
+            if (slot.trace) {
+                slot.trace->name = name;
+            }
+        }
+
+        std::string Trace::exportChromeJson() {
+            Registry& traces = registry();
+            std::lock_guard<std::mutex> lock(traces.mutex);
+            uint64_t exportTime = now();
+            std::string pid = std::to_string(currentProcessId());
+
+            std::string out = "{\"traceEvents\":[";
+            bool first = true;
+            auto beginEvent = [&out, &first, &pid](const char* name, const char* phase, uint64_t threadId) {
+                out += first ? "\n" : ",\n";
+                first = false;
+                out += "{\"name\":";
+                appendJsonString(out, name);
+                out += ",\"ph\":\"";
+                out += phase;
+                out += "\",\"pid\":" + pid + ",\"tid\":" + std::to_string(threadId);
+            };
+
+            std::vector<Span> spans;
+            for (const auto& thread : traces.threads) {
+                beginEvent("thread_name", "M", thread->threadId);
+                out += ",\"args\":{\"name\":";
+                appendJsonString(out, thread->name.empty() ? "Thread " + std::to_string(thread->threadId) : thread->name);
+                out += "}}";
+
+                TraceEvent* events = thread->events.load(std::memory_order_acquire);
+                uint64_t written = thread->written.load(std::memory_order_acquire);
+                if (!events) {
+                    continue;
+                }
+
+                uint64_t begin = std::max(thread->baseline.events, written > kEventsPerThread ? written - kEventsPerThread : 0);
+                spans.clear();
+                for (uint64_t index = begin; index < written; ++index) {
+                    const TraceEvent& event = events[index & (kEventsPerThread - 1)];
+                    spans.push_back({ event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+                        event.duration.load(std::memory_order_relaxed) });
+                }
+
+                // Spans whose slots the thread claimed meanwhile may be torn
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t claimed = thread->claimed.load(std::memory_order_relaxed);
+                uint64_t valid = claimed > kEventsPerThread ? claimed - kEventsPerThread : 0;
+                for (uint64_t index = std::max(begin, valid); index < written; ++index) {
+                    const Span& span = spans[index - begin];
+                    if (span.start < traces.epoch) {
+                        continue;
+                    }
+                    beginEvent(span.name, "X", thread->threadId);
+                    out += ",\"cat\":\"vune\",\"ts\":";
+                    appendMicroseconds(out, span.start - traces.epoch);
+                    out += ",\"dur\":";
+                    appendMicroseconds(out, span.duration);
+                    out += "}";
+                }
+            }
+
+            for (size_t i = 0; i < kCounterCount; ++i) {
+                beginEvent(kCounterNames[i], "C", 0);
+                out += ",\"ts\":";
+                appendMicroseconds(out, exportTime - std::min(exportTime, traces.epoch));
+                out += ",\"args\":{\"value\":" + std::to_string(countSince(traces, static_cast<TraceCounter>(i))) + "}}";
+            }
+
+            out += "\n],\"displayTimeUnit\":\"ns\",\"metadata\":{\"histograms\":{";
+            for (size_t i = 0; i < kHistogramCount; ++i) {
+                TraceHistogramSummary summary = histogramSince(traces, static_cast<TraceHistogram>(i));
+                if (i > 0) {
+                    out += ",";
+                }
+                appendJsonString(out, kHistogramNames[i]);
+                out += ":{\"unit\":\"ns\",\"count\":" + std::to_string(summary.count) + ",\"sum\":" + std::to_string(summary.sum) +
+                    ",\"p50\":" + std::to_string(summary.p50) + ",\"p90\":" + std::to_string(summary.p90) +
+                    ",\"p99\":" + std::to_string(summary.p99) + ",\"max\":" + std::to_string(summary.max) + "}";
+            }
+            out += "}}}\n";
+            return out;
+        }
+
+        void TraceScope::finish() {
+            uint64_t end = Trace::now();
+            Trace::recordSpan(name, start, end);
+            if (histogram != TraceHistogram::Count) {
+                Trace::addSample(histogram, end - start);
+            }
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "pch.h"
+#include <atomic>
+
+namespace Vune {
+    namespace Core {
+
+        // Running totals kept while tracing is enabled
+        enum class TraceCounter {
+            Edits,              // TextBuffer edits, undos and redos
+            Allocations,        // piece tree nodes and text chunks
+            BytesRead,          // by FileSystem reads
+            BytesWritten,       // by FileSystem writes
+            BytesMapped,        // by FileSystem::mapFile
+            Count
+        };
+
+        // Durations sampled while tracing is enabled, in nanoseconds
+        enum class TraceHistogram {
+            EditLatency,
+            FileReadLatency,
+            Count
+        };
+
+        struct TraceHistogramSummary {
+            uint64_t count;
+            uint64_t sum;
+            // Upper bounds of the power-of-two buckets the percentiles fall in
+            uint64_t p50;
+            uint64_t p90;
+            uint64_t p99;
+            uint64_t max;
+
+            TraceHistogramSummary() : count(0), sum(0), p50(0), p90(0), p99(0), max(0) {}
+        };
+
+        // Process-wide tracing. Spans go into a ring buffer of the thread recording
+        // them, which only that thread writes, so recording takes no lock and never
+        // waits; when a ring is full its oldest spans are overwritten. Counters and
+        // histograms are per thread too and summed when read. While tracing is
+        // disabled a count or sample costs one predictable branch, and a
+        // TraceScope one at each end. A thread gets its ring on its first record,
+        // and leaves it to the next thread when it exits, so threads that come and
+        // go do not add up.
+        class Trace {
+        public:
+            static bool isEnabled() {
+                return enabled.load(std::memory_order_relaxed);
+            }
+
+            static void setEnabled(bool enable);
+
+            // Drop what was recorded so far. Threads keep recording while it runs.
+            static void clear();
+
+            // Steady clock in nanoseconds
+            static uint64_t now();
+
+            // Record a span from start to end, unless tracing is disabled. The name is
+            // kept as a pointer, so it must live as long as the trace, such as a
+            // string literal.
+            static void recordSpan(const char* name, uint64_t start, uint64_t end);
+
+            static void addCount(TraceCounter counter, uint64_t amount = 1) {
+                if (isEnabled()) {
+                    addCountEnabled(counter, amount);
+                }
+            }
+
+            static void addSample(TraceHistogram histogram, uint64_t nanoseconds) {
+                if (isEnabled()) {
+                    addSampleEnabled(histogram, nanoseconds);
+                }
+            }
+
+            static uint64_t getCount(TraceCounter counter);
+            static TraceHistogramSummary getHistogram(TraceHistogram histogram);
+
+            // Name the calling thread in exported traces. Takes no ring until the
+            // thread records.
+            static void setThreadName(const std::string& name);
+
+            // Everything recorded since the last clear in the Chrome trace event
+            // format, which Perfetto and chrome://tracing open. Counters are counter
+            // events at the time of the export and histograms are in the metadata.
+            static std::string exportChromeJson();
+
+        private:
+            static void addCountEnabled(TraceCounter counter, uint64_t amount);
+            static void addSampleEnabled(TraceHistogram histogram, uint64_t nanoseconds);
+
+            static std::atomic<bool> enabled;
+        };
+
+        // Records the span of a scope, and optionally samples its duration into a
+        // histogram, if tracing was enabled when it started
+        class TraceScope {
+        public:
+            explicit TraceScope(const char* name)
+                : name(name), histogram(TraceHistogram::Count), start(Trace::isEnabled() ? Trace::now() : 0) {}
+
+            TraceScope(const char* name, TraceHistogram histogram)
+                : name(name), histogram(histogram), start(Trace::isEnabled() ? Trace::now() : 0) {}
+
+            ~TraceScope() {
+                if (start != 0) {
+                    finish();
+                }
+            }
+
+        private:
+            // Prevent copying
+            TraceScope(const TraceScope&) = delete;
+            TraceScope& operator=(const TraceScope&) = delete;
+
+            void finish();
+
+            const char* name;
+            TraceHistogram histogram;
+            uint64_t start;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,745 @@
+#include "pch.h"
+#include "TrigramIndex.h"
+#include "DirectoryWalker.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            const char kMagic[4] = { 'V', 'T', 'R', 'I' };
+            const uint32_t kFormatVersion = 1;
+
+            // Larger files are not indexed, and are candidates for every query
+            const uint64_t kMaxIndexedFileSize = 64 * 1024 * 1024;
+
+            // Files at least this large are mapped instead of read
+            const uint64_t kMapThreshold = 64 * 1024;
+
+            // A NUL byte this close to the start marks a file as binary
+            const size_t kBinaryProbeLength = 8 * 1024;
+
+            const uint32_t kBinaryFile = 1;
+            const uint32_t kUnindexedFile = 2;
+
+            const uint32_t kNoFile = static_cast<uint32_t>(-1);
+
+            // Saved layout. Sections follow the header in this order, each starting at
+            // a multiple of 8 bytes.
+            struct Header {
+                char magic[4];
+                uint32_t version;
+                uint32_t fileCount;
+                uint32_t trigramCount;
+                uint64_t filesOffset;
+                uint64_t pathsOffset;
+                uint64_t trigramsOffset;
+                uint64_t postingsOffset;
+                uint64_t totalSize;
+            };
+
+            struct FileRecord {
+                uint64_t pathOffset;    // from the start of the paths section
+                uint32_t pathLength;
+                uint32_t flags;
+                uint64_t size;
+                int64_t modified;
+            };
+
+            // Sorted by trigram. Postings are file ids as LEB128 varints, the first
+            // absolute and the rest as differences from the previous id.
+            struct TrigramRecord {
+                uint32_t trigram;
+                uint32_t fileCount;
+                uint64_t postingOffset; // from the start of the postings section
+            };
+
+            // What indexing found in a file changed since the index was loaded
+            struct FileData {
+                uint64_t size;
+                int64_t modified;
+                uint32_t flags;
+                std::vector<uint32_t> trigrams; // sorted
+            };
+
+            struct FoldTable {
+                unsigned char bytes[256];
+
+                FoldTable() {
+                    for (int i = 0; i < 256; ++i) {
+                        bytes[i] = static_cast<unsigned char>(i >= 'A' && i <= 'Z' ? i + ('a' - 'A') : i);
+                    }
+                }
+            };
+
+            const FoldTable foldTable;
+
+            // Distinct case-folded trigrams of data, sorted
+            void collectTrigrams(const char* data, size_t length, std::vector<uint32_t>& trigrams) {
+                // One bit per possible trigram, cleared again before returning
+                thread_local std::vector<uint64_t> seen(1 << 18);
+
+                trigrams.clear();
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+                uint32_t trigram = 0;
+                for (size_t i = 0; i < length; ++i) {
+                    trigram = ((trigram << 8) | foldTable.bytes[bytes[i]]) & 0xFFFFFF;
+                    if (i < 2) {
+                        continue;
+                    }
+
+                    uint64_t bit = 1ull << (trigram & 63);
+                    uint64_t& word = seen[trigram >> 6];
+                    if (!(word & bit)) {
+                        word |= bit;
+                        trigrams.push_back(trigram);
+                    }
+                }
+
+                for (uint32_t found : trigrams) {
+                    seen[found >> 6] = 0;
+                }
+                std::sort(trigrams.begin(), trigrams.end());
+            }
+
+            // Literal strings every match of an ECMAScript expression must contain. Errs
+            // on the side of returning less: group contents, classes and anything after
+            // an alternation are left out.
+            std::vector<std::string> requiredLiterals(const std::string& pattern) {
+                std::vector<std::string> literals;
+                if (pattern.find('|') != std::string::npos) {
+                    return literals;
+                }
+
+                std::string run;
+                int depth = 0;
+                auto endRun = [&] {
+                    if (run.size() >= 3) {
+                        literals.push_back(run);
+                    }
+                    run.clear();
+                };
+
+                for (size_t i = 0; i < pattern.size(); ++i) {
+                    char c = pattern[i];
+                    char literal;
+
+                    if (c == '\\' && i + 1 < pattern.size()) {
+                        char next = pattern[++i];
+                        if (next == 'n' || next == 't' || next == 'r') {
+                            literal = next == 'n' ? '\n' : next == 't' ? '\t' : '\r';
+                        }
+                        else if (std::strchr("\\^$.|?*+()[]{}/-", next)) {
+                            literal = next;
+                        }
+                        else {
+                            // Classes, assertions, back references and code escapes
+                            size_t skip = next == 'x' ? 2 : next == 'u' ? 4 : next == 'c' ? 1 : 0;
+                            while (next >= '0' && next <= '9' && i + 1 < pattern.size() && pattern[i + 1] >= '0' && pattern[i + 1] <= '9') {
+                                ++i;
+                            }
+                            i += std::min(skip, pattern.size() - 1 - i);
+                            endRun();
+                            continue;
+                        }
+                    }
+                    else if (c == '[') {
+                        for (++i; i < pattern.size() && pattern[i] != ']'; ++i) {
+                            if (pattern[i] == '\\') {
+                                ++i;
+                            }
+                        }
+                        endRun();
+                        continue;
+                    }
+                    else if (c == '(' || c == ')') {
+                        depth += c == '(' ? 1 : -1;
+                        endRun();
+                        continue;
+                    }
+                    else if (c == '*' || c == '?' || c == '{') {
+                        // The preceding character may not occur at all
+                        if (!run.empty()) {
+                            run.pop_back();
+                        }
+                        endRun();
+                        if (c == '{') {
+                            i = std::min(pattern.find('}', i), pattern.size());
+                        }
+                        continue;
+                    }
+                    else if (c == '+' || c == '.' || c == '^' || c == '$') {
+                        endRun();
+                        continue;
+                    }
+                    else {
+                        literal = c;
+                    }
+
+                    if (depth == 0) {
+                        run.push_back(literal);
+                    }
+                }
+
+                endRun();
+                return literals;
+            }
+
+            // Trigrams every file matching the query contains
+            std::vector<uint32_t> requiredTrigrams(const SearchOptions& query) {
+                std::vector<std::string> literals;
+                if (query.isRegex) {
+                    literals = requiredLiterals(query.pattern);
+                }
+                else {
+                    literals.push_back(query.pattern);
+                }
+
+                std::vector<uint32_t> result;
+                std::vector<uint32_t> trigrams;
+                for (const auto& literal : literals) {
+                    collectTrigrams(literal.data(), literal.size(), trigrams);
+                    result.insert(result.end(), trigrams.begin(), trigrams.end());
+                }
+
+                std::sort(result.begin(), result.end());
+                result.erase(std::unique(result.begin(), result.end()), result.end());
+                return result;
+            }
+
+            void appendVarint(std::string& out, uint32_t value) {
+                while (value >= 0x80) {
+                    out.push_back(static_cast<char>(value | 0x80));
+                    value >>= 7;
+                }
+                out.push_back(static_cast<char>(value));
+            }
+
+            template <typename T>
+            void appendRaw(std::string& out, const T& value) {
+                out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            void alignTo8(std::string& out) {
+                out.resize((out.size() + 7) & ~static_cast<size_t>(7), '\0');
+            }
+
+            // Sort (trigram << 32 | file id) pairs by trigram with two stable 12-bit
+            // counting passes. Ids are appended in ascending order and stay that way
+            // within each trigram.
+            void sortByTrigram(std::vector<uint64_t>& entries) {
+                std::vector<uint64_t> scratch(entries.size());
+                for (int shift = 32; shift < 56; shift += 12) {
+                    std::vector<size_t> starts(4097, 0);
+                    for (uint64_t entry : entries) {
+                        starts[((entry >> shift) & 0xFFF) + 1]++;
+                    }
+                    for (size_t i = 1; i < starts.size(); ++i) {
+                        starts[i] += starts[i - 1];
+                    }
+                    for (uint64_t entry : entries) {
+                        scratch[starts[(entry >> shift) & 0xFFF]++] = entry;
+                    }
+                    entries.swap(scratch);
+                }
+            }
+
+            // Whether count records of recordSize fit between an 8-byte aligned offset
+            // and limit
+            bool fitsSection(uint64_t offset, uint64_t count, size_t recordSize, uint64_t limit) {
+                return offset % 8 == 0 && offset <= limit && count <= (limit - offset) / recordSize;
+            }
+
+            bool isBinary(const char* data, size_t length) {
+                return std::memchr(data, '\0', std::min(length, kBinaryProbeLength)) != nullptr;
+            }
+        }
+
+        class TrigramIndex::Impl {
+        public:
+            explicit Impl(FileSystem& fileSystem) : fileSystem(fileSystem) {
+                clear();
+            }
+
+            void clear() {
+                mapped.reset();
+                header = nullptr;
+                files = nullptr;
+                paths = nullptr;
+                trigrams = nullptr;
+                postings = nullptr;
+                postingsLength = 0;
+                baseIds.clear();
+                baseRemoved.clear();
+                removedCount = 0;
+                baseUnindexed.clear();
+                overlay.clear();
+            }
+
+            // Map a saved index in place of the current contents. The file is checked
+            // before anything is dropped, so on failure the index stays as it was.
+            bool map(const std::string& indexPath) {
+                std::shared_ptr<MappedFile> file = fileSystem.mapFile(indexPath);
+                if (!file || file->size() < sizeof(Header)) {
+                    return false;
+                }
+
+                // Offsets are compared one at a time and counts by division, so no
+                // sum can wrap around
+                const Header* candidate = reinterpret_cast<const Header*>(file->data());
+                uint64_t size = file->size();
+                if (std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) != 0 || candidate->version != kFormatVersion ||
+                    candidate->totalSize != size ||
+                    candidate->filesOffset < sizeof(Header) ||
+                    candidate->pathsOffset > candidate->trigramsOffset ||
+                    candidate->trigramsOffset > candidate->postingsOffset ||
+                    candidate->postingsOffset > size ||
+                    !fitsSection(candidate->filesOffset, candidate->fileCount, sizeof(FileRecord), candidate->pathsOffset) ||
+                    !fitsSection(candidate->trigramsOffset, candidate->trigramCount, sizeof(TrigramRecord), candidate->postingsOffset)) {
+                    return false;
+                }
+
+                const FileRecord* records = reinterpret_cast<const FileRecord*>(file->data() + candidate->filesOffset);
+                uint64_t pathsLength = candidate->trigramsOffset - candidate->pathsOffset;
+                for (uint32_t id = 0; id < candidate->fileCount; ++id) {
+                    if (records[id].pathOffset > pathsLength || records[id].pathLength > pathsLength - records[id].pathOffset) {
+                        return false;
+                    }
+                }
+
+                clear();
+                mapped = std::move(file);
+                header = candidate;
+                files = records;
+                paths = mapped->data() + header->pathsOffset;
+                trigrams = reinterpret_cast<const TrigramRecord*>(mapped->data() + header->trigramsOffset);
+                postings = reinterpret_cast<const uint8_t*>(mapped->data() + header->postingsOffset);
+                postingsLength = size - header->postingsOffset;
+
+                baseRemoved.assign(header->fileCount, false);
+                baseIds.reserve(header->fileCount);
+                for (uint32_t id = 0; id < header->fileCount; ++id) {
+                    baseIds.emplace(basePath(id), id);
+                    if (files[id].flags & kUnindexedFile) {
+                        baseUnindexed.push_back(id);
+                    }
+                }
+                return true;
+            }
+
+            uint32_t baseCount() const {
+                return header ? header->fileCount : 0;
+            }
+
+            std::string basePath(uint32_t id) const {
+                return std::string(paths + files[id].pathOffset, files[id].pathLength);
+            }
+
+            void decodeRecord(const TrigramRecord& record, std::vector<uint32_t>& ids) const {
+                ids.clear();
+                ids.reserve(record.fileCount);
+
+                uint64_t position = record.postingOffset;
+                uint32_t id = 0;
+                for (uint32_t i = 0; i < record.fileCount && position < postingsLength; ++i) {
+                    uint32_t value = 0;
+                    for (int shift = 0; position < postingsLength; shift += 7) {
+                        uint8_t byte = postings[position++];
+                        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                        if (!(byte & 0x80) || shift >= 28) {
+                            break;
+                        }
+                    }
+
+                    id = i == 0 ? value : id + value;
+                    if (id >= header->fileCount) {
+                        break;
+                    }
+                    ids.push_back(id);
+                }
+            }
+
+            FileData indexFile(const DirectoryEntry& entry) const {
+                FileData data{ entry.size, entry.modified, 0, {} };
+                if (entry.size > kMaxIndexedFileSize) {
+                    data.flags = kUnindexedFile;
+                    return data;
+                }
+
+                // Small files reuse one buffer per pool thread
+                thread_local std::string buffer;
+                std::shared_ptr<MappedFile> file;
+                const char* bytes = nullptr;
+                size_t length = 0;
+
+                if (entry.size >= kMapThreshold) {
+                    file = fileSystem.mapFile(entry.path);
+                    if (file) {
+                        bytes = file->data();
+                        length = file->size();
+                    }
+                }
+                else if (fileSystem.readFile(entry.path, buffer)) {
+                    bytes = buffer.data();
+                    length = buffer.size();
+                }
+
+                if (!bytes && entry.size > 0) {
+                    // Unreadable for now; let searches try it
+                    data.flags = kUnindexedFile;
+                }
+                else if (isBinary(bytes, length)) {
+                    data.flags = kBinaryFile;
+                }
+                else {
+                    collectTrigrams(bytes, length, data.trigrams);
+                }
+                return data;
+            }
+
+            // Replace what the index holds for a file; the caller holds the lock
+            void put(const std::string& path, FileData data) {
+                removeSaved(path);
+                overlay[path] = std::move(data);
+            }
+
+            void removeSaved(const std::string& path) {
+                auto found = baseIds.find(path);
+                if (found != baseIds.end() && !baseRemoved[found->second]) {
+                    baseRemoved[found->second] = true;
+                    removedCount++;
+                }
+            }
+
+            // Visit every file under root on the pool, concurrently. The walk does not
+            // stat, so each directory's files are described by a task of their own.
+            void walk(ThreadPool& pool, const std::string& root, const WalkOptions& options,
+                const std::function<void(const DirectoryEntry&)>& visit) const {
+                TaskGroup group(pool);
+                DirectoryWalker walker(fileSystem, pool, root, options, [this, &group, &visit](const WalkBatch& batch) {
+                    group.run([this, &visit, batch] {
+                        DirectoryEntry entry;
+                        for (const WalkEntry& found : batch.entries) {
+                            if (!found.isDirectory && fileSystem.getEntry(batch.getPath(found), entry) && !entry.isDirectory) {
+                                visit(entry);
+                            }
+                        }
+                    });
+                    return true;
+                });
+                walker.wait();
+                group.wait();
+            }
+
+            FileSystem& fileSystem;
+
+            // Saved index
+            std::shared_ptr<MappedFile> mapped;
+            const Header* header;
+            const FileRecord* files;
+            const char* paths;
+            const TrigramRecord* trigrams;
+            const uint8_t* postings;
+            uint64_t postingsLength;
+            std::unordered_map<std::string, uint32_t> baseIds;
+            std::vector<bool> baseRemoved;
+            size_t removedCount;
+            std::vector<uint32_t> baseUnindexed;
+
+            // Files indexed since it was loaded, sorted by path so saves are stable
+            std::map<std::string, FileData> overlay;
+
+            mutable std::mutex mutex;
+        };
+
+        TrigramIndex::TrigramIndex(FileSystem& fileSystem) : pImpl(std::make_unique<Impl>(fileSystem)) {
+        }
+
+        TrigramIndex::~TrigramIndex() {
+        }
+
+        bool TrigramIndex::load(const std::string& indexPath) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            if (!pImpl->map(indexPath)) {
+                pImpl->clear();
+                return false;
+            }
+            return true;
+        }
+
+        bool TrigramIndex::save(const std::string& indexPath) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            Impl& impl = *pImpl;
+
+            // Saved files that are still current keep their order, then come the
+            // files indexed since
+            std::string fileSection;
+            std::string pathSection;
+            std::vector<uint32_t> newIds(impl.baseCount(), kNoFile);
+            uint32_t fileCount = 0;
+
+            auto addFile = [&](const std::string& path, uint32_t flags, uint64_t size, int64_t modified) {
+                FileRecord record = { pathSection.size(), static_cast<uint32_t>(path.size()), flags, size, modified };
+                appendRaw(fileSection, record);
+                pathSection += path;
+                return fileCount++;
+            };
+
+            for (uint32_t id = 0; id < impl.baseCount(); ++id) {
+                if (!impl.baseRemoved[id]) {
+                    const FileRecord& record = impl.files[id];
+                    newIds[id] = addFile(impl.basePath(id), record.flags, record.size, record.modified);
+                }
+            }
+
+            // Trigram and file id of every file indexed since, sorted by trigram
+            std::vector<uint64_t> added;
+            size_t addedCount = 0;
+            for (const auto& file : impl.overlay) {
+                addedCount += file.second.trigrams.size();
+            }
+            added.reserve(addedCount);
+            for (const auto& file : impl.overlay) {
+                uint32_t id = addFile(file.first, file.second.flags, file.second.size, file.second.modified);
+                for (uint32_t trigram : file.second.trigrams) {
+                    added.push_back(static_cast<uint64_t>(trigram) << 32 | id);
+                }
+            }
+            sortByTrigram(added);
+
+            // Merge the saved posting lists with the new ones, trigram by trigram
+            std::string trigramSection;
+            std::string postingSection;
+            uint32_t trigramCount = 0;
+            std::vector<uint32_t> saved;
+            std::vector<uint32_t> ids;
+            const TrigramRecord* base = impl.trigrams;
+            const TrigramRecord* baseEnd = base + (impl.header ? impl.header->trigramCount : 0);
+            auto next = added.begin();
+
+            while (base != baseEnd || next != added.end()) {
+                uint32_t trigram = base == baseEnd ? static_cast<uint32_t>(*next >> 32)
+                    : next == added.end() ? base->trigram
+                    : std::min(base->trigram, static_cast<uint32_t>(*next >> 32));
+
+                ids.clear();
+                if (base != baseEnd && base->trigram == trigram) {
+                    impl.decodeRecord(*base++, saved);
+                    for (uint32_t id : saved) {
+                        if (newIds[id] != kNoFile) {
+                            ids.push_back(newIds[id]);
+                        }
+                    }
+                }
+                for (; next != added.end() && (*next >> 32) == trigram; ++next) {
+                    ids.push_back(static_cast<uint32_t>(*next));
+                }
+                if (ids.empty()) {
+                    continue;
+                }
+
+                TrigramRecord record = { trigram, static_cast<uint32_t>(ids.size()), postingSection.size() };
+                appendRaw(trigramSection, record);
+                trigramCount++;
+                for (size_t i = 0; i < ids.size(); ++i) {
+                    appendVarint(postingSection, i == 0 ? ids[i] : ids[i] - ids[i - 1]);
+                }
+            }
+
+            Header header = {};
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kFormatVersion;
+            header.fileCount = fileCount;
+            header.trigramCount = trigramCount;
+
+            std::string content;
+            content.reserve(sizeof(Header) + fileSection.size() + pathSection.size() + trigramSection.size() + postingSection.size() + 16);
+            appendRaw(content, header);
+            header.filesOffset = content.size();
+            content += fileSection;
+            header.pathsOffset = content.size();
+            content += pathSection;
+            alignTo8(content);
+            header.trigramsOffset = content.size();
+            content += trigramSection;
+            header.postingsOffset = content.size();
+            content += postingSection;
+            header.totalSize = content.size();
+            std::memcpy(&content[0], &header, sizeof(header));
+
+            // The mapping of the old index survives the file being replaced, so if the
+            // new one cannot be mapped the index carries on with the old one and its
+            // changes
+            if (!impl.fileSystem.writeTextFile(indexPath, content)) {
+                return false;
+            }
+            return impl.map(indexPath);
+        }
+
+        void TrigramIndex::build(ThreadPool& pool, const std::string& root, const WalkOptions& options) {
+            {
+                std::lock_guard<std::mutex> lock(pImpl->mutex);
+                pImpl->clear();
+            }
+
+            pImpl->walk(pool, root, options, [this](const DirectoryEntry& entry) {
+                FileData data = pImpl->indexFile(entry);
+                std::lock_guard<std::mutex> lock(pImpl->mutex);
+                pImpl->overlay[entry.path] = std::move(data);
+            });
+        }
+
+        size_t TrigramIndex::refresh(ThreadPool& pool, const std::string& root, const WalkOptions& options) {
+            std::unordered_set<std::string> seen;
+            std::atomic<size_t> changed(0);
+
+            pImpl->walk(pool, root, options, [&](const DirectoryEntry& entry) {
+                {
+                    std::lock_guard<std::mutex> lock(pImpl->mutex);
+                    seen.insert(entry.path);
+
+                    auto indexed = pImpl->overlay.find(entry.path);
+                    if (indexed != pImpl->overlay.end()) {
+                        if (indexed->second.size == entry.size && indexed->second.modified == entry.modified) {
+                            return;
+                        }
+                    }
+                    else {
+                        auto saved = pImpl->baseIds.find(entry.path);
+                        if (saved != pImpl->baseIds.end() && !pImpl->baseRemoved[saved->second] &&
+                            pImpl->files[saved->second].size == entry.size && pImpl->files[saved->second].modified == entry.modified) {
+                            return;
+                        }
+                    }
+                }
+
+                changed++;
+                FileData data = pImpl->indexFile(entry);
+                std::lock_guard<std::mutex> lock(pImpl->mutex);
+                pImpl->put(entry.path, std::move(data));
+            });
+
+            // Whatever the walk did not reach is gone
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            for (uint32_t id = 0; id < pImpl->baseCount(); ++id) {
+                if (!pImpl->baseRemoved[id] && seen.count(pImpl->basePath(id)) == 0) {
+                    pImpl->baseRemoved[id] = true;
+                    pImpl->removedCount++;
+                    changed++;
+                }
+            }
+            for (auto it = pImpl->overlay.begin(); it != pImpl->overlay.end();) {
+                if (seen.count(it->first) == 0) {
+                    it = pImpl->overlay.erase(it);
+                    changed++;
+                }
+                else {
+                    ++it;
+                }
+            }
+            return changed;
+        }
+
+        void TrigramIndex::updateFile(const std::string& path) {
+            DirectoryEntry entry;
+            if (!pImpl->fileSystem.getEntry(path, entry) || entry.isDirectory) {
+                removeFile(path);
+                return;
+            }
+
+            FileData data = pImpl->indexFile(entry);
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            pImpl->put(path, std::move(data));
+        }
+
+        void TrigramIndex::removeFile(const std::string& path) {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            pImpl->removeSaved(path);
+            pImpl->overlay.erase(path);
+        }
+
+        std::vector<DirectoryEntry> TrigramIndex::findCandidates(const SearchOptions& query) const {
+            std::vector<uint32_t> required = requiredTrigrams(query);
+            std::vector<DirectoryEntry> result;
+
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            const Impl& impl = *pImpl;
+
+            // Saved files: intersect posting lists, shortest first
+            std::vector<uint32_t> ids;
+            if (required.empty()) {
+                for (uint32_t id = 0; id < impl.baseCount(); ++id) {
+                    ids.push_back(id);
+                }
+            }
+            else if (impl.header) {
+                std::vector<const TrigramRecord*> records;
+                const TrigramRecord* end = impl.trigrams + impl.header->trigramCount;
+                for (uint32_t trigram : required) {
+                    const TrigramRecord* found = std::lower_bound(impl.trigrams, end, trigram, [](const TrigramRecord& record, uint32_t value) {
+                        return record.trigram < value;
+                    });
+                    if (found == end || found->trigram != trigram) {
+                        records.clear();
+                        break;
+                    }
+                    records.push_back(found);
+                }
+                std::sort(records.begin(), records.end(), [](const TrigramRecord* left, const TrigramRecord* right) {
+                    return left->fileCount < right->fileCount;
+                });
+
+                std::vector<uint32_t> list;
+                std::vector<uint32_t> both;
+                for (size_t i = 0; i < records.size() && (i == 0 || !ids.empty()); ++i) {
+                    impl.decodeRecord(*records[i], i == 0 ? ids : list);
+                    if (i > 0) {
+                        both.clear();
+                        std::set_intersection(ids.begin(), ids.end(), list.begin(), list.end(), std::back_inserter(both));
+                        ids.swap(both);
+                    }
+                }
+
+                // Files too large to index could match anything
+                both.clear();
+                std::set_union(ids.begin(), ids.end(), impl.baseUnindexed.begin(), impl.baseUnindexed.end(), std::back_inserter(both));
+                ids.swap(both);
+            }
+
+            for (uint32_t id : ids) {
+                const FileRecord& record = impl.files[id];
+                if (!impl.baseRemoved[id] && !(record.flags & kBinaryFile)) {
+                    result.emplace_back(impl.basePath(id), false, record.size, record.modified);
+                }
+            }
+
+            // Files indexed since loading
+            for (const auto& file : impl.overlay) {
+                const FileData& data = file.second;
+                if (data.flags & kBinaryFile) {
+                    continue;
+                }
+
+                bool candidate = (data.flags & kUnindexedFile) || std::all_of(required.begin(), required.end(), [&data](uint32_t trigram) {
+                    return std::binary_search(data.trigrams.begin(), data.trigrams.end(), trigram);
+                });
+                if (candidate) {
+                    result.emplace_back(file.first, false, data.size, data.modified);
+                }
+            }
+            return result;
+        }
+
+        size_t TrigramIndex::getFileCount() const {
+            std::lock_guard<std::mutex> lock(pImpl->mutex);
+            return pImpl->baseCount() - pImpl->removedCount + pImpl->overlay.size();
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
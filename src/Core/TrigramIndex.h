@@ -0,0 +1,63 @@
+#pragma once
+
+#include "pch.h"
+#include "FileSystem.h"
+#include "TextSearch.h"
+
+namespace Vune {
+    namespace Core {
+
+        class ThreadPool;
+        struct WalkOptions;
+
+        // Index from every three-byte sequence (ASCII case folded) to the files that
+        // contain it. A query looks up the trigrams its pattern requires and intersects
+        // their posting lists, narrowing the files a WorkspaceSearch has to verify.
+        //
+        // Saved indexes are memory-mapped as they are: a header, a table of files, a
+        // sorted trigram table and delta-encoded posting lists. Changes since loading
+        // are kept in memory on top of the mapping until the next save.
+        class TrigramIndex {
+        public:
+            explicit TrigramIndex(FileSystem& fileSystem);
+            ~TrigramIndex();
+
+            // Map a saved index, dropping current contents. Returns false if the file
+            // is missing or not an index; the index is then empty.
+            bool load(const std::string& indexPath);
+
+            // Write the index with every change merged in, and map the result. If the
+            // result cannot be mapped, the index keeps what it held.
+            bool save(const std::string& indexPath);
+
+            // Index every file under root from scratch, skipping what options exclude
+            // or ignore files ignore
+            void build(ThreadPool& pool, const std::string& root, const WalkOptions& options);
+
+            // Reindex files under root whose size or modification time differ from the
+            // index, add new ones and drop deleted ones. Returns how many changed.
+            size_t refresh(ThreadPool& pool, const std::string& root, const WalkOptions& options);
+
+            // Reindex one file, e.g. when a watcher reports a change; a missing file is
+            // removed
+            void updateFile(const std::string& path);
+            void removeFile(const std::string& path);
+
+            // Files that may match, a superset of those that do. Binary files are never
+            // candidates; files too large to index always are.
+            std::vector<DirectoryEntry> findCandidates(const SearchOptions& query) const;
+
+            size_t getFileCount() const;
+
+        private:
+            // Prevent copying
+            TrigramIndex(const TrigramIndex&) = delete;
+            TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "UndoHistory.h"
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            const size_t kDefaultMemoryLimit = 64 * 1024 * 1024;
+        }
+
+        UndoHistory::UndoHistory()
+            : groupDepth(0), groupHasEntry(false), memoryLimit(kDefaultMemoryLimit), memoryUsage(0) {
+        }
+
+        void UndoHistory::record(Step step, size_t cost) {
+            // A new edit invalidates everything that could be redone
+            for (const auto& entry : redoStack) {
+                memoryUsage -= entry.cost;
+            }
+            redoStack.clear();
+
+            if (groupDepth > 0 && groupHasEntry && !undoStack.empty()) {
+                Entry& entry = undoStack.back();
+                entry.steps.push_back(std::move(step));
+                entry.cost += cost;
+            }
+            else {
+                Entry entry;
+                entry.steps.push_back(std::move(step));
+                entry.cost = cost;
+                undoStack.push_back(std::move(entry));
+                groupHasEntry = groupDepth > 0;
+            }
+
+            memoryUsage += cost;
+            trim();
+        }
+
+        const UndoHistory::Entry* UndoHistory::undo() {
+            if (undoStack.empty()) {
+                return nullptr;
+            }
+
+            // Stepping back closes any open group
+            groupHasEntry = false;
+
+            redoStack.push_back(std::move(undoStack.back()));
+            undoStack.pop_back();
+            return &redoStack.back();
+        }
+
+        const UndoHistory::Entry* UndoHistory::redo() {
+            if (redoStack.empty()) {
+                return nullptr;
+            }
+
+            groupHasEntry = false;
+
+            undoStack.push_back(std::move(redoStack.back()));
+            redoStack.pop_back();
+            return &undoStack.back();
+        }
+
+        bool UndoHistory::canUndo() const {
+            return !undoStack.empty();
+        }
+
+        bool UndoHistory::canRedo() const {
+            return !redoStack.empty();
+        }
+
+        void UndoHistory::beginGroup() {
+            if (groupDepth++ == 0) {
+                groupHasEntry = false;
+            }
+        }
+
+        void UndoHistory::endGroup() {
+            if (groupDepth > 0 && --groupDepth == 0) {
+                groupHasEntry = false;
+            }
+        }
+
+        void UndoHistory::setMemoryLimit(size_t bytes) {
+            memoryLimit = bytes;
+            trim();
+        }
+
+        size_t UndoHistory::getMemoryUsage() const {
+            return memoryUsage;
+        }
+
+        void UndoHistory::clear() {
+            undoStack.clear();
+            redoStack.clear();
+            groupHasEntry = false;
+            memoryUsage = 0;
+        }
+
+        void UndoHistory::trim() {
+            // The newest entry is always kept so the last edit can be undone
+            while (memoryUsage > memoryLimit && undoStack.size() > 1) {
+                memoryUsage -= undoStack.front().cost;
+                undoStack.pop_front();
+            }
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
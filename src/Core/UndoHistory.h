@@ -0,0 +1,80 @@
+#pragma once
+
+#include "pch.h"
+#include "PieceTree.h"
+#include "TextBuffer.h"
+#include <deque>
+
+namespace Vune {
+    namespace Core {
+
+        // Undo/redo stack of document states. Piece tree roots are persistent, so an
+        // entry only pins the nodes and text its own edit created, and stepping back
+        // or forward just swaps the root.
+        class UndoHistory {
+        public:
+            struct State {
+                PieceTree::NodePtr root;
+                EndOfLine eol;
+            };
+
+            // Where one change of an edit sits before and after it. Texts are not
+            // copied; they can be read back from the roots of the step.
+            struct Change {
+                Range oldRange;
+                size_t oldOffset;
+                size_t oldLength;
+                Range newRange;
+                size_t newOffset;
+                size_t newLength;
+            };
+
+            // One edit, with its non-overlapping changes in ascending order
+            struct Step {
+                State before;
+                State after;
+                std::vector<Change> changes;
+            };
+
+            // Edits that are undone and redone together, oldest first
+            struct Entry {
+                std::vector<Step> steps;
+                size_t cost;
+            };
+
+            UndoHistory();
+
+            // Record an edit; cost is what it allocated
+            void record(Step step, size_t cost);
+
+            // Step through history, returning the entry that was undone or redone, or
+            // null when there is nothing to step to. The entry stays valid until the
+            // history changes again.
+            const Entry* undo();
+            const Entry* redo();
+            bool canUndo() const;
+            bool canRedo() const;
+
+            // Edits recorded between the outermost begin/end pair form one undo step
+            void beginGroup();
+            void endGroup();
+
+            // Drop the oldest entries once the total cost exceeds the limit
+            void setMemoryLimit(size_t bytes);
+            size_t getMemoryUsage() const;
+
+            void clear();
+
+        private:
+            void trim();
+
+            std::deque<Entry> undoStack;
+            std::vector<Entry> redoStack;
+            int groupDepth;
+            bool groupHasEntry;
+            size_t memoryLimit;
+            size_t memoryUsage;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
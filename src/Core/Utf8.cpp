@@ -0,0 +1,365 @@
+#include "pch.h"
+#include "Utf8.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            using AsciiPrefixFunction = size_t(*)(const char*, size_t);
+            using ValidateFunction = bool(*)(const char*, size_t);
+
+            // Length of the well-formed sequence starting at data, or 0 if there is none
+            size_t sequenceLength(const unsigned char* data, size_t remaining) {
+                unsigned char lead = data[0];
+                if (lead < 0x80) {
+                    return 1;
+                }
+
+                // Second bytes are narrowed to rule out overlongs, surrogates and
+                // values above U+10FFFF
+                size_t length;
+                unsigned char low = 0x80;
+                unsigned char high = 0xBF;
+                if (lead >= 0xC2 && lead <= 0xDF) {
+                    length = 2;
+                }
+                else if (lead >= 0xE0 && lead <= 0xEF) {
+                    length = 3;
+                    if (lead == 0xE0) {
+                        low = 0xA0;
+                    }
+                    else if (lead == 0xED) {
+                        high = 0x9F;
+                    }
+                }
+                else if (lead >= 0xF0 && lead <= 0xF4) {
+                    length = 4;
+                    if (lead == 0xF0) {
+                        low = 0x90;
+                    }
+                    else if (lead == 0xF4) {
+                        high = 0x8F;
+                    }
+                }
+                else {
+                    return 0;
+                }
+
+                if (remaining < length || data[1] < low || data[1] > high) {
+                    return 0;
+                }
+                for (size_t i = 2; i < length; ++i) {
+                    if ((data[i] & 0xC0) != 0x80) {
+                        return 0;
+                    }
+                }
+                return length;
+            }
+
+            // Validate from position, which must start a character, skipping ASCII
+            // with the given prefix scan
+            bool validateFrom(const char* data, size_t length, size_t position, AsciiPrefixFunction asciiPrefix) {
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+                while (position < length) {
+                    if (bytes[position] < 0x80) {
+                        position += asciiPrefix(data + position, length - position);
+                        continue;
+                    }
+
+                    size_t sequence = sequenceLength(bytes + position, length - position);
+                    if (sequence == 0) {
+                        return false;
+                    }
+                    position += sequence;
+                }
+                return true;
+            }
+
+            size_t asciiPrefixScalar(const char* data, size_t length) {
+                size_t position = 0;
+                for (; position + 8 <= length; position += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, data + position, 8);
+                    if (word & 0x8080808080808080ull) {
+                        break;
+                    }
+                }
+                while (position < length && static_cast<unsigned char>(data[position]) < 0x80) {
+                    ++position;
+                }
+                return position;
+            }
+
+            bool isValidScalar(const char* data, size_t length) {
+                return validateFrom(data, length, 0, asciiPrefixScalar);
+            }
+
+#ifdef VUNE_X86
+            VUNE_TARGET("sse2")
+            size_t asciiPrefixSse2(const char* data, size_t length) {
+                size_t position = 0;
+                for (; position + 16 <= length; position += 16) {
+                    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+                    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(block));
+                    if (mask) {
+                        return position + countTrailingZeros(mask);
+                    }
+                }
+                return position + asciiPrefixScalar(data + position, length - position);
+            }
+
+            // Without a byte shuffle the lookup validator cannot be built, so only the
+            // ASCII runs are vectorized
+            bool isValidSse2(const char* data, size_t length) {
+                return validateFrom(data, length, 0, asciiPrefixSse2);
+            }
+
+            VUNE_TARGET("avx2")
+            size_t asciiPrefixAvx2(const char* data, size_t length) {
+                size_t position = 0;
+                for (; position + 32 <= length; position += 32) {
+                    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+                    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(block));
+                    if (mask) {
+                        return position + countTrailingZeros(mask);
+                    }
+                }
+                return position + asciiPrefixScalar(data + position, length - position);
+            }
+
+            // Error classes of a pair of adjacent bytes, after Keiser and Lemire,
+            // "Validating UTF-8 In Less Than One Instruction Per Byte". Each table
+            // maps one nibble of the pair to the classes it allows; a class is an
+            // error only if all three nibbles allow it.
+            const int8_t kTooShort = 1 << 0;        // lead followed by a lead or ASCII
+            const int8_t kTooLong = 1 << 1;         // ASCII followed by a continuation
+            const int8_t kOverlong3 = 1 << 2;       // E0 80..9F
+            const int8_t kTooLarge = 1 << 3;        // F4 90..BF, F5..FF
+            const int8_t kSurrogate = 1 << 4;       // ED A0..BF
+            const int8_t kOverlong2 = 1 << 5;       // C0, C1
+            const int8_t kTooLarge1000 = 1 << 6;    // F5..FF 80..8F
+            const int8_t kOverlong4 = 1 << 6;       // F0 80..8F
+            const int8_t kTwoContinuations = static_cast<int8_t>(1 << 7);
+            const int8_t kCarry = kTooShort | kTooLong | kTwoContinuations;
+
+            // High nibble of the first byte
+            const int8_t kFirstHigh[16] = {
+                kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+                kTwoContinuations, kTwoContinuations, kTwoContinuations, kTwoContinuations,
+                kTooShort | kOverlong2,
+                kTooShort,
+                kTooShort | kOverlong3 | kSurrogate,
+                kTooShort | kTooLarge | kTooLarge1000 | kOverlong4
+            };
+
+            // Low nibble of the first byte
+            const int8_t kFirstLow[16] = {
+                kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+                kCarry | kOverlong2,
+                kCarry,
+                kCarry,
+                kCarry | kTooLarge,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+                kCarry | kTooLarge | kTooLarge1000,
+                kCarry | kTooLarge | kTooLarge1000
+            };
+
+            // High nibble of the second byte
+            const int8_t kSecondHigh[16] = {
+                kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+                kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge1000 | kOverlong4,
+                kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge,
+                kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+                kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+                kTooShort, kTooShort, kTooShort, kTooShort
+            };
+
+            VUNE_TARGET("avx2")
+            inline __m256i loadTable(const int8_t* table) {
+                return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+            }
+
+            // The block shifted later by count bytes, with the end of the previous
+            // block shifted in
+            template <int count>
+            VUNE_TARGET("avx2")
+            inline __m256i shiftIn(__m256i block, __m256i previous) {
+                return _mm256_alignr_epi8(block, _mm256_permute2x128_si256(previous, block, 0x21), 16 - count);
+            }
+
+            VUNE_TARGET("avx2")
+            bool isValidAvx2(const char* data, size_t length) {
+                const __m256i firstHigh = loadTable(kFirstHigh);
+                const __m256i firstLow = loadTable(kFirstLow);
+                const __m256i secondHigh = loadTable(kSecondHigh);
+                const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+                const __m256i highBit = _mm256_set1_epi8(static_cast<char>(0x80));
+                const __m256i thirdByteLead = _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80));
+                const __m256i fourthByteLead = _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80));
+
+                // Leads in the last three bytes of a block that need bytes from the next
+                const __m256i incompleteLimit = _mm256_setr_epi8(
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    static_cast<char>(0xEF), static_cast<char>(0xDF), static_cast<char>(0xBF));
+
+                __m256i previous = _mm256_setzero_si256();
+                __m256i incomplete = _mm256_setzero_si256();
+                __m256i error = _mm256_setzero_si256();
+
+                size_t position = 0;
+                for (; position + 32 <= length; position += 32) {
+                    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+                    if (_mm256_movemask_epi8(block) == 0) {
+                        // An ASCII block is only wrong if the last one ended mid-sequence
+                        error = _mm256_or_si256(error, incomplete);
+                    }
+                    else {
+                        __m256i previous1 = shiftIn<1>(block, previous);
+                        __m256i classes = _mm256_and_si256(
+                            _mm256_and_si256(
+                                _mm256_shuffle_epi8(firstHigh, _mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibble)),
+                                _mm256_shuffle_epi8(firstLow, _mm256_and_si256(previous1, lowNibble))),
+                            _mm256_shuffle_epi8(secondHigh, _mm256_and_si256(_mm256_srli_epi16(block, 4), lowNibble)));
+
+                        // Continuations two or three bytes after a lead are not seen by
+                        // the pair tables; they must line up with two continuations
+                        __m256i third = _mm256_subs_epu8(shiftIn<2>(block, previous), thirdByteLead);
+                        __m256i fourth = _mm256_subs_epu8(shiftIn<3>(block, previous), fourthByteLead);
+                        __m256i expected = _mm256_and_si256(_mm256_or_si256(third, fourth), highBit);
+                        error = _mm256_or_si256(error, _mm256_xor_si256(expected, classes));
+                    }
+
+                    incomplete = _mm256_subs_epu8(block, incompleteLimit);
+                    previous = block;
+                }
+
+                if (!_mm256_testz_si256(error, error)) {
+                    return false;
+                }
+
+                // The tail, from the start of the last character that may be unfinished
+                size_t start = position >= 3 ? position - 3 : 0;
+                while (start < position && (static_cast<unsigned char>(data[start]) & 0xC0) == 0x80) {
+                    ++start;
+                }
+                return validateFrom(data, length, start, asciiPrefixAvx2);
+            }
+#endif
+
+            struct Utf8Implementation {
+                AsciiPrefixFunction asciiPrefix;
+                ValidateFunction validate;
+                const char* name;
+            };
+
+            const Utf8Implementation& selectImplementation() {
+                static const Utf8Implementation implementation = []() -> Utf8Implementation {
+#ifdef VUNE_X86
+                    if (CpuFeatures::hasAvx2()) {
+                        return { asciiPrefixAvx2, isValidAvx2, "avx2" };
+                    }
+                    if (CpuFeatures::hasSse2()) {
+                        return { asciiPrefixSse2, isValidSse2, "sse2" };
+                    }
+#endif
+                    return { asciiPrefixScalar, isValidScalar, "scalar" };
+                }();
+                return implementation;
+            }
+        }
+
+        size_t Utf8::asciiPrefixLength(const char* data, size_t length) {
+            return selectImplementation().asciiPrefix(data, length);
+        }
+
+        bool Utf8::isValid(const char* data, size_t length) {
+            return selectImplementation().validate(data, length);
+        }
+
+        const char* Utf8::implementationName() {
+            return selectImplementation().name;
+        }
+
+        LineColumns::LineColumns(std::string_view line) {
+            const char* data = line.data();
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+            size_t size = line.size();
+            size_t position = Utf8::asciiPrefixLength(data, size);
+            int end[3] = { static_cast<int>(position), static_cast<int>(position), static_cast<int>(position) };
+
+            if (position < size) {
+                auto add = [this, &end](int bytes, int units, int characters) {
+                    if (runs.empty() || runs.back().width[0] != bytes || runs.back().width[1] != units) {
+                        Run run = { { end[0], end[1], end[2] }, { static_cast<uint8_t>(bytes), static_cast<uint8_t>(units), 1 } };
+                        runs.push_back(run);
+                    }
+                    end[0] += bytes * characters;
+                    end[1] += units * characters;
+                    end[2] += characters;
+                };
+
+                if (position > 0) {
+                    runs.push_back({ { 0, 0, 0 }, { 1, 1, 1 } });
+                }
+
+                while (position < size) {
+                    if (bytes[position] < 0x80) {
+                        size_t ascii = Utf8::asciiPrefixLength(data + position, size - position);
+                        add(1, 1, static_cast<int>(ascii));
+                        position += ascii;
+                        continue;
+                    }
+
+                    // Invalid bytes stand for one replacement character each
+                    size_t sequence = sequenceLength(bytes + position, size - position);
+                    if (sequence == 0) {
+                        add(1, 1, 1);
+                        position += 1;
+                    }
+                    else {
+                        add(static_cast<int>(sequence), sequence == 4 ? 2 : 1, 1);
+                        position += sequence;
+                    }
+                }
+            }
+
+            std::copy(end, end + 3, length);
+        }
+
+        int LineColumns::convert(int column, ColumnEncoding from, ColumnEncoding to) const {
+            int source = static_cast<int>(from);
+            int target = static_cast<int>(to);
+            if (column <= 0) {
+                return 0;
+            }
+            if (column >= length[source]) {
+                return length[target];
+            }
+            if (runs.empty()) {
+                return column;
+            }
+
+            // The first run starts at 0, so one always starts at or before column
+            auto run = std::upper_bound(runs.begin(), runs.end(), column, [source](int value, const Run& run) {
+                return value < run.start[source];
+            });
+            --run;
+
+            int characters = (column - run->start[source]) / run->width[source];
+            return run->start[target] + characters * run->width[target];
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
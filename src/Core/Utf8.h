@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pch.h"
+
+namespace Vune {
+    namespace Core {
+
+        // Unit a column counts. TextBuffer positions count UTF-8 bytes, while the UI
+        // and the language server protocol count UTF-16 code units.
+        enum class ColumnEncoding {
+            Utf8,
+            Utf16,
+            CodePoints
+        };
+
+        // Vectorized UTF-8 checks. The widest implementation the CPU supports (AVX2,
+        // SSE2 or scalar) is picked on first use.
+        class Utf8 {
+        public:
+            // Number of bytes before the first one outside ASCII
+            static size_t asciiPrefixLength(const char* data, size_t length);
+
+            static bool isAscii(const char* data, size_t length) {
+                return asciiPrefixLength(data, length) == length;
+            }
+
+            // Well-formed UTF-8: no stray continuation bytes, truncated or overlong
+            // sequences, surrogates or code points above U+10FFFF
+            static bool isValid(const char* data, size_t length);
+
+            // Name of the implementation in use, for diagnostics
+            static const char* implementationName();
+        };
+
+        // Column table of one line. Consecutive characters of the same byte length
+        // form a run, so converting a column is a binary search over the runs and
+        // some arithmetic; ASCII lines have no runs at all. Bytes that are not valid
+        // UTF-8 count as one code point and one UTF-16 unit each, as they decode to
+        // U+FFFD.
+        class LineColumns {
+        public:
+            explicit LineColumns(std::string_view line);
+
+            bool isAscii() const {
+                return runs.empty();
+            }
+
+            // Length of the line in the given unit
+            int getLength(ColumnEncoding encoding) const {
+                return length[static_cast<int>(encoding)];
+            }
+
+            // A column inside a character moves to the start of it; columns past
+            // the end clamp to the end
+            int convert(int column, ColumnEncoding from, ColumnEncoding to) const;
+
+        private:
+            struct Run {
+                int start[3];           // indexed by ColumnEncoding
+                uint8_t width[3];       // of each character in the run
+            };
+
+            std::vector<Run> runs;
+            int length[3];
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
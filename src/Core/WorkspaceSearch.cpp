@@ -0,0 +1,431 @@
+#include "pch.h"
+#include "WorkspaceSearch.h"
+#include "FileSystem.h"
+#include "LineScanner.h"
+#include "LiteralSearcher.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <regex>
+
+namespace Vune {
+    namespace Core {
+
+        namespace {
+            // Files at least this large are mapped instead of read
+            const uint64_t kMapThreshold = 64 * 1024;
+
+            // A NUL byte this close to the start marks a file as binary
+            const size_t kBinaryProbeLength = 8 * 1024;
+
+            // First "\n" or "\r" in a range, or end. Lone "\r" breaks lines as it does
+            // in a TextBuffer.
+            const char* findLineBreak(const char* start, const char* end) {
+                return std::find_if(start, end, [](char c) {
+                    return c == '\n' || c == '\r';
+                });
+            }
+
+            std::string previewOf(const char* lineStart, const char* end) {
+                const char* limit = lineStart + std::min<size_t>(end - lineStart, FileMatch::kMaxPreviewLength);
+                return std::string(lineStart, findLineBreak(lineStart, limit));
+            }
+
+            // Shared with the pool tasks, which may outlive the search object by the
+            // time they take to return
+            struct WorkspaceSearchState {
+                WorkspaceSearchState(const FileSystem& fileSystem, ThreadPool& pool, const WorkspaceSearchOptions& options, FileSearchResultCallback callback)
+                    : fileSystem(fileSystem), pool(pool), options(options), callback(std::move(callback)),
+                      cancelled(false), pending(0), bytesInFlight(0),
+                      filesSearched(0), filesSkipped(0), filesMatched(0), bytesSearched(0) {
+                    if (options.query.isRegex) {
+                        auto flags = std::regex::ECMAScript | std::regex::optimize;
+                        if (!options.query.caseSensitive) {
+                            flags |= std::regex::icase;
+                        }
+                        expression = std::regex(options.query.pattern, flags);
+                    }
+                    else {
+                        literal = std::make_unique<LiteralSearcher>(options.query.pattern, options.query.caseSensitive);
+                    }
+                }
+
+                const FileSystem& fileSystem;
+                ThreadPool& pool;
+                WorkspaceSearchOptions options;
+                FileSearchResultCallback callback;
+                std::unique_ptr<LiteralSearcher> literal;
+                std::regex expression;
+
+                std::atomic<bool> cancelled;
+
+                // Guards the task count and the memory budget
+                std::mutex mutex;
+                std::condition_variable changed;
+                size_t pending;
+                uint64_t bytesInFlight;
+
+                // Files that did not fit the budget, in the order they came
+                std::deque<DirectoryEntry> waiting;
+
+                // First exception thrown by a task
+                std::exception_ptr error;
+
+                // Serializes callback invocations
+                std::mutex callbackMutex;
+
+                std::atomic<size_t> filesSearched;
+                std::atomic<size_t> filesSkipped;
+                std::atomic<size_t> filesMatched;
+                std::atomic<uint64_t> bytesSearched;
+            };
+
+            using StatePtr = std::shared_ptr<WorkspaceSearchState>;
+
+            // Queue a task and count it until it has run
+            void spawn(const StatePtr& state, std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->pending++;
+                }
+
+                state->pool.submit([state, task = std::move(task)] {
+                    std::exception_ptr error;
+                    if (!state->cancelled) {
+                        try {
+                            task();
+                        }
+                        catch (...) {
+                            error = std::current_exception();
+                        }
+                    }
+
+                    // A task that throws, running out of memory on a huge file for
+                    // example, ends the search; wait rethrows its error
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (error && !state->error) {
+                        state->error = error;
+                        state->cancelled = true;
+                        state->waiting.clear();
+                    }
+                    if (--state->pending == 0) {
+                        state->changed.notify_all();
+                    }
+                });
+            }
+
+            void searchFileInBudget(const StatePtr& state, const DirectoryEntry& entry);
+
+            // Whether size more bytes fit in the budget. One file is always let
+            // through, however large, so the search cannot stall.
+            bool fitsBudget(const WorkspaceSearchState& state, uint64_t size) {
+                return state.bytesInFlight == 0 || state.bytesInFlight + size <= state.options.maxBytesInFlight;
+            }
+
+            // Reserve the bytes of a file, or park it in the waiting queue until
+            // releases make room. Files are held back rather than tasks blocked, so
+            // the search never ties up pool threads others need. Returns whether the
+            // file may be searched now.
+            bool acquireBytes(WorkspaceSearchState& state, const DirectoryEntry& entry) {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.cancelled) {
+                    return false;
+                }
+                if (state.waiting.empty() && fitsBudget(state, entry.size)) {
+                    state.bytesInFlight += entry.size;
+                    return true;
+                }
+                state.waiting.push_back(entry);
+                return false;
+            }
+
+            // Return the bytes of a file and start the waiting files that now fit
+            void releaseBytes(const StatePtr& state, uint64_t size) {
+                std::vector<DirectoryEntry> ready;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->bytesInFlight -= size;
+                    while (!state->cancelled && !state->waiting.empty() && fitsBudget(*state, state->waiting.front().size)) {
+                        state->bytesInFlight += state->waiting.front().size;
+                        ready.push_back(std::move(state->waiting.front()));
+                        state->waiting.pop_front();
+                    }
+                }
+
+                for (auto& entry : ready) {
+                    spawn(state, [state, entry = std::move(entry)] {
+                        searchFileInBudget(state, entry);
+                    });
+                }
+            }
+
+            // Tracks the line of each match as the search moves forward through a file
+            class LineTracker {
+            public:
+                LineTracker(const char* data, const char* end) : end(end), counted(data), lineStart(data), line(0) {}
+
+                void addMatch(const char* match, size_t length, std::vector<FileMatch>& matches) {
+                    // A match starting on the "\n" of a "\r\n" leaves the "\r" for the
+                    // next scan, which sees the whole break
+                    const char* scanEnd = match > counted && match[-1] == '\r' && match < end && *match == '\n' ? match - 1 : match;
+                    lineStarts.clear();
+                    line += LineScanner::scan(counted, scanEnd - counted, &lineStarts).total();
+                    if (!lineStarts.empty()) {
+                        lineStart = counted + lineStarts.back();
+                    }
+                    counted = scanEnd;
+
+                    matches.emplace_back();
+                    FileMatch& result = matches.back();
+                    result.line = static_cast<int>(line);
+                    result.character = static_cast<int>(match - lineStart);
+                    result.length = static_cast<int>(length);
+                    result.preview = previewOf(lineStart, end);
+                }
+
+            private:
+                const char* end;
+                const char* counted;
+                const char* lineStart;
+                size_t line;
+                std::vector<uint32_t> lineStarts;
+            };
+
+            void findLiteral(const LiteralSearcher& literal, const char* data, size_t length, std::vector<FileMatch>& matches) {
+                LineTracker lines(data, data + length);
+                size_t patternLength = literal.getPatternLength();
+                for (size_t position = 0; position < length;) {
+                    size_t found = literal.find(data + position, length - position);
+                    if (found == LiteralSearcher::npos) {
+                        break;
+                    }
+
+                    lines.addMatch(data + position + found, patternLength, matches);
+                    position += found + patternLength;
+                }
+            }
+
+            void findRegex(const std::regex& expression, const char* data, size_t length, std::vector<FileMatch>& matches) {
+                LineTracker lines(data, data + length);
+                const char* end = data + length;
+                std::cmatch match;
+
+                for (const char* lineStart = data; lineStart <= end;) {
+                    const char* contentEnd = findLineBreak(lineStart, end);
+
+                    auto flags = std::regex_constants::match_default;
+                    for (const char* position = lineStart; position <= contentEnd;) {
+                        if (!std::regex_search(position, contentEnd, match, expression, flags)) {
+                            break;
+                        }
+
+                        lines.addMatch(match[0].first, static_cast<size_t>(match.length(0)), matches);
+                        position = match[0].second;
+                        if (match.length(0) == 0) {
+                            if (position == contentEnd) {
+                                break;
+                            }
+                            ++position;
+                        }
+                        flags = std::regex_constants::match_prev_avail;
+                    }
+
+                    if (contentEnd == end) {
+                        break;
+                    }
+                    lineStart = contentEnd + (contentEnd[0] == '\r' && contentEnd + 1 < end && contentEnd[1] == '\n' ? 2 : 1);
+                }
+            }
+
+            void searchFile(const StatePtr& state, const DirectoryEntry& entry) {
+                const WorkspaceSearchOptions& options = state->options;
+                if (options.maxFileSize > 0 && entry.size > options.maxFileSize) {
+                    state->filesSkipped++;
+                    return;
+                }
+
+                if (acquireBytes(*state, entry)) {
+                    searchFileInBudget(state, entry);
+                }
+            }
+
+            // Search a file whose bytes are reserved in the budget
+            void searchFileInBudget(const StatePtr& state, const DirectoryEntry& entry) {
+                // Small files reuse one buffer per pool thread
+                thread_local std::string buffer;
+                std::shared_ptr<MappedFile> mapped;
+                const char* data = nullptr;
+                size_t length = 0;
+                bool readable;
+
+                if (entry.size >= kMapThreshold) {
+                    mapped = state->fileSystem.mapFile(entry.path);
+                    readable = mapped != nullptr;
+                    if (mapped) {
+                        data = mapped->data();
+                        length = mapped->size();
+                    }
+                }
+                else {
+                    readable = state->fileSystem.readFile(entry.path, buffer);
+                    data = buffer.data();
+                    length = buffer.size();
+                }
+
+                FileSearchResult result;
+                bool binary = readable && std::memchr(data, '\0', std::min(length, kBinaryProbeLength)) != nullptr;
+                if (readable && !binary) {
+                    if (state->literal) {
+                        findLiteral(*state->literal, data, length, result.matches);
+                    }
+                    else {
+                        findRegex(state->expression, data, length, result.matches);
+                    }
+                }
+
+                mapped.reset();
+                releaseBytes(state, entry.size);
+
+                if (!readable || binary) {
+                    state->filesSkipped++;
+                    return;
+                }
+                state->filesSearched++;
+                state->bytesSearched += length;
+
+                if (!result.matches.empty()) {
+                    state->filesMatched++;
+                    result.path = entry.path;
+
+                    std::lock_guard<std::mutex> lock(state->callbackMutex);
+                    if (!state->cancelled && !state->callback(result)) {
+                        state->cancelled = true;
+                    }
+                }
+            }
+
+            // Files found by the walk, which does not stat them, still need a size
+            void searchWalkedFile(const StatePtr& state, const std::string& path) {
+                DirectoryEntry entry;
+                if (!state->fileSystem.getEntry(path, entry) || entry.isDirectory) {
+                    state->filesSkipped++;
+                    return;
+                }
+                searchFile(state, entry);
+            }
+        }
+
+        class WorkspaceSearch::Impl {
+        public:
+            StatePtr state;
+
+            // Feeds files to the search when it runs over a directory tree
+            std::unique_ptr<DirectoryWalker> walker;
+        };
+
+        WorkspaceSearch::WorkspaceSearch(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+            const WorkspaceSearchOptions& options, FileSearchResultCallback callback)
+            : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<WorkspaceSearchState>(fileSystem, pool, options, std::move(callback));
+            if (options.query.pattern.empty()) {
+                return;
+            }
+
+            StatePtr state = pImpl->state;
+            pImpl->walker = std::make_unique<DirectoryWalker>(fileSystem, pool, root, options.files, [state](const WalkBatch& batch) {
+                for (const WalkEntry& entry : batch.entries) {
+                    if (!entry.isDirectory) {
+                        spawn(state, [state, path = batch.getPath(entry)] {
+                            searchWalkedFile(state, path);
+                        });
+                    }
+                }
+                return !state->cancelled;
+            });
+        }
+
+        WorkspaceSearch::WorkspaceSearch(const FileSystem& fileSystem, ThreadPool& pool, std::vector<DirectoryEntry> files,
+            const WorkspaceSearchOptions& options, FileSearchResultCallback callback)
+            : pImpl(std::make_unique<Impl>()) {
+            pImpl->state = std::make_shared<WorkspaceSearchState>(fileSystem, pool, options, std::move(callback));
+            if (options.query.pattern.empty()) {
+                return;
+            }
+
+            StatePtr state = pImpl->state;
+            for (auto& entry : files) {
+                spawn(state, [state, entry = std::move(entry)] {
+                    searchFile(state, entry);
+                });
+            }
+        }
+
+        WorkspaceSearch::~WorkspaceSearch() {
+            cancel();
+            try {
+                wait();
+            }
+            catch (...) {
+                // An error nobody waited for is dropped
+            }
+        }
+
+        void WorkspaceSearch::cancel() {
+            WorkspaceSearchState& state = *pImpl->state;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.cancelled = true;
+                state.waiting.clear();
+            }
+
+            if (pImpl->walker) {
+                pImpl->walker->cancel();
+            }
+        }
+
+        void WorkspaceSearch::wait() {
+            // Once the walk is over no more files are queued
+            if (pImpl->walker) {
+                pImpl->walker->wait();
+            }
+
+            WorkspaceSearchState& state = *pImpl->state;
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&state] {
+                return state.pending == 0;
+            });
+            if (state.error) {
+                std::exception_ptr error = std::move(state.error);
+                state.error = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+
+        bool WorkspaceSearch::isFinished() const {
+            if (pImpl->walker && !pImpl->walker->isFinished()) {
+                return false;
+            }
+
+            WorkspaceSearchState& state = *pImpl->state;
+            std::lock_guard<std::mutex> lock(state.mutex);
+            return state.pending == 0;
+        }
+
+        WorkspaceSearchStats WorkspaceSearch::getStats() const {
+            const WorkspaceSearchState& state = *pImpl->state;
+            WorkspaceSearchStats stats;
+            stats.filesSearched = state.filesSearched;
+            stats.filesSkipped = state.filesSkipped;
+            stats.filesMatched = state.filesMatched;
+            stats.bytesSearched = state.bytesSearched;
+            return stats;
+        }
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file
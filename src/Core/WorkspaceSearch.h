@@ -0,0 +1,112 @@
+#pragma once
+
+#include "pch.h"
+#include "DirectoryWalker.h"
+#include "TextSearch.h"
+
+namespace Vune {
+    namespace Core {
+
+        class FileSystem;
+        class ThreadPool;
+        struct DirectoryEntry;
+
+        struct WorkspaceSearchOptions {
+            SearchOptions query;
+
+            // Which files under the root to search; ignore files apply by default
+            WalkOptions files;
+
+            // Larger files are skipped; 0 searches files of any size
+            uint64_t maxFileSize;
+
+            // File bytes read or mapped at once across all workers. A single file
+            // larger than this is still searched, alone.
+            uint64_t maxBytesInFlight;
+
+            WorkspaceSearchOptions()
+                : query(), files(), maxFileSize(0), maxBytesInFlight(256ull * 1024 * 1024) {}
+        };
+
+        // Match in a file. Line and character are zero-based; character and length count
+        // bytes, like positions in a TextBuffer.
+        struct FileMatch {
+            int line;
+            int character;
+            int length;
+
+            // Text of the line the match starts on, without its line break, cut to at
+            // most kMaxPreviewLength bytes
+            std::string preview;
+
+            static constexpr size_t kMaxPreviewLength = 512;
+
+            FileMatch() : line(0), character(0), length(0), preview() {}
+        };
+
+        // Every match in one file
+        struct FileSearchResult {
+            std::string path;
+            std::vector<FileMatch> matches;
+        };
+
+        // Receives files with matches as they are searched, one call at a time from the
+        // pool threads, in no particular order. Return false to cancel the search.
+        using FileSearchResultCallback = std::function<bool(const FileSearchResult&)>;
+
+        struct WorkspaceSearchStats {
+            size_t filesSearched;
+            size_t filesSkipped;    // binary, too large or unreadable
+            size_t filesMatched;
+            uint64_t bytesSearched;
+
+            WorkspaceSearchStats() : filesSearched(0), filesSkipped(0), filesMatched(0), bytesSearched(0) {}
+        };
+
+        // Searches the files under a directory on a ThreadPool. A DirectoryWalker lists
+        // directories while files are searched as separate tasks, so work-stealing
+        // spreads both over all cores. Large files are memory-mapped, small ones read
+        // into per-thread buffers, and files with a NUL byte near the start are skipped
+        // as binary.
+        // Literal queries use the vectorized LiteralSearcher; regular expressions are
+        // matched line by line.
+        class WorkspaceSearch {
+        public:
+            // Starts searching right away. Throws std::regex_error if a regular
+            // expression does not compile.
+            WorkspaceSearch(const FileSystem& fileSystem, ThreadPool& pool, const std::string& root,
+                const WorkspaceSearchOptions& options, FileSearchResultCallback callback);
+
+            // Search just the given files, such as the candidates of a TrigramIndex.
+            // Sizes only steer the memory budget and may be stale. options.files is not
+            // used.
+            WorkspaceSearch(const FileSystem& fileSystem, ThreadPool& pool, std::vector<DirectoryEntry> files,
+                const WorkspaceSearchOptions& options, FileSearchResultCallback callback);
+
+            // Cancels the search and waits for the tasks in progress
+            ~WorkspaceSearch();
+
+            // Stop starting new tasks; files being searched finish without reporting
+            void cancel();
+
+            // Block until the search has finished or been cancelled. Must not be called
+            // from a thread of the pool. If a task threw, the search was cancelled and
+            // its exception is rethrown here.
+            void wait();
+
+            bool isFinished() const;
+
+            WorkspaceSearchStats getStats() const;
+
+        private:
+            // Prevent copying
+            WorkspaceSearch(const WorkspaceSearch&) = delete;
+            WorkspaceSearch& operator=(const WorkspaceSearch&) = delete;
+
+            // Implementation details
+            class Impl;
+            std::unique_ptr<Impl> pImpl;
+        };
+
+    } // namespace Core
+} // namespace Vune
\ No newline at end of file